@@ -22,7 +22,45 @@ enum {
 	// Arithmetic operations
 	IR_NEG,		// negation
 	IR_NOT,		// bitwise not
+	IR_ADD,		// addition, also of a byte offset to a pointer
+	IR_SUB,		// subtraction
+	IR_MUL,		// multiplication
+	IR_SMULH,	// signed multiplication, high half of the double width product
+	IR_UMULH,	// unsigned multiplication, high half of the double width product
+	IR_SDIV,	// signed division, rounding towards zero
+	IR_UDIV,	// unsigned division
+	IR_SREM,	// signed remainder, having the sign of the dividend
+	IR_UREM,	// unsigned remainder
+	IR_SHL,		// shift left
+	IR_LSHR,	// logical shift right
+	IR_ASHR,	// arithmetic shift right
+	IR_AND,		// bitwise and
+	IR_OR,		// bitwise or
+	IR_XOR,		// bitwise exclusive or
+
+	// Comparisons, producing bools
 	IR_CMP_EQ,	// compare whether equal
+	IR_CMP_NE,	// compare whether not equal
+	IR_CMP_LT,	// signed less than
+	IR_CMP_LE,	// signed less than or equal
+	IR_CMP_GT,	// signed greater than
+	IR_CMP_GE,	// signed greater than or equal
+	IR_CMP_ULT,	// unsigned less than
+	IR_CMP_ULE,	// unsigned less than or equal
+	IR_CMP_UGT,	// unsigned greater than
+	IR_CMP_UGE,	// unsigned greater than or equal
+
+	// Selection
+	IR_SELECT,	// choose one of two values by a bool, without branching
+
+	// Memory
+	IR_ALLOCA,	// address of a stack slot, living as long as the function
+	IR_LOAD,	// load a value from an address
+	IR_STORE,	// store a value to an address
+
+	// Functions
+	IR_PARAM,	// value of a parameter of the function, only in the entry block
+	IR_CALL,	// call a function, with value arguments
 
 	// Terminates
 	IR_RET,		// return 
@@ -46,6 +84,13 @@ enum {
 	IRT_EXCEED
 };
 
+// Element of a basic block predecessor list.
+// A predecessor appears once for each edge coming from it.
+struct IRpredecessor {
+	struct llist_node n;		// linklist header
+	struct IRblock *b;		// predecessor basic block
+};
+
 // Argument of phi function.
 struct IRphi_arg {
 	struct llist_node n;		// linklist header
@@ -60,12 +105,22 @@ struct IRinstruction {
 	int op;			// operation code
 	int id;			// value identifier
 	int type;		// value type in IR type code
+	bool is_fused;		// comparison only used by the branch right after it, see IRopt_fuse_cmp()
+	bool is_folded;		// computed by the machine instruction of its only user, see X64isel_run()
 	struct IRblock *owner;	// the basic block containing this instruction
 	union {
 		struct { struct IRinstruction *left, *right; };	// left/right operands for calculations
-		struct { struct IRinstruction *cond; 		// jump condition
-			 struct IRblock *bt, *bf; };		// true branch & false branch for conditional jump
+		struct { struct IRinstruction *cond; 		// jump or select condition
+			 union {
+				struct { struct IRblock *bt, *bf; };		// true branch & false branch for conditional jump
+				struct { struct IRinstruction *vt, *vf; };	// selected values when the condition is true & false
+			 }; };
 		struct linklist phi;				// Phi instruction argument list
+		struct { int slot_type, slot_count; };		// stack slot: element type and number of elements
+		int param_index;				// parameter: position in the parameter list
+		struct { struct IRfunction *callee;		// call: the function called
+			 struct IRinstruction **args;		// call: argument values
+			 int argc; };				// call: number of arguments
 		int32_t val_i32;				// immediate: 32bits integer
 		int64_t val_i64;				// immediate: 64bits integer
 		bool val_i1;					// immediate: bool
@@ -78,29 +133,79 @@ struct IRblock {
 	int id;				// block identifier, the function entry block will have value 0
 	struct linklist ins;		// contained instructions
 	bool is_complete;		// whether the block is properly ended with a terminate
-	struct linklist pre;		// predecessor list of this basic block
+	struct linklist pre;		// predecessor list of this basic block (struct IRpredecessor)
 	struct IRfunction *owner;	// the function containing this function
 };
 
 // Function containing IR instructions.
-// TODO: paramaters
+// Parameters are read by IR_PARAM instructions in the entry block.
 struct IRfunction {
 	struct llist_node n;		// linklist header
+	int id;				// position of the function in its translation unit
 	char *name;			// function name
 	struct linklist bs;		// basic blocks
 	int ins_count;			// number of instructions, used for allocating instruction identifier.
+	int param_count;		// number of parameters
+};
+
+// Functions of a translation unit, in order of declaration.
+struct IRunit {
+	struct linklist funcs;
 };
 
 // Constructs an IRinstruction with an operator, and two operands.
 struct IRinstruction* IRinstruction_new(struct IRblock *owner, int op, int type,
 					struct IRinstruction *left, struct IRinstruction *right);
 
+// Constructs an IRinstruction like IRinstruction_new(), but inserts it right before
+// _pos_ in the block containing _pos_, instead of appending it.
+struct IRinstruction* IRinstruction_new_before(struct IRinstruction *pos, int op, int type,
+					struct IRinstruction *left, struct IRinstruction *right);
+
+// Moves the instruction right before _pos_, which may be in another block.
+void IRinstruction_move_before(struct IRinstruction *self, struct IRinstruction *pos);
+
 // Constructs an IRinstruction with an integer immediate (32bits).
 struct IRinstruction* IRinstruction_new_i32(struct IRblock *owner, int32_t v);
 
+// Constructs an IRinstruction with an integer immediate of the given type.
+struct IRinstruction* IRinstruction_new_imm(struct IRblock *owner, int type, int64_t v);
+
+// Contructs an IRinstruction with an undef immediate only.
+struct IRinstruction* IRinstruction_new_undef(struct IRblock *owner);
+
 // Contructs an IRinstruction with an void immediate only.
 struct IRinstruction* IRinstruction_new_void(struct IRblock *owner);
 
+// Constructs an integer immediate placed after the phis at the beginning of the block,
+// so that it is available to every instruction of the block.
+struct IRinstruction* IRblock_new_const(struct IRblock *self, int type, int64_t v);
+
+// Constructs a stack slot of _count_ elements of type _type_, placed after the phis at the
+// beginning of the block, which should be the function entry.
+struct IRinstruction* IRblock_new_alloca(struct IRblock *self, int type, int count);
+
+// Constructs a call of _callee_ returning a value of type _type_. The argument table, of
+// _argc_ values, is owned by the instruction afterwards.
+struct IRinstruction* IRinstruction_new_call(struct IRblock *owner, struct IRfunction *callee, int type,
+						struct IRinstruction **args, int argc);
+
+// Appends a copy of a non-phi instruction to the block, with the same operands.
+struct IRinstruction* IRinstruction_clone(struct IRinstruction *self, struct IRblock *owner);
+
+// Constructs an empty phi instruction at the beginning of the block.
+struct IRinstruction* IRinstruction_new_phi(struct IRblock *owner, int type);
+
+// Appends an argument to a phi instruction.
+void IRphi_add_arg(struct IRinstruction *self, struct IRblock *source, struct IRinstruction *value);
+
+// Returns the value of a phi instruction when coming from _source_, or NULL if there is none.
+struct IRinstruction* IRphi_get_arg(struct IRinstruction *self, struct IRblock *source);
+
+// Constructs a select instruction right before _pos_: _vt_ if _cond_ holds, otherwise _vf_.
+struct IRinstruction* IRinstruction_new_select(struct IRinstruction *pos, struct IRinstruction *cond,
+						struct IRinstruction *vt, struct IRinstruction *vf);
+
 // Constructs a IRinstuction with instruction IR_JMP or IR_BR (which is conditional jump).
 struct IRinstruction* IRinstruction_new_jmp(struct IRblock *owner, int op, struct IRinstruction *cond,
 						struct IRblock *bt, struct IRblock *bf);
@@ -112,23 +217,109 @@ bool IRis_terminate(int op);
 // Returns whether an IR opcode is a jump opcode.
 bool IRis_jmp(int op);
 
+// Returns whether an IR opcode has effects other than producing its value.
+// Such instructions must be kept even if their values are never used.
+bool IRhas_side_effect(int op);
+
+// Returns whether an IR opcode takes two value operands (arithmetics and comparisons).
+bool IRis_binary(int op);
+
+// Returns whether an IR opcode is a comparison.
+bool IRis_cmp(int op);
+
+// Returns whether the operands of an IR opcode can be swapped without changing the result.
+bool IRis_commutative(int op);
+
+// Returns the comparison giving the opposite result on the same operands.
+int IRcmp_inverse(int op);
+
+// Returns the comparison giving the same result with the operands swapped.
+int IRcmp_swap(int op);
+
+// Write the sum, difference or product of two integers into _res_, wrapped.
+// Return whether the exact result overflows 64 bits.
+bool IRadd_overflow(int64_t a, int64_t b, int64_t *res);
+bool IRsub_overflow(int64_t a, int64_t b, int64_t *res);
+bool IRmul_overflow(int64_t a, int64_t b, int64_t *res);
+
+// Evaluates a binary opcode on integer constants of the operand type _type_.
+// Writes the result into _res_, wrapped into the result type.
+// Returns false if the result is undefined, e.g. a division by zero.
+bool IRopcode_fold(int op, int type, int64_t a, int64_t b, int64_t *res);
+
+// Callback type of IRinstruction_foreach_operand().
+typedef void (*IRoperand_fn)(struct IRinstruction **slot, void *arg);
+
+// Calls _fn_ on every value operand slot of the instruction, including phi arguments.
+void IRinstruction_foreach_operand(struct IRinstruction *self, IRoperand_fn fn, void *arg);
+
 // Constructs a IRblock.
 struct IRblock* IRblock_new(struct IRfunction *owner);
 
+// Returns the terminate of the block, or NULL if the block is not complete.
+struct IRinstruction* IRblock_terminator(struct IRblock *self);
+
+// Writes the successors of the block into _res_.
+// Returns the number of successors (0, 1 or 2).
+int IRblock_successors(struct IRblock *self, struct IRblock *res[2]);
+
+// Appends _pre_ to the predecessor list of the block.
+void IRblock_add_pre(struct IRblock *self, struct IRblock *pre);
+
+// Removes one occurrence of _pre_ from the predecessor list of the block,
+// together with the matching argument of each phi instruction.
+void IRblock_remove_pre(struct IRblock *self, struct IRblock *pre);
+
+// Renames every occurrence of _old_ in the predecessor list and phi arguments into _new_.
+void IRblock_replace_pre(struct IRblock *self, struct IRblock *old, struct IRblock *new);
+
+// Replaces every operand x of the function's instructions with repl[x->id], if it is not NULL.
+// Chains of replacements are followed to their end.
+void IRfunction_apply_replacements(struct IRfunction *self, struct IRinstruction **repl);
+
+// Reassigns block and instruction identifiers in layout order,
+// so that tables indexed by identifiers stay compact.
+void IRfunction_renumber(struct IRfunction *self);
+
 // Allocating instruction identifiers in IRfunction
 int IRfunction_alloc_ins(struct IRfunction *self);
 
 // Translates a VType into an IR type code.
 int IRTypecode_from_VType(const struct VType *v);
 
+// Returns the type code after integer promotion.
+int IRTypecode_integer_promote(int self);
+
+// Returns whether the type code is an integer type (including bool).
+bool IRTypecode_is_int(int self);
+
+// Returns the number of bits of an integer type code.
+int IRTypecode_bits(int self);
+
+// Wraps an integer into the range of the given integer type (sign extended).
+int64_t IRTypecode_wrap(int self, int64_t v);
+
+// Returns the size in bytes of a value of the type in memory.
+int IRTypecode_size(int self);
+
+// Returns the integer type code as wide as pointers, used for address offsets.
+int IRTypecode_offset(void);
+
+// Returns the value of an integer immediate, sign extended (bools are 0 or 1).
+int64_t IRimm_value(const struct IRinstruction *self);
+
+// Turns the instruction into an integer immediate of the given type and value.
+void IRimm_set(struct IRinstruction *self, int type, int64_t v);
+
 // Returns a string identifier for the given type.
 const char *IRTypecode_stringify(int self);
 
 // Returns a string identifier for the given operation code.
 const char* IRopcode_stringify(int op);
 
-// Generates IR Repersentation from an AST
-struct IRfunction* IRfunction_from_ast(struct Afunction *afunc);
+// Generates IR Repersentation from the AST of a translation unit.
+// Only the functions defined are translated.
+struct IRunit* IRunit_from_ast(struct Aunit *aunit);
 
 // Frees a IRinstruction and all its components.
 void IRinstruction_free(struct IRinstruction *self);
@@ -139,6 +330,9 @@ void IRblock_free(struct IRblock *self);
 // Frees a IRfunction and all its components.
 void IRfunction_free(struct IRfunction *self);
 
+// Frees a translation unit and all its functions.
+void IRunit_free(struct IRunit *self);
+
 // Outputs the instruction.
 void IRinstruction_print(struct IRinstruction *self, FILE *Outfile);
 
@@ -148,4 +342,7 @@ void IRblock_print(struct IRblock *self, FILE *Outfile);
 // Outputs the containing instructions of the IRfunction.
 void IRfunction_print(struct IRfunction *self, FILE *Outfile);
 
+// Outputs every function of the translation unit.
+void IRunit_print(struct IRunit *self, FILE *Outfile);
+
 #endif
@@ -9,19 +9,19 @@
 // AST operation types
 enum {
 	A_ASSIGN,
-	A_NEG, A_ADD, A_SUB, A_MUL, A_DIV,
+	A_NEG, A_ADD, A_SUB, A_MUL, A_DIV, A_MOD,
 	A_EQ, A_NE, A_LT, A_GT, A_LE, A_GE,
 	A_LNOT, A_LAND, A_LOR,
-	A_BNOT,
+	A_BNOT, A_BAND, A_BOR, A_BXOR, A_LSHIFT, A_RSHIFT,
 	A_LIT_I32, A_LIT_I64,
-	A_VAR,
+	A_VAR, A_INDEX, A_CALL,
 	A_BLOCK,
 	A_PRINT, A_IF, A_WHILE,
 	A_RETURN,
 	A_SOUL // what?
 };
 
-extern const char *ast_opname[31];
+extern const char *ast_opname[33];
 
 // AST structure field shared by all types 
 // llist_node *n	: linklist header
@@ -86,37 +86,67 @@ struct ASTassignnode {
 // AST variable value node
 struct ASTvarnode {
 	ACC_ASTnode_SHARED_FIELDS 
-	int id;
+	int id;		// local variable identifier
+	int len;	// number of elements of an array, 0 for scalars
+};
+
+// AST array element node
+struct ASTindexnode {
+	ACC_ASTnode_SHARED_FIELDS 
+	struct ASTnode *left;	// the array variable
+	struct ASTnode *right;	// the index
+};
+
+// AST function call node
+// The arguments are linked by their linklist headers, in order.
+struct ASTcallnode {
+	ACC_ASTnode_SHARED_FIELDS 
+	struct Afunction *callee;
+	struct linklist args;
 };
 
 // A function with its AST root.
-// TODO: parameters
+// Parameters are the first local variables, identified by 0 .. param_count - 1.
 struct Afunction {
 	struct llist_node n;	// linklist header
+	int id;			// position of the function in its translation unit
 	char *name;		// function name
 	struct ASTnode *rt;	// AST root
+	bool is_defined;	// whether the body has been seen, rather than a declaration only
 	struct VType ret_type;	// return type
+	int param_count;	// number of parameters
+	struct VType *param_types;	// type of each parameter
+	int var_count;		// number of local variables, identified by 0 .. var_count - 1
+};
+
+// A translation unit: the functions of a source file, in order of declaration.
+struct Aunit {
+	struct linklist funcs;
 };
 
 struct Afunction* Afunction_new();
 
-struct ASTnode* ASTbinnode_new(int op, struct ASTnode *left, struct ASTnode *right);
+struct ASTnode* ASTbinnode_new(int op, struct ASTnode *left, struct ASTnode *right, int line);
 struct ASTnode* ASTi32node_new(int32_t x);
 struct ASTnode* ASTi64node_new(int64_t x);
 struct ASTnode* ASTunnode_new(int op, struct ASTnode *c, int line);
 struct ASTnode* ASTblocknode_new();
-struct ASTnode* ASTvarnode_new(int id);
-struct ASTnode* ASTassignnode_new(int op, struct ASTnode *left, struct ASTnode *right);
+struct ASTnode* ASTvarnode_new(int id, const struct VType *type, int len);
+struct ASTnode* ASTindexnode_new(struct ASTnode *var, struct ASTnode *index, int line);
+struct ASTnode* ASTcallnode_new(struct Afunction *callee, struct linklist *args, int line);
+struct ASTnode* ASTassignnode_new(int op, struct ASTnode *left, struct ASTnode *right, int line);
 struct ASTnode* ASTifnode_new(struct ASTnode *left, struct ASTnode *right, struct ASTnode *cond);
 
 void ASTnode_print(FILE *Outfile, struct ASTnode *rt);
 void Afunction_print(FILE *Outfile, struct Afunction *f);
+void Aunit_print(FILE *Outfile, struct Aunit *u);
 
 void Afunction_free(struct Afunction *f);
+void Aunit_free(struct Aunit *u);
 void ASTnode_free(struct ASTnode *x);
 
 // Parse source into AST.
-struct Afunction* Afunction_from_source(const char *filename);
+struct Aunit* Aunit_from_source(const char *filename);
 
 #endif
 
@@ -14,5 +14,6 @@ noreturn void fail_ast_op(int op, const char *func_name);
 noreturn void fail_ce_expect(int line, const char *expected, const char *got);
 noreturn void fail_ce(int line, const char *reason);
 noreturn void fail_char(int line, int c);
+noreturn void fail_run(const char *reason);
 
 #endif
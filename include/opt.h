@@ -0,0 +1,405 @@
+#ifndef ACC_OPT_H
+#define ACC_OPT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "acir.h"
+#include "util/array.h"
+#include "util/linklist.h"
+
+// Def-use chains: the users of every instruction.
+// A user is listed once for each operand slot referring to the value.
+// Entries may go stale when operands are changed without IRuses_replace(),
+// so users should be checked before relying on them.
+struct IRuses {
+	int n;			// size of the table
+	struct array *users;	// users of each instruction, indexed by instruction id
+};
+
+// Builds the def-use chains of a function.
+void IRuses_build(struct IRuses *self, struct IRfunction *f);
+
+// Returns the user list of an instruction.
+struct array* IRuses_get(struct IRuses *self, struct IRinstruction *value);
+
+// Records that _user_ uses _value_.
+void IRuses_add(struct IRuses *self, struct IRinstruction *value, struct IRinstruction *user);
+
+// Replaces all uses of _old_ with _new_, and moves the users to the user list of _new_.
+void IRuses_replace(struct IRuses *self, struct IRinstruction *old, struct IRinstruction *new);
+
+// Frees the def-use chains.
+void IRuses_free(struct IRuses *self);
+
+// Integer range and known bits of an ACIR value.
+// Values are considered sign extended to 64 bits, except bools which are 0 or 1.
+// A range with lo > hi is empty: no definition of the value has been seen.
+struct IRrange {
+	int64_t lo, hi;		// inclusive signed bounds
+	uint64_t zero, one;	// masks of the bits known to be 0 and known to be 1
+};
+
+// Computes the range of every instruction in the function, indexed by instruction id.
+struct IRrange* IRrange_analyze(struct IRfunction *self);
+
+// Returns whether the range is empty.
+bool IRrange_is_empty(const struct IRrange *self);
+
+// Returns whether every value of the range is representable in the given integer type.
+bool IRrange_fits(const struct IRrange *self, int type);
+
+// Dominator tree, computed by the iterative algorithm of Cooper, Harvey and Kennedy.
+// Tables are indexed by block id, so identifiers must be compact, see IRfunction_renumber().
+struct IRdomtree {
+	int n;				// size of the tables
+	int count;			// number of blocks reachable from the entry
+	struct IRblock **order;		// reachable blocks in reverse postorder
+	int *rpo;			// position of each block in _order_, -1 if unreachable
+	struct IRblock **idom;		// immediate dominator of each block, NULL for the entry and unreachable blocks
+	int *depth;			// depth of each block in the tree, 0 for the entry
+};
+
+// Builds the dominator tree of a function.
+void IRdomtree_build(struct IRdomtree *self, struct IRfunction *f);
+
+// Builds the post-dominator tree of a function, in which returning blocks are the roots.
+// Blocks from which no return is reachable are left unreachable.
+void IRdomtree_build_post(struct IRdomtree *self, struct IRfunction *f);
+
+// Returns whether the block is reachable from the function entry.
+bool IRdomtree_reachable(const struct IRdomtree *self, struct IRblock *b);
+
+// Returns whether _a_ dominates _b_. Every block dominates itself.
+bool IRdomtree_dominates(const struct IRdomtree *self, struct IRblock *a, struct IRblock *b);
+
+// Frees the dominator tree.
+void IRdomtree_free(struct IRdomtree *self);
+
+// Natural loop: a header, and the blocks reaching one of the back edges into the header
+// without passing through it.
+struct IRloop {
+	struct llist_node n;		// linklist header
+	struct IRblock *header;		// the only block entered from outside of the loop
+	struct IRloop *parent;		// innermost loop containing this one, NULL for outermost loops
+	int depth;			// nesting depth, 1 for outermost loops
+	struct array blocks;		// blocks of the loop and of nested loops, in reverse postorder
+};
+
+// Loop nest of a function.
+struct IRloopinfo {
+	int n;				// size of the table
+	struct IRloop **inner;		// innermost loop containing each block, indexed by block id
+	struct linklist loops;		// every loop, nested loops before the loops containing them
+};
+
+// Builds the loop nest of a function from its dominator tree.
+void IRloopinfo_build(struct IRloopinfo *self, const struct IRdomtree *dom);
+
+// Returns the innermost loop containing the block, or NULL if it is in no loop.
+struct IRloop* IRloopinfo_get(const struct IRloopinfo *self, struct IRblock *b);
+
+// Returns the loop nesting depth of the block, 0 outside of loops.
+int IRloopinfo_depth(const struct IRloopinfo *self, struct IRblock *b);
+
+// Returns whether the loop contains the block, possibly through nested loops.
+bool IRloop_contains(const struct IRloopinfo *info, struct IRloop *loop, struct IRblock *b);
+
+// Returns the preheader of the loop: its only predecessor outside of the loop, provided that
+// the predecessor jumps to the header unconditionally. Returns NULL if there is none.
+struct IRblock* IRloop_preheader(const struct IRloopinfo *info, struct IRloop *loop);
+
+// Creates a preheader for a loop whose header is not the function entry.
+// The analyses are not updated: identifiers must be renumbered before they are built again.
+struct IRblock* IRloop_insert_preheader(const struct IRloopinfo *info, struct IRloop *loop);
+
+// Frees the loop nest.
+void IRloopinfo_free(struct IRloopinfo *self);
+
+// Location accessed by a load or a store: an address decomposed into a root pointer plus
+// a variable offset and a constant offset, and the type of the value accessed.
+struct IRmemloc {
+	struct IRinstruction *root;	// stack slot or other pointer the address is computed from
+	struct IRinstruction *var;	// variable byte offset, NULL if there is none
+	int64_t offset;			// constant byte offset
+	int type;			// type of the value accessed
+	int size;			// size in bytes of the access
+};
+
+// Answers of the alias analysis.
+enum {
+	IR_NO_ALIAS,
+	IR_MAY_ALIAS,
+	IR_MUST_ALIAS,
+};
+
+// Alias analysis: which stack slots have their address escaping.
+struct IRalias {
+	int n;			// size of the table
+	bool *escaped;		// whether the address of a slot escapes, indexed by instruction id
+};
+
+// Builds the alias analysis of a function.
+void IRalias_build(struct IRalias *self, struct IRfunction *f);
+
+// Returns whether the address of the stack slot may be known outside of the accesses through it.
+// Values which are not slots, and slots created after the analysis, are considered escaping.
+bool IRalias_escapes(const struct IRalias *self, struct IRinstruction *x);
+
+// Returns how two memory locations may overlap: IR_NO_ALIAS, IR_MAY_ALIAS or IR_MUST_ALIAS.
+// Must-aliasing locations also have the same type.
+int IRalias_query(const struct IRalias *self, const struct IRmemloc *a, const struct IRmemloc *b);
+
+// Frees the alias analysis.
+void IRalias_free(struct IRalias *self);
+
+// Computes the location accessed by a load or a store.
+void IRmemloc_of(struct IRmemloc *self, struct IRinstruction *access);
+
+// Returns whether two locations are the same one.
+bool IRmemloc_eq(const struct IRmemloc *a, const struct IRmemloc *b);
+
+// Call graph of a translation unit, indexed by function id.
+struct IRcallgraph {
+	int n;				// number of functions
+	struct IRfunction **funcs;	// functions, indexed by id
+	struct array *callees;		// functions called by each function, listed once
+	int *scc;			// strongly connected component of each function
+	struct IRfunction **order;	// bottom-up order: callees before their callers, cycles excepted
+};
+
+// Builds the call graph of a translation unit.
+void IRcallgraph_build(struct IRcallgraph *self, struct IRunit *unit);
+
+// Returns whether _a_ and _b_ are in the same strongly connected component: each of them
+// may end up calling the other, or they are the same function.
+bool IRcallgraph_same_scc(const struct IRcallgraph *self, struct IRfunction *a, struct IRfunction *b);
+
+// Frees the call graph.
+void IRcallgraph_free(struct IRcallgraph *self);
+
+// Live interval of a value over the linear order of the instructions of its function.
+struct IRinterval {
+	int start, end;		// positions of the first and last points covered, -1 for no value
+};
+
+// Liveness of the values of a function, the instructions producing a result held in a
+// register, see IRliveness_is_value(). Instructions are numbered in layout order, two
+// positions apart. Sets of values are lists of instruction ids in increasing order, the set
+// of block _b_ running from index begin[b] to begin[b + 1].
+struct IRliveness {
+	int n, nb;			// numbers of instructions and blocks
+	int *in_begin, *live_in;	// values live at the entry of each block
+	int *out_begin, *live_out;	// values live at the end of each block
+	int *pos;			// position of each instruction, indexed by instruction id
+	int *from, *to;			// position of the first instruction of each block, and past its last one
+	struct IRinterval *intervals;	// live interval of each value, indexed by instruction id
+	int *pressure;			// largest number of values live at once in each block
+	int max_pressure;		// largest number of values live at once in the function
+};
+
+// Computes the liveness of the values of a function, by exploring the paths from each use
+// back to the definition, without iterating to a fixed point.
+// Instruction and block identifiers must be compact, see IRfunction_renumber().
+void IRliveness_build(struct IRliveness *self, struct IRfunction *f);
+
+// Returns whether the instruction produces a value held in a register.
+bool IRliveness_is_value(const struct IRinstruction *x);
+
+// Calls _fn_ on every operand slot read by the instruction, including phi arguments: the
+// operands of an instruction folded into it are read by it instead, and a folded instruction
+// reads nothing itself.
+void IRliveness_foreach_use(struct IRinstruction *x, IRoperand_fn fn, void *arg);
+
+// Returns the values live at the entry of the block, phis of the block included, and their
+// number in _count_.
+const int* IRliveness_in(const struct IRliveness *self, struct IRblock *b, int *count);
+
+// Returns the values live at the end of the block, arguments of the phis of its successors
+// included, and their number in _count_.
+const int* IRliveness_out(const struct IRliveness *self, struct IRblock *b, int *count);
+
+// Outputs the function with the register pressure of each block and the values live at its
+// entry, as comments.
+void IRliveness_print(const struct IRliveness *self, struct IRfunction *f, FILE *Outfile);
+
+// Frees the liveness.
+void IRliveness_free(struct IRliveness *self);
+
+// Outputs every function of the translation unit with its register pressure, see
+// IRliveness_print(). Identifiers are renumbered.
+void IRunit_print_pressure(struct IRunit *self, FILE *Outfile);
+
+// Analyses cached by the pass manager, as a bit mask.
+enum {
+	IRA_DOM = 1 << 0,	// dominator tree
+	IRA_POSTDOM = 1 << 1,	// post-dominator tree
+	IRA_LOOPS = 1 << 2,	// loop nest
+	IRA_LIVENESS = 1 << 3,	// liveness of values
+};
+
+// Analyses depending on the control flow graph only, preserved by the passes keeping it.
+#define IRA_CFG (IRA_DOM | IRA_POSTDOM | IRA_LOOPS)
+
+// Analysis cache of a function. Analyses are built on first request, and kept until a pass
+// changing the function invalidates them, which passes do by declaring what they preserve.
+// A pass changing the CFG in the middle of its work invalidates the cache itself.
+struct IRanalyses {
+	struct IRfunction *f;
+	const struct IRcallgraph *cg;	// call graph of the unit, NULL for a function alone
+	int valid;			// analyses up to date
+	struct IRdomtree dom, postdom;
+	struct IRloopinfo loops;
+	struct IRliveness liveness;
+	const char *fixpoint;		// last pass group which left the function unchanged, see IRpipeline_run()
+	int remarked;			// passes reported over their limits on the function, a bit each
+};
+
+// Initializes the analysis cache of a function.
+void IRanalyses_init(struct IRanalyses *self, struct IRfunction *f, const struct IRcallgraph *cg);
+
+// Returns the dominator tree of the function.
+struct IRdomtree* IRanalyses_dom(struct IRanalyses *self);
+
+// Returns the post-dominator tree of the function.
+struct IRdomtree* IRanalyses_postdom(struct IRanalyses *self);
+
+// Returns the loop nest of the function.
+struct IRloopinfo* IRanalyses_loops(struct IRanalyses *self);
+
+// Returns the liveness of the values of the function.
+struct IRliveness* IRanalyses_liveness(struct IRanalyses *self);
+
+// Drops the analyses which are not in _preserved_, after a change of the function.
+void IRanalyses_invalidate(struct IRanalyses *self, int preserved);
+
+// Frees the analysis cache.
+void IRanalyses_free(struct IRanalyses *self);
+
+// Register allocators.
+enum {
+	RA_LINEAR_SCAN,	// linear scan, fast
+	RA_COLORING,	// graph coloring with coalescing, slower but allocating better
+};
+
+// Options of the optimizer, set from the command line.
+struct opt_info {
+	int unroll_budget;	// largest number of instructions of an unrolled loop, 0 disables unrolling
+	int inline_threshold;	// largest cost of a function inlined into its callers, 0 disables inlining
+	bool strict_aliasing;	// whether values of different types are assumed never to overlap in memory
+	const char *pipeline;	// passes to run, in the syntax of IRpipeline_parse()
+	bool remark_skipped;	// whether passes degraded or skipped on large functions are reported
+	bool print_pressure;	// whether dumps of ACIR show the register pressure and live values of blocks
+	int regalloc;		// register allocator, one of RA_*
+};
+
+extern struct opt_info Oinfo;
+
+// Parses an optimizer option of the command line into Oinfo.
+// Returns false if the option is unknown or malformed.
+bool Oinfo_parse(const char *arg);
+
+// Applies the defaults of the optimization level to the options not given explicitly, once
+// every option is parsed.
+void Oinfo_resolve(void);
+
+// Machine-independent optimizations on ACIR.
+// Every pass returns whether the function was changed.
+
+// Function inlining: replaces the calls whose cost is below the threshold with a copy of the
+// body of the callee, except within cycles of the call graph. Callees should be optimized
+// before their callers, in the bottom-up order of the call graph. Identifiers are renumbered.
+bool IRopt_inline(struct IRfunction *self, const struct IRcallgraph *cg, int threshold);
+
+// Aggressive dead code elimination combined with CFG simplification:
+// removes unreachable blocks, folds constant branches, threads jumps through
+// empty blocks, merges straight-line blocks and deletes instructions whose
+// results are never used. Instruction and block identifiers are renumbered.
+bool IRopt_dce(struct IRfunction *self);
+
+// Peephole instruction combiner: folds constants, redundant casts and algebraic
+// identities described by a rule table, until no rule applies any more.
+// Replaced instructions are left for IRopt_dce() to remove.
+bool IRopt_instcombine(struct IRfunction *self);
+
+// Range based simplification: replaces values known to be constant, deletes
+// extensions of truncations whose input already fits, and narrows 64 bits
+// operations whose operands and result fit in 32 bits.
+bool IRopt_narrow(struct IRfunction *self);
+
+// Scalar replacement of aggregates: stack slots of several elements, only accessed at
+// constant offsets, are split into one slot per element. Identifiers are renumbered.
+bool IRopt_sroa(struct IRfunction *self);
+
+// Promotion of stack slots of one element, only accessed by loads and stores, into SSA
+// values with phis. Identifiers are renumbered.
+bool IRopt_mem2reg(struct IRfunction *self);
+
+// Redundant load elimination: loads of a location whose value is known on every path, from
+// a store or an earlier load, are replaced with that value. Identifiers are renumbered.
+bool IRopt_load_elim(struct IRfunction *self, struct IRanalyses *am);
+
+// Dead store elimination: removes the stores overwritten before any load may read them, and
+// the stores to stack slots which are never read afterwards. Identifiers are renumbered.
+bool IRopt_dse(struct IRfunction *self, struct IRanalyses *am);
+
+// Local variants of the two passes above, for functions too large for them: values are only
+// known within blocks, from a few of the last locations accessed. Identifiers are renumbered.
+bool IRopt_load_elim_local(struct IRfunction *self, struct IRanalyses *am);
+bool IRopt_dse_local(struct IRfunction *self, struct IRanalyses *am);
+
+// Partial redundancy elimination by lazy code motion: computations available on some
+// incoming paths only are inserted on the others, and the redundant ones deleted, without
+// lengthening any path. Critical edges are split where needed. Identifiers are renumbered.
+bool IRopt_pre(struct IRfunction *self, struct IRanalyses *am);
+
+// If-conversion: turns small side-effect-free branch diamonds and triangles
+// into selects, when a cost model finds executing both sides cheaper than a
+// possibly mispredicted branch. Identifiers are renumbered.
+bool IRopt_ifconvert(struct IRfunction *self);
+
+// Loop invariant code motion: moves invariant instructions which can not trap into loop
+// preheaders. Preheaders are created where needed, and identifiers renumbered then.
+bool IRopt_licm(struct IRfunction *self, struct IRanalyses *am);
+
+// Strength reduction of induction variables: multiplications of induction variables become
+// additive recurrences, and exit tests are moved onto the reduced values when that lets the
+// original counter die. Loops without preheaders are skipped. Identifiers are renumbered.
+bool IRopt_strength_reduce(struct IRfunction *self, struct IRanalyses *am);
+
+// Loop unrolling: innermost loops with a constant trip count are unrolled fully, other
+// counted loops by a factor, followed by a remainder loop. The budget bounds the number of
+// instructions of the unrolled code. Identifiers are renumbered.
+bool IRopt_unroll(struct IRfunction *self, struct IRanalyses *am, int budget);
+
+// Division by constants: signed and unsigned divisions and remainders by constants become
+// multiplications high by magic numbers, shifts and corrections, on operations no wider than
+// the registers of the target. Identifiers are renumbered.
+bool IRopt_div_const(struct IRfunction *self);
+
+// Compare and branch fusion: marks the comparisons whose only use is the conditional
+// jump ending their block, and moves them right before it. The marks are only kept
+// valid until the function is changed again, so this should run last.
+bool IRopt_fuse_cmp(struct IRfunction *self);
+
+// Pass pipeline: a comma separated list of passes run in order, e.g. "dce,instcombine".
+// A group fix(...) repeats its passes until none of them changes the function.
+// At a barrier, every function of the unit has run the passes before it, functions being
+// visited bottom-up in the call graph, before any function goes on.
+struct IRpipeline {
+	struct array steps;		// struct IRstep, see passes.c
+};
+
+// Parses a pipeline. Returns false if it is malformed or names an unknown pass.
+bool IRpipeline_parse(struct IRpipeline *self, const char *text);
+
+// Runs the passes of a pipeline on every function of the unit.
+void IRpipeline_run(const struct IRpipeline *self, struct IRunit *unit);
+
+// Frees a pipeline.
+void IRpipeline_free(struct IRpipeline *self);
+
+// Runs the optimization pipeline on every function of the translation unit.
+void IRunit_optimize(struct IRunit *self);
+
+#endif
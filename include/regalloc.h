@@ -0,0 +1,167 @@
+#ifndef ACC_REGALLOC_H
+#define ACC_REGALLOC_H
+
+#include <stdio.h>
+#include "acir.h"
+#include "opt.h"
+#include "target.h"
+
+// Largest number of values of a function allocated by graph coloring.
+#define RA_COLORING_MAX_VALUES 4000
+
+// Register allocation of the values of a function, see IRliveness_is_value().
+// Positions are the ones of the liveness: an instruction at position p reads its operands at
+// p and writes its result at p + 1, so that the result may take the register of an operand
+// dying there. A call at p clobbers the caller-saved registers after reading its arguments.
+
+// Part of the live interval of a value, kept in one location.
+// A segment starting at an even position inside a block is moved there from the previous
+// segment of the value, before the instruction at that position. Across an edge, the value
+// goes from its location at the end of the predecessor to the one at the entry of the
+// successor.
+struct IRsegment {
+	int value;	// instruction id of the value
+	int start, end;	// first and last positions covered
+	int reg;	// allocated register, as an index in the register file, -1 on the stack
+	int slot;	// spill slot of the value when on the stack, -1 otherwise
+	bool remat;	// whether the value is computed again where used instead, on the stack with no slot
+	int next;	// next segment of the value, -1 for the last one
+};
+
+// Locations of the values of a function.
+struct IRregalloc {
+	const struct IRliveness *lv;	// liveness the allocation was computed from
+	const struct target_regs *regs;	// register file
+	struct IRsegment *segs;		// segments of every value
+	int seg_count, seg_cap;
+	int *first;			// first segment of each value, indexed by instruction id, -1 for none
+	int slot_count;			// number of spill slots
+	int spill_count;		// number of segments on the stack
+	unsigned used;			// mask of the registers allocated
+};
+
+// Initializes the allocation with one segment on the stack for each value, covering its live
+// interval, for the allocators to split and assign.
+void IRregalloc_init(struct IRregalloc *self, struct IRfunction *f, const struct IRliveness *lv,
+				const struct target_regs *regs);
+
+// Splits the segment before the position, inside it. Returns the new segment, from the position.
+int IRregalloc_split(struct IRregalloc *self, int seg, int pos);
+
+// Linear scan register allocation, on the live intervals in layout order. A value spilled
+// for lack of registers stays on the stack until its next use, where it is reloaded; spill
+// slots are shared by values which are not live at the same time. Runs in time linear in the
+// number of instructions and segments, times the number of registers.
+// The liveness must outlive the allocation.
+void IRregalloc_linear_scan(struct IRregalloc *self, struct IRfunction *f,
+				const struct IRliveness *lv, const struct target_regs *regs);
+
+// Graph coloring register allocation by iterated register coalescing: a phi and its arguments
+// share a register where they do not interfere, so that the copies of the phi disappear. A value
+// spilled for lack of registers stays on the stack for its whole life, and is loaded into a
+// scratch register where it is used; unlike linear scan, stack segments may have register uses.
+// A segment covers the whole live interval of its value even where the value is dead, and
+// values which do not interfere may share a register while their intervals overlap, so that
+// locations should be looked up where the values are live only. Time and memory grow with the
+// square of the number of values. The liveness must outlive the allocation.
+void IRregalloc_coloring(struct IRregalloc *self, struct IRfunction *f,
+				const struct IRliveness *lv, const struct target_regs *regs);
+
+// Allocates registers with the allocator of Oinfo. Graph coloring falls back to linear scan on
+// functions of more than RA_COLORING_MAX_VALUES values.
+void IRregalloc_run(struct IRregalloc *self, struct IRfunction *f, const struct IRliveness *lv,
+				const struct target_regs *regs);
+
+// Returns the segment holding the value at the position, NULL if the value is not live there.
+const struct IRsegment* IRregalloc_at(const struct IRregalloc *self, struct IRinstruction *v, int pos);
+
+// Returns the segment holding the value at the entry of the block.
+const struct IRsegment* IRregalloc_at_entry(const struct IRregalloc *self, struct IRinstruction *v,
+				struct IRblock *b);
+
+// Returns the segment holding the value at the end of the block, after its terminator.
+const struct IRsegment* IRregalloc_at_exit(const struct IRregalloc *self, struct IRinstruction *v,
+				struct IRblock *b);
+
+// Frees the allocation.
+void IRregalloc_free(struct IRregalloc *self);
+
+// Translation out of SSA form after register allocation. Phis become parallel copies on the
+// edges into their block, together with the moves of the values whose location differs at
+// both ends of an edge. Each parallel copy is sequentialized into plain copies.
+
+// Locations of copies: registers are numbered as in the register file, and spill slot s is
+// the number of registers plus s.
+#define IRLOC_TEMP (-1)		// scratch register of the code generator, breaking cycles of copies
+#define IRLOC_VALUE (-2)	// no location: the value, a constant, a stack address or rematerialized,
+				// is computed into the destination
+
+// Copy of a value between locations. A copy between two spill slots goes through a scratch
+// register other than the one of IRLOC_TEMP.
+struct IRcopy {
+	int from, to;			// locations, see IRLOC_*
+	struct IRinstruction *value;	// value copied
+};
+
+// Places of the copies of an edge.
+enum {
+	IRC_EXIT,	// at the end of the predecessor, before its terminator, as it has a single successor
+	IRC_ENTRY,	// at the entry of the successor, as it has a single predecessor
+	IRC_SPLIT,	// in a block of their own, jumping to the successor
+};
+
+// Copies on an edge, in the order to make them.
+struct IRedge_copies {
+	struct IRblock *from, *to;
+	int place;		// one of IRC_*
+	int begin, count;	// copies, in _copies_ of IRoutssa
+};
+
+struct oc_context;
+
+// Copies on every edge of a function, and moves inside its blocks.
+struct IRoutssa {
+	const struct IRregalloc *ra;	// allocation the copies were computed from
+	struct IRedge_copies *edges;	// every edge, by predecessor in layout order, then successor
+	int edge_count;
+	int *edge_begin;		// first edge from each block, indexed by block id
+	int *move_begin, *move_count;	// copies before each instruction, moving values between their
+					// segments, indexed by instruction id
+	struct IRcopy *copies;
+	int copy_count, copy_cap;
+	int split_count;		// number of edges split
+	struct oc_context *ctx;		// working state of the sequentialization
+};
+
+// Computes the copies of every edge of the function. Each parallel copy takes as many copies as
+// values changing location, plus one to IRLOC_TEMP for each cycle. Copies are placed at the end
+// of the predecessor or the entry of the successor, and only critical edges with copies are split.
+// The allocation must outlive the copies.
+void IRoutssa_build(struct IRoutssa *self, struct IRfunction *f, const struct IRregalloc *ra);
+
+// Returns the copies of the edge to the successor of the block of index _succ_, in the order
+// of IRblock_successors().
+const struct IRedge_copies* IRoutssa_edge(const struct IRoutssa *self, struct IRblock *b, int succ);
+
+// Returns the segment holding the value at the position, NULL if the value is not live there,
+// like IRregalloc_at() but by bisection.
+const struct IRsegment* IRoutssa_at(const struct IRoutssa *self, struct IRinstruction *v, int pos);
+
+// Sequentializes a parallel copy into distinct locations, such as the arguments of a call, as
+// the copies of edges. Copies from a location to itself are dropped. The copies are appended to
+// _copies_, from the index returned, and may be dropped by the caller once made.
+int IRoutssa_sequentialize(struct IRoutssa *self, const struct IRcopy *copies, int count);
+
+// Frees the copies.
+void IRoutssa_free(struct IRoutssa *self);
+
+// Outputs the function with the location of every value, the moves between the segments of a
+// value inside blocks and the copies on edges if not NULL, as comments.
+void IRregalloc_print(const struct IRregalloc *self, const struct IRoutssa *copies,
+				struct IRfunction *f, FILE *Outfile);
+
+// Outputs every function of the translation unit after register allocation and translation
+// out of SSA form. Identifiers are renumbered.
+void IRunit_print_regalloc(struct IRunit *self, FILE *Outfile);
+
+#endif
@@ -16,10 +16,21 @@ enum {
 	TARGET_NULL,
 };
 
+// Register file of a target, as seen by the register allocator. Registers reserved for the
+// stack and frame pointers, or as scratch registers of the code generator, are not listed.
+struct target_regs {
+	int count;			// number of allocatable registers, at most 32
+	const char *const *names;	// name of each allocatable register
+	unsigned caller_saved;		// mask of the registers clobbered by calls
+};
+
 // Target archtechture infomation.
 struct target_info {
 	int int_size;		// size of int(in bytes).
 	int long_size;		// size of long(in bytes).
+	int reg_size;		// size of general purpose registers(in bytes).
+	bool has_cmov;		// whether selects can be done with a single conditional move.
+	const struct target_regs *regs;	// register file.
 };
 
 extern struct target_info Tinfo;
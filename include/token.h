@@ -20,11 +20,15 @@ struct token {
 enum {
 	T_EOF,
 	T_SEMI,					// ;
+	T_COMMA,				// ,
 	T_LB, T_RB, T_LP, T_RP,			// { } ( )
+	T_LS, T_RS,				// [ ]
 	T_ASSIGN,				// =
 	T_PLUS, T_MINUS, T_STAR, T_SLASH,	// - + - * /
+	T_PERCENT,				// %
 	T_LNOT, T_LAND, T_LOR,			// ! && ||
-	T_BNOT,					// ~
+	T_BNOT, T_AMPER, T_OR, T_XOR,		// ~ & | ^
+	T_LSHIFT, T_RSHIFT,			// << >>
 	T_EQ, T_NE, T_LT, T_GT, T_LE, T_GE,	// == != < > <= >=
 	T_INT, T_VOID, T_CHAR, T_LONG,		// int void char long
 	T_SHORT,				// short
@@ -0,0 +1,61 @@
+// This file implements dense bit sets over the integers 0 to n - 1, packed into 64-bit words.
+// A set is a plain array of bitset_words(n) words, so that the sets of a dataflow problem may
+// be laid out in a single table, one row per block. Operations over whole sets are simple
+// loops over the words, which compilers turn into vector instructions.
+
+#ifndef ACC_UTIL_BITSET_H
+#define ACC_UTIL_BITSET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Returns the number of words of a set of _n_ elements.
+int bitset_words(int n);
+
+// Allocates a set of _nw_ words, all elements absent.
+uint64_t* bitset_new(int nw);
+
+// Returns whether _i_ is in the set.
+bool bitset_test(const uint64_t *s, int i);
+
+// Adds _i_ to the set.
+void bitset_add(uint64_t *s, int i);
+
+// Removes _i_ from the set.
+void bitset_remove(uint64_t *s, int i);
+
+// Makes every element present, or absent.
+void bitset_fill(uint64_t *s, int nw, bool v);
+
+// Copies _src_ into _dst_.
+void bitset_copy(uint64_t *dst, const uint64_t *src, int nw);
+
+// Copies _src_ into _dst_, and returns whether _dst_ changed.
+bool bitset_update(uint64_t *dst, const uint64_t *src, int nw);
+
+// dst = dst | src. Returns whether _dst_ changed.
+bool bitset_union(uint64_t *dst, const uint64_t *src, int nw);
+
+// dst = dst & src. Returns whether _dst_ changed.
+bool bitset_intersect(uint64_t *dst, const uint64_t *src, int nw);
+
+// dst = dst & ~src. Returns whether _dst_ changed.
+bool bitset_diff(uint64_t *dst, const uint64_t *src, int nw);
+
+// Returns whether two sets are equal.
+bool bitset_equal(const uint64_t *a, const uint64_t *b, int nw);
+
+// Returns the number of bits set in a word.
+int bitword_count(uint64_t w);
+
+// Returns the index of the lowest bit set in a word, which must not be null.
+int bitword_lowest(uint64_t w);
+
+// Returns the number of elements of the set.
+int bitset_count(const uint64_t *s, int nw);
+
+// Returns the smallest element not less than _i_, or -1 if there is none.
+// Elements are listed by: for (int i = bitset_next(s, nw, 0); i >= 0; i = bitset_next(s, nw, i + 1)).
+int bitset_next(const uint64_t *s, int nw, int i);
+
+#endif
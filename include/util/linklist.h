@@ -22,7 +22,9 @@ void* llist_get(struct linklist *l, int x);
 void llist_set(struct linklist *l, int x, void *val);
 
 void llist_insert(struct linklist *l, int x, void *val);
+void llist_insert_after(struct linklist *l, void *pos, void *val);
 void* llist_popfront(struct linklist *l);
 void* llist_remove(struct linklist *l, int index);
+void llist_unlink(struct linklist *l, void *val);
 
 #endif
@@ -7,6 +7,7 @@
 #define ACC_ARRAY_LENGTH(a) (sizeof((a))/sizeof(*(a)))
 
 void* try_malloc(size_t s, const char *func_name);
+void* try_calloc(size_t n, size_t s, const char *func_name);
 bool strequal(const char *s1, const char *s2);
 char* strclone(const char *s);
 
@@ -0,0 +1,44 @@
+// This file implements sparse sets over the integers 0 to cap - 1 (Briggs and Torczon, An
+// Efficient Representation for Sparse Sets). Elements are kept in insertion order in a dense
+// array, and a sparse array maps each element to its position there, so that a set is
+// cleared in constant time and listed in time proportional to its size. Suited to worklists
+// and visited sets indexed by instruction or block identifiers, which are reused many times.
+
+#ifndef ACC_UTIL_SPARSESET_H
+#define ACC_UTIL_SPARSESET_H
+
+#include <stdbool.h>
+
+struct sparseset {
+	int length;	// number of elements
+	int cap;	// upper bound of elements
+	int *dense;	// elements, in insertion order
+	int *sparse;	// position of each element in _dense_
+};
+
+// Initializes an empty set of elements below _cap_.
+void sparseset_init(struct sparseset *self, int cap);
+
+// Frees the set.
+void sparseset_free(struct sparseset *self);
+
+// Raises the upper bound of elements to at least _cap_, e.g. after new instruction identifiers
+// were allocated.
+void sparseset_reserve(struct sparseset *self, int cap);
+
+// Returns whether _i_ is in the set.
+bool sparseset_has(const struct sparseset *self, int i);
+
+// Adds _i_ to the set. Returns false if it was there already.
+bool sparseset_add(struct sparseset *self, int i);
+
+// Removes _i_ from the set. The last element added takes its place in the dense array.
+void sparseset_remove(struct sparseset *self, int i);
+
+// Removes every element.
+void sparseset_clear(struct sparseset *self);
+
+// Removes and returns the last element added, which must exist.
+int sparseset_pop(struct sparseset *self);
+
+#endif
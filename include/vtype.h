@@ -23,6 +23,10 @@ struct VType {
 // Writes into parameter _res_
 void VType_unary(const struct VType *self, int op, struct VType *res, int line);
 
+// Find out the type after appling the give ast operator(binary arithmetic variant).
+// Writes into parameter _res_
+void VType_binary(const struct VType *x, const struct VType *y, int op, struct VType *res, int line);
+
 // Initialize a VType.
 void VType_init(struct VType *self);
 
@@ -0,0 +1,157 @@
+#ifndef ACC_X86_64_H
+#define ACC_X86_64_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+
+// Code generation for x86-64 and the System V ABI. Instructions are selected on ACIR before
+// register allocation, then emitted as machine instructions once values have locations.
+
+// Forms of the instructions computed by machine instructions of their own.
+enum {
+	X64R_NONE,	// no code, or folded into its user
+	X64R_REG,	// operands in registers or immediates, and the memory operand of a load or store
+	X64R_MEM,	// one operand loaded from memory by the machine instruction itself
+	X64R_LEA,	// address arithmetic done by lea
+	X64R_CC,	// condition in the flags of the comparison folded into it
+};
+
+// Memory operand: base + index * scale + disp.
+struct X64addr {
+	struct IRinstruction *base;	// value in a register, or stack slot addressed from the frame
+	struct IRinstruction *index;	// value scaled, NULL for none
+	int scale;			// 1, 2, 4 or 8
+	int64_t disp;
+};
+
+// Instructions selected for a function.
+struct X64isel {
+	int n;			// number of instructions
+	int *rule;		// form of each instruction not folded, X64R_*, indexed by instruction id
+	struct X64addr *addr;	// memory operand of each instruction using one, indexed by instruction id
+};
+
+// Selects the machine instructions of a function, covering the trees of each block with
+// patterns of least cost, and marks the instructions folded into their user. The identifiers
+// must be compact, see IRfunction_renumber().
+void X64isel_run(struct X64isel *self, struct IRfunction *f);
+
+// Frees the selection.
+void X64isel_free(struct X64isel *self);
+
+// Registers, by hardware number.
+enum {
+	X64_RAX, X64_RCX, X64_RDX, X64_RBX, X64_RSP, X64_RBP, X64_RSI, X64_RDI,
+	X64_R8, X64_R9, X64_R10, X64_R11, X64_R12, X64_R13, X64_R14, X64_R15,
+};
+
+// Condition codes, by hardware number.
+enum {
+	X64_CC_O, X64_CC_NO, X64_CC_B, X64_CC_AE, X64_CC_E, X64_CC_NE, X64_CC_BE, X64_CC_A,
+	X64_CC_S, X64_CC_NS, X64_CC_P, X64_CC_NP, X64_CC_L, X64_CC_GE, X64_CC_LE, X64_CC_G,
+};
+
+// Machine operations.
+enum {
+	X64_LABEL,	// pseudo operation defining the label of _dst_
+	X64_MOV,
+	X64_MOVABS,	// 64 bits immediate into a register
+	X64_MOVSXD,	// sign extension from 32 to 64 bits
+	X64_MOVZXB,	// zero extension from 8 to 32 bits
+	X64_LEA,
+	X64_ADD, X64_SUB, X64_AND, X64_OR, X64_XOR, X64_CMP, X64_TEST,
+	X64_IMUL,	// multiplication of _dst_ by _src_
+	X64_IMUL3,	// multiplication of _src_ by the immediate _imm_ into _dst_
+	X64_SHL, X64_SHR, X64_SAR,	// shift of _dst_ by an immediate or cl
+	X64_NEG, X64_NOT,
+	X64_CQO,	// sign extension of rax into rdx
+	X64_IDIV, X64_DIV, X64_IMUL1, X64_MUL1,	// rdx:rax by _src_
+	X64_SETCC, X64_CMOVCC, X64_JCC, X64_JMP, X64_CALL, X64_RET, X64_PUSH, X64_POP,
+};
+
+// Kinds of operands.
+enum {
+	X64O_NONE,
+	X64O_REG,
+	X64O_IMM,
+	X64O_MEM,
+	X64O_LABEL,
+	X64O_FUNC,
+};
+
+// Operand of a machine instruction.
+struct X64operand {
+	int kind;			// one of X64O_*
+	int reg;			// register, or base register of memory, -1 for none
+	int index, scale;		// index register of memory, -1 for none
+	int64_t imm;			// immediate, displacement of memory, or label number
+	struct IRfunction *func;	// function called
+};
+
+// Machine instruction. Sizes of operands are 1, 4 or 8 bytes.
+struct X64ins {
+	int op;				// one of X64_*
+	int size;			// size of the operands
+	int cc;				// condition of X64_SETCC, X64_CMOVCC and X64_JCC
+	struct X64operand src, dst;
+	int64_t imm;			// immediate of X64_IMUL3
+};
+
+// Machine code of a function.
+struct X64function {
+	struct IRfunction *f;
+	int index;			// index of the function in its unit, naming its labels
+	struct X64ins *code;
+	int length, cap;
+	int labels;			// number of labels
+};
+
+// Generates the machine code of a function: selects its instructions, allocates registers
+// with the allocator of Oinfo and translates it out of SSA form. Identifiers are renumbered.
+void X64function_build(struct X64function *self, struct IRfunction *f, int index);
+
+// Outputs the machine code of the function in GNU assembler syntax.
+void X64function_print(const struct X64function *self, FILE *Outfile);
+
+// Frees the machine code.
+void X64function_free(struct X64function *self);
+
+// Outputs every function of the translation unit as x86-64 assembly, for the GNU assembler.
+void IRunit_print_asm(struct IRunit *self, FILE *Outfile);
+
+// Call from the encoded code, by a 32 bits displacement from the end of the instruction.
+struct X64reloc {
+	int offset;			// offset of the displacement in the code
+	struct IRfunction *func;	// function called
+};
+
+// Machine code encoded, functions laid out one after another.
+struct X64code {
+	uint8_t *text;
+	int length, cap;
+	struct X64reloc *relocs;	// calls, left for the linker to resolve
+	int reloc_count, reloc_cap;
+};
+
+// Initializes empty code.
+void X64code_init(struct X64code *self);
+
+// Encodes the machine code of a function at the end of the code, aligned on 16 bytes by nops.
+// Jumps take 8 bits displacements wherever they reach their label. Returns the offset of the
+// function in the code.
+int X64code_encode(struct X64code *self, const struct X64function *f);
+
+// Frees the code.
+void X64code_free(struct X64code *self);
+
+// Writes every function of the translation unit as an ELF64 relocatable object.
+void IRunit_write_obj(struct IRunit *self, FILE *Outfile);
+
+// Compiles every function of the translation unit into executable memory, calls main without
+// arguments and outputs the value it returns. Needs an x86-64 host with POSIX mmap.
+void IRunit_run(struct IRunit *self, FILE *Outfile);
+
+#endif
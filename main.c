@@ -5,12 +5,25 @@
 #include "ast.h"
 #include "target.h"
 #include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "x86_64.h"
+#include "fatals.h"
 #include "util/misc.h"
 
 // Print out a usage if started incorrectly
 static void usage(char *prog) {
 	fprintf(stderr, "ACC the C compiler. built on: %s.\n", __DATE__);
-	fprintf(stderr, "Usage: %s target format infile (outfile)\n", prog);
+	fprintf(stderr, "Usage: %s [options] target format infile (outfile)\n", prog);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -O0 -O1 -O2 -Os\toptimization level of the _opt, _ra, asm, obj and run formats, -O2 by default\n");
+	fprintf(stderr, "  -passes=LIST\t\tpasses to run instead, e.g. dce,fix(instcombine,mem2reg),barrier,unroll\n");
+	fprintf(stderr, "  -unroll-budget=N\tlargest number of instructions of an unrolled loop, 0 disables unrolling\n");
+	fprintf(stderr, "  -inline-threshold=N\tlargest cost of a function inlined into its callers, 0 disables inlining\n");
+	fprintf(stderr, "  -fno-strict-aliasing\tassume that values of different types may overlap in memory\n");
+	fprintf(stderr, "  -Rpass-skipped\treport the passes degraded or skipped on functions over their size limits\n");
+	fprintf(stderr, "  -regalloc=ALLOCATOR\tlinear or coloring, the register allocator of the _ra, asm, obj and run formats, by -O level by default\n");
+	fprintf(stderr, "  -print-pressure\tshow the register pressure and live values of blocks in the _ir and _opt formats\n");
 	exit(1);
 }
 
@@ -23,28 +36,87 @@ void unload(void) {
 	}
 }
 
+// Outputs the ACIR of the unit, with the register pressure if requested.
+static void print_ir(struct IRunit *ir) {
+	if (Oinfo.print_pressure) {
+		IRunit_print_pressure(ir, Outfile);
+	} else {
+		IRunit_print(ir, Outfile);
+	}
+}
+
 int main(int argc, char *argv[]) {
 	atexit(unload);
-	if (argc < 4) {
+
+	// Options may appear anywhere, the other arguments are positional.
+	char *args[4];
+	int nargs = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] == '-') {
+			if (!Oinfo_parse(argv[i])) {
+				usage(argv[0]);
+			}
+		} else if (nargs < 4) {
+			args[nargs++] = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (nargs < 3) {
 		usage(argv[0]);
 	}
+	Oinfo_resolve();
 
-	if (argc >= 5) {
-		Outfile = fopen(argv[4], "w");
+	if (nargs >= 4) {
+		Outfile = fopen(args[3], strequal(args[1], "obj") ? "wb" : "w");
 	} else {
 		Outfile = stdout;
 	}
 
-	int target = target_parse(argv[1]);
+	int target = target_parse(args[0]);
 	Tinfo_load(target);
-	struct Afunction *afunc = Afunction_from_source(argv[3]);
-	if (strequal(argv[2], "_ast")) {
-		Afunction_print(Outfile, afunc);
-	} else if (strequal(argv[2], "_ir")) {
-		struct IRfunction *ir = IRfunction_from_ast(afunc);
-		IRfunction_print(ir, Outfile);
-		IRfunction_free(ir);
+	struct Aunit *aunit = Aunit_from_source(args[2]);
+	if (strequal(args[1], "_ast")) {
+		Aunit_print(Outfile, aunit);
+	} else if (strequal(args[1], "_ir")) {
+		struct IRunit *ir = IRunit_from_ast(aunit);
+		print_ir(ir);
+		IRunit_free(ir);
+	} else if (strequal(args[1], "_opt")) {
+		struct IRunit *ir = IRunit_from_ast(aunit);
+		IRunit_optimize(ir);
+		print_ir(ir);
+		IRunit_free(ir);
+	} else if (strequal(args[1], "_ra")) {
+		struct IRunit *ir = IRunit_from_ast(aunit);
+		IRunit_optimize(ir);
+		IRunit_print_regalloc(ir, Outfile);
+		IRunit_free(ir);
+	} else if (strequal(args[1], "asm")) {
+		if (target != TARGET_X86_64) {
+			fail_target(args[0]);
+		}
+		struct IRunit *ir = IRunit_from_ast(aunit);
+		IRunit_optimize(ir);
+		IRunit_print_asm(ir, Outfile);
+		IRunit_free(ir);
+	} else if (strequal(args[1], "obj")) {
+		if (target != TARGET_X86_64) {
+			fail_target(args[0]);
+		}
+		struct IRunit *ir = IRunit_from_ast(aunit);
+		IRunit_optimize(ir);
+		IRunit_write_obj(ir, Outfile);
+		IRunit_free(ir);
+	} else if (strequal(args[1], "run")) {
+		if (target != TARGET_X86_64) {
+			fail_target(args[0]);
+		}
+		struct IRunit *ir = IRunit_from_ast(aunit);
+		IRunit_optimize(ir);
+		IRunit_run(ir, Outfile);
+		IRunit_free(ir);
 	}
-	Afunction_free(afunc);
+	Aunit_free(aunit);
 	return (0);
 }
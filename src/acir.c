@@ -1,20 +1,25 @@
 #include <stdlib.h>
 #include <vtype.h>
 #include "util/misc.h"
+#include "util/array.h"
 #include "fatals.h"
+#include "target.h"
 #include "acir.h"
 
 #define IRinstruction_constructor_shared_code \
 	struct IRinstruction *self = try_malloc(sizeof(struct IRinstruction), __FUNCTION__);	\
+	IRblock_add_ins(owner, self);								\
 	self->id = IRfunction_alloc_ins(owner->owner);						\
 	self->owner = owner;									\
-	IRblock_add_ins(owner, self);								\
+	self->is_fused = false;									\
+	self->is_folded = false;								\
 
 // Adds one instruction to list.
 // Internal function only: IRinstruction_new_xxx() automaticly calls this function.
+// Nothing may follow the terminate of a block, callers must start a new block instead.
 static void IRblock_add_ins(struct IRblock *self, struct IRinstruction *x) {
 	if (self->is_complete) {
-		return;
+		fail_unreachable(__FUNCTION__);
 	}
 	llist_pushback(&self->ins, x);
 }
@@ -35,6 +40,43 @@ struct IRinstruction* IRinstruction_new(struct IRblock *owner, int op, int type,
 	return (self);
 }
 
+// Constructs an IRinstruction like IRinstruction_new(), but inserts it right before
+// _pos_ in the block containing _pos_, instead of appending it.
+struct IRinstruction* IRinstruction_new_before(struct IRinstruction *pos, int op, int type,
+					struct IRinstruction *left, struct IRinstruction *right) {
+	struct IRblock *owner = pos->owner;
+	struct IRinstruction *self = try_malloc(sizeof(struct IRinstruction), __FUNCTION__);
+	self->id = IRfunction_alloc_ins(owner->owner);
+	self->owner = owner;
+	self->is_fused = false;
+	self->is_folded = false;
+	self->op = op;
+	self->type = type;
+	self->left = left;
+	self->right = right;
+
+	struct llist_node *p = owner->ins.head, *prev = NULL;
+	while (p != (struct llist_node*)pos) {
+		prev = p;
+		p = p->nxt;
+	}
+	llist_insert_after(&owner->ins, prev, self);
+	return (self);
+}
+
+// Moves the instruction right before _pos_, which may be in another block.
+void IRinstruction_move_before(struct IRinstruction *self, struct IRinstruction *pos) {
+	llist_unlink(&self->owner->ins, self);
+	self->owner = pos->owner;
+
+	struct llist_node *p = pos->owner->ins.head, *prev = NULL;
+	while (p != (struct llist_node*)pos) {
+		prev = p;
+		p = p->nxt;
+	}
+	llist_insert_after(&pos->owner->ins, prev, self);
+}
+
 // Constructs an IRinstruction with an integer immediate (32bits).
 struct IRinstruction* IRinstruction_new_i32(struct IRblock *owner, int32_t v) {
 	IRinstruction_constructor_shared_code
@@ -45,6 +87,14 @@ struct IRinstruction* IRinstruction_new_i32(struct IRblock *owner, int32_t v) {
 	return (self);
 }
 
+// Constructs an IRinstruction with an integer immediate of the given type.
+struct IRinstruction* IRinstruction_new_imm(struct IRblock *owner, int type, int64_t v) {
+	IRinstruction_constructor_shared_code
+
+	IRimm_set(self, type, v);
+	return (self);
+}
+
 // Contructs an IRinstruction with an undef immediate only.
 struct IRinstruction* IRinstruction_new_undef(struct IRblock *owner) {
 	IRinstruction_constructor_shared_code
@@ -63,6 +113,131 @@ struct IRinstruction* IRinstruction_new_void(struct IRblock *owner) {
 	return (self);
 }
 
+// Inserts an instruction right after the phis at the beginning of the block.
+static void IRblock_insert_head(struct IRblock *self, struct IRinstruction *x) {
+	struct llist_node *p = self->ins.head, *last = NULL;
+	while (p && ((struct IRinstruction*)p)->op == IR_PHI) {
+		last = p;
+		p = p->nxt;
+	}
+	llist_insert_after(&self->ins, last, x);
+}
+
+// Constructs an integer immediate placed after the phis at the beginning of the block,
+// so that it is available to every instruction of the block.
+struct IRinstruction* IRblock_new_const(struct IRblock *self, int type, int64_t v) {
+	struct IRinstruction *x = try_malloc(sizeof(struct IRinstruction), __FUNCTION__);
+	x->id = IRfunction_alloc_ins(self->owner);
+	x->owner = self;
+	x->is_fused = false;
+	x->is_folded = false;
+	IRimm_set(x, type, v);
+	IRblock_insert_head(self, x);
+	return (x);
+}
+
+// Constructs a stack slot of _count_ elements of type _type_, placed after the phis at the
+// beginning of the block, which should be the function entry.
+struct IRinstruction* IRblock_new_alloca(struct IRblock *self, int type, int count) {
+	struct IRinstruction *x = try_malloc(sizeof(struct IRinstruction), __FUNCTION__);
+	x->id = IRfunction_alloc_ins(self->owner);
+	x->owner = self;
+	x->is_fused = false;
+	x->is_folded = false;
+	x->op = IR_ALLOCA;
+	x->type = IRT_PTR;
+	x->slot_type = type;
+	x->slot_count = count;
+	IRblock_insert_head(self, x);
+	return (x);
+}
+
+// Constructs a call of _callee_ returning a value of type _type_. The argument table, of
+// _argc_ values, is owned by the instruction afterwards.
+struct IRinstruction* IRinstruction_new_call(struct IRblock *owner, struct IRfunction *callee, int type,
+						struct IRinstruction **args, int argc) {
+	IRinstruction_constructor_shared_code
+
+	self->op = IR_CALL;
+	self->type = type;
+	self->callee = callee;
+	self->args = args;
+	self->argc = argc;
+	return (self);
+}
+
+// Appends a copy of a non-phi instruction to the block, with the same operands.
+// The argument table of a call is copied as well.
+struct IRinstruction* IRinstruction_clone(struct IRinstruction *self, struct IRblock *owner) {
+	if (self->op == IR_PHI) {
+		fail_ir_op(self->op, __FUNCTION__);
+	}
+
+	struct IRinstruction *x = IRinstruction_new(owner, self->op, self->type, NULL, NULL);
+	struct llist_node n = x->n;
+	int id = x->id;
+	*x = *self;
+	x->n = n;
+	x->id = id;
+	x->owner = owner;
+	x->is_fused = false;
+	x->is_folded = false;
+	if (x->op == IR_CALL) {
+		x->args = try_malloc((x->argc + 1) * sizeof(struct IRinstruction*), __FUNCTION__);
+		for (int i = 0; i < x->argc; ++i) {
+			x->args[i] = self->args[i];
+		}
+	}
+	return (x);
+}
+
+// Constructs an empty phi instruction at the beginning of the block.
+// Unlike other instructions, phis may be added to blocks that are already complete.
+struct IRinstruction* IRinstruction_new_phi(struct IRblock *owner, int type) {
+	struct IRinstruction *self = try_malloc(sizeof(struct IRinstruction), __FUNCTION__);
+	self->id = IRfunction_alloc_ins(owner->owner);
+	self->owner = owner;
+	self->is_fused = false;
+	self->is_folded = false;
+	self->op = IR_PHI;
+	self->type = type;
+	llist_init(&self->phi);
+	// Phis are unordered, so the newest goes first rather than after the others, which would
+	// make placing many phis in a block quadratic.
+	llist_insert_after(&owner->ins, NULL, self);
+	return (self);
+}
+
+// Appends an argument to a phi instruction.
+void IRphi_add_arg(struct IRinstruction *self, struct IRblock *source, struct IRinstruction *value) {
+	struct IRphi_arg *a = try_malloc(sizeof(struct IRphi_arg), __FUNCTION__);
+	a->source = source;
+	a->value = value;
+	llist_pushback(&self->phi, a);
+}
+
+// Returns the value of a phi instruction when coming from _source_, or NULL if there is none.
+struct IRinstruction* IRphi_get_arg(struct IRinstruction *self, struct IRblock *source) {
+	for (struct llist_node *p = self->phi.head; p; p = p->nxt) {
+		struct IRphi_arg *a = (void*)p;
+		if (a->source == source) {
+			return (a->value);
+		}
+	}
+	return (NULL);
+}
+
+// Constructs a select instruction right before _pos_: _vt_ if _cond_ holds, otherwise _vf_.
+struct IRinstruction* IRinstruction_new_select(struct IRinstruction *pos, struct IRinstruction *cond,
+						struct IRinstruction *vt, struct IRinstruction *vf) {
+	struct IRinstruction *self = IRinstruction_new_before(pos, IR_SELECT,
+						vt->type == IRT_UNDEF ? vf->type : vt->type, NULL, NULL);
+	self->cond = cond;
+	self->vt = vt;
+	self->vf = vf;
+	return (self);
+}
+
 // Constructs a IRinstuction with instruction IR_JMP or IR_BR (which is conditional jump).
 struct IRinstruction* IRinstruction_new_jmp(struct IRblock *owner, int op, struct IRinstruction *cond,
 						struct IRblock *bt, struct IRblock *bf) {
@@ -76,10 +251,10 @@ struct IRinstruction* IRinstruction_new_jmp(struct IRblock *owner, int op, struc
 	owner->is_complete = true;
 
 	if (bt) {
-		llist_pushback(&bt->pre, owner);
+		IRblock_add_pre(bt, owner);
 	}
 	if (bf) {
-		llist_pushback(&bf->pre, owner);
+		IRblock_add_pre(bf, owner);
 	}
 	return (self);
 }
@@ -107,6 +282,240 @@ bool IRis_jmp(int op) {
 	}
 }
 
+// Returns whether an IR opcode has effects other than producing its value.
+// Such instructions must be kept even if their values are never used.
+// Calls are assumed to have some, as the callee is not analyzed.
+bool IRhas_side_effect(int op) {
+	return (IRis_terminate(op) || op == IR_STORE || op == IR_CALL);
+}
+
+// Returns whether an IR opcode takes two value operands (arithmetics and comparisons).
+bool IRis_binary(int op) {
+	return ((IR_ADD <= op && op <= IR_XOR) || IRis_cmp(op));
+}
+
+// Returns whether an IR opcode is a comparison.
+bool IRis_cmp(int op) {
+	return (IR_CMP_EQ <= op && op <= IR_CMP_UGE);
+}
+
+// Returns whether the operands of an IR opcode can be swapped without changing the result.
+bool IRis_commutative(int op) {
+	switch (op) {
+		case IR_ADD: case IR_MUL: case IR_SMULH: case IR_UMULH:
+		case IR_AND: case IR_OR: case IR_XOR:
+		case IR_CMP_EQ: case IR_CMP_NE:
+			return (true);
+
+		default:
+			return (false);
+	}
+}
+
+// Returns the comparison giving the opposite result on the same operands.
+int IRcmp_inverse(int op) {
+	static const int map[][2] = {
+		{IR_CMP_EQ,	IR_CMP_NE},
+		{IR_CMP_LT,	IR_CMP_GE},
+		{IR_CMP_LE,	IR_CMP_GT},
+		{IR_CMP_ULT,	IR_CMP_UGE},
+		{IR_CMP_ULE,	IR_CMP_UGT},
+		{IR_NULL},
+	};
+
+	for (int i = 0; map[i][0] != IR_NULL; ++i) {
+		if (map[i][0] == op) {
+			return (map[i][1]);
+		}
+		if (map[i][1] == op) {
+			return (map[i][0]);
+		}
+	}
+	fail_ir_op(op, __FUNCTION__);
+}
+
+// Returns the comparison giving the same result with the operands swapped.
+int IRcmp_swap(int op) {
+	static const int map[][2] = {
+		{IR_CMP_EQ,	IR_CMP_EQ},
+		{IR_CMP_NE,	IR_CMP_NE},
+		{IR_CMP_LT,	IR_CMP_GT},
+		{IR_CMP_LE,	IR_CMP_GE},
+		{IR_CMP_ULT,	IR_CMP_UGT},
+		{IR_CMP_ULE,	IR_CMP_UGE},
+		{IR_NULL},
+	};
+
+	for (int i = 0; map[i][0] != IR_NULL; ++i) {
+		if (map[i][0] == op) {
+			return (map[i][1]);
+		}
+		if (map[i][1] == op) {
+			return (map[i][0]);
+		}
+	}
+	fail_ir_op(op, __FUNCTION__);
+}
+
+// Returns the high 64 bits of the 128 bits product of two unsigned integers.
+static uint64_t IRmul_high(uint64_t a, uint64_t b) {
+	uint64_t al = a & UINT32_MAX, ah = a >> 32, bl = b & UINT32_MAX, bh = b >> 32;
+	uint64_t ll = al * bl, lh = al * bh, hl = ah * bl;
+	uint64_t mid = (ll >> 32) + (lh & UINT32_MAX) + (hl & UINT32_MAX);
+	return (ah * bh + (lh >> 32) + (hl >> 32) + (mid >> 32));
+}
+
+// Writes a + b into _res_, wrapped. Returns whether the sum overflows.
+bool IRadd_overflow(int64_t a, int64_t b, int64_t *res) {
+	*res = (int64_t)((uint64_t)a + (uint64_t)b);
+	return ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b));
+}
+
+// Writes a - b into _res_, wrapped. Returns whether the difference overflows.
+bool IRsub_overflow(int64_t a, int64_t b, int64_t *res) {
+	*res = (int64_t)((uint64_t)a - (uint64_t)b);
+	return ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b));
+}
+
+// Writes a * b into _res_, wrapped. Returns whether the product overflows, checked by
+// dividing a bound of the sign of the product by one of the factors.
+bool IRmul_overflow(int64_t a, int64_t b, int64_t *res) {
+	*res = (int64_t)((uint64_t)a * (uint64_t)b);
+	if (a == 0 || b == 0) {
+		return (false);
+	}
+	if (a > 0) {
+		return ((b > 0) ? a > INT64_MAX / b : b < INT64_MIN / a);
+	}
+	return ((b > 0) ? a < INT64_MIN / b : b < INT64_MAX / a);
+}
+
+// Evaluates a binary opcode on integer constants of the operand type _type_.
+// Writes the result into _res_, wrapped into the result type.
+// Returns false if the result is undefined: a division by zero, a signed division
+// overflowing, or a shift amount out of the range of the type.
+bool IRopcode_fold(int op, int type, int64_t a, int64_t b, int64_t *res) {
+	int bits = IRTypecode_bits(type);
+	uint64_t mask = (bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+	uint64_t ua = (uint64_t)a & mask, ub = (uint64_t)b & mask, r;
+	int64_t min = (bits == 64) ? INT64_MIN : -(INT64_C(1) << (bits - 1));
+
+	switch (op) {
+		case IR_ADD:	r = ua + ub;	break;
+		case IR_SUB:	r = ua - ub;	break;
+		case IR_MUL:	r = ua * ub;	break;
+		case IR_AND:	r = ua & ub;	break;
+		case IR_OR:	r = ua | ub;	break;
+		case IR_XOR:	r = ua ^ ub;	break;
+
+		case IR_SMULH: case IR_UMULH: {
+			if (bits < 64) {
+				r = (op == IR_SMULH) ? (uint64_t)(a * b >> bits) : ua * ub >> bits;
+			} else {
+				r = IRmul_high(ua, ub);
+				if (op == IR_SMULH) {
+					r -= (a < 0 ? ub : 0) + (b < 0 ? ua : 0);
+				}
+			}
+		}	break;
+
+		case IR_SDIV: case IR_SREM: {
+			if (b == 0 || (a == min && b == -1)) {
+				return (false);
+			}
+			r = (op == IR_SDIV) ? (uint64_t)(a / b) : (uint64_t)(a % b);
+		}	break;
+
+		case IR_UDIV: case IR_UREM: {
+			if (ub == 0) {
+				return (false);
+			}
+			r = (op == IR_UDIV) ? ua / ub : ua % ub;
+		}	break;
+
+		case IR_SHL: case IR_LSHR: case IR_ASHR: {
+			if (b < 0 || b >= bits) {
+				return (false);
+			}
+			if (op == IR_SHL) {
+				r = ua << b;
+			} else if (op == IR_LSHR) {
+				r = ua >> b;
+			} else {
+				r = (uint64_t)(a >> b);
+			}
+		}	break;
+
+		case IR_CMP_EQ:		*res = (a == b);	return (true);
+		case IR_CMP_NE:		*res = (a != b);	return (true);
+		case IR_CMP_LT:		*res = (a < b);		return (true);
+		case IR_CMP_LE:		*res = (a <= b);	return (true);
+		case IR_CMP_GT:		*res = (a > b);		return (true);
+		case IR_CMP_GE:		*res = (a >= b);	return (true);
+		case IR_CMP_ULT:	*res = (ua < ub);	return (true);
+		case IR_CMP_ULE:	*res = (ua <= ub);	return (true);
+		case IR_CMP_UGT:	*res = (ua > ub);	return (true);
+		case IR_CMP_UGE:	*res = (ua >= ub);	return (true);
+
+		default: {
+			fail_ir_op(op, __FUNCTION__);
+		}
+	}
+
+	*res = IRTypecode_wrap(type, (int64_t)r);
+	return (true);
+}
+
+// Calls _fn_ on every value operand slot of the instruction, including phi arguments.
+void IRinstruction_foreach_operand(struct IRinstruction *self, IRoperand_fn fn, void *arg) {
+	switch (self->op) {
+		case IR_IMM: case IR_JMP: case IR_ALLOCA: case IR_PARAM: {
+		}	break;
+
+		case IR_CALL: {
+			for (int i = 0; i < self->argc; ++i) {
+				fn(&self->args[i], arg);
+			}
+		}	break;
+
+		case IR_STORE: {
+			fn(&self->left, arg);
+			fn(&self->right, arg);
+		}	break;
+
+		case IR_PHI: {
+			struct llist_node *p = self->phi.head;
+			while (p) {
+				fn(&((struct IRphi_arg*)p)->value, arg);
+				p = p->nxt;
+			}
+		}	break;
+
+		case IR_BR: {
+			fn(&self->cond, arg);
+		}	break;
+
+		case IR_SELECT: {
+			fn(&self->cond, arg);
+			fn(&self->vt, arg);
+			fn(&self->vf, arg);
+		}	break;
+
+		case IR_ZEXT: case IR_SEXT: case IR_TRUNC:
+		case IR_NEG: case IR_NOT: case IR_RET: case IR_LOAD: {
+			fn(&self->left, arg);
+		}	break;
+
+		default: {
+			if (!IRis_binary(self->op)) {
+				fail_ir_op(self->op, __FUNCTION__);
+			}
+			fn(&self->left, arg);
+			fn(&self->right, arg);
+		}
+	}
+}
+
 // Constructs a IRblock.
 struct IRblock* IRblock_new(struct IRfunction *owner) {
 	struct IRblock *self = try_malloc(sizeof(struct IRblock), __FUNCTION__);
@@ -120,11 +529,153 @@ struct IRblock* IRblock_new(struct IRfunction *owner) {
 	return (self);
 }
 
+// Returns the terminate of the block, or NULL if the block is not complete.
+struct IRinstruction* IRblock_terminator(struct IRblock *self) {
+	if (!self->is_complete) {
+		return (NULL);
+	}
+	return ((void*)self->ins.tail);
+}
+
+// Writes the successors of the block into _res_.
+// Returns the number of successors (0, 1 or 2).
+int IRblock_successors(struct IRblock *self, struct IRblock *res[2]) {
+	struct IRinstruction *t = IRblock_terminator(self);
+	if (t == NULL) {
+		return (0);
+	}
+
+	switch (t->op) {
+		case IR_JMP: {
+			res[0] = t->bt;
+			return (1);
+		}
+
+		case IR_BR: {
+			res[0] = t->bt;
+			res[1] = t->bf;
+			return (2);
+		}
+
+		default: {
+			return (0);
+		}
+	}
+}
+
+// Appends _pre_ to the predecessor list of the block.
+void IRblock_add_pre(struct IRblock *self, struct IRblock *pre) {
+	struct IRpredecessor *x = try_malloc(sizeof(struct IRpredecessor), __FUNCTION__);
+	x->b = pre;
+	llist_pushback(&self->pre, x);
+}
+
+// Unlinks and frees the first node of the list matching the given source block.
+// The list may either be a predecessor list or a phi argument list, both of which
+// keep the source block pointer right after the linklist header.
+// Returns whether a node was found.
+static bool IRsource_list_remove(struct linklist *l, struct IRblock *source) {
+	struct llist_node *p = l->head, *prev = NULL;
+	while (p) {
+		if (((struct IRpredecessor*)p)->b == source) {
+			if (prev) {
+				prev->nxt = p->nxt;
+			} else {
+				l->head = p->nxt;
+			}
+			if (l->tail == p) {
+				l->tail = prev;
+			}
+			l->length -= 1;
+			free(p);
+			return (true);
+		}
+		prev = p;
+		p = p->nxt;
+	}
+	return (false);
+}
+
+// Removes one occurrence of _pre_ from the predecessor list of the block,
+// together with the matching argument of each phi instruction.
+void IRblock_remove_pre(struct IRblock *self, struct IRblock *pre) {
+	IRsource_list_remove(&self->pre, pre);
+
+	struct llist_node *p = self->ins.head;
+	while (p && ((struct IRinstruction*)p)->op == IR_PHI) {
+		IRsource_list_remove(&((struct IRinstruction*)p)->phi, pre);
+		p = p->nxt;
+	}
+}
+
+// Renames every occurrence of _old_ in the predecessor list and phi arguments into _new_.
+void IRblock_replace_pre(struct IRblock *self, struct IRblock *old, struct IRblock *new) {
+	for (struct llist_node *p = self->pre.head; p; p = p->nxt) {
+		struct IRpredecessor *x = (void*)p;
+		if (x->b == old) {
+			x->b = new;
+		}
+	}
+
+	struct llist_node *p = self->ins.head;
+	while (p && ((struct IRinstruction*)p)->op == IR_PHI) {
+		for (struct llist_node *q = ((struct IRinstruction*)p)->phi.head; q; q = q->nxt) {
+			struct IRphi_arg *a = (void*)q;
+			if (a->source == old) {
+				a->source = new;
+			}
+		}
+		p = p->nxt;
+	}
+}
+
 // Allocating instruction identifiers in IRfunction
 int IRfunction_alloc_ins(struct IRfunction *self) {
 	return self->ins_count++;
 }
 
+// Operand callback of IRfunction_apply_replacements().
+static void IRreplace_operand(struct IRinstruction **slot, void *arg) {
+	struct IRinstruction **repl = arg, *x = *slot, *v = x;
+	if (x == NULL) {
+		return;
+	}
+	while (repl[v->id]) {
+		v = repl[v->id];
+	}
+	// Shortens the chain for the next uses.
+	while (x != v) {
+		struct IRinstruction *nxt = repl[x->id];
+		repl[x->id] = v;
+		x = nxt;
+	}
+	*slot = v;
+}
+
+// Replaces every operand x of the function's instructions with repl[x->id], if it is not NULL.
+// Chains of replacements are followed to their end.
+void IRfunction_apply_replacements(struct IRfunction *self, struct IRinstruction **repl) {
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			IRinstruction_foreach_operand((void*)q, IRreplace_operand, repl);
+		}
+	}
+}
+
+// Reassigns block and instruction identifiers in layout order,
+// so that tables indexed by identifiers stay compact.
+void IRfunction_renumber(struct IRfunction *self) {
+	int bid = 0;
+	self->ins_count = 0;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		b->id = bid++;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			((struct IRinstruction*)q)->id = IRfunction_alloc_ins(self);
+		}
+	}
+}
+
 // Translates a VType into an IR type code.
 int IRTypecode_from_VType(const struct VType *v) {
 	int map[][2] = {
@@ -144,6 +695,7 @@ int IRTypecode_from_VType(const struct VType *v) {
 	fail_unreachable(__FUNCTION__);
 }
 
+// Returns the type code after integer promotion.
 int IRTypecode_integer_promote(int self) {
 	switch(self) {
 		case IRT_I1: case IRT_I32:
@@ -170,6 +722,7 @@ const char *IRTypecode_stringify(int self) {
 	return map[self];
 }
 
+// Returns whether the type code is an integer type (including bool).
 bool IRTypecode_is_int(int self) {
 	switch (self) {
 		case IRT_I1: case IRT_I32: case IRT_I64:
@@ -179,6 +732,67 @@ bool IRTypecode_is_int(int self) {
 	}
 }
 
+// Returns the number of bits of an integer type code.
+int IRTypecode_bits(int self) {
+	switch (self) {
+		case IRT_I1:	return (1);
+		case IRT_I32:	return (32);
+		case IRT_I64:	return (64);
+		default:	fail_unreachable(__FUNCTION__);
+	}
+}
+
+// Wraps an integer into the range of the given integer type (sign extended).
+int64_t IRTypecode_wrap(int self, int64_t v) {
+	switch (self) {
+		case IRT_I1:	return (v & 1);
+		case IRT_I32:	return ((int32_t)(uint32_t)(uint64_t)v);
+		case IRT_I64:	return (v);
+		default:	fail_unreachable(__FUNCTION__);
+	}
+}
+
+// Returns the size in bytes of a value of the type in memory.
+int IRTypecode_size(int self) {
+	switch (self) {
+		case IRT_I1:	return (1);
+		case IRT_I32:	return (4);
+		case IRT_I64:	return (8);
+		case IRT_PTR:	return (Tinfo.reg_size);
+		default:	fail_unreachable(__FUNCTION__);
+	}
+}
+
+// Returns the integer type code as wide as pointers, used for address offsets.
+int IRTypecode_offset(void) {
+	return (Tinfo.reg_size == 8 ? IRT_I64 : IRT_I32);
+}
+
+// Returns the value of an integer immediate, sign extended (bools are 0 or 1).
+int64_t IRimm_value(const struct IRinstruction *self) {
+	switch (self->type) {
+		case IRT_I1:	return (self->val_i1);
+		case IRT_I32:	return (self->val_i32);
+		case IRT_I64:	return (self->val_i64);
+		default:	fail_unreachable(__FUNCTION__);
+	}
+}
+
+// Turns the instruction into an integer immediate of the given type and value.
+// Instructions with phi argument lists can not be turned into immediates.
+void IRimm_set(struct IRinstruction *self, int type, int64_t v) {
+	self->op = IR_IMM;
+	self->is_fused = false;
+	self->is_folded = false;
+	self->type = type;
+	switch (type) {
+		case IRT_I1:	self->val_i1 = v & 1;		break;
+		case IRT_I32:	self->val_i32 = (int32_t)v;	break;
+		case IRT_I64:	self->val_i64 = v;		break;
+		default:	fail_unreachable(__FUNCTION__);
+	}
+}
+
 // Translate an AST unary arithmetic opcode to a IR opcode.
 static int IRopcode_from_ast_unary(int op) {
 	switch (op) {
@@ -188,6 +802,37 @@ static int IRopcode_from_ast_unary(int op) {
 	}
 }
 
+// Translate an AST binary arithmetic or comparison opcode to a IR opcode.
+// Every integer type of the source language is signed.
+static int IRopcode_from_ast_binary(int op) {
+	static const int map[][2] = {
+		{A_ADD,		IR_ADD},
+		{A_SUB,		IR_SUB},
+		{A_MUL,		IR_MUL},
+		{A_DIV,		IR_SDIV},
+		{A_MOD,		IR_SREM},
+		{A_BAND,	IR_AND},
+		{A_BOR,		IR_OR},
+		{A_BXOR,	IR_XOR},
+		{A_LSHIFT,	IR_SHL},
+		{A_RSHIFT,	IR_ASHR},
+		{A_EQ,		IR_CMP_EQ},
+		{A_NE,		IR_CMP_NE},
+		{A_LT,		IR_CMP_LT},
+		{A_GT,		IR_CMP_GT},
+		{A_LE,		IR_CMP_LE},
+		{A_GE,		IR_CMP_GE},
+		{A_SOUL},
+	};
+
+	for (int i = 0; map[i][0] != A_SOUL; ++i) {
+		if (map[i][0] == op) {
+			return (map[i][1]);
+		}
+	}
+	fail_ast_op(op, __FUNCTION__);
+}
+
 // Returns a string identifier for the given operation code.
 const char* IRopcode_stringify(int self) {
 	static const char *map[] = {
@@ -198,7 +843,37 @@ const char* IRopcode_stringify(int self) {
 		"trunc",
 		"neg",
 		"not",
+		"add",
+		"sub",
+		"mul",
+		"smulh",
+		"umulh",
+		"sdiv",
+		"udiv",
+		"srem",
+		"urem",
+		"shl",
+		"lshr",
+		"ashr",
+		"and",
+		"or",
+		"xor",
 		"eq",
+		"ne",
+		"lt",
+		"le",
+		"gt",
+		"ge",
+		"ult",
+		"ule",
+		"ugt",
+		"uge",
+		"select",
+		"alloca",
+		"load",
+		"store",
+		"param",
+		"call",
 		"ret",
 		"jmp",
 		"br",
@@ -208,8 +883,24 @@ const char* IRopcode_stringify(int self) {
 	return (map[self]);
 }
 
-struct IRinstruction *IRinstruction_cast(struct IRinstruction *self, const struct VType *vt
-					, struct IRinstruction *undef) {
+// Converts an integer value into another integer type, with a single instruction.
+// Bools are zero extended, other integers are sign extended.
+static struct IRinstruction* IRinstruction_convert(struct IRblock *b, struct IRinstruction *x, int tc) {
+	int from = IRTypecode_bits(x->type), to = IRTypecode_bits(tc);
+	if (from == to) {
+		return (x);
+	}
+
+	if (from > to) {
+		return (IRinstruction_new(b, IR_TRUNC, tc, x, NULL));
+	}
+	return (IRinstruction_new(b, x->type == IRT_I1 ? IR_ZEXT : IR_SEXT, tc, x, NULL));
+}
+
+// Casts an IR value into the given value type, appending the conversion to block _b_.
+// Returns _undef_ if the value can not be represented.
+static struct IRinstruction *IRinstruction_cast(struct IRblock *b, struct IRinstruction *self,
+					const struct VType *vt, struct IRinstruction *undef) {
 	int tc = IRTypecode_from_VType(vt);
 	if (self->type == tc) {
 		return (self);
@@ -227,22 +918,224 @@ struct IRinstruction *IRinstruction_cast(struct IRinstruction *self, const struc
 		if (!VType_is_int(vt)) {
 			return (undef);
 		}
-
-		struct IRinstruction *pmt = IRinstruction_new(self->owner, IR_SEXT,
-						IRTypecode_integer_promote(self->type), self, NULL);
-		struct IRinstruction *res = IRinstruction_new(self->owner, IR_TRUNC, tc, pmt, NULL);
-		return (res);
+		return (IRinstruction_convert(b, self, tc));
 	}
 	fail_todo(__FUNCTION__);
 }
 
+// Code generation state of a basic block, for building the SSA form of local variables.
+// See Braun et al., Simple and Efficient Construction of Static Single Assignment Form.
+struct cg_block {
+	bool sealed;				// whether every predecessor of the block is known
+	struct IRinstruction **def;		// current value of each variable at the end of the block
+	struct IRinstruction **incomplete;	// phi of each variable waiting for the block to be sealed
+};
+
 struct cg_context {
 	struct IRblock *b;
 	struct IRfunction *irf;
 	struct Afunction *af;
 	struct IRinstruction *undef;
+	struct array blocks;		// struct cg_block of every IR block, indexed by block id
+	struct IRinstruction **slots;	// stack slot of each array variable, indexed by variable id
+	struct IRfunction **funcs;	// IR function of each function of the unit, indexed by function id
 };
 
+static struct IRinstruction* IRcg_dfs(struct ASTnode *x, struct cg_context *ctx);
+
+// Returns the code generation state of a block.
+static struct cg_block* IRcg_block(struct cg_context *ctx, struct IRblock *b) {
+	while (ctx->blocks.length <= b->id) {
+		struct cg_block *x = try_malloc(sizeof(struct cg_block), __FUNCTION__);
+		x->sealed = false;
+		x->def = try_calloc(ctx->af->var_count, sizeof(struct IRinstruction*), __FUNCTION__);
+		x->incomplete = try_calloc(ctx->af->var_count, sizeof(struct IRinstruction*), __FUNCTION__);
+		array_pushback(&ctx->blocks, x);
+	}
+	return (ctx->blocks.begin[b->id]);
+}
+
+// Records _v_ as the current value of a variable in the block.
+static void IRcg_write_var(struct cg_context *ctx, int var, struct IRblock *b, struct IRinstruction *v) {
+	IRcg_block(ctx, b)->def[var] = v;
+}
+
+static struct IRinstruction* IRcg_read_var(struct cg_context *ctx, int var, int type, struct IRblock *b);
+
+// Fills a phi of a variable with its value coming from each predecessor of the block.
+static void IRcg_add_phi_operands(struct cg_context *ctx, int var, struct IRinstruction *phi) {
+	for (struct llist_node *p = phi->owner->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		IRphi_add_arg(phi, pre, IRcg_read_var(ctx, var, phi->type, pre));
+	}
+}
+
+// Looks up the value of a variable not defined in the block itself, in its predecessors.
+// A phi is placed when the predecessors may disagree, or when they are not all known yet.
+static struct IRinstruction* IRcg_read_var_recursive(struct cg_context *ctx, int var, int type, struct IRblock *b) {
+	struct cg_block *info = IRcg_block(ctx, b);
+	struct IRinstruction *v;
+
+	if (!info->sealed) {
+		v = IRinstruction_new_phi(b, type);
+		info->incomplete[var] = v;
+	} else if (b->pre.length == 0) {
+		// Read before any assignment: the value is indeterminate, zero is as good as any.
+		v = IRblock_new_const(b, type, 0);
+	} else if (b->pre.length == 1) {
+		v = IRcg_read_var(ctx, var, type, ((struct IRpredecessor*)b->pre.head)->b);
+	} else {
+		v = IRinstruction_new_phi(b, type);
+		IRcg_write_var(ctx, var, b, v);	// breaks cycles through loops
+		IRcg_add_phi_operands(ctx, var, v);
+	}
+	IRcg_write_var(ctx, var, b, v);
+	return (v);
+}
+
+// Returns the current value of a variable of IR type _type_ at the end of the block.
+static struct IRinstruction* IRcg_read_var(struct cg_context *ctx, int var, int type, struct IRblock *b) {
+	struct IRinstruction *v = IRcg_block(ctx, b)->def[var];
+	if (v) {
+		return (v);
+	}
+	return (IRcg_read_var_recursive(ctx, var, type, b));
+}
+
+// Marks that every predecessor of the block is known, and completes its pending phis.
+static void IRcg_seal(struct cg_context *ctx, struct IRblock *b) {
+	struct cg_block *info = IRcg_block(ctx, b);
+	for (int i = 0; i < ctx->af->var_count; ++i) {
+		if (info->incomplete[i]) {
+			IRcg_add_phi_operands(ctx, i, info->incomplete[i]);
+			info->incomplete[i] = NULL;
+		}
+	}
+	info->sealed = true;
+}
+
+// Constructs a block whose predecessors are all known already.
+static struct IRblock* IRcg_new_sealed_block(struct cg_context *ctx) {
+	struct IRblock *b = IRblock_new(ctx->irf);
+	IRcg_block(ctx, b)->sealed = true;
+	return (b);
+}
+
+// Converts a value into a bool by comparing it to zero.
+static struct IRinstruction* IRcg_to_bool(struct IRinstruction *v, struct cg_context *ctx) {
+	if (v->type == IRT_I1) {
+		return (v);
+	}
+	struct IRinstruction *zero = IRinstruction_new_imm(ctx->b, v->type, 0);
+	return (IRinstruction_new(ctx->b, IR_CMP_NE, IRT_I1, v, zero));
+}
+
+// Returns the address of an array element.
+// The stack slot of an array is constructed in the entry block when the array is first used.
+static struct IRinstruction* IRcg_element_address(struct ASTindexnode *x, struct cg_context *ctx) {
+	struct ASTvarnode *v = (void*)x->left;
+	int type = IRTypecode_from_VType(&v->type), otype = IRTypecode_offset();
+	if (ctx->slots[v->id] == NULL) {
+		ctx->slots[v->id] = IRblock_new_alloca((void*)ctx->irf->bs.head, type, v->len);
+	}
+
+	struct IRinstruction *index = IRinstruction_convert(ctx->b, IRcg_dfs(x->right, ctx), otype),
+			     *size = IRinstruction_new_imm(ctx->b, otype, IRTypecode_size(type)),
+			     *offset = IRinstruction_new(ctx->b, IR_MUL, otype, index, size);
+	return (IRinstruction_new(ctx->b, IR_ADD, IRT_PTR, ctx->slots[v->id], offset));
+}
+
+// Generates a binary arithmetic operation or a comparison.
+// Both operands are converted to the same type first: the type of the result for
+// arithmetics, and the common promoted type of the operands for comparisons.
+static struct IRinstruction* IRcg_binary(struct ASTbinnode *x, struct cg_context *ctx) {
+	struct IRinstruction *l = IRcg_dfs(x->left, ctx), *r = IRcg_dfs(x->right, ctx);
+	int op = IRopcode_from_ast_binary(x->op), type;
+
+	if (IRis_cmp(op)) {
+		type = IRTypecode_integer_promote(l->type);
+		if (IRTypecode_integer_promote(r->type) == IRT_I64) {
+			type = IRT_I64;
+		}
+	} else {
+		type = IRTypecode_from_VType(&x->type);
+	}
+
+	l = IRinstruction_convert(ctx->b, l, type);
+	r = IRinstruction_convert(ctx->b, r, type);
+	return (IRinstruction_new(ctx->b, op, IRis_cmp(op) ? IRT_I1 : type, l, r));
+}
+
+// Generates a condition in branch context: control goes to _bt_ if the condition
+// holds, and to _bf_ otherwise. Logical operations become jumps instead of values.
+// The current block is complete afterwards.
+static void IRcg_cond(struct ASTnode *x, struct cg_context *ctx, struct IRblock *bt, struct IRblock *bf) {
+	switch (x->op) {
+		case A_LAND: case A_LOR: {
+			struct ASTbinnode *t = (void*)x;
+			struct IRblock *rhs = IRblock_new(ctx->irf);
+			if (x->op == A_LAND) {
+				IRcg_cond(t->left, ctx, rhs, bf);
+			} else {
+				IRcg_cond(t->left, ctx, bt, rhs);
+			}
+			IRcg_seal(ctx, rhs);
+			ctx->b = rhs;
+			IRcg_cond(t->right, ctx, bt, bf);
+		}	break;
+
+		case A_LNOT: {
+			IRcg_cond(((struct ASTunnode*)x)->left, ctx, bf, bt);
+		}	break;
+
+		case A_LIT_I32: {
+			struct IRblock *target = ((struct ASTi32node*)x)->val ? bt : bf;
+			IRinstruction_new_jmp(ctx->b, IR_JMP, NULL, target, NULL);
+		}	break;
+
+		default: {
+			struct IRinstruction *c = IRcg_to_bool(IRcg_dfs(x, ctx), ctx);
+			IRinstruction_new_jmp(ctx->b, IR_BR, c, bt, bf);
+		}	break;
+	}
+}
+
+// Generates a logical and/or in value context.
+// The left operand is generated in branch context, and all the edges leaving early
+// carry the same constant into a single phi at the join block.
+static struct IRinstruction* IRcg_logical(struct ASTbinnode *x, struct cg_context *ctx) {
+	struct IRblock *rhs = IRblock_new(ctx->irf), *join = IRblock_new(ctx->irf);
+	bool early = (x->op == A_LOR);		// value when leaving after the left operand
+
+	if (early) {
+		IRcg_cond(x->left, ctx, join, rhs);
+	} else {
+		IRcg_cond(x->left, ctx, rhs, join);
+	}
+	IRcg_seal(ctx, rhs);
+
+	ctx->b = rhs;
+	struct IRinstruction *v = IRcg_to_bool(IRcg_dfs(x->right, ctx), ctx);
+	struct IRblock *last = ctx->b;
+	IRinstruction_new_jmp(last, IR_JMP, NULL, join, NULL);
+	IRcg_seal(ctx, join);
+
+	ctx->b = join;
+	struct IRinstruction *phi = IRinstruction_new_phi(join, IRT_I1), *k = NULL;
+	for (struct llist_node *p = join->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		if (pre == last) {
+			IRphi_add_arg(phi, pre, v);
+		} else {
+			if (k == NULL) {
+				k = IRblock_new_const((void*)ctx->irf->bs.head, IRT_I1, early);
+			}
+			IRphi_add_arg(phi, pre, k);
+		}
+	}
+	return (phi);
+}
+
 // DFS on an AST and build IR.
 static struct IRinstruction* IRcg_dfs(struct ASTnode *x, struct cg_context *ctx) {
 	// nothing to do, return the undef object.
@@ -254,9 +1147,8 @@ static struct IRinstruction* IRcg_dfs(struct ASTnode *x, struct cg_context *ctx)
 		case A_RETURN: {
 			struct ASTunnode *t = (void*)x;
 			struct IRinstruction *value = IRcg_dfs(t->left, ctx);
-			value = IRinstruction_cast(value, &ctx->af->ret_type, ctx->undef);
+			value = IRinstruction_cast(ctx->b, value, &ctx->af->ret_type, ctx->undef);
 			IRinstruction_new(ctx->b, IR_RET, IRT_VOID, value, NULL);
-			ctx->b->is_complete = true;
 			return (ctx->undef);
 		}
 
@@ -264,6 +1156,11 @@ static struct IRinstruction* IRcg_dfs(struct ASTnode *x, struct cg_context *ctx)
 			struct ASTblocknode *t = (void*)x;
 			struct llist_node *p = t->st.head;
 			while (p) {
+				// Statements following a terminate are unreachable, but they still need
+				// a block to live in. The optimizer will remove it later.
+				if (ctx->b->is_complete) {
+					ctx->b = IRcg_new_sealed_block(ctx);
+				}
 				IRcg_dfs((struct ASTnode*)p, ctx);
 				p = p->nxt;
 			}
@@ -275,14 +1172,52 @@ static struct IRinstruction* IRcg_dfs(struct ASTnode *x, struct cg_context *ctx)
 			return (IRinstruction_new_i32(ctx->b, t->val));
 		}
 
+		case A_LIT_I64: {
+			struct ASTi64node *t = (void*)x;
+			return (IRinstruction_new_imm(ctx->b, IRT_I64, t->val));
+		}
+
+		case A_VAR: {
+			struct ASTvarnode *t = (void*)x;
+			return (IRcg_read_var(ctx, t->id, IRTypecode_from_VType(&x->type), ctx->b));
+		}
+
+		case A_INDEX: {
+			struct IRinstruction *addr = IRcg_element_address((void*)x, ctx);
+			return (IRinstruction_new(ctx->b, IR_LOAD, IRTypecode_from_VType(&x->type), addr, NULL));
+		}
+
+		case A_CALL: {
+			struct ASTcallnode *t = (void*)x;
+			struct IRinstruction **args = try_malloc((t->args.length + 1) * sizeof(struct IRinstruction*), __FUNCTION__);
+			int i = 0;
+			for (struct llist_node *p = t->args.head; p; p = p->nxt, ++i) {
+				struct IRinstruction *v = IRcg_dfs((void*)p, ctx);
+				args[i] = IRinstruction_cast(ctx->b, v, &t->callee->param_types[i], ctx->undef);
+			}
+			return (IRinstruction_new_call(ctx->b, ctx->funcs[t->callee->id],
+						IRTypecode_from_VType(&x->type), args, t->args.length));
+		}
+
+		case A_ASSIGN: {
+			struct ASTassignnode *t = (void*)x;
+			struct IRinstruction *value = IRcg_dfs(t->right, ctx);
+			value = IRinstruction_cast(ctx->b, value, &x->type, ctx->undef);
+			if (t->left->op == A_INDEX) {
+				struct IRinstruction *addr = IRcg_element_address((void*)t->left, ctx);
+				IRinstruction_new(ctx->b, IR_STORE, IRT_VOID, addr, value);
+			} else {
+				IRcg_write_var(ctx, ((struct ASTvarnode*)t->left)->id, ctx->b, value);
+			}
+			return (value);
+		}
+
 		case A_NEG: case A_BNOT: {
 			struct ASTunnode *t = (void*)x;
 			struct IRinstruction *value = IRcg_dfs(t->left, ctx);
 
 			int type = IRTypecode_integer_promote(value->type);
-			if (type != value->type) {
-				value = IRinstruction_new(ctx->b, IR_SEXT, type, value, NULL);
-			}
+			value = IRinstruction_convert(ctx->b, value, type);
 
 			return (IRinstruction_new(ctx->b, IRopcode_from_ast_unary(x->op), type, value, NULL));
 		}
@@ -291,26 +1226,81 @@ static struct IRinstruction* IRcg_dfs(struct ASTnode *x, struct cg_context *ctx)
 			struct ASTunnode *t = (void*)x;
 			// A logical not operation is basicly equivlant to comparing the value to 0.
 			struct IRinstruction *value = IRcg_dfs(t->left, ctx),
-					     *zero = IRinstruction_new_i32(ctx->b, 0);
+					     *zero = IRinstruction_new_imm(ctx->b, value->type, 0);
 			return (IRinstruction_new(ctx->b, IR_CMP_EQ, IRT_I1, value, zero));
 		}
 
+		case A_LAND: case A_LOR: {
+			return (IRcg_logical((void*)x, ctx));
+		}
+
+		case A_ADD: case A_SUB: case A_MUL: case A_DIV: case A_MOD:
+		case A_BAND: case A_BOR: case A_BXOR: case A_LSHIFT: case A_RSHIFT:
+		case A_EQ: case A_NE: case A_LT: case A_GT: case A_LE: case A_GE: {
+			return (IRcg_binary((void*)x, ctx));
+		}
+
+		case A_IF: {
+			struct ASTifnode *t = (void*)x;
+			struct IRblock *then = IRblock_new(ctx->irf),
+				       *els = t->right ? IRblock_new(ctx->irf) : NULL,
+				       *end = IRblock_new(ctx->irf);
+
+			IRcg_cond(t->cond, ctx, then, els ? els : end);
+			IRcg_seal(ctx, then);
+			if (els) {
+				IRcg_seal(ctx, els);
+			}
+
+			ctx->b = then;
+			IRcg_dfs(t->left, ctx);
+			if (!ctx->b->is_complete) {
+				IRinstruction_new_jmp(ctx->b, IR_JMP, NULL, end, NULL);
+			}
+
+			if (els) {
+				ctx->b = els;
+				IRcg_dfs(t->right, ctx);
+				if (!ctx->b->is_complete) {
+					IRinstruction_new_jmp(ctx->b, IR_JMP, NULL, end, NULL);
+				}
+			}
+			IRcg_seal(ctx, end);
+			ctx->b = end;
+			return (ctx->undef);
+		}
+
+		case A_WHILE: {
+			struct ASTbinnode *t = (void*)x;
+			struct IRblock *head = IRblock_new(ctx->irf),
+				       *body = IRblock_new(ctx->irf),
+				       *end = IRblock_new(ctx->irf);
+
+			IRinstruction_new_jmp(ctx->b, IR_JMP, NULL, head, NULL);
+			ctx->b = head;
+			IRcg_cond(t->left, ctx, body, end);
+			IRcg_seal(ctx, body);
+			IRcg_seal(ctx, end);
+
+			ctx->b = body;
+			IRcg_dfs(t->right, ctx);
+			if (!ctx->b->is_complete) {
+				IRinstruction_new_jmp(ctx->b, IR_JMP, NULL, head, NULL);
+			}
+			IRcg_seal(ctx, head);	// the back edge is known now
+			ctx->b = end;
+			return (ctx->undef);
+		}
+
 		default: {
 			fail_ast_op(x->op, __FUNCTION__);
 		}
 	}
 }
 
-// Generates IR Repersentation from an AST
-struct IRfunction* IRfunction_from_ast(struct Afunction *afunc) {
-	struct IRfunction *self = try_malloc(sizeof(struct IRfunction), __FUNCTION__);
-
-	self->name = afunc->name;	// transfer ownership of function name string
-	afunc->name = NULL;		// prevents the pointer being freed when freeing the Afunction
-
-	self->ins_count = 0;
-	llist_init(&self->bs);
-
+// Generates the body of an IR function from the AST of a function.
+// Parameters are the first variables, defined in the entry block.
+static void IRcg_function(struct IRfunction *self, struct Afunction *afunc, struct IRfunction **funcs) {
 	struct IRblock *entry = IRblock_new(self);	// construct the function entry block.
 
 	struct cg_context *ctx = try_malloc(sizeof(struct cg_context), __FUNCTION__);
@@ -318,9 +1308,66 @@ struct IRfunction* IRfunction_from_ast(struct Afunction *afunc) {
 	ctx->af = afunc;
 	ctx->b = entry;
 	ctx->irf = self;
+	ctx->funcs = funcs;
+	array_init(&ctx->blocks);
+	ctx->slots = try_calloc(afunc->var_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	IRcg_seal(ctx, entry);
+
+	for (int i = 0; i < afunc->param_count; ++i) {
+		struct IRinstruction *x = IRinstruction_new(entry, IR_PARAM,
+						IRTypecode_from_VType(&afunc->param_types[i]), NULL, NULL);
+		x->param_index = i;
+		IRcg_write_var(ctx, i, entry, x);
+	}
 
 	IRcg_dfs(afunc->rt, ctx);		// generate code by doing a DFS in our AST.
+	if (!ctx->b->is_complete) {		// falling off the end of the function.
+		IRinstruction_new(ctx->b, IR_RET, IRT_VOID, ctx->undef, NULL);
+	}
+
+	for (int i = 0; i < ctx->blocks.length; ++i) {
+		struct cg_block *x = ctx->blocks.begin[i];
+		free(x->def);
+		free(x->incomplete);
+		free(x);
+	}
+	array_free(&ctx->blocks);
+	free(ctx->slots);
 	free(ctx);
+}
+
+// Generates IR Repersentation from the AST of a translation unit.
+// Only the functions defined are translated. Every function is constructed before the
+// bodies are generated, so that calls may refer to functions defined later.
+struct IRunit* IRunit_from_ast(struct Aunit *aunit) {
+	struct IRunit *self = try_malloc(sizeof(struct IRunit), __FUNCTION__);
+	llist_init(&self->funcs);
+
+	struct IRfunction **funcs = try_calloc(aunit->funcs.length + 1, sizeof(struct IRfunction*), __FUNCTION__);
+	for (struct llist_node *p = aunit->funcs.head; p; p = p->nxt) {
+		struct Afunction *af = (void*)p;
+		if (!af->is_defined) {
+			continue;
+		}
+
+		struct IRfunction *f = try_malloc(sizeof(struct IRfunction), __FUNCTION__);
+		f->name = af->name;	// transfer ownership of function name string
+		af->name = NULL;	// prevents the pointer being freed when freeing the Afunction
+		f->id = self->funcs.length;
+		f->ins_count = 0;
+		f->param_count = af->param_count;
+		llist_init(&f->bs);
+		llist_pushback(&self->funcs, f);
+		funcs[af->id] = f;
+	}
+
+	for (struct llist_node *p = aunit->funcs.head; p; p = p->nxt) {
+		struct Afunction *af = (void*)p;
+		if (af->is_defined) {
+			IRcg_function(funcs[af->id], af, funcs);
+		}
+	}
+	free(funcs);
 	return (self);
 }
 
@@ -328,6 +1375,8 @@ struct IRfunction* IRfunction_from_ast(struct Afunction *afunc) {
 void IRinstruction_free(struct IRinstruction *self) {
 	if (self->op == IR_PHI) {
 		llist_free(&self->phi);
+	} else if (self->op == IR_CALL) {
+		free(self->args);
 	}
 	free(self);
 }
@@ -340,6 +1389,7 @@ void IRblock_free(struct IRblock *self) {
 		IRinstruction_free((void*)p);
 		p = nxt;
 	}
+	llist_free(&self->pre);
 	free(self);
 }
 
@@ -359,6 +1409,17 @@ void IRfunction_free(struct IRfunction *self) {
 	free(self);
 }
 
+// Frees a translation unit and all its functions.
+void IRunit_free(struct IRunit *self) {
+	struct llist_node *p = self->funcs.head, *nxt;
+	while (p) {
+		nxt = p->nxt;
+		IRfunction_free((void*)p);
+		p = nxt;
+	}
+	free(self);
+}
+
 // Outputs the instruction.
 void IRinstruction_print(struct IRinstruction *self, FILE *Outfile) {
 	switch(self->op) {
@@ -387,20 +1448,62 @@ void IRinstruction_print(struct IRinstruction *self, FILE *Outfile) {
 			fprintf(Outfile, "\tret $%d.\n", self->left->id);
 		}	break;
 
+		case IR_JMP: {
+			fprintf(Outfile, "\tjmp L%d.\n", self->bt->id);
+		}	break;
+
+		case IR_BR: {
+			fprintf(Outfile, "\tbr $%d L%d L%d.\n", self->cond->id, self->bt->id, self->bf->id);
+		}	break;
+
+		case IR_PHI: {
+			fprintf(Outfile, "\t$%d = %s phi", self->id, IRTypecode_stringify(self->type));
+			for (struct llist_node *p = self->phi.head; p; p = p->nxt) {
+				struct IRphi_arg *a = (void*)p;
+				fprintf(Outfile, " [L%d $%d]", a->source->id, a->value->id);
+			}
+			fputs(";\n", Outfile);
+		}	break;
+
+		case IR_SELECT: {
+			fprintf(Outfile, "\t$%d = %s select $%d $%d $%d;\n", self->id, IRTypecode_stringify(self->type),
+				self->cond->id, self->vt->id, self->vf->id);
+		}	break;
+
+		case IR_ALLOCA: {
+			fprintf(Outfile, "\t$%d = ptr alloca %s %d;\n", self->id,
+				IRTypecode_stringify(self->slot_type), self->slot_count);
+		}	break;
+
+		case IR_STORE: {
+			fprintf(Outfile, "\tstore $%d $%d;\n", self->left->id, self->right->id);
+		}	break;
+
+		case IR_PARAM: {
+			fprintf(Outfile, "\t$%d = %s param %d;\n", self->id, IRTypecode_stringify(self->type), self->param_index);
+		}	break;
+
+		case IR_CALL: {
+			fprintf(Outfile, "\t$%d = %s call %s", self->id, IRTypecode_stringify(self->type), self->callee->name);
+			for (int i = 0; i < self->argc; ++i) {
+				fprintf(Outfile, " $%d", self->args[i]->id);
+			}
+			fputs(";\n", Outfile);
+		}	break;
+
 		case IR_SEXT: case IR_ZEXT: case IR_TRUNC:
-		case IR_NEG: case IR_NOT: {
+		case IR_NEG: case IR_NOT: case IR_LOAD: {
 			fprintf(Outfile, "\t$%d = %s %s $%d;\n", self->id, 
 				IRTypecode_stringify(self->type), IRopcode_stringify(self->op), self->left->id);
 		}	break;
 
-		case IR_CMP_EQ: {
-			fprintf(Outfile, "\t$%d = %s %s $%d $%d;\n", self->id
-				, IRTypecode_stringify(self->type), IRopcode_stringify(self->op), self->left->id
-				, self->right->id);
-		}	break;
-
 		default: {
-			fail_ir_op(self->op, __FUNCTION__);
+			if (!IRis_binary(self->op)) {
+				fail_ir_op(self->op, __FUNCTION__);
+			}
+			fprintf(Outfile, "\t$%d = %s %s $%d $%d%s;\n", self->id
+				, IRTypecode_stringify(self->type), IRopcode_stringify(self->op), self->left->id
+				, self->right->id, self->is_fused ? " fused" : "");
 		}	break;
 	}
 }
@@ -426,3 +1529,10 @@ void IRfunction_print(struct IRfunction *self, FILE *Outfile) {
 		p = p->nxt;
 	}
 }
+
+// Outputs every function of the translation unit.
+void IRunit_print(struct IRunit *self, FILE *Outfile) {
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		IRfunction_print((void*)p, Outfile);
+	}
+}
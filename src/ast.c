@@ -7,12 +7,12 @@
 
 const char *ast_opname[] = {
 	"=",
-	"neg", "add", "sub", "mul", "div",
+	"neg", "add", "sub", "mul", "div", "mod",
 	"==", "!=", "<", ">", "<=", ">=",
 	"not", "and", "or",
-	"~",
+	"~", "&", "|", "^", "<<", ">>",
 	"int32", "int64",
-	"var",
+	"var", "index", "call",
 	"block",
 	"print", "if", "while",
 	"return",
@@ -20,11 +20,15 @@ const char *ast_opname[] = {
 };
 
 // Constructs a binary AST node
-struct ASTnode* ASTbinnode_new(int op, struct ASTnode *left, struct ASTnode *right) {
+// A while loop is also a binary node: its condition and its body.
+struct ASTnode* ASTbinnode_new(int op, struct ASTnode *left, struct ASTnode *right, int line) {
 	struct ASTbinnode *self = try_malloc(sizeof(struct ASTbinnode), __FUNCTION__);
 
-	VType_init(&self->type);
-	self->type.bt = VT_VOID; // FIXME: calculate the correct type.
+	if (op == A_WHILE) {
+		VType_init(&self->type);
+	} else {
+		VType_binary(&left->type, &right->type, op, &self->type, line);
+	}
 	self->op = op;
 	self->left = left;
 	self->right = right;
@@ -54,12 +58,49 @@ struct ASTnode* ASTi64node_new(int64_t v) {
 }
 
 // Make an AST variable value node
-struct ASTnode* ASTvarnode_new(int id) {
-	fail_todo(__FUNCTION__);
+// The type of an array variable is the type of its elements.
+struct ASTnode* ASTvarnode_new(int id, const struct VType *type, int len) {
 	struct ASTvarnode *self = try_malloc(sizeof(struct ASTvarnode), __FUNCTION__);
 
+	self->type = *type;
 	self->op = A_VAR;
 	self->id = id;
+	self->len = len;
+	return ((void*)self);
+}
+
+// Constructs an array element node: the element of the array variable _var_ at _index_.
+struct ASTnode* ASTindexnode_new(struct ASTnode *var, struct ASTnode *index, int line) {
+	if (index == NULL || !VType_is_int(&index->type)) {
+		fail_type(line);
+	}
+
+	struct ASTindexnode *self = try_malloc(sizeof(struct ASTindexnode), __FUNCTION__);
+	self->type = var->type;
+	self->op = A_INDEX;
+	self->left = var;
+	self->right = index;
+	return ((void*)self);
+}
+
+// Constructs a function call node, taking the argument nodes out of _args_.
+// Arguments are converted to the parameter types, as by an assignment.
+struct ASTnode* ASTcallnode_new(struct Afunction *callee, struct linklist *args, int line) {
+	if (args->length != callee->param_count) {
+		fail_ce(line, "wrong number of arguments in function call");
+	}
+	for (struct llist_node *p = args->head; p; p = p->nxt) {
+		if (!VType_is_int(&((struct ASTnode*)p)->type)) {
+			fail_type(line);
+		}
+	}
+
+	struct ASTcallnode *self = try_malloc(sizeof(struct ASTcallnode), __FUNCTION__);
+	self->type = callee->ret_type;
+	self->op = A_CALL;
+	self->callee = callee;
+	self->args = *args;
+	llist_init(args);
 	return ((void*)self);
 }
 
@@ -84,10 +125,17 @@ struct ASTnode* ASTblocknode_new() {
 }
 
 // Make a assignment ast node
-struct ASTnode* ASTassignnode_new(int op, struct ASTnode *left, struct ASTnode *right) {
-	fail_todo(__FUNCTION__);
-	struct ASTassignnode *x = try_malloc(sizeof(struct ASTassignnode), __FUNCTION__);
+// The value of an assignment is the value stored, which has the type of the variable.
+struct ASTnode* ASTassignnode_new(int op, struct ASTnode *left, struct ASTnode *right, int line) {
+	if (left->op != A_VAR && left->op != A_INDEX) {
+		fail_ce(line, "lvalue required as left operand of assignment");
+	}
+	if (right == NULL || !VType_is_int(&right->type)) {
+		fail_type(line);
+	}
 
+	struct ASTassignnode *x = try_malloc(sizeof(struct ASTassignnode), __FUNCTION__);
+	x->type = left->type;
 	x->op = op;
 	x->left = left;
 	x->right = right;
@@ -96,9 +144,9 @@ struct ASTnode* ASTassignnode_new(int op, struct ASTnode *left, struct ASTnode *
 
 // Make a if statement ast node
 struct ASTnode* ASTifnode_new(struct ASTnode *left, struct ASTnode *right, struct ASTnode *cond) {
-	fail_todo(__FUNCTION__);
 	struct ASTifnode *x = try_malloc(sizeof(struct ASTifnode), __FUNCTION__);
 
+	VType_init(&x->type);
 	x->op = A_IF;
 	x->left = left;
 	x->right = right;
@@ -124,6 +172,32 @@ static void ast_print_dfs(FILE* Outfile, struct ASTnode *x, int tabs) {
 			ast_print_dfs(Outfile, t->left, tabs + 1);
 		}	break;
 
+		case A_LAND: case A_LOR: case A_ASSIGN:
+		case A_ADD: case A_SUB: case A_MUL: case A_DIV: case A_MOD:
+		case A_BAND: case A_BOR: case A_BXOR: case A_LSHIFT: case A_RSHIFT:
+		case A_EQ: case A_NE: case A_GT: case A_LT: case A_GE: case A_LE:
+		case A_INDEX: {
+			struct ASTbinnode *t = (struct ASTbinnode*)x;
+			fprintf(Outfile, "--->BINOP(%s)\n", ast_opname[x->op]);
+			ast_print_dfs(Outfile, t->left, tabs + 1);
+			ast_print_dfs(Outfile, t->right, tabs + 1);
+		}	break;
+
+		case A_IF: {
+			struct ASTifnode *t = (struct ASTifnode*)x;
+			fprintf(Outfile, "--->IF\n");
+			ast_print_dfs(Outfile, t->cond, tabs + 1);
+			ast_print_dfs(Outfile, t->left, tabs + 1);
+			ast_print_dfs(Outfile, t->right, tabs + 1);
+		}	break;
+
+		case A_WHILE: {
+			struct ASTbinnode *t = (struct ASTbinnode*)x;
+			fprintf(Outfile, "--->WHILE\n");
+			ast_print_dfs(Outfile, t->left, tabs + 1);
+			ast_print_dfs(Outfile, t->right, tabs + 1);
+		}	break;
+
 		case A_LIT_I32: {
 			struct ASTi32node *t = (struct ASTi32node*)x;
 			fprintf(Outfile, "--->INT32(%d)\n", t->val);
@@ -134,6 +208,23 @@ static void ast_print_dfs(FILE* Outfile, struct ASTnode *x, int tabs) {
 			fprintf(Outfile, "--->INT64(%lld)\n", t->val);
 		}	break;
 
+		case A_VAR: {
+			struct ASTvarnode *t = (struct ASTvarnode*)x;
+			if (t->len > 0) {
+				fprintf(Outfile, "--->VAR(%d[%d])\n", t->id, t->len);
+			} else {
+				fprintf(Outfile, "--->VAR(%d)\n", t->id);
+			}
+		}	break;
+
+		case A_CALL: {
+			struct ASTcallnode *t = (struct ASTcallnode*)x;
+			fprintf(Outfile, "--->CALL(%s, %d arguments)\n", t->callee->name, t->args.length);
+			for (struct llist_node *p = t->args.head; p; p = p->nxt) {
+				ast_print_dfs(Outfile, (struct ASTnode*)p, tabs + 1);
+			}
+		}	break;
+
 		case A_BLOCK: {
 			struct ASTblocknode *t = (struct ASTblocknode*)x;
 			fprintf(Outfile, "--->BLOCK(%d statements)\n", t->st.length);
@@ -161,12 +252,27 @@ void Afunction_print(FILE *Outfile, struct Afunction *f) {
 	ast_print_dfs(Outfile, f->rt, 0);
 }
 
+// Prints the functions defined in a translation unit into Outfile.
+void Aunit_print(FILE *Outfile, struct Aunit *u) {
+	for (struct llist_node *p = u->funcs.head; p; p = p->nxt) {
+		struct Afunction *f = (void*)p;
+		if (f->is_defined) {
+			Afunction_print(Outfile, f);
+		}
+	}
+}
+
 // Constructs a Afunction.
 struct Afunction* Afunction_new() {
 	struct Afunction *res = (void*)try_malloc(sizeof(struct Afunction), __FUNCTION__);
 
+	res->id = 0;
 	res->rt = NULL;
 	res->name = NULL;
+	res->is_defined = false;
+	res->param_count = 0;
+	res->param_types = NULL;
+	res->var_count = 0;
 	return res;
 }
 
@@ -180,9 +286,21 @@ void Afunction_free(struct Afunction *f) {
 		ASTnode_free(f->rt);
 	}
 
+	free(f->param_types);
 	free(f);
 }
 
+// Frees a translation unit and all its functions.
+void Aunit_free(struct Aunit *u) {
+	struct llist_node *p = u->funcs.head, *nxt;
+	while (p) {
+		nxt = p->nxt;
+		Afunction_free((void*)p);
+		p = nxt;
+	}
+	free(u);
+}
+
 // Frees an AST's memory, including its childs.
 void ASTnode_free(struct ASTnode *x) {
 	if (x == NULL) {
@@ -194,10 +312,11 @@ void ASTnode_free(struct ASTnode *x) {
 			ASTnode_free(((struct ASTifnode*)x)->cond);
 		}	// fall through
 
-		case A_ASSIGN:
-		case A_ADD: case A_SUB: case A_MUL: case A_DIV:
+		case A_ASSIGN: case A_LAND: case A_LOR:
+		case A_ADD: case A_SUB: case A_MUL: case A_DIV: case A_MOD:
+		case A_BAND: case A_BOR: case A_BXOR: case A_LSHIFT: case A_RSHIFT:
 		case A_EQ: case A_NE: case A_GT: case A_LT: case A_GE: case A_LE:
-		case A_WHILE: {
+		case A_WHILE: case A_INDEX: {
 			struct ASTbinnode *t = (void*)x;
 			ASTnode_free(t->left);
 			ASTnode_free(t->right);
@@ -209,6 +328,16 @@ void ASTnode_free(struct ASTnode *x) {
 			ASTnode_free(t->left);
 		}	break;
 
+		case A_CALL: {
+			struct ASTcallnode *t = (void*)x;
+			struct llist_node *p = t->args.head, *nxt;
+			while (p) {
+				nxt = p->nxt;
+				ASTnode_free((void*)p);
+				p = nxt;
+			}
+		}	break;
+
 		case A_BLOCK: {
 			struct ASTblocknode *t = (void*)x;
 			struct llist_node *p = t->st.head, *nxt;
@@ -219,7 +348,7 @@ void ASTnode_free(struct ASTnode *x) {
 			}
 		}	break;
 
-		case A_LIT_I32: case A_LIT_I64: {
+		case A_LIT_I32: case A_LIT_I64: case A_VAR: {
 		}	break;
 
 		default: {
@@ -0,0 +1,763 @@
+// Graph coloring register allocation by iterated register coalescing (George and Appel,
+// "Iterated Register Coalescing").
+// Nodes of the interference graph are the values, and one precolored node per register. In
+// SSA form, two values interfere when one is live where the other is defined, so edges are
+// found walking each block backwards from the values live at its end. A value live across
+// a call interferes with the caller-saved registers. Phis and their arguments are the moves,
+// coalesced conservatively (Briggs' test, George's against registers) so that a phi and its
+// arguments take the same register and the copies of the phi disappear.
+//
+// Nodes which may not be colored are spilled for the whole function: the value stays in a
+// spill slot, loaded into a scratch register where it is used, and slots are shared by spilled
+// values which do not interfere. Spill costs count the definition and uses of a value,
+// weighted by the loop depth of their blocks, so values of inner loops are spilled last.
+// A value computed from constants and stack addresses only is rematerialized instead: it is
+// computed again where it is used, and needs no slot. Constants themselves are never values.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "util/bitset.h"
+#include "util/sparseset.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+
+// Weight of an access at each loop depth, by which spill costs grow.
+#define COLORING_LOOP_WEIGHT 10
+
+// Deepest loop depth making a difference in spill costs.
+#define COLORING_MAX_DEPTH 6
+
+// States of the nodes.
+enum {
+	RC_PRECOLORED,	// a register
+	RC_SIMPLIFY,	// of low degree, not related to a move
+	RC_FREEZE,	// of low degree, related to a move
+	RC_SPILL,	// of high degree
+	RC_SELECTED,	// removed from the graph, on the select stack
+	RC_COALESCED,	// merged into another node
+	RC_COLORED,	// given a register
+	RC_SPILLED,	// given no register
+};
+
+// States of the moves.
+enum {
+	RM_WORKLIST,	// may be coalesced
+	RM_ACTIVE,	// not yet ready for coalescing
+	RM_COALESCED,	// both ends merged
+	RM_CONSTRAINED,	// both ends interfere
+	RM_FROZEN,	// given up
+};
+
+// Growable list of integers.
+struct rc_list {
+	int *v;
+	int length, cap;
+};
+
+// Appends an integer to the list.
+static void list_push(struct rc_list *l, int x) {
+	if (l->length == l->cap) {
+		l->cap = (l->cap < 4) ? 4 : l->cap * 2;
+		l->v = realloc(l->v, l->cap * sizeof(int));
+		if (l->v == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	l->v[l->length++] = x;
+}
+
+// Hash set of the edges of the interference graph, by open addressing.
+struct rc_edges {
+	uint64_t *keys;		// 0 for an empty entry
+	int length, cap;	// _cap_ is a power of two
+};
+
+// Returns the key of the edge between two nodes.
+static uint64_t edge_key(int u, int v) {
+	if (u > v) {
+		int t = u;
+		u = v;
+		v = t;
+	}
+	return (((uint64_t)u << 32 | (uint32_t)v) + 1);
+}
+
+// Returns the entry of the key in the table, empty if it is absent.
+static uint64_t* edges_find(const struct rc_edges *e, uint64_t key) {
+	size_t i = (key * 0x9e3779b97f4a7c15ULL) >> 20;
+	for (;; ++i) {
+		uint64_t *k = &e->keys[i & (e->cap - 1)];
+		if (*k == 0 || *k == key) {
+			return (k);
+		}
+	}
+}
+
+// Returns whether the nodes are adjacent.
+static bool edges_has(const struct rc_edges *e, int u, int v) {
+	return (e->cap > 0 && *edges_find(e, edge_key(u, v)) != 0);
+}
+
+// Adds an edge. Returns false if it was there already.
+static bool edges_add(struct rc_edges *e, int u, int v) {
+	if (2 * (e->length + 1) > e->cap) {
+		struct rc_edges bigger = { .cap = (e->cap < 64) ? 64 : 2 * e->cap, .length = e->length };
+		bigger.keys = try_calloc(bigger.cap, sizeof(uint64_t), __FUNCTION__);
+		for (int i = 0; i < e->cap; ++i) {
+			if (e->keys[i] != 0) {
+				*edges_find(&bigger, e->keys[i]) = e->keys[i];
+			}
+		}
+		free(e->keys);
+		*e = bigger;
+	}
+	uint64_t key = edge_key(u, v), *k = edges_find(e, key);
+	if (*k != 0) {
+		return (false);
+	}
+	*k = key;
+	e->length += 1;
+	return (true);
+}
+
+// Move from a phi argument to the phi.
+struct rc_move {
+	int src, dst;		// nodes
+	int state;
+	double weight;		// cost of the copy, by the loop depth of the edge
+	int order;		// index of the move when found
+};
+
+// Sorting order of moves, the heaviest first.
+static int compare_move(const void *pa, const void *pb) {
+	const struct rc_move *a = pa, *b = pb;
+	if (a->weight != b->weight) {
+		return ((a->weight < b->weight) ? 1 : -1);
+	}
+	return (a->order - b->order);
+}
+
+// Working state of the allocator. Nodes 0 to k - 1 are the registers, then come the values.
+struct rc_context {
+	struct IRregalloc *ra;
+	const struct IRliveness *lv;
+	int k;				// number of registers
+	unsigned caller_saved;		// registers clobbered by calls
+	int nn;				// number of nodes
+	int *node_of;			// node of each value, -1 for none, indexed by instruction id
+	struct IRinstruction **value;	// value of each node, NULL for registers
+	struct rc_edges adj_set;
+	struct rc_list *adj;		// neighbours of each node, empty for registers
+	int *degree;
+	struct rc_list *move_list;	// moves of each node
+	struct rc_move *moves;
+	int move_count;
+	int *state;
+	int *alias;			// node a coalesced node was merged into
+	int *color;
+	double *cost;			// spill cost of each node
+	bool *remat;			// whether each node may be rematerialized instead of spilled
+	int *stamp;			// last query each node was counted in, by briggs()
+	int stamps;
+	struct rc_list simplify, freeze, worklist_moves, select;
+};
+
+// Adds an edge between two nodes.
+static void add_edge(struct rc_context *ctx, int u, int v) {
+	if (u == v || !edges_add(&ctx->adj_set, u, v)) {
+		return;
+	}
+	if (ctx->state[u] != RC_PRECOLORED) {
+		list_push(&ctx->adj[u], v);
+		ctx->degree[u] += 1;
+	}
+	if (ctx->state[v] != RC_PRECOLORED) {
+		list_push(&ctx->adj[v], u);
+		ctx->degree[v] += 1;
+	}
+}
+
+// Returns whether the node is still in the graph.
+static bool in_graph(struct rc_context *ctx, int n) {
+	return (ctx->state[n] != RC_SELECTED && ctx->state[n] != RC_COALESCED);
+}
+
+// Returns whether the move may still be coalesced.
+static bool is_pending(struct rc_context *ctx, int m) {
+	return (ctx->moves[m].state == RM_ACTIVE || ctx->moves[m].state == RM_WORKLIST);
+}
+
+// Returns whether the node is related to a move which may still be coalesced.
+static bool move_related(struct rc_context *ctx, int n) {
+	for (int i = 0; i < ctx->move_list[n].length; ++i) {
+		if (is_pending(ctx, ctx->move_list[n].v[i])) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Returns the node the node was merged into, itself if it was not.
+static int get_alias(struct rc_context *ctx, int n) {
+	while (ctx->state[n] == RC_COALESCED) {
+		n = ctx->alias[n];
+	}
+	return (n);
+}
+
+// Moves the node to a worklist, by its degree and moves.
+static void set_worklist(struct rc_context *ctx, int n) {
+	if (ctx->degree[n] >= ctx->k) {
+		ctx->state[n] = RC_SPILL;
+	} else if (move_related(ctx, n)) {
+		ctx->state[n] = RC_FREEZE;
+		list_push(&ctx->freeze, n);
+	} else {
+		ctx->state[n] = RC_SIMPLIFY;
+		list_push(&ctx->simplify, n);
+	}
+}
+
+// Makes the moves of the node candidates for coalescing again.
+static void enable_moves(struct rc_context *ctx, int n) {
+	for (int i = 0; i < ctx->move_list[n].length; ++i) {
+		int m = ctx->move_list[n].v[i];
+		if (ctx->moves[m].state == RM_ACTIVE) {
+			ctx->moves[m].state = RM_WORKLIST;
+			list_push(&ctx->worklist_moves, m);
+		}
+	}
+}
+
+// Decrements the degree of a node whose neighbour left the graph. A node getting a low
+// degree may be simplified, and its neighbours coalesced.
+static void decrement_degree(struct rc_context *ctx, int n) {
+	if (ctx->state[n] == RC_PRECOLORED) {
+		return;
+	}
+	if (ctx->degree[n]-- != ctx->k) {
+		return;
+	}
+	enable_moves(ctx, n);
+	for (int i = 0; i < ctx->adj[n].length; ++i) {
+		int t = ctx->adj[n].v[i];
+		if (in_graph(ctx, t)) {
+			enable_moves(ctx, t);
+		}
+	}
+	if (ctx->state[n] == RC_SPILL) {
+		set_worklist(ctx, n);
+	}
+}
+
+// Removes a node of low degree from the graph.
+static void simplify(struct rc_context *ctx, int n) {
+	ctx->state[n] = RC_SELECTED;
+	list_push(&ctx->select, n);
+	for (int i = 0; i < ctx->adj[n].length; ++i) {
+		int t = ctx->adj[n].v[i];
+		if (in_graph(ctx, t)) {
+			decrement_degree(ctx, t);
+		}
+	}
+}
+
+// Makes a node simplifiable once it has no pending move and a low degree.
+static void add_worklist(struct rc_context *ctx, int n) {
+	if (ctx->state[n] == RC_FREEZE && !move_related(ctx, n) && ctx->degree[n] < ctx->k) {
+		ctx->state[n] = RC_SIMPLIFY;
+		list_push(&ctx->simplify, n);
+	}
+}
+
+// George's test: merging a node into register _r_ is safe if each of its neighbours has a
+// low degree, is a register, or already interferes with _r_.
+static bool george(struct rc_context *ctx, int v, int r) {
+	for (int i = 0; i < ctx->adj[v].length; ++i) {
+		int t = ctx->adj[v].v[i];
+		if (in_graph(ctx, t) && ctx->degree[t] >= ctx->k && ctx->state[t] != RC_PRECOLORED
+				&& !edges_has(&ctx->adj_set, t, r)) {
+			return (false);
+		}
+	}
+	return (true);
+}
+
+// Briggs' test: merging two nodes is safe if the merged node has fewer than k neighbours of
+// high degree.
+static bool briggs(struct rc_context *ctx, int u, int v) {
+	ctx->stamps += 1;
+	int count = 0;
+	int nodes[2] = { u, v };
+	for (int j = 0; j < 2; ++j) {
+		for (int i = 0; i < ctx->adj[nodes[j]].length; ++i) {
+			int t = ctx->adj[nodes[j]].v[i];
+			if (in_graph(ctx, t) && ctx->stamp[t] != ctx->stamps) {
+				ctx->stamp[t] = ctx->stamps;
+				count += (ctx->degree[t] >= ctx->k);
+			}
+		}
+	}
+	return (count < ctx->k);
+}
+
+// Merges node _v_ into node _u_.
+static void combine(struct rc_context *ctx, int u, int v) {
+	ctx->state[v] = RC_COALESCED;
+	ctx->alias[v] = u;
+	for (int i = 0; i < ctx->move_list[v].length; ++i) {
+		list_push(&ctx->move_list[u], ctx->move_list[v].v[i]);
+	}
+	enable_moves(ctx, v);
+	for (int i = 0; i < ctx->adj[v].length; ++i) {
+		int t = ctx->adj[v].v[i];
+		if (in_graph(ctx, t)) {
+			add_edge(ctx, t, u);
+			decrement_degree(ctx, t);
+		}
+	}
+	ctx->cost[u] += ctx->cost[v];
+	ctx->remat[u] = false;
+	if (ctx->degree[u] >= ctx->k && ctx->state[u] == RC_FREEZE) {
+		ctx->state[u] = RC_SPILL;
+	}
+}
+
+// Coalesces a move, or puts it aside until its ends get a lower degree.
+static void coalesce(struct rc_context *ctx, int m) {
+	int u = get_alias(ctx, ctx->moves[m].src), v = get_alias(ctx, ctx->moves[m].dst);
+	if (ctx->state[v] == RC_PRECOLORED) {
+		int t = u;
+		u = v;
+		v = t;
+	}
+	if (u == v) {
+		ctx->moves[m].state = RM_COALESCED;
+		add_worklist(ctx, u);
+	} else if (ctx->state[v] == RC_PRECOLORED || edges_has(&ctx->adj_set, u, v)) {
+		ctx->moves[m].state = RM_CONSTRAINED;
+		add_worklist(ctx, u);
+		add_worklist(ctx, v);
+	} else if ((ctx->state[u] == RC_PRECOLORED) ? george(ctx, v, u) : briggs(ctx, u, v)) {
+		ctx->moves[m].state = RM_COALESCED;
+		combine(ctx, u, v);
+		add_worklist(ctx, u);
+	} else {
+		ctx->moves[m].state = RM_ACTIVE;
+	}
+}
+
+// Gives up coalescing the moves of a node.
+static void freeze_moves(struct rc_context *ctx, int u) {
+	for (int i = 0; i < ctx->move_list[u].length; ++i) {
+		int m = ctx->move_list[u].v[i];
+		if (!is_pending(ctx, m)) {
+			continue;
+		}
+		int x = get_alias(ctx, ctx->moves[m].src), y = get_alias(ctx, ctx->moves[m].dst);
+		int v = (y == get_alias(ctx, u)) ? x : y;
+		ctx->moves[m].state = RM_FROZEN;
+		if (ctx->state[v] == RC_FREEZE && !move_related(ctx, v) && ctx->degree[v] < ctx->k) {
+			ctx->state[v] = RC_SIMPLIFY;
+			list_push(&ctx->simplify, v);
+		}
+	}
+}
+
+// Picks a node of high degree to remove from the graph, which will likely be spilled: the
+// one of lowest cost for its degree. Returns false if there is none left.
+static bool select_spill(struct rc_context *ctx) {
+	int best = -1;
+	for (int n = ctx->k; n < ctx->nn; ++n) {
+		if (ctx->state[n] == RC_SPILL && (best < 0
+				|| ctx->cost[n] * ctx->degree[best] < ctx->cost[best] * ctx->degree[n])) {
+			best = n;
+		}
+	}
+	if (best < 0) {
+		return (false);
+	}
+	ctx->state[best] = RC_SIMPLIFY;
+	list_push(&ctx->simplify, best);
+	freeze_moves(ctx, best);
+	return (true);
+}
+
+// Returns whether the worklist has an entry in the state, dropping the stale ones on top.
+static bool has_pending(struct rc_list *l, const int *state, int s) {
+	while (l->length > 0 && state[l->v[l->length - 1]] != s) {
+		--l->length;
+	}
+	return (l->length > 0);
+}
+
+// Operand callback of is_rematerializable().
+static void check_operand(struct IRinstruction **slot, void *arg) {
+	if (IRliveness_is_value(*slot)) {
+		*(bool*)arg = false;
+	}
+}
+
+// Operand callback of is_rematerializable(): a load folded into the value reads memory which
+// may change.
+static void check_folded(struct IRinstruction **slot, void *arg) {
+	if ((*slot)->is_folded) {
+		if ((*slot)->op == IR_LOAD) {
+			*(bool*)arg = false;
+		}
+		IRinstruction_foreach_operand(*slot, check_folded, arg);
+	}
+}
+
+// Returns whether the value may be computed again where it is used: none of its operands is a
+// value, and it reads nothing which may change. Divisions and high multiplications cost more
+// than the load they would save.
+static bool is_rematerializable(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_PHI: case IR_LOAD: case IR_CALL: case IR_PARAM:
+		case IR_SMULH: case IR_UMULH: case IR_SDIV: case IR_UDIV: case IR_SREM: case IR_UREM:
+			return (false);
+	}
+	bool remat = true;
+	IRliveness_foreach_use(x, check_operand, &remat);
+	IRinstruction_foreach_operand(x, check_folded, &remat);
+	return (remat);
+}
+
+// Returns the cost of an access in the block.
+static double block_weight(const struct IRloopinfo *loops, struct IRblock *b) {
+	double weight = 1;
+	int depth = IRloopinfo_depth(loops, b);
+	for (int d = 0; d < depth && d < COLORING_MAX_DEPTH; ++d) {
+		weight *= COLORING_LOOP_WEIGHT;
+	}
+	return (weight);
+}
+
+// Context of the operand callbacks of build().
+struct rc_walk {
+	struct rc_context *ctx;
+	struct sparseset live;		// values live after the instruction visited
+	double weight;			// spill cost of an access in the block visited
+};
+
+// Operand callback of build(): makes the operand live before its use.
+static void use_operand(struct IRinstruction **slot, void *arg) {
+	struct rc_walk *w = arg;
+	int n = (*slot)->id < w->ctx->lv->n ? w->ctx->node_of[(*slot)->id] : -1;
+	if (n >= 0) {
+		sparseset_add(&w->live, (*slot)->id);
+		w->ctx->cost[n] += w->weight;
+	}
+}
+
+// Builds the interference graph and the moves, and computes the spill costs.
+static void build(struct rc_context *ctx, struct IRfunction *f, const struct IRloopinfo *loops) {
+	const struct IRliveness *lv = ctx->lv;
+	struct rc_walk w = { .ctx = ctx };
+	sparseset_init(&w.live, lv->n);
+	struct array ins;
+	array_init(&ins);
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		w.weight = block_weight(loops, b);
+
+		int nout;
+		const int *out = IRliveness_out(lv, b, &nout);
+		sparseset_clear(&w.live);
+		for (int i = 0; i < nout; ++i) {
+			if (ctx->node_of[out[i]] >= 0) {
+				sparseset_add(&w.live, out[i]);
+			}
+		}
+
+		ins.length = 0;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			array_pushback(&ins, q);
+		}
+
+		// Non-phis backwards: a value interferes with the values live after its definition.
+		int i = ins.length - 1;
+		for (; i >= 0 && ((struct IRinstruction*)ins.begin[i])->op != IR_PHI; --i) {
+			struct IRinstruction *x = ins.begin[i];
+			int n = ctx->node_of[x->id];
+			if (n >= 0) {
+				sparseset_remove(&w.live, x->id);
+				for (int j = 0; j < w.live.length; ++j) {
+					add_edge(ctx, n, ctx->node_of[w.live.dense[j]]);
+				}
+				ctx->cost[n] += ctx->remat[n] ? 0 : w.weight;
+			}
+			if (x->op == IR_CALL) {
+				for (int j = 0; j < w.live.length; ++j) {
+					for (int r = 0; r < ctx->k; ++r) {
+						if (ctx->caller_saved & (1u << r)) {
+							add_edge(ctx, ctx->node_of[w.live.dense[j]], r);
+						}
+					}
+				}
+			}
+			if (x->op != IR_CALL) {
+				IRliveness_foreach_use(x, use_operand, &w);
+			} else {
+				double weight = w.weight;
+				w.weight = 0;	// arguments are moved from wherever they are
+				IRliveness_foreach_use(x, use_operand, &w);
+				w.weight = weight;
+			}
+		}
+
+		// Phis are defined together at the entry, where the values live are the live-in ones.
+		for (; i >= 0; --i) {
+			struct IRinstruction *x = ins.begin[i];
+			int n = ctx->node_of[x->id];
+			if (n < 0) {
+				continue;
+			}
+			sparseset_add(&w.live, x->id);
+			for (int j = 0; j < w.live.length; ++j) {
+				add_edge(ctx, n, ctx->node_of[w.live.dense[j]]);
+			}
+			for (struct llist_node *r = x->phi.head; r; r = r->nxt) {
+				struct IRphi_arg *a = (void*)r;
+				int src = ctx->node_of[a->value->id];
+				if (src < 0) {
+					continue;
+				}
+				if (ctx->move_count % 64 == 0) {
+					ctx->moves = realloc(ctx->moves, (ctx->move_count + 64) * sizeof(struct rc_move));
+					if (ctx->moves == NULL) {
+						fail_malloc(__FUNCTION__);
+					}
+				}
+				ctx->moves[ctx->move_count] = (struct rc_move){ .src = src, .dst = n,
+						.state = RM_WORKLIST, .weight = block_weight(loops, a->source),
+						.order = ctx->move_count };
+				ctx->move_count += 1;
+			}
+		}
+	}
+	array_free(&ins);
+	sparseset_free(&w.live);
+
+	// Moves are listed by node once sorted.
+	if (ctx->move_count > 0) {
+		qsort(ctx->moves, ctx->move_count, sizeof(struct rc_move), compare_move);
+	}
+	for (int m = 0; m < ctx->move_count; ++m) {
+		list_push(&ctx->move_list[ctx->moves[m].src], m);
+		list_push(&ctx->move_list[ctx->moves[m].dst], m);
+	}
+}
+
+// Returns whether the slot is in the list.
+static bool has_slot(const struct rc_list *used, int s) {
+	for (int i = 0; i < used->length; ++i) {
+		if (used->v[i] == s) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Gives the spilled nodes a slot, shared by the ones which do not interfere: the slot of a node
+// related to it by a move if it is free, so that the copy disappears, or else the lowest free one.
+// The neighbours of a node are the ones of every node merged into it, as a neighbour removed
+// from the graph before the merge has no edge to the merged node.
+static void assign_slots(struct rc_context *ctx) {
+	int nn = ctx->nn;
+	int *slot = try_malloc(nn * sizeof(int), __FUNCTION__);
+	int *member_begin = try_calloc(nn + 1, sizeof(int), __FUNCTION__);
+	int *members = try_malloc(nn * sizeof(int), __FUNCTION__);
+	for (int n = 0; n < nn; ++n) {
+		slot[n] = -1;
+		member_begin[get_alias(ctx, n)] += 1;
+	}
+	for (int n = 1; n <= nn; ++n) {
+		member_begin[n] += member_begin[n - 1];
+	}
+	for (int n = nn - 1; n >= 0; --n) {
+		members[--member_begin[get_alias(ctx, n)]] = n;
+	}
+
+	struct rc_list used = { 0 };
+	for (int n = ctx->k; n < nn; ++n) {
+		if (ctx->state[n] != RC_SPILLED || ctx->remat[n]) {
+			continue;
+		}
+		used.length = 0;
+		for (int j = member_begin[n]; j < member_begin[n + 1]; ++j) {
+			const struct rc_list *adj = &ctx->adj[members[j]];
+			for (int i = 0; i < adj->length; ++i) {
+				int t = get_alias(ctx, adj->v[i]);
+				if (slot[t] >= 0) {
+					list_push(&used, slot[t]);
+				}
+			}
+		}
+		int s = -1;
+		for (int i = 0; i < ctx->move_list[n].length && s < 0; ++i) {
+			struct rc_move *m = &ctx->moves[ctx->move_list[n].v[i]];
+			int t = get_alias(ctx, (get_alias(ctx, m->src) == n) ? m->dst : m->src);
+			if (slot[t] >= 0 && !has_slot(&used, slot[t])) {
+				s = slot[t];
+			}
+		}
+		for (int i = 0; s < 0; ++i) {
+			if (!has_slot(&used, i)) {
+				s = i;
+			}
+		}
+		slot[n] = s;
+		if (s >= ctx->ra->slot_count) {
+			ctx->ra->slot_count = s + 1;
+		}
+	}
+	for (int n = ctx->k; n < ctx->nn; ++n) {
+		struct IRsegment *seg = &ctx->ra->segs[ctx->ra->first[ctx->value[n]->id]];
+		int a = get_alias(ctx, n);
+		if (ctx->state[a] == RC_COLORED) {
+			seg->reg = ctx->color[a];
+			ctx->ra->used |= 1u << seg->reg;
+		} else {
+			seg->slot = slot[a];
+			seg->remat = ctx->remat[a];
+			ctx->ra->spill_count += 1;
+		}
+	}
+	free(used.v);
+	free(members);
+	free(member_begin);
+	free(slot);
+}
+
+// Graph coloring register allocation by iterated register coalescing.
+void IRregalloc_coloring(struct IRregalloc *self, struct IRfunction *f,
+				const struct IRliveness *lv, const struct target_regs *regs) {
+	IRregalloc_init(self, f, lv, regs);
+	struct IRdomtree dom;
+	struct IRloopinfo loops;
+	IRdomtree_build(&dom, f);
+	IRloopinfo_build(&loops, &dom);
+
+	int k = regs->count, nn = k;
+	struct rc_context ctx = {
+		.ra = self,
+		.lv = lv,
+		.k = k,
+		.caller_saved = regs->caller_saved,
+		.node_of = try_malloc((lv->n + 1) * sizeof(int), __FUNCTION__),
+	};
+	for (int i = 0; i < lv->n; ++i) {
+		ctx.node_of[i] = (self->first[i] >= 0) ? nn++ : -1;
+	}
+	ctx.nn = nn;
+	ctx.value = try_calloc(nn, sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.adj = try_calloc(nn, sizeof(struct rc_list), __FUNCTION__);
+	ctx.degree = try_calloc(nn, sizeof(int), __FUNCTION__);
+	ctx.move_list = try_calloc(nn, sizeof(struct rc_list), __FUNCTION__);
+	ctx.state = try_malloc(nn * sizeof(int), __FUNCTION__);
+	ctx.alias = try_malloc(nn * sizeof(int), __FUNCTION__);
+	ctx.color = try_malloc(nn * sizeof(int), __FUNCTION__);
+	ctx.cost = try_calloc(nn, sizeof(double), __FUNCTION__);
+	ctx.remat = try_calloc(nn, sizeof(bool), __FUNCTION__);
+	ctx.stamp = try_calloc(nn, sizeof(int), __FUNCTION__);
+	for (int n = 0; n < nn; ++n) {
+		ctx.state[n] = (n < k) ? RC_PRECOLORED : RC_SIMPLIFY;
+		ctx.alias[n] = n;
+		ctx.color[n] = (n < k) ? n : -1;
+	}
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			int n = ctx.node_of[x->id];
+			if (n >= 0) {
+				ctx.value[n] = x;
+				ctx.remat[n] = is_rematerializable(x);
+			}
+		}
+	}
+	build(&ctx, f, &loops);
+
+	// Moves of the deepest loops are tried first, while the graph has the most freedom.
+	for (int m = ctx.move_count - 1; m >= 0; --m) {
+		list_push(&ctx.worklist_moves, m);
+	}
+	for (int n = k; n < nn; ++n) {
+		set_worklist(&ctx, n);
+	}
+	for (;;) {
+		if (has_pending(&ctx.simplify, ctx.state, RC_SIMPLIFY)) {
+			simplify(&ctx, ctx.simplify.v[--ctx.simplify.length]);
+		} else if (ctx.worklist_moves.length > 0) {
+			int m = ctx.worklist_moves.v[--ctx.worklist_moves.length];
+			if (ctx.moves[m].state == RM_WORKLIST) {
+				coalesce(&ctx, m);
+			}
+		} else if (has_pending(&ctx.freeze, ctx.state, RC_FREEZE)) {
+			int n = ctx.freeze.v[--ctx.freeze.length];
+			ctx.state[n] = RC_SIMPLIFY;
+			list_push(&ctx.simplify, n);
+			freeze_moves(&ctx, n);
+		} else if (!select_spill(&ctx)) {
+			break;
+		}
+	}
+
+	// Colors are given in the reverse order of simplification: the one of a node related to
+	// it by a move if it is free, so that the copy disappears anyway, or else the lowest free
+	// one, caller-saved registers being listed first.
+	while (ctx.select.length > 0) {
+		int n = ctx.select.v[--ctx.select.length];
+		unsigned ok = (k == 32) ? ~0u : (1u << k) - 1;
+		for (int i = 0; i < ctx.adj[n].length; ++i) {
+			int t = get_alias(&ctx, ctx.adj[n].v[i]);
+			if (ctx.state[t] == RC_COLORED || ctx.state[t] == RC_PRECOLORED) {
+				ok &= ~(1u << ctx.color[t]);
+			}
+		}
+		if (ok == 0) {
+			ctx.state[n] = RC_SPILLED;
+			continue;
+		}
+		ctx.state[n] = RC_COLORED;
+		ctx.color[n] = bitword_lowest(ok);
+		for (int i = 0; i < ctx.move_list[n].length; ++i) {
+			struct rc_move *m = &ctx.moves[ctx.move_list[n].v[i]];
+			int t = get_alias(&ctx, (get_alias(&ctx, m->src) == n) ? m->dst : m->src);
+			if (ctx.state[t] == RC_COLORED && (ok & (1u << ctx.color[t]))) {
+				ctx.color[n] = ctx.color[t];
+				break;
+			}
+		}
+	}
+	assign_slots(&ctx);
+
+	for (int n = 0; n < nn; ++n) {
+		free(ctx.adj[n].v);
+		free(ctx.move_list[n].v);
+	}
+	free(ctx.adj);
+	free(ctx.move_list);
+	free(ctx.node_of);
+	free(ctx.value);
+	free(ctx.degree);
+	free(ctx.state);
+	free(ctx.alias);
+	free(ctx.color);
+	free(ctx.cost);
+	free(ctx.remat);
+	free(ctx.stamp);
+	free(ctx.moves);
+	free(ctx.adj_set.keys);
+	free(ctx.simplify.v);
+	free(ctx.freeze.v);
+	free(ctx.worklist_moves.v);
+	free(ctx.select.v);
+	IRloopinfo_free(&loops);
+	IRdomtree_free(&dom);
+}
@@ -0,0 +1,413 @@
+// Linear scan register allocation (Poletto and Sarkar, "Linear Scan Register Allocation"),
+// with the splitting of Wimmer and Franz, "Linear Scan Register Allocation on SSA Form".
+// Segments are visited by increasing start position. A segment takes a free register for
+// as long as it can: caller-saved registers only up to the next call, where the rest of the
+// segment is split off and visited later. When every register is taken, the segment whose
+// value is used the farthest away is evicted, up to its next use where it is visited again,
+// unless the current segment is itself used after all of them, and is the one spilled.
+// Intervals have no holes, so a register is busy from the start of its segment to its end.
+// A phi and its arguments prefer each other's register and spill slot when free, so that most
+// copies of the phi disappear out of SSA form.
+//
+// Only operands read by an instruction itself need a register: arguments of calls and phis
+// are moved from wherever they are. Every other use ends a spilled segment, so that no
+// instruction reads its operands from the stack.
+
+#include <limits.h>
+#include <stdlib.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+
+// Entry of a priority queue.
+struct ls_entry {
+	int key, id;
+};
+
+// Binary heap of entries, smallest key first.
+struct ls_heap {
+	struct ls_entry *e;
+	int length, cap;
+};
+
+// Adds an entry to the heap.
+static void heap_push(struct ls_heap *h, int key, int id) {
+	if (h->length == h->cap) {
+		h->cap = (h->cap < 16) ? 16 : h->cap * 2;
+		h->e = realloc(h->e, h->cap * sizeof(struct ls_entry));
+		if (h->e == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	int i = h->length++;
+	while (i > 0 && h->e[(i - 1) / 2].key > key) {
+		h->e[i] = h->e[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	h->e[i].key = key;
+	h->e[i].id = id;
+}
+
+// Removes and returns the entry with the smallest key. The heap must not be empty.
+static struct ls_entry heap_pop(struct ls_heap *h) {
+	struct ls_entry top = h->e[0], last = h->e[--h->length];
+	int i = 0;
+	for (;;) {
+		int c = 2 * i + 1;
+		if (c >= h->length) {
+			break;
+		}
+		if (c + 1 < h->length && h->e[c + 1].key < h->e[c].key) {
+			++c;
+		}
+		if (h->e[c].key >= last.key) {
+			break;
+		}
+		h->e[i] = h->e[c];
+		i = c;
+	}
+	h->e[i] = last;
+	return (top);
+}
+
+// Working state of the allocator.
+struct ls_context {
+	struct IRregalloc *ra;
+	const struct IRliveness *lv;
+	int k;				// number of registers
+	unsigned caller_saved;		// registers clobbered by calls
+	int active[32];			// segment in each register, -1 when free
+	int *uses;			// positions of the register uses, grouped by value in position order
+	int *use_begin;			// first use of each value in _uses_, indexed by instruction id
+	int *cursor;			// next use of each value not yet passed, indexed by instruction id
+	int *next_call;			// position of the first call from each instruction index, INT_MAX for none
+	int *value_end;			// end of the live interval of each value, indexed by instruction id
+	int *slot_of;			// spill slot of each value, -1 for none, indexed by instruction id
+	int *hint;			// value related to each value by a phi, -1 for none, indexed by instruction id
+	int *hint_pos;			// position where the location of the hint is preferred
+	int *free_slots;		// spill slots not holding a live value
+	int free_count;
+	struct ls_heap unhandled;	// segments to visit, by start position
+	struct ls_heap busy;		// spill slots holding a value, by end of its interval
+};
+
+// Context of the operand callback of walk_uses().
+struct ls_use_walk {
+	struct ls_context *ctx;
+	int pos;	// position of the user
+	bool fill;	// whether positions are recorded, or only counted
+};
+
+// Operand callback of walk_uses(): counts or records a register use of the operand.
+static void visit_use(struct IRinstruction **slot, void *arg) {
+	struct ls_use_walk *w = arg;
+	struct ls_context *ctx = w->ctx;
+	if (!IRliveness_is_value(*slot)) {
+		return;
+	}
+	if (w->fill) {
+		ctx->uses[ctx->cursor[(*slot)->id]++] = w->pos;
+	} else {
+		ctx->use_begin[(*slot)->id + 1] += 1;
+	}
+}
+
+// Counts or records the register uses of every value.
+static void walk_uses(struct ls_context *ctx, struct IRfunction *f, bool fill) {
+	struct ls_use_walk w = { .ctx = ctx, .fill = fill };
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			w.pos = ctx->lv->pos[x->id];
+			if (x->op != IR_PHI && x->op != IR_CALL) {
+				IRliveness_foreach_use(x, visit_use, &w);
+			}
+		}
+	}
+}
+
+// Collects the register uses of every value, and the positions of the calls.
+static void collect_uses(struct ls_context *ctx, struct IRfunction *f) {
+	const struct IRliveness *lv = ctx->lv;
+	walk_uses(ctx, f, false);
+	for (int i = 0; i < lv->n; ++i) {
+		ctx->use_begin[i + 1] += ctx->use_begin[i];
+		ctx->cursor[i] = ctx->use_begin[i];
+	}
+	ctx->uses = try_malloc((ctx->use_begin[lv->n] + 1) * sizeof(int), __FUNCTION__);
+	walk_uses(ctx, f, true);
+	for (int i = 0; i < lv->n; ++i) {
+		ctx->cursor[i] = ctx->use_begin[i];
+	}
+
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			int pos = lv->pos[x->id];
+			ctx->next_call[pos / 2] = (x->op == IR_CALL) ? pos : INT_MAX;
+		}
+	}
+	for (int i = lv->n - 1; i >= 0; --i) {
+		if (ctx->next_call[i] == INT_MAX) {
+			ctx->next_call[i] = ctx->next_call[i + 1];
+		}
+	}
+}
+
+// Returns the first register use of the value from the position, INT_MAX for none.
+// Positions asked for a value never decrease by more than one.
+static int next_use(struct ls_context *ctx, int v, int pos) {
+	int i = ctx->cursor[v], end = ctx->use_begin[v + 1];
+	while (i < end && ctx->uses[i] < (pos & ~1)) {
+		++i;
+	}
+	ctx->cursor[v] = i;
+	while (i < end && ctx->uses[i] < pos) {
+		++i;
+	}
+	return ((i < end) ? ctx->uses[i] : INT_MAX);
+}
+
+// Returns the position of the first call from the position, INT_MAX for none.
+static int next_call(struct ls_context *ctx, int pos) {
+	return (ctx->next_call[(pos + 1) / 2]);
+}
+
+// Returns the register of the hint of the segment at the position of the hint, if the segment
+// is the first one of its value and the hint was allocated before it, -1 otherwise.
+static int hinted_register(struct ls_context *ctx, int seg) {
+	const struct IRsegment *s = &ctx->ra->segs[seg];
+	int h = ctx->hint[s->value], pos = ctx->hint_pos[s->value];
+	if (h < 0 || ctx->ra->first[s->value] != seg) {
+		return (-1);
+	}
+	for (int i = ctx->ra->first[h]; i >= 0; i = ctx->ra->segs[i].next) {
+		const struct IRsegment *t = &ctx->ra->segs[i];
+		if (pos <= t->end) {
+			return ((pos >= t->start && t->start < s->start) ? t->reg : -1);
+		}
+	}
+	return (-1);
+}
+
+// Takes a free spill slot for the value: the one of its hint if it is free.
+static int take_slot(struct ls_context *ctx, int v) {
+	int h = ctx->hint[v];
+	for (int i = 0; h >= 0 && ctx->slot_of[h] >= 0 && i < ctx->free_count; ++i) {
+		if (ctx->free_slots[i] == ctx->slot_of[h]) {
+			ctx->free_slots[i] = ctx->free_slots[--ctx->free_count];
+			return (ctx->slot_of[h]);
+		}
+	}
+	return ((ctx->free_count > 0) ? ctx->free_slots[--ctx->free_count] : ctx->ra->slot_count++);
+}
+
+// Puts the segment on the stack, in the spill slot of its value.
+static void spill(struct ls_context *ctx, int seg) {
+	struct IRsegment *s = &ctx->ra->segs[seg];
+	int v = s->value;
+	if (ctx->slot_of[v] < 0) {
+		ctx->slot_of[v] = take_slot(ctx, v);
+		heap_push(&ctx->busy, ctx->value_end[v], ctx->slot_of[v]);
+	}
+	s->reg = -1;
+	s->slot = ctx->slot_of[v];
+	ctx->ra->spill_count += 1;
+}
+
+// Assigns the register to the segment.
+static void assign(struct ls_context *ctx, int seg, int r) {
+	ctx->ra->segs[seg].reg = r;
+	ctx->ra->segs[seg].slot = -1;
+	ctx->active[r] = seg;
+	ctx->ra->used |= 1u << r;
+}
+
+// Splits the segment before the position, and queues the rest of it.
+static void split_rest(struct ls_context *ctx, int seg, int pos) {
+	int t = IRregalloc_split(ctx->ra, seg, pos);
+	heap_push(&ctx->unhandled, pos, t);
+}
+
+// Returns the last position up to which the register may hold the segment, from its start:
+// caller-saved registers are clobbered by the next call the segment lives across.
+static int register_limit(struct ls_context *ctx, int r, const struct IRsegment *s) {
+	if (ctx->caller_saved & (1u << r)) {
+		int c = next_call(ctx, s->start);
+		if (c < s->end) {
+			return (c - 1);
+		}
+	}
+	return (INT_MAX);
+}
+
+// Assigns a free register to the segment, splitting it where the register gets clobbered.
+// The register of its hint is preferred if it holds the whole segment, so that no copy is
+// needed for their phi. Returns false if no register is free at its start.
+static bool try_free(struct ls_context *ctx, int seg) {
+	const struct IRsegment *s = &ctx->ra->segs[seg];
+	int h = hinted_register(ctx, seg);
+	if (h >= 0 && ctx->active[h] < 0 && register_limit(ctx, h, s) >= s->end) {
+		assign(ctx, seg, h);
+		return (true);
+	}
+	int best = -1, best_limit = -1;
+	for (int r = 0; r < ctx->k; ++r) {
+		if (ctx->active[r] < 0) {
+			int limit = register_limit(ctx, r, s);
+			if (limit > best_limit) {
+				best = r;
+				best_limit = limit;
+			}
+		}
+	}
+	if (best < 0 || best_limit < s->start) {
+		return (false);
+	}
+	if (best_limit < s->end) {
+		split_rest(ctx, seg, best_limit + 1);
+	}
+	assign(ctx, seg, best);
+	return (true);
+}
+
+// Frees a register for the segment, by spilling either the segment up to its first use or
+// the segment in the register whose value is used the farthest away.
+static void allocate_blocked(struct ls_context *ctx, int seg) {
+	const struct IRsegment *s = &ctx->ra->segs[seg];
+	int start = s->start, end = s->end, v = s->value;
+	int evict_at = start & ~1;	// a result is written after the operands are read
+	int u = next_use(ctx, v, start);
+	if (u > end) {
+		u = INT_MAX;
+	}
+
+	int best = -1, best_use = -1;
+	for (int r = 0; r < ctx->k && u != INT_MAX; ++r) {
+		int w = ctx->active[r];
+		if (w < 0 || register_limit(ctx, r, s) < u) {
+			continue;
+		}
+		int wu = next_use(ctx, ctx->ra->segs[w].value, evict_at);
+		if (wu > best_use) {
+			best = r;
+			best_use = wu;
+		}
+	}
+
+	if (best < 0 || best_use <= u) {
+		if (u <= start) {
+			fail_unreachable(__FUNCTION__);	// more operands than registers
+		}
+		if (u != INT_MAX) {
+			split_rest(ctx, seg, u);
+		}
+		spill(ctx, seg);
+		return;
+	}
+
+	// The evicted segment goes to the stack until its next use, where it is visited again.
+	int w = ctx->active[best];
+	if (ctx->ra->segs[w].start < evict_at) {
+		w = IRregalloc_split(ctx->ra, w, evict_at);
+	}
+	spill(ctx, w);
+	if (best_use <= ctx->ra->segs[w].end) {
+		split_rest(ctx, w, best_use);
+	}
+	ctx->active[best] = -1;
+
+	int limit = register_limit(ctx, best, &ctx->ra->segs[seg]);
+	if (limit < end) {
+		split_rest(ctx, seg, limit + 1);
+	}
+	assign(ctx, seg, best);
+}
+
+// Linear scan register allocation, on the live intervals in layout order.
+void IRregalloc_linear_scan(struct IRregalloc *self, struct IRfunction *f,
+				const struct IRliveness *lv, const struct target_regs *regs) {
+	IRregalloc_init(self, f, lv, regs);
+	int n = lv->n;
+	struct ls_context ctx = {
+		.ra = self,
+		.lv = lv,
+		.k = regs->count,
+		.caller_saved = regs->caller_saved,
+		.use_begin = try_calloc(n + 2, sizeof(int), __FUNCTION__),
+		.cursor = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+		.next_call = try_malloc((n + 2) * sizeof(int), __FUNCTION__),
+		.value_end = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+		.slot_of = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+		.hint = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+		.hint_pos = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+		.free_slots = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+	};
+	ctx.next_call[n] = ctx.next_call[n + 1] = INT_MAX;
+	for (int r = 0; r < ctx.k; ++r) {
+		ctx.active[r] = -1;
+	}
+	collect_uses(&ctx, f);
+	for (int i = 0; i < n; ++i) {
+		ctx.slot_of[i] = ctx.hint[i] = -1;
+		if (self->first[i] >= 0) {
+			ctx.value_end[i] = self->segs[self->first[i]].end;
+			heap_push(&ctx.unhandled, self->segs[self->first[i]].start, self->first[i]);
+		}
+	}
+
+	// A phi argument prefers the location of the phi, and a phi the one of its first argument
+	// defined before it.
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		for (struct llist_node *q = b->ins.head; q && ((struct IRinstruction*)q)->op == IR_PHI; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			for (struct llist_node *r = x->phi.head; r; r = r->nxt) {
+				struct IRphi_arg *a = (void*)r;
+				int v = a->value->id;
+				if (!IRliveness_is_value(a->value) || self->first[v] < 0 || self->first[x->id] < 0) {
+					continue;
+				}
+				if (ctx.hint[v] < 0) {
+					ctx.hint[v] = x->id;
+					ctx.hint_pos[v] = lv->from[b->id];
+				}
+				if (ctx.hint[x->id] < 0 && lv->pos[v] < lv->pos[x->id]) {
+					ctx.hint[x->id] = v;
+					ctx.hint_pos[x->id] = lv->to[a->source->id] - 1;
+				}
+			}
+		}
+	}
+
+	while (ctx.unhandled.length > 0) {
+		int seg = heap_pop(&ctx.unhandled).id;
+		int start = self->segs[seg].start;
+		for (int r = 0; r < ctx.k; ++r) {
+			if (ctx.active[r] >= 0 && self->segs[ctx.active[r]].end < start) {
+				ctx.active[r] = -1;
+			}
+		}
+		// An evicted value may be stored from the position before an odd start.
+		while (ctx.busy.length > 0 && ctx.busy.e[0].key < (start & ~1)) {
+			ctx.free_slots[ctx.free_count++] = heap_pop(&ctx.busy).id;
+		}
+		if (!try_free(&ctx, seg)) {
+			allocate_blocked(&ctx, seg);
+		}
+	}
+
+	free(ctx.uses);
+	free(ctx.use_begin);
+	free(ctx.cursor);
+	free(ctx.next_call);
+	free(ctx.value_end);
+	free(ctx.slot_of);
+	free(ctx.hint);
+	free(ctx.hint_pos);
+	free(ctx.free_slots);
+	free(ctx.unhandled.e);
+	free(ctx.busy.e);
+}
@@ -0,0 +1,389 @@
+// Translation out of SSA form after register allocation (Boissinot, Darte, Rastello, Dupont de
+// Dinechin and Guillon, "Revisiting Out-of-SSA Translation for Correctness, Code Quality, and
+// Efficiency").
+// The phis of a block are copies made on each edge into it, all at once: the arguments are read
+// before any phi is written. Values live across an edge whose location changes there, as split by
+// linear scan, move at the same time. Allocation already coalesced most phis with their arguments,
+// so these parallel copies are mostly empty. The others are sequentialized: a copy is made once its
+// destination is read by no pending copy, and a cycle of copies is broken by saving one of its
+// locations into a scratch register. A copy which would precede the terminator of a block with
+// several successors, into a block with several predecessors, needs a block of its own.
+// The moves of values split inside blocks by linear scan are sequentialized the same way, as one
+// parallel copy before each instruction.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+
+// Working state of the sequentialization.
+struct oc_context {
+	struct IRoutssa *out;
+	int k;				// number of registers
+	int temp;			// location standing for IRLOC_TEMP, after the spill slots
+	int *loc;			// location holding the value first in each location, -1 for none
+	int *pred;			// source of the copy into each location, -1 for none
+	struct IRinstruction **held;	// value first in each location, read by a copy
+	bool *copied;			// whether the copy into each location was made
+	struct IRinstruction **by_id;	// instruction of each identifier
+	int *phi_mark;			// index of the last edge whose successor defines each phi
+	int *seg_begin;			// first segment of each value in _segs_, indexed by instruction id
+	int *segs;			// segments of every value, grouped by value in position order
+	struct IRcopy *pending;		// parallel copy being sequentialized
+	int pending_count, pending_cap;
+	struct IRcopy *computed;	// copies from IRLOC_VALUE, made last
+	int computed_count;
+	int *ready, *todo;
+};
+
+// Returns the location of a segment.
+static int location(struct oc_context *ctx, const struct IRsegment *s) {
+	return ((s->reg >= 0) ? s->reg : ctx->k + s->slot);
+}
+
+// Appends a copy to the edge being sequentialized.
+static void emit(struct oc_context *ctx, int from, int to, struct IRinstruction *v) {
+	struct IRoutssa *out = ctx->out;
+	if (out->copy_count == out->copy_cap) {
+		out->copy_cap = (out->copy_cap < 16) ? 16 : out->copy_cap * 2;
+		out->copies = realloc(out->copies, out->copy_cap * sizeof(struct IRcopy));
+		if (out->copies == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	out->copies[out->copy_count++] = (struct IRcopy){
+		.from = (from == ctx->temp) ? IRLOC_TEMP : from,
+		.to = (to == ctx->temp) ? IRLOC_TEMP : to,
+		.value = v,
+	};
+}
+
+// Adds a copy to the parallel copy of the edge, unless the value stays where it is.
+static void add_copy(struct oc_context *ctx, const struct IRsegment *from, const struct IRsegment *to,
+				struct IRinstruction *v) {
+	int src = (from == NULL || from->remat) ? IRLOC_VALUE : location(ctx, from);
+	int dst = location(ctx, to);
+	if (src == IRLOC_VALUE) {
+		ctx->computed[ctx->computed_count++] = (struct IRcopy){ .from = src, .to = dst, .value = v };
+	} else if (src != dst) {
+		ctx->pending[ctx->pending_count++] = (struct IRcopy){ .from = src, .to = dst, .value = v };
+	}
+}
+
+// Sequentializes the parallel copy of the edge. A copy is ready once its destination is the
+// source of no copy left; the copies left then form cycles, each broken through the temporary.
+// A value copied to several destinations is read from wherever it was copied last, as its
+// own location may have been overwritten since.
+static void sequentialize(struct oc_context *ctx) {
+	int nready = 0, ntodo = 0;
+	for (int i = 0; i < ctx->pending_count; ++i) {
+		ctx->loc[ctx->pending[i].to] = -1;
+		ctx->pred[ctx->pending[i].from] = -1;
+	}
+	for (int i = 0; i < ctx->pending_count; ++i) {
+		struct IRcopy *c = &ctx->pending[i];
+		ctx->loc[c->from] = c->from;
+		ctx->pred[c->to] = c->from;
+		ctx->held[c->from] = c->value;
+		ctx->todo[ntodo++] = c->to;
+	}
+	for (int i = 0; i < ctx->pending_count; ++i) {
+		if (ctx->loc[ctx->pending[i].to] < 0) {
+			ctx->ready[nready++] = ctx->pending[i].to;
+		}
+	}
+	ctx->pred[ctx->temp] = -1;
+	while (ntodo > 0) {
+		while (nready > 0) {
+			int b = ctx->ready[--nready];
+			int a = ctx->pred[b], c = ctx->loc[a];
+			emit(ctx, c, b, ctx->held[a]);
+			ctx->copied[b] = true;
+			ctx->loc[a] = b;
+			if (a == c && ctx->pred[a] >= 0) {
+				ctx->ready[nready++] = a;
+			}
+		}
+		int b = ctx->todo[--ntodo];
+		if (!ctx->copied[b]) {
+			emit(ctx, b, ctx->temp, ctx->held[b]);
+			ctx->loc[b] = ctx->temp;
+			ctx->ready[nready++] = b;
+		}
+	}
+
+	// Locations are left as they were found, for the next edge.
+	for (int i = 0; i < ctx->pending_count; ++i) {
+		ctx->copied[ctx->pending[i].to] = false;
+		ctx->loc[ctx->pending[i].from] = ctx->loc[ctx->pending[i].to] = -1;
+		ctx->pred[ctx->pending[i].from] = ctx->pred[ctx->pending[i].to] = -1;
+	}
+	ctx->loc[ctx->temp] = -1;
+}
+
+// Returns the segment holding the value at the position, NULL if the value is not live there.
+// Values split by linear scan may have many segments, searched by bisection.
+static const struct IRsegment* segment_at(struct oc_context *ctx, struct IRinstruction *v, int pos) {
+	const struct IRsegment *segs = ctx->out->ra->segs;
+	int lo = ctx->seg_begin[v->id], hi = ctx->seg_begin[v->id + 1];
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (segs[ctx->segs[mid]].end < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == ctx->seg_begin[v->id + 1] || segs[ctx->segs[lo]].start > pos) {
+		return (NULL);
+	}
+	return (&segs[ctx->segs[lo]]);
+}
+
+// Returns the argument of the phi coming from the block, NULL if there is none.
+static struct IRinstruction* phi_arg(struct IRinstruction *phi, struct IRblock *from) {
+	for (struct llist_node *p = phi->phi.head; p; p = p->nxt) {
+		struct IRphi_arg *a = (void*)p;
+		if (a->source == from) {
+			return (a->value);
+		}
+	}
+	return (NULL);
+}
+
+// Computes the copies of an edge.
+static void edge_copies(struct oc_context *ctx, struct IRedge_copies *e, int index) {
+	const struct IRregalloc *ra = ctx->out->ra;
+	int entry = ra->lv->from[e->to->id], exit = ra->lv->to[e->from->id] - 1;
+	ctx->pending_count = ctx->computed_count = 0;
+	for (struct llist_node *p = e->to->ins.head; p; p = p->nxt) {
+		struct IRinstruction *x = (void*)p;
+		if (x->op != IR_PHI) {
+			break;
+		}
+		ctx->phi_mark[x->id] = index;
+		const struct IRsegment *to = segment_at(ctx, x, entry);
+		struct IRinstruction *v = phi_arg(x, e->from);
+		if (to == NULL || to->remat || v == NULL) {
+			continue;
+		}
+		if (!IRliveness_is_value(v)) {
+			if (v->op != IR_IMM || v->type != IRT_UNDEF) {
+				add_copy(ctx, NULL, to, v);
+			}
+			continue;
+		}
+		// A predecessor which is never reached has no location for the argument.
+		const struct IRsegment *from = segment_at(ctx, v, exit);
+		if (from != NULL) {
+			add_copy(ctx, from, to, v);
+		}
+	}
+
+	int count;
+	const int *in = IRliveness_in(ra->lv, e->to, &count);
+	for (int i = 0; i < count; ++i) {
+		if (ctx->phi_mark[in[i]] == index) {
+			continue;
+		}
+		struct IRinstruction *v = ctx->by_id[in[i]];
+		const struct IRsegment *to = segment_at(ctx, v, entry);
+		const struct IRsegment *from = segment_at(ctx, v, exit);
+		if (to != NULL && from != NULL && !to->remat && to != from) {
+			add_copy(ctx, from, to, v);
+		}
+	}
+
+	e->begin = ctx->out->copy_count;
+	sequentialize(ctx);
+	for (int i = 0; i < ctx->computed_count; ++i) {
+		emit(ctx, IRLOC_VALUE, ctx->computed[i].to, ctx->computed[i].value);
+	}
+	e->count = ctx->out->copy_count - e->begin;
+}
+
+// Computes the moves between consecutive segments of values inside blocks, before the
+// instruction where the next segment starts. Those at the entry of a block are made on its
+// edges instead.
+static void block_moves(struct oc_context *ctx, struct IRfunction *f) {
+	struct IRoutssa *out = ctx->out;
+	const struct IRregalloc *ra = out->ra;
+	const struct IRliveness *lv = ra->lv;
+	int *begin = try_calloc(lv->n + 2, sizeof(int), __FUNCTION__);
+	int *order = try_malloc((ra->seg_count + 1) * sizeof(int), __FUNCTION__);
+	for (int i = 0; i < ra->seg_count; ++i) {
+		if (ra->segs[i].next >= 0) {
+			begin[ra->segs[ra->segs[i].next].start / 2 + 2] += 1;
+		}
+	}
+	for (int i = 0; i < lv->n; ++i) {
+		begin[i + 2] += begin[i + 1];
+	}
+	for (int i = 0; i < ra->seg_count; ++i) {
+		if (ra->segs[i].next >= 0) {
+			order[begin[ra->segs[ra->segs[i].next].start / 2 + 1]++] = i;
+		}
+	}
+
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			int k = lv->pos[x->id] / 2;
+			out->move_begin[x->id] = out->copy_count;
+			out->move_count[x->id] = 0;
+			if (q == ((struct IRblock*)p)->ins.head) {
+				continue;
+			}
+			ctx->pending_count = ctx->computed_count = 0;
+			for (int i = begin[k]; i < begin[k + 1]; ++i) {
+				const struct IRsegment *s = &ra->segs[order[i]];
+				add_copy(ctx, s, &ra->segs[s->next], ctx->by_id[s->value]);
+			}
+			sequentialize(ctx);
+			out->move_count[x->id] = out->copy_count - out->move_begin[x->id];
+		}
+	}
+	free(begin);
+	free(order);
+}
+
+// Computes the copies of every edge of the function, and the moves inside its blocks.
+void IRoutssa_build(struct IRoutssa *self, struct IRfunction *f, const struct IRregalloc *ra) {
+	const struct IRliveness *lv = ra->lv;
+	self->ra = ra;
+	self->edges = try_malloc((2 * lv->nb + 1) * sizeof(struct IRedge_copies), __FUNCTION__);
+	self->edge_count = 0;
+	self->edge_begin = try_malloc((lv->nb + 1) * sizeof(int), __FUNCTION__);
+	self->move_begin = try_malloc((lv->n + 1) * sizeof(int), __FUNCTION__);
+	self->move_count = try_malloc((lv->n + 1) * sizeof(int), __FUNCTION__);
+	self->copies = NULL;
+	self->copy_count = self->copy_cap = 0;
+	self->split_count = 0;
+
+	// Locations are the registers, the spill slots and the temporary.
+	int k = ra->regs->count, size = k + ra->slot_count + 1;
+	struct oc_context *ctx = try_malloc(sizeof(struct oc_context), __FUNCTION__);
+	*ctx = (struct oc_context){
+		.out = self,
+		.k = k,
+		.temp = size - 1,
+		.loc = try_malloc(size * sizeof(int), __FUNCTION__),
+		.pred = try_malloc(size * sizeof(int), __FUNCTION__),
+		.held = try_calloc(size, sizeof(struct IRinstruction*), __FUNCTION__),
+		.copied = try_calloc(size, sizeof(bool), __FUNCTION__),
+		.by_id = try_calloc(lv->n + 1, sizeof(struct IRinstruction*), __FUNCTION__),
+		.phi_mark = try_malloc((lv->n + 1) * sizeof(int), __FUNCTION__),
+		.seg_begin = try_malloc((lv->n + 1) * sizeof(int), __FUNCTION__),
+		.segs = try_malloc((ra->seg_count + 1) * sizeof(int), __FUNCTION__),
+		.pending = try_malloc((lv->n + 1) * sizeof(struct IRcopy), __FUNCTION__),
+		.pending_cap = lv->n + 1,
+		.computed = try_malloc((lv->n + 1) * sizeof(struct IRcopy), __FUNCTION__),
+		.ready = try_malloc(size * sizeof(int), __FUNCTION__),
+		.todo = try_malloc(size * sizeof(int), __FUNCTION__),
+	};
+	self->ctx = ctx;
+	for (int i = 0; i < size; ++i) {
+		ctx->loc[i] = ctx->pred[i] = -1;
+	}
+	int count = 0;
+	for (int i = 0; i < lv->n; ++i) {
+		ctx->phi_mark[i] = -1;
+		ctx->seg_begin[i] = count;
+		for (int j = ra->first[i]; j >= 0; j = ra->segs[j].next) {
+			ctx->segs[count++] = j;
+		}
+	}
+	ctx->seg_begin[lv->n] = count;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			ctx->by_id[((struct IRinstruction*)q)->id] = (void*)q;
+		}
+	}
+
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p, *succ[2];
+		int n = IRblock_successors(b, succ);
+		self->edge_begin[b->id] = self->edge_count;
+		for (int i = 0; i < n; ++i) {
+			struct IRedge_copies *e = &self->edges[self->edge_count];
+			e->from = b;
+			e->to = succ[i];
+			edge_copies(ctx, e, self->edge_count++);
+			if (n == 1) {
+				e->place = IRC_EXIT;
+			} else if (succ[i]->pre.length == 1) {
+				e->place = IRC_ENTRY;
+			} else {
+				e->place = IRC_SPLIT;
+				self->split_count += (e->count > 0);
+			}
+		}
+	}
+	block_moves(ctx, f);
+}
+
+// Returns the copies of the edge to the successor of the block of index _succ_.
+const struct IRedge_copies* IRoutssa_edge(const struct IRoutssa *self, struct IRblock *b, int succ) {
+	return (&self->edges[self->edge_begin[b->id] + succ]);
+}
+
+// Returns the segment holding the value at the position, NULL if the value is not live there.
+const struct IRsegment* IRoutssa_at(const struct IRoutssa *self, struct IRinstruction *v, int pos) {
+	if (v->id >= self->ra->lv->n) {
+		return (NULL);
+	}
+	return (segment_at(self->ctx, v, pos));
+}
+
+// Sequentializes a parallel copy between locations, appending the copies to _copies_.
+// Returns the index of the first one.
+int IRoutssa_sequentialize(struct IRoutssa *self, const struct IRcopy *copies, int count) {
+	struct oc_context *ctx = self->ctx;
+	if (count > ctx->pending_cap) {
+		ctx->pending_cap = count;
+		ctx->pending = realloc(ctx->pending, count * sizeof(struct IRcopy));
+		ctx->computed = realloc(ctx->computed, count * sizeof(struct IRcopy));
+		if (ctx->pending == NULL || ctx->computed == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	ctx->pending_count = ctx->computed_count = 0;
+	for (int i = 0; i < count; ++i) {
+		if (copies[i].from == IRLOC_VALUE) {
+			ctx->computed[ctx->computed_count++] = copies[i];
+		} else if (copies[i].from != copies[i].to) {
+			ctx->pending[ctx->pending_count++] = copies[i];
+		}
+	}
+	int begin = self->copy_count;
+	sequentialize(ctx);
+	for (int i = 0; i < ctx->computed_count; ++i) {
+		emit(ctx, IRLOC_VALUE, ctx->computed[i].to, ctx->computed[i].value);
+	}
+	return (begin);
+}
+
+// Frees the copies.
+void IRoutssa_free(struct IRoutssa *self) {
+	struct oc_context *ctx = self->ctx;
+	free(ctx->loc);
+	free(ctx->pred);
+	free(ctx->held);
+	free(ctx->copied);
+	free(ctx->by_id);
+	free(ctx->phi_mark);
+	free(ctx->seg_begin);
+	free(ctx->segs);
+	free(ctx->pending);
+	free(ctx->computed);
+	free(ctx->ready);
+	free(ctx->todo);
+	free(ctx);
+	free(self->edges);
+	free(self->edge_begin);
+	free(self->move_begin);
+	free(self->move_count);
+	free(self->copies);
+}
@@ -0,0 +1,290 @@
+// Locations of values after register allocation, shared by the allocators.
+// Every value starts as a single segment covering its live interval; allocators split
+// segments and assign each one a register or a spill slot. Intervals have no holes, so a
+// value live across a block which does not use it keeps a location there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+
+// Appends a segment on the stack, not linked to the other segments of its value.
+static int new_segment(struct IRregalloc *self, int value, int start, int end) {
+	if (self->seg_count == self->seg_cap) {
+		self->seg_cap = (self->seg_cap < 16) ? 16 : self->seg_cap * 2;
+		self->segs = realloc(self->segs, self->seg_cap * sizeof(struct IRsegment));
+		if (self->segs == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	struct IRsegment *s = &self->segs[self->seg_count];
+	s->value = value;
+	s->start = start;
+	s->end = end;
+	s->reg = -1;
+	s->slot = -1;
+	s->remat = false;
+	s->next = -1;
+	return (self->seg_count++);
+}
+
+// Initializes the allocation with one segment on the stack for each value, covering its live
+// interval. The result of an instruction is written after its operands are read; phis are
+// defined at the entry of their block, and a value live into a block laid out before its
+// definition starts there.
+void IRregalloc_init(struct IRregalloc *self, struct IRfunction *f, const struct IRliveness *lv,
+				const struct target_regs *regs) {
+	self->lv = lv;
+	self->regs = regs;
+	self->segs = NULL;
+	self->seg_count = self->seg_cap = 0;
+	self->first = try_malloc((lv->n + 1) * sizeof(int), __FUNCTION__);
+	self->slot_count = 0;
+	self->spill_count = 0;
+	self->used = 0;
+	for (int i = 0; i < lv->n; ++i) {
+		self->first[i] = -1;
+	}
+
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			const struct IRinterval *i = &lv->intervals[x->id];
+			if (!IRliveness_is_value(x) || i->start < 0) {
+				continue;
+			}
+			int start = (x->op != IR_PHI && i->start == lv->pos[x->id]) ? i->start + 1 : i->start;
+			self->first[x->id] = new_segment(self, x->id, start, (i->end > start) ? i->end : start);
+		}
+	}
+}
+
+// Splits the segment before the position, inside it. Returns the new segment, from the position,
+// with the location of the old one.
+int IRregalloc_split(struct IRregalloc *self, int seg, int pos) {
+	struct IRsegment *s = &self->segs[seg];
+	if (pos <= s->start || pos > s->end) {
+		fail_unreachable(__FUNCTION__);
+	}
+	int t = new_segment(self, s->value, pos, s->end);
+	s = &self->segs[seg];
+	self->segs[t].reg = s->reg;
+	self->segs[t].slot = s->slot;
+	self->segs[t].next = s->next;
+	s->end = pos - 1;
+	s->next = t;
+	return (t);
+}
+
+// Returns the segment holding the value at the position, NULL if the value is not live there.
+const struct IRsegment* IRregalloc_at(const struct IRregalloc *self, struct IRinstruction *v, int pos) {
+	if (v->id >= self->lv->n) {
+		return (NULL);
+	}
+	for (int i = self->first[v->id]; i >= 0; i = self->segs[i].next) {
+		if (pos <= self->segs[i].end) {
+			return ((pos >= self->segs[i].start) ? &self->segs[i] : NULL);
+		}
+	}
+	return (NULL);
+}
+
+// Returns the segment holding the value at the entry of the block.
+const struct IRsegment* IRregalloc_at_entry(const struct IRregalloc *self, struct IRinstruction *v,
+				struct IRblock *b) {
+	return (IRregalloc_at(self, v, self->lv->from[b->id]));
+}
+
+// Returns the segment holding the value at the end of the block, after its terminator.
+const struct IRsegment* IRregalloc_at_exit(const struct IRregalloc *self, struct IRinstruction *v,
+				struct IRblock *b) {
+	return (IRregalloc_at(self, v, self->lv->to[b->id] - 1));
+}
+
+// Outputs the location of a segment.
+static void print_location(const struct IRregalloc *self, const struct IRsegment *s, FILE *Outfile) {
+	if (s->reg >= 0) {
+		fprintf(Outfile, "%s", self->regs->names[s->reg]);
+	} else if (s->remat) {
+		fprintf(Outfile, "remat");
+	} else {
+		fprintf(Outfile, "[%d]", s->slot);
+	}
+}
+
+// Outputs the location of a copy.
+static void print_copy_location(const struct IRregalloc *self, int loc, const struct IRcopy *c,
+				FILE *Outfile) {
+	if (loc == IRLOC_TEMP) {
+		fprintf(Outfile, "temp");
+	} else if (loc == IRLOC_VALUE) {
+		fprintf(Outfile, "$%d", c->value->id);
+	} else if (loc < self->regs->count) {
+		fprintf(Outfile, "%s", self->regs->names[loc]);
+	} else {
+		fprintf(Outfile, "[%d]", loc - self->regs->count);
+	}
+}
+
+// Outputs the copies of an edge, if any.
+static void print_copies(const struct IRregalloc *self, const struct IRoutssa *copies,
+				const struct IRedge_copies *e, FILE *Outfile) {
+	if (e->count == 0) {
+		return;
+	}
+	fprintf(Outfile, "\t// copies L%d -> L%d%s:", e->from->id, e->to->id,
+			(e->place == IRC_SPLIT) ? ", split" : "");
+	for (int i = e->begin; i < e->begin + e->count; ++i) {
+		const struct IRcopy *c = &copies->copies[i];
+		fprintf(Outfile, (i == e->begin) ? " " : ", ");
+		print_copy_location(self, c->from, c, Outfile);
+		fprintf(Outfile, " -> ");
+		print_copy_location(self, c->to, c, Outfile);
+	}
+	fprintf(Outfile, "\n");
+}
+
+// Move between consecutive segments of a value.
+struct ra_move {
+	const struct IRsegment *from, *to;
+};
+
+// Sorting order of moves, by position.
+static int compare_move(const void *pa, const void *pb) {
+	const struct ra_move *a = pa, *b = pb;
+	if (a->to->start != b->to->start) {
+		return (a->to->start - b->to->start);
+	}
+	return (a->to->value - b->to->value);
+}
+
+// Outputs the function with the location of every value, the moves between the segments of a
+// value inside blocks and the copies on edges if not NULL, as comments.
+void IRregalloc_print(const struct IRregalloc *self, const struct IRoutssa *copies,
+				struct IRfunction *f, FILE *Outfile) {
+	const struct IRliveness *lv = self->lv;
+	int regs = 0;
+	for (unsigned m = self->used; m; m &= m - 1) {
+		++regs;
+	}
+	fprintf(Outfile, "%s:\t\t\t// registers %d, spill slots %d, spilled segments %d",
+			f->name, regs, self->slot_count, self->spill_count);
+	if (copies != NULL) {
+		fprintf(Outfile, ", copies %d, split edges %d", copies->copy_count, copies->split_count);
+	}
+	fprintf(Outfile, "\n");
+
+	int count = 0;
+	struct ra_move *moves = try_malloc((self->seg_count + 1) * sizeof(struct ra_move), __FUNCTION__);
+	for (int i = 0; i < self->seg_count; ++i) {
+		const struct IRsegment *s = &self->segs[i];
+		if (s->next >= 0) {
+			moves[count].from = s;
+			moves[count++].to = &self->segs[s->next];
+		}
+	}
+	qsort(moves, count, sizeof(struct ra_move), compare_move);
+
+	// Moves at the entry of a block are made on its incoming edges instead. Copies are shown
+	// where they are made: after the phis, before the terminator, or after it for split edges.
+	int k = 0;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p, *succ[2];
+		int n = IRblock_successors(b, succ);
+		bool entry = (copies != NULL && b->pre.length == 1);
+		fprintf(Outfile, "L%d:\n", b->id);
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (entry && x->op != IR_PHI) {
+				struct IRblock *pred = ((struct IRpredecessor*)b->pre.head)->b, *ps[2];
+				int pn = IRblock_successors(pred, ps);
+				for (int i = 0; i < pn; ++i) {
+					const struct IRedge_copies *e = IRoutssa_edge(copies, pred, i);
+					if (e->to == b && e->place == IRC_ENTRY) {
+						print_copies(self, copies, e, Outfile);
+					}
+				}
+				entry = false;
+			}
+			for (; k < count && moves[k].to->start <= lv->pos[x->id]; ++k) {
+				if (moves[k].to->start != lv->from[b->id]) {
+					fprintf(Outfile, "\t// move $%d ", moves[k].to->value);
+					print_location(self, moves[k].from, Outfile);
+					fprintf(Outfile, " -> ");
+					print_location(self, moves[k].to, Outfile);
+					fprintf(Outfile, "\n");
+				}
+			}
+			if (copies != NULL && q == b->ins.tail && n == 1) {
+				print_copies(self, copies, IRoutssa_edge(copies, b, 0), Outfile);
+			}
+			IRinstruction_print(x, Outfile);
+			if (self->first[x->id] >= 0) {
+				fprintf(Outfile, "\t// $%d in ", x->id);
+				print_location(self, &self->segs[self->first[x->id]], Outfile);
+				fprintf(Outfile, "\n");
+			}
+		}
+		for (int i = 0; copies != NULL && i < n; ++i) {
+			const struct IRedge_copies *e = IRoutssa_edge(copies, b, i);
+			if (e->place == IRC_SPLIT) {
+				print_copies(self, copies, e, Outfile);
+			}
+		}
+	}
+	free(moves);
+}
+
+// Allocates registers with the allocator of Oinfo. Graph coloring falls back to linear scan on
+// functions of more than RA_COLORING_MAX_VALUES values. With -Rpass-skipped, the fallback is
+// reported.
+void IRregalloc_run(struct IRregalloc *self, struct IRfunction *f, const struct IRliveness *lv,
+				const struct target_regs *regs) {
+	if (Oinfo.regalloc == RA_LINEAR_SCAN) {
+		IRregalloc_linear_scan(self, f, lv, regs);
+		return;
+	}
+	int values = 0;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			values += IRliveness_is_value((struct IRinstruction*)q);
+		}
+	}
+	if (values <= RA_COLORING_MAX_VALUES) {
+		IRregalloc_coloring(self, f, lv, regs);
+		return;
+	}
+	if (Oinfo.remark_skipped) {
+		fprintf(stderr, "remark: function '%s': register allocation degraded to linear scan, %d values over the limit of %d [-Rpass-skipped]\n",
+				f->name, values, RA_COLORING_MAX_VALUES);
+	}
+	IRregalloc_linear_scan(self, f, lv, regs);
+}
+
+// Frees the allocation.
+void IRregalloc_free(struct IRregalloc *self) {
+	free(self->segs);
+	free(self->first);
+}
+
+// Outputs every function of the translation unit after register allocation and translation
+// out of SSA form. Identifiers are renumbered.
+void IRunit_print_regalloc(struct IRunit *self, FILE *Outfile) {
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		struct IRfunction *f = (void*)p;
+		struct IRliveness lv;
+		struct IRregalloc ra;
+		IRfunction_renumber(f);
+		IRliveness_build(&lv, f);
+		struct IRoutssa copies;
+		IRregalloc_run(&ra, f, &lv, Tinfo.regs);
+		IRoutssa_build(&copies, f, &ra);
+		IRregalloc_print(&ra, &copies, f, Outfile);
+		IRoutssa_free(&copies);
+		IRregalloc_free(&ra);
+		IRliveness_free(&lv);
+	}
+}
@@ -0,0 +1,196 @@
+// Output of x86-64 machine code in the AT&T syntax of the GNU assembler.
+
+#include <stdio.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "x86_64.h"
+
+// Names of the registers by hardware number, for each size of operand.
+static const char *const names64[] = {
+	"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+	"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+};
+static const char *const names32[] = {
+	"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+	"r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+};
+static const char *const names8[] = {
+	"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+	"r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+};
+
+// Suffixes of conditions, by condition code.
+static const char *const cc_names[] = {
+	"o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g",
+};
+
+// Mnemonics of the operations, without suffix of size.
+static const char *const op_names[] = {
+	[X64_MOV] = "mov", [X64_LEA] = "lea",
+	[X64_ADD] = "add", [X64_SUB] = "sub", [X64_AND] = "and", [X64_OR] = "or", [X64_XOR] = "xor",
+	[X64_CMP] = "cmp", [X64_TEST] = "test", [X64_IMUL] = "imul", [X64_IMUL3] = "imul",
+	[X64_SHL] = "shl", [X64_SHR] = "shr", [X64_SAR] = "sar", [X64_NEG] = "neg", [X64_NOT] = "not",
+	[X64_IDIV] = "idiv", [X64_DIV] = "div", [X64_IMUL1] = "imul", [X64_MUL1] = "mul",
+	[X64_PUSH] = "push", [X64_POP] = "pop",
+};
+
+// Returns the suffix of an operation on operands of the size.
+static char suffix(int size) {
+	return ((size == 1) ? 'b' : (size == 4) ? 'l' : 'q');
+}
+
+// Outputs the name of a register of the size.
+static void print_reg(int reg, int size, FILE *Outfile) {
+	const char *const *names = (size == 1) ? names8 : (size == 4) ? names32 : names64;
+	fprintf(Outfile, "%%%s", names[reg]);
+}
+
+// Outputs an operand, its register of the size.
+static void print_operand(const struct X64function *self, const struct X64operand *o, int size,
+				FILE *Outfile) {
+	switch (o->kind) {
+		case X64O_REG: {
+			print_reg(o->reg, size, Outfile);
+		}	break;
+
+		case X64O_IMM: {
+			fprintf(Outfile, "$%lld", (long long)o->imm);
+		}	break;
+
+		case X64O_MEM: {
+			if (o->imm != 0 || (o->reg < 0 && o->index < 0)) {
+				fprintf(Outfile, "%lld", (long long)o->imm);
+			}
+			fprintf(Outfile, "(");
+			if (o->reg >= 0) {
+				print_reg(o->reg, 8, Outfile);
+			}
+			if (o->index >= 0) {
+				fprintf(Outfile, ",");
+				print_reg(o->index, 8, Outfile);
+				fprintf(Outfile, ",%d", o->scale);
+			}
+			fprintf(Outfile, ")");
+		}	break;
+
+		case X64O_LABEL: {
+			fprintf(Outfile, ".L%d_%lld", self->index, (long long)o->imm);
+		}	break;
+
+		case X64O_FUNC: {
+			fprintf(Outfile, "%s", o->func->name);
+		}	break;
+
+		default: {
+			fail_unreachable(__FUNCTION__);
+		}
+	}
+}
+
+// Outputs a machine instruction.
+static void print_ins(const struct X64function *self, const struct X64ins *x, FILE *Outfile) {
+	switch (x->op) {
+		case X64_LABEL: {
+			print_operand(self, &x->dst, 8, Outfile);
+			fprintf(Outfile, ":\n");
+		}	return;
+
+		case X64_MOVABS: {
+			fprintf(Outfile, "\tmovabsq\t");
+		}	break;
+
+		case X64_MOVSXD: {
+			fprintf(Outfile, "\tmovslq\t");
+			print_operand(self, &x->src, 4, Outfile);
+			fprintf(Outfile, ", ");
+			print_operand(self, &x->dst, 8, Outfile);
+			fprintf(Outfile, "\n");
+		}	return;
+
+		case X64_MOVZXB: {
+			fprintf(Outfile, "\tmovzbl\t");
+			print_operand(self, &x->src, 1, Outfile);
+			fprintf(Outfile, ", ");
+			print_operand(self, &x->dst, 4, Outfile);
+			fprintf(Outfile, "\n");
+		}	return;
+
+		case X64_SHL: case X64_SHR: case X64_SAR: {
+			fprintf(Outfile, "\t%s%c\t", op_names[x->op], suffix(x->size));
+			print_operand(self, &x->src, 1, Outfile);
+			fprintf(Outfile, ", ");
+			print_operand(self, &x->dst, x->size, Outfile);
+			fprintf(Outfile, "\n");
+		}	return;
+
+		case X64_IMUL3: {
+			fprintf(Outfile, "\timul%c\t$%lld, ", suffix(x->size), (long long)x->imm);
+		}	break;
+
+		case X64_CQO: {
+			fprintf(Outfile, (x->size == 8) ? "\tcqto\n" : "\tcltd\n");
+		}	return;
+
+		case X64_SETCC: {
+			fprintf(Outfile, "\tset%s\t", cc_names[x->cc]);
+		}	break;
+
+		case X64_CMOVCC: {
+			fprintf(Outfile, "\tcmov%s%c\t", cc_names[x->cc], suffix(x->size));
+		}	break;
+
+		case X64_JCC: {
+			fprintf(Outfile, "\tj%s\t", cc_names[x->cc]);
+		}	break;
+
+		case X64_JMP: {
+			fprintf(Outfile, "\tjmp\t");
+		}	break;
+
+		case X64_CALL: {
+			fprintf(Outfile, "\tcall\t");
+		}	break;
+
+		case X64_RET: {
+			fprintf(Outfile, "\tret\n");
+		}	return;
+
+		default: {
+			fprintf(Outfile, "\t%s%c\t", op_names[x->op], suffix(x->size));
+		}
+	}
+	bool first = true;
+	if (x->src.kind != X64O_NONE) {
+		print_operand(self, &x->src, x->size, Outfile);
+		first = false;
+	}
+	if (x->dst.kind != X64O_NONE) {
+		fprintf(Outfile, first ? "" : ", ");
+		print_operand(self, &x->dst, x->size, Outfile);
+	}
+	fprintf(Outfile, "\n");
+}
+
+// Outputs the machine code of the function in GNU assembler syntax.
+void X64function_print(const struct X64function *self, FILE *Outfile) {
+	const char *name = self->f->name;
+	fprintf(Outfile, "\t.globl\t%s\n\t.type\t%s, @function\n\t.p2align\t4\n%s:\n", name, name, name);
+	for (int i = 0; i < self->length; ++i) {
+		print_ins(self, &self->code[i], Outfile);
+	}
+	fprintf(Outfile, "\t.size\t%s, .-%s\n", name, name);
+}
+
+// Outputs every function of the translation unit as x86-64 assembly, for the GNU assembler.
+void IRunit_print_asm(struct IRunit *self, FILE *Outfile) {
+	fprintf(Outfile, "\t.text\n");
+	int index = 0;
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		struct X64function mf;
+		X64function_build(&mf, (struct IRfunction*)p, index++);
+		X64function_print(&mf, Outfile);
+		X64function_free(&mf);
+	}
+	fprintf(Outfile, "\t.section\t.note.GNU-stack,\"\",@progbits\n");
+}
@@ -0,0 +1,243 @@
+// Output of x86-64 machine code as an ELF64 relocatable object, laid out field by field in
+// little endian so that no system header is needed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "x86_64.h"
+
+// Constants of the ELF64 format used.
+enum {
+	ELF_EHSIZE = 64,	// size of the file header
+	ELF_SHENTSIZE = 64,	// size of a section header
+	ELF_SYMENTSIZE = 24,	// size of a symbol
+	ELF_RELAENTSIZE = 24,	// size of a relocation with addend
+	ELF_ET_REL = 1,
+	ELF_EM_X86_64 = 62,
+	ELF_SHT_PROGBITS = 1, ELF_SHT_SYMTAB = 2, ELF_SHT_STRTAB = 3, ELF_SHT_RELA = 4,
+	ELF_SHF_WRITE = 1, ELF_SHF_ALLOC = 2, ELF_SHF_EXECINSTR = 4, ELF_SHF_INFO_LINK = 0x40,
+	ELF_STB_GLOBAL = 1, ELF_STT_FUNC = 2,
+	ELF_R_X86_64_PLT32 = 4,
+};
+
+// Sections of the object, by index.
+enum {
+	XO_NULL, XO_TEXT, XO_DATA, XO_RODATA, XO_RELA_TEXT, XO_SYMTAB, XO_STRTAB, XO_SHSTRTAB,
+	XO_NOTE_STACK, XO_SECTIONS,
+};
+
+// Names of the sections, by index.
+static const char *const section_names[XO_SECTIONS] = {
+	"", ".text", ".data", ".rodata", ".rela.text", ".symtab", ".strtab", ".shstrtab",
+	".note.GNU-stack",
+};
+
+// Header of a section.
+struct xo_section {
+	int name;			// offset of the name in .shstrtab
+	int type, flags;
+	int64_t offset, size;
+	int link, info;
+	int align, entsize;
+};
+
+// Bytes written, or a table of strings each ended by a null byte.
+struct xo_bytes {
+	uint8_t *b;
+	int length, cap;
+};
+
+// State of the writing of an object, built in memory as the header comes first but is known last.
+struct xo_context {
+	struct xo_bytes out;
+	struct xo_section sections[XO_SECTIONS];
+	struct xo_bytes strtab, shstrtab;
+};
+
+// Appends bytes.
+static void put_bytes(struct xo_bytes *self, const void *bytes, int length) {
+	if (self->length + length > self->cap) {
+		self->cap = (self->cap < 64) ? 64 : self->cap;
+		while (self->length + length > self->cap) {
+			self->cap *= 2;
+		}
+		self->b = realloc(self->b, self->cap);
+		if (self->b == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	memcpy(self->b + self->length, bytes, length);
+	self->length += length;
+}
+
+// Appends a field of _size_ bytes in little endian.
+static void put(struct xo_bytes *self, int64_t v, int size) {
+	uint8_t bytes[8];
+	for (int i = 0; i < size; ++i) {
+		bytes[i] = (uint8_t)(((uint64_t)v >> (8 * i)) & 0xff);
+	}
+	put_bytes(self, bytes, size);
+}
+
+// Appends _n_ null bytes.
+static void put_zeros(struct xo_bytes *self, int n) {
+	for (int i = 0; i < n; ++i) {
+		put(self, 0, 1);
+	}
+}
+
+// Appends a string to the table, and returns its offset.
+static int add_string(struct xo_bytes *self, const char *s) {
+	int offset = self->length;
+	put_bytes(self, s, (int)strlen(s) + 1);
+	return (offset);
+}
+
+// Appends null bytes up to the alignment.
+static void pad(struct xo_bytes *self, int alignment) {
+	put_zeros(self, (alignment - self->length % alignment) % alignment);
+}
+
+// Starts the contents of a section, aligned.
+static void begin_section(struct xo_context *ctx, int index, int type, int flags, int align) {
+	struct xo_section *s = &ctx->sections[index];
+	pad(&ctx->out, align);
+	s->type = type;
+	s->flags = flags;
+	s->offset = ctx->out.length;
+	s->align = align;
+}
+
+// Ends the contents of a section, recording its size.
+static void end_section(struct xo_context *ctx, int index) {
+	struct xo_section *s = &ctx->sections[index];
+	s->size = ctx->out.length - s->offset;
+}
+
+// Writes the file header into the bytes reserved for it.
+static void write_header(struct xo_context *ctx, int64_t shoff) {
+	struct xo_bytes head = { 0 };
+	static const uint8_t ident[16] = { 0x7f, 'E', 'L', 'F', 2, 1, 1 };
+	put_bytes(&head, ident, sizeof(ident));
+	put(&head, ELF_ET_REL, 2);
+	put(&head, ELF_EM_X86_64, 2);
+	put(&head, 1, 4);			// e_version
+	put(&head, 0, 8);			// e_entry
+	put(&head, 0, 8);			// e_phoff
+	put(&head, shoff, 8);
+	put(&head, 0, 4);			// e_flags
+	put(&head, ELF_EHSIZE, 2);
+	put(&head, 0, 2);			// e_phentsize
+	put(&head, 0, 2);			// e_phnum
+	put(&head, ELF_SHENTSIZE, 2);
+	put(&head, XO_SECTIONS, 2);
+	put(&head, XO_SHSTRTAB, 2);
+	memcpy(ctx->out.b, head.b, ELF_EHSIZE);
+	free(head.b);
+}
+
+// Writes the section headers.
+static void write_section_headers(struct xo_context *ctx) {
+	for (int i = 0; i < XO_SECTIONS; ++i) {
+		const struct xo_section *s = &ctx->sections[i];
+		put(&ctx->out, s->name, 4);
+		put(&ctx->out, s->type, 4);
+		put(&ctx->out, s->flags, 8);
+		put(&ctx->out, 0, 8);			// sh_addr
+		put(&ctx->out, s->offset, 8);
+		put(&ctx->out, s->size, 8);
+		put(&ctx->out, s->link, 4);
+		put(&ctx->out, s->info, 4);
+		put(&ctx->out, s->align, 8);
+		put(&ctx->out, s->entsize, 8);
+	}
+}
+
+// Writes every function of the translation unit as an ELF64 relocatable object. Each function
+// is a global symbol of .text, called through relocations left for the linker to resolve;
+// .data and .rodata are empty as the language has no global variables.
+void IRunit_write_obj(struct IRunit *self, FILE *Outfile) {
+	struct xo_context ctx = { 0 };
+	struct X64code code;
+	X64code_init(&code);
+	int n = self->funcs.length, index = 0;
+	int *value = try_malloc((n + 1) * sizeof(int), __FUNCTION__);
+	int *size = try_malloc((n + 1) * sizeof(int), __FUNCTION__);
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		struct X64function mf;
+		X64function_build(&mf, (struct IRfunction*)p, index);
+		value[index] = X64code_encode(&code, &mf);
+		size[index] = code.length - value[index];
+		++index;
+		X64function_free(&mf);
+	}
+
+	for (int i = 0; i < XO_SECTIONS; ++i) {
+		ctx.sections[i].name = add_string(&ctx.shstrtab, section_names[i]);
+	}
+	add_string(&ctx.strtab, "");
+
+	put_zeros(&ctx.out, ELF_EHSIZE);
+	begin_section(&ctx, XO_TEXT, ELF_SHT_PROGBITS, ELF_SHF_ALLOC | ELF_SHF_EXECINSTR, 16);
+	put_bytes(&ctx.out, code.text, code.length);
+	end_section(&ctx, XO_TEXT);
+	begin_section(&ctx, XO_DATA, ELF_SHT_PROGBITS, ELF_SHF_WRITE | ELF_SHF_ALLOC, 1);
+	end_section(&ctx, XO_DATA);
+	begin_section(&ctx, XO_RODATA, ELF_SHT_PROGBITS, ELF_SHF_ALLOC, 1);
+	end_section(&ctx, XO_RODATA);
+
+	// Symbols: the null symbol, then the functions by position, all global.
+	begin_section(&ctx, XO_SYMTAB, ELF_SHT_SYMTAB, 0, 8);
+	put_zeros(&ctx.out, ELF_SYMENTSIZE);
+	index = 0;
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt, ++index) {
+		put(&ctx.out, add_string(&ctx.strtab, ((struct IRfunction*)p)->name), 4);
+		put(&ctx.out, ELF_STB_GLOBAL << 4 | ELF_STT_FUNC, 1);
+		put(&ctx.out, 0, 1);		// st_other
+		put(&ctx.out, XO_TEXT, 2);
+		put(&ctx.out, value[index], 8);
+		put(&ctx.out, size[index], 8);
+	}
+	end_section(&ctx, XO_SYMTAB);
+	ctx.sections[XO_SYMTAB].link = XO_STRTAB;
+	ctx.sections[XO_SYMTAB].info = 1;	// index of the first global symbol
+	ctx.sections[XO_SYMTAB].entsize = ELF_SYMENTSIZE;
+
+	// Calls, by their displacement from the end of the instruction.
+	begin_section(&ctx, XO_RELA_TEXT, ELF_SHT_RELA, ELF_SHF_INFO_LINK, 8);
+	for (int i = 0; i < code.reloc_count; ++i) {
+		const struct X64reloc *r = &code.relocs[i];
+		put(&ctx.out, r->offset, 8);
+		put(&ctx.out, (int64_t)(r->func->id + 1) << 32 | ELF_R_X86_64_PLT32, 8);
+		put(&ctx.out, -4, 8);
+	}
+	end_section(&ctx, XO_RELA_TEXT);
+	ctx.sections[XO_RELA_TEXT].link = XO_SYMTAB;
+	ctx.sections[XO_RELA_TEXT].info = XO_TEXT;
+	ctx.sections[XO_RELA_TEXT].entsize = ELF_RELAENTSIZE;
+
+	begin_section(&ctx, XO_STRTAB, ELF_SHT_STRTAB, 0, 1);
+	put_bytes(&ctx.out, ctx.strtab.b, ctx.strtab.length);
+	end_section(&ctx, XO_STRTAB);
+	begin_section(&ctx, XO_SHSTRTAB, ELF_SHT_STRTAB, 0, 1);
+	put_bytes(&ctx.out, ctx.shstrtab.b, ctx.shstrtab.length);
+	end_section(&ctx, XO_SHSTRTAB);
+	begin_section(&ctx, XO_NOTE_STACK, ELF_SHT_PROGBITS, 0, 1);
+	end_section(&ctx, XO_NOTE_STACK);
+
+	pad(&ctx.out, 8);
+	int64_t shoff = ctx.out.length;
+	write_section_headers(&ctx);
+	write_header(&ctx, shoff);
+	fwrite(ctx.out.b, 1, ctx.out.length, Outfile);
+
+	free(value);
+	free(size);
+	free(ctx.out.b);
+	free(ctx.strtab.b);
+	free(ctx.shstrtab.b);
+	X64code_free(&code);
+}
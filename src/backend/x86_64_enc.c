@@ -0,0 +1,395 @@
+// Encoding of x86-64 machine instructions into bytes, choosing the forms the GNU assembler does:
+// 8 bits immediates and displacements where they fit, the short forms of the accumulator, and
+// jumps relaxed from 8 to 32 bits displacements until every label is reached.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "x86_64.h"
+
+// Bytes of an instruction encoded.
+struct xe_ins {
+	uint8_t bytes[16];
+	int length;
+	int reloc;		// offset of the displacement of a call, -1 for none
+};
+
+// Opcode extensions of the arithmetic instructions, in ModRM or added to the opcodes.
+static const int alu_ext[] = {
+	[X64_ADD] = 0, [X64_OR] = 1, [X64_AND] = 4, [X64_SUB] = 5, [X64_XOR] = 6, [X64_CMP] = 7,
+	[X64_SHL] = 4, [X64_SHR] = 5, [X64_SAR] = 7,
+	[X64_NOT] = 2, [X64_NEG] = 3, [X64_MUL1] = 4, [X64_IMUL1] = 5, [X64_DIV] = 6, [X64_IDIV] = 7,
+};
+
+// Appends a byte.
+static void put(struct xe_ins *e, int byte) {
+	e->bytes[e->length++] = (uint8_t)byte;
+}
+
+// Appends an immediate of _size_ bytes, in little endian.
+static void put_imm(struct xe_ins *e, int64_t v, int size) {
+	for (int i = 0; i < size; ++i) {
+		put(e, (int)(((uint64_t)v >> (8 * i)) & 0xff));
+	}
+}
+
+// Returns whether the constant fits in a sign extended byte.
+static bool fits8(int64_t c) {
+	return (c >= -128 && c <= 127);
+}
+
+// Appends the REX prefix of the operands, if any: 64 bits operation, register _reg_ in the reg
+// field of ModRM, and the register or memory operand _rm_. Byte operands in spl, bpl, sil and
+// dil take an empty prefix.
+static void put_rex(struct xe_ins *e, bool wide, int reg, bool byte_reg, const struct X64operand *rm,
+				bool byte_rm) {
+	int rex = wide ? 8 : 0;
+	bool empty = byte_reg && reg >= 4 && reg < 8;
+	if (reg >= 8) {
+		rex |= 4;
+	}
+	if (rm->kind == X64O_MEM) {
+		rex |= (rm->index >= 8) ? 2 : 0;
+		rex |= (rm->reg >= 8) ? 1 : 0;
+	} else if (rm->kind == X64O_REG) {
+		rex |= (rm->reg >= 8) ? 1 : 0;
+		empty = empty || (byte_rm && rm->reg >= 4 && rm->reg < 8);
+	}
+	if (rex != 0 || empty) {
+		put(e, 0x40 | rex);
+	}
+}
+
+// Appends the ModRM byte, and the SIB byte and displacement of a memory operand. The reg field
+// takes a register or an opcode extension.
+static void put_modrm(struct xe_ins *e, int reg, const struct X64operand *rm) {
+	reg &= 7;
+	if (rm->kind == X64O_REG) {
+		put(e, 0xc0 | reg << 3 | (rm->reg & 7));
+		return;
+	}
+	int base = rm->reg, index = (rm->index >= 0) ? rm->index & 7 : 4;
+	int scale = (rm->scale == 8) ? 3 : (rm->scale == 4) ? 2 : (rm->scale == 2) ? 1 : 0;
+	if (base < 0) {
+		put(e, reg << 3 | 4);
+		put(e, scale << 6 | index << 3 | 5);
+		put_imm(e, rm->imm, 4);
+		return;
+	}
+	// rbp and r13 as bases take a displacement; rsp and r12 take a SIB byte.
+	int mod = (rm->imm == 0 && (base & 7) != 5) ? 0 : fits8(rm->imm) ? 1 : 2;
+	if (rm->index < 0 && (base & 7) != 4) {
+		put(e, mod << 6 | reg << 3 | (base & 7));
+	} else {
+		put(e, mod << 6 | reg << 3 | 4);
+		put(e, scale << 6 | index << 3 | (base & 7));
+	}
+	put_imm(e, rm->imm, (mod == 1) ? 1 : (mod == 2) ? 4 : 0);
+}
+
+// Appends an instruction of opcode _op_, of one byte or two after 0x0f, with ModRM.
+static void put_op(struct xe_ins *e, bool wide, int op, int reg, bool byte_reg,
+				const struct X64operand *rm, bool byte_rm) {
+	put_rex(e, wide, reg, byte_reg, rm, byte_rm);
+	if (op > 0xff) {
+		put(e, op >> 8);
+	}
+	put(e, op & 0xff);
+	put_modrm(e, reg, rm);
+}
+
+// Appends an instruction taking the register in the low bits of its opcode.
+static void put_short(struct xe_ins *e, bool wide, int op, int reg) {
+	struct X64operand r = { .kind = X64O_REG, .reg = reg, .index = -1 };
+	put_rex(e, wide, 0, false, &r, false);
+	put(e, op + (reg & 7));
+}
+
+// Encodes an arithmetic instruction of two operands.
+static void encode_alu(struct xe_ins *e, const struct X64ins *x) {
+	bool wide = (x->size == 8);
+	int ext = alu_ext[x->op];
+	if (x->src.kind == X64O_IMM) {
+		if (fits8(x->src.imm)) {
+			put_op(e, wide, 0x83, ext, false, &x->dst, false);
+			put_imm(e, x->src.imm, 1);
+		} else if (x->dst.kind == X64O_REG && x->dst.reg == X64_RAX) {
+			put_rex(e, wide, 0, false, &x->dst, false);
+			put(e, ext << 3 | 5);
+			put_imm(e, x->src.imm, 4);
+		} else {
+			put_op(e, wide, 0x81, ext, false, &x->dst, false);
+			put_imm(e, x->src.imm, 4);
+		}
+	} else if (x->src.kind == X64O_REG) {
+		put_op(e, wide, ext << 3 | 1, x->src.reg, false, &x->dst, false);
+	} else {
+		put_op(e, wide, ext << 3 | 3, x->dst.reg, false, &x->src, false);
+	}
+}
+
+// Encodes a move.
+static void encode_mov(struct xe_ins *e, const struct X64ins *x) {
+	bool wide = (x->size == 8), byte = (x->size == 1);
+	if (x->src.kind == X64O_IMM && x->dst.kind == X64O_REG && !wide) {
+		put_short(e, false, 0xb8, x->dst.reg);
+		put_imm(e, x->src.imm, 4);
+	} else if (x->src.kind == X64O_IMM) {
+		put_op(e, wide, byte ? 0xc6 : 0xc7, 0, false, &x->dst, false);
+		put_imm(e, x->src.imm, byte ? 1 : 4);
+	} else if (x->src.kind == X64O_REG) {
+		put_op(e, wide, byte ? 0x88 : 0x89, x->src.reg, byte, &x->dst, byte);
+	} else {
+		put_op(e, wide, byte ? 0x8a : 0x8b, x->dst.reg, byte, &x->src, false);
+	}
+}
+
+// Encodes a machine instruction. Jumps take the displacement _disp_ from the end of the
+// instruction, on 32 bits if _wide_.
+static void encode(struct xe_ins *e, const struct X64ins *x, bool wide, int64_t disp) {
+	e->length = 0;
+	e->reloc = -1;
+	bool w = (x->size == 8);
+	switch (x->op) {
+		case X64_LABEL: {
+			// defines its label, no code
+		}	break;
+
+		case X64_MOV: {
+			encode_mov(e, x);
+		}	break;
+
+		case X64_MOVABS: {
+			put_short(e, true, 0xb8, x->dst.reg);
+			put_imm(e, x->src.imm, 8);
+		}	break;
+
+		case X64_MOVSXD: {
+			put_op(e, true, 0x63, x->dst.reg, false, &x->src, false);
+		}	break;
+
+		case X64_MOVZXB: {
+			put_op(e, false, 0x0fb6, x->dst.reg, false, &x->src, true);
+		}	break;
+
+		case X64_LEA: {
+			put_op(e, w, 0x8d, x->dst.reg, false, &x->src, false);
+		}	break;
+
+		case X64_ADD: case X64_SUB: case X64_AND: case X64_OR: case X64_XOR: case X64_CMP: {
+			encode_alu(e, x);
+		}	break;
+
+		case X64_TEST: {
+			put_op(e, w, 0x85, x->src.reg, false, &x->dst, false);
+		}	break;
+
+		case X64_IMUL: {
+			put_op(e, w, 0x0faf, x->dst.reg, false, &x->src, false);
+		}	break;
+
+		case X64_IMUL3: {
+			put_op(e, w, fits8(x->imm) ? 0x6b : 0x69, x->dst.reg, false, &x->src, false);
+			put_imm(e, x->imm, fits8(x->imm) ? 1 : 4);
+		}	break;
+
+		case X64_SHL: case X64_SHR: case X64_SAR: {
+			if (x->src.kind == X64O_REG) {
+				put_op(e, w, 0xd3, alu_ext[x->op], false, &x->dst, false);
+			} else if (x->src.imm == 1) {
+				put_op(e, w, 0xd1, alu_ext[x->op], false, &x->dst, false);
+			} else {
+				put_op(e, w, 0xc1, alu_ext[x->op], false, &x->dst, false);
+				put_imm(e, x->src.imm, 1);
+			}
+		}	break;
+
+		case X64_NEG: case X64_NOT: {
+			put_op(e, w, 0xf7, alu_ext[x->op], false, &x->dst, false);
+		}	break;
+
+		case X64_IDIV: case X64_DIV: case X64_IMUL1: case X64_MUL1: {
+			put_op(e, w, 0xf7, alu_ext[x->op], false, &x->src, false);
+		}	break;
+
+		case X64_CQO: {
+			if (w) {
+				put(e, 0x48);
+			}
+			put(e, 0x99);
+		}	break;
+
+		case X64_SETCC: {
+			put_op(e, false, 0x0f90 + x->cc, 0, false, &x->dst, true);
+		}	break;
+
+		case X64_CMOVCC: {
+			put_op(e, w, 0x0f40 + x->cc, x->dst.reg, false, &x->src, false);
+		}	break;
+
+		case X64_JCC: {
+			if (wide) {
+				put(e, 0x0f);
+				put(e, 0x80 + x->cc);
+				put_imm(e, disp, 4);
+			} else {
+				put(e, 0x70 + x->cc);
+				put_imm(e, disp, 1);
+			}
+		}	break;
+
+		case X64_JMP: {
+			put(e, wide ? 0xe9 : 0xeb);
+			put_imm(e, disp, wide ? 4 : 1);
+		}	break;
+
+		case X64_CALL: {
+			put(e, 0xe8);
+			e->reloc = e->length;
+			put_imm(e, 0, 4);
+		}	break;
+
+		case X64_RET: {
+			put(e, 0xc3);
+		}	break;
+
+		case X64_PUSH: {
+			if (x->src.kind == X64O_REG) {
+				put_short(e, false, 0x50, x->src.reg);
+			} else if (x->src.kind == X64O_IMM) {
+				put(e, fits8(x->src.imm) ? 0x6a : 0x68);
+				put_imm(e, x->src.imm, fits8(x->src.imm) ? 1 : 4);
+			} else {
+				put_op(e, false, 0xff, 6, false, &x->src, false);
+			}
+		}	break;
+
+		case X64_POP: {
+			put_short(e, false, 0x58, x->dst.reg);
+		}	break;
+
+		default: {
+			fail_unreachable(__FUNCTION__);
+		}
+	}
+}
+
+// Appends bytes to the code.
+static void append(struct X64code *self, const uint8_t *bytes, int length) {
+	if (self->length + length > self->cap) {
+		self->cap = (self->cap < 256) ? 256 : self->cap;
+		while (self->length + length > self->cap) {
+			self->cap *= 2;
+		}
+		self->text = realloc(self->text, self->cap);
+		if (self->text == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	memcpy(self->text + self->length, bytes, length);
+	self->length += length;
+}
+
+// Appends nops up to the alignment, by the multi-byte forms recommended by Intel.
+static void align(struct X64code *self, int alignment) {
+	static const uint8_t nops[9][9] = {
+		{ 0x90 },
+		{ 0x66, 0x90 },
+		{ 0x0f, 0x1f, 0x00 },
+		{ 0x0f, 0x1f, 0x40, 0x00 },
+		{ 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+		{ 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+		{ 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+		{ 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+		{ 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	};
+	int pad = (alignment - self->length % alignment) % alignment;
+	while (pad > 0) {
+		int n = (pad > 9) ? 9 : pad;
+		append(self, nops[n - 1], n);
+		pad -= n;
+	}
+}
+
+// Initializes empty code.
+void X64code_init(struct X64code *self) {
+	self->text = NULL;
+	self->length = self->cap = 0;
+	self->relocs = NULL;
+	self->reloc_count = self->reloc_cap = 0;
+}
+
+// Returns whether the machine instruction is a jump to a label.
+static bool is_jump(const struct X64ins *x) {
+	return (x->op == X64_JCC || x->op == X64_JMP);
+}
+
+// Encodes the machine code of a function at the end of the code, aligned on 16 bytes by nops.
+// Jumps start with 8 bits displacements, and those out of reach are widened until no label
+// moves any more; as jumps only grow, this ends.
+int X64code_encode(struct X64code *self, const struct X64function *f) {
+	align(self, 16);
+	int start = self->length, n = f->length;
+	int *at = try_malloc((n + 1) * sizeof(int), __FUNCTION__);
+	int *label = try_calloc(f->labels + 1, sizeof(int), __FUNCTION__);
+	bool *wide = try_calloc(n + 1, sizeof(bool), __FUNCTION__);
+	struct xe_ins e;
+
+	bool changed = true;
+	while (changed) {
+		int offset = 0;
+		for (int i = 0; i < n; ++i) {
+			const struct X64ins *x = &f->code[i];
+			at[i] = offset;
+			if (x->op == X64_LABEL) {
+				label[x->dst.imm] = offset;
+			}
+			encode(&e, x, wide[i], 0);
+			offset += e.length;
+		}
+		changed = false;
+		for (int i = 0; i < n; ++i) {
+			const struct X64ins *x = &f->code[i];
+			if (is_jump(x) && !wide[i]) {
+				encode(&e, x, false, 0);
+				if (!fits8(label[x->src.imm] - (at[i] + e.length))) {
+					wide[i] = changed = true;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < n; ++i) {
+		const struct X64ins *x = &f->code[i];
+		encode(&e, x, wide[i], 0);
+		if (is_jump(x)) {
+			encode(&e, x, wide[i], label[x->src.imm] - (at[i] + e.length));
+		}
+		if (e.reloc >= 0) {
+			if (self->reloc_count == self->reloc_cap) {
+				self->reloc_cap = (self->reloc_cap < 16) ? 16 : self->reloc_cap * 2;
+				self->relocs = realloc(self->relocs, self->reloc_cap * sizeof(struct X64reloc));
+				if (self->relocs == NULL) {
+					fail_malloc(__FUNCTION__);
+				}
+			}
+			self->relocs[self->reloc_count++] = (struct X64reloc){
+				.offset = self->length + e.reloc,
+				.func = x->src.func,
+			};
+		}
+		append(self, e.bytes, e.length);
+	}
+	free(at);
+	free(label);
+	free(wide);
+	return (start);
+}
+
+// Frees the code.
+void X64code_free(struct X64code *self) {
+	free(self->text);
+	free(self->relocs);
+}
@@ -0,0 +1,1116 @@
+// Code generation for x86-64 and the System V ABI, from the instructions selected by
+// X64isel_run() and the locations of values after register allocation.
+// The frame pointer addresses, downwards, the callee-saved registers pushed, the spill slots,
+// the argument registers saved and the stack slots of allocas; rsp stays aligned on 16 bytes
+// at calls. Values of 32 bits are computed by 32 bits instructions, bools are 0 or 1 in a
+// register and a byte in memory. Operands on the stack are read as memory operands where the
+// machine instruction takes one, and through the scratch registers r10 and r11 otherwise; r10
+// is also the IRLOC_TEMP of the copies. Divisions, high multiplications and shifts by a variable
+// amount use fixed registers, which they save on the stack when allocated to other values.
+// Rematerialized operands computed where used may need more than two scratch registers; a
+// callee-saved register the instruction does not touch is then borrowed, saved in a slot at the
+// bottom of the frame until the instruction is done.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "target.h"
+#include "acir.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "x86_64.h"
+
+// Kinds of operands accepted by a machine instruction, see operand(). Registers always are.
+enum {
+	XG_REG = 0,
+	XG_IMM = 1,
+	XG_MEM = 2,
+};
+
+// Mask of the scratch registers.
+#define XG_SCRATCH ((1u << X64_R10) | (1u << X64_R11))
+
+// Largest number of registers borrowed at once.
+#define XG_MAX_BORROWED 4
+
+// Hardware number of each register of the register file, see x86_64_regs in target.c.
+static const int hw_regs[] = {
+	X64_RAX, X64_RCX, X64_RDX, X64_RSI, X64_RDI, X64_R8, X64_R9,
+	X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15,
+};
+
+// Registers of the first arguments.
+static const int arg_regs[] = { X64_RDI, X64_RSI, X64_RDX, X64_RCX, X64_R8, X64_R9 };
+
+// Registers which may be borrowed as scratch registers: callee-saved, fixed by no instruction.
+static const int borrow_regs[] = { X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15 };
+
+// Working state of the code generation.
+struct xg_context {
+	struct X64function *out;
+	const struct X64isel *isel;
+	const struct IRliveness *lv;
+	const struct IRregalloc *ra;
+	struct IRoutssa *copies;
+	int pos;		// position of the instruction generated
+	unsigned busy;		// scratch registers holding operands of the instruction, by hardware number
+	int cc;			// condition of the fused comparison generated last
+	int saved;		// number of callee-saved registers pushed
+	int *frame;		// offset of the stack slot of each alloca from the frame pointer, by instruction id
+	int home[6];		// offset of the saved register of each parameter, 0 if read from the register
+	int next;		// label of the code laid out after the block generated, -1 for none
+	unsigned avoid;		// registers read or written by the instruction generated, by hardware number
+	int borrowed[XG_MAX_BORROWED];	// registers borrowed for the instruction generated
+	int borrow_count;
+	int borrow_max;		// largest number of registers borrowed at once, for the frame
+	int frame_size;		// size of the frame below the frame pointer, without the borrowed slots
+	int frame_at;		// position of the allocation of the frame in the code, see prologue()
+};
+
+// Returns a register operand.
+static struct X64operand reg_op(int reg) {
+	return ((struct X64operand){ .kind = X64O_REG, .reg = reg, .index = -1, .scale = 1 });
+}
+
+// Returns an immediate operand.
+static struct X64operand imm_op(int64_t imm) {
+	return ((struct X64operand){ .kind = X64O_IMM, .reg = -1, .index = -1, .scale = 1, .imm = imm });
+}
+
+// Returns a memory operand addressed by a register and a displacement.
+static struct X64operand mem_op(int base, int64_t disp) {
+	return ((struct X64operand){ .kind = X64O_MEM, .reg = base, .index = -1, .scale = 1, .imm = disp });
+}
+
+// Returns a label operand.
+static struct X64operand label_op(int label) {
+	return ((struct X64operand){ .kind = X64O_LABEL, .reg = -1, .index = -1, .scale = 1, .imm = label });
+}
+
+// Returns the absent operand.
+static struct X64operand no_op(void) {
+	return ((struct X64operand){ .kind = X64O_NONE, .reg = -1, .index = -1, .scale = 1 });
+}
+
+// Returns whether the operand reads the register.
+static bool reads(const struct X64operand *o, int reg) {
+	switch (o->kind) {
+		case X64O_REG:	return (o->reg == reg);
+		case X64O_MEM:	return (o->reg == reg || o->index == reg);
+		default:	return (false);
+	}
+}
+
+// Appends a machine instruction.
+static void emit_ins(struct xg_context *ctx, struct X64ins ins) {
+	struct X64function *out = ctx->out;
+	if (out->length == out->cap) {
+		out->cap = (out->cap < 64) ? 64 : out->cap * 2;
+		out->code = realloc(out->code, out->cap * sizeof(struct X64ins));
+		if (out->code == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	out->code[out->length++] = ins;
+}
+
+// Appends a machine instruction of two operands.
+static void emit(struct xg_context *ctx, int op, int size, struct X64operand src, struct X64operand dst) {
+	emit_ins(ctx, (struct X64ins){ .op = op, .size = size, .src = src, .dst = dst });
+}
+
+// Appends a machine instruction taking a condition.
+static void emit_cc(struct xg_context *ctx, int op, int size, int cc, struct X64operand src,
+				struct X64operand dst) {
+	emit_ins(ctx, (struct X64ins){ .op = op, .size = size, .cc = cc, .src = src, .dst = dst });
+}
+
+// Returns the size of the machine operands of a value.
+static int size_of(int type) {
+	return ((type == IRT_I64 || type == IRT_PTR) ? 8 : 4);
+}
+
+// Returns the value of a constant, 0 if undefined.
+static int64_t imm_value(const struct IRinstruction *v) {
+	return ((v->type == IRT_UNDEF || v->type == IRT_VOID) ? 0 : IRimm_value(v));
+}
+
+// Returns whether the constant fits in a sign extended 32 bits immediate.
+static bool fits32(int64_t c) {
+	return (c >= INT32_MIN && c <= INT32_MAX);
+}
+
+// Returns the offset of a spill slot from the frame pointer.
+static int slot_offset(struct xg_context *ctx, int slot) {
+	return (-8 * (ctx->saved + slot + 1));
+}
+
+// Returns the operand of a location of the copies.
+static struct X64operand location(struct xg_context *ctx, int loc) {
+	int k = ctx->ra->regs->count;
+	if (loc == IRLOC_TEMP) {
+		return (reg_op(X64_R10));
+	}
+	return ((loc < k) ? reg_op(hw_regs[loc]) : mem_op(X64_RBP, slot_offset(ctx, loc - k)));
+}
+
+// Returns the location of the register of the register file.
+static int location_of(int reg) {
+	for (int i = 0; i < (int)(sizeof(hw_regs) / sizeof(int)); ++i) {
+		if (hw_regs[i] == reg) {
+			return (i);
+		}
+	}
+	fail_unreachable(__FUNCTION__);
+}
+
+// Returns the slot saving the register borrowed _k_-th.
+static struct X64operand borrow_slot(struct xg_context *ctx, int k) {
+	return (mem_op(X64_RBP, -(ctx->frame_size + 8 * (k + 1))));
+}
+
+// Borrows a register the instruction generated does not touch, saving its value.
+static int borrow(struct xg_context *ctx) {
+	for (int i = 0; i < ctx->borrow_count; ++i) {
+		if (!(ctx->busy & (1u << ctx->borrowed[i]))) {
+			return (ctx->borrowed[i]);
+		}
+	}
+	if (ctx->borrow_count == XG_MAX_BORROWED) {
+		fail_unreachable(__FUNCTION__);
+	}
+	for (int i = 0; i < (int)(sizeof(borrow_regs) / sizeof(int)); ++i) {
+		int reg = borrow_regs[i];
+		if (!(ctx->avoid & (1u << reg)) && !(ctx->busy & (1u << reg))) {
+			emit(ctx, X64_MOV, 8, reg_op(reg), borrow_slot(ctx, ctx->borrow_count));
+			ctx->borrowed[ctx->borrow_count++] = reg;
+			if (ctx->borrow_count > ctx->borrow_max) {
+				ctx->borrow_max = ctx->borrow_count;
+			}
+			return (reg);
+		}
+	}
+	fail_unreachable(__FUNCTION__);
+}
+
+// Restores the registers borrowed, once the instruction reading them is generated.
+static void give_back(struct xg_context *ctx) {
+	while (ctx->borrow_count > 0) {
+		int k = --ctx->borrow_count;
+		emit(ctx, X64_MOV, 8, borrow_slot(ctx, k), reg_op(ctx->borrowed[k]));
+	}
+	ctx->busy = 0;
+}
+
+// Takes a scratch register for an operand of the instruction generated, borrowing one when r10
+// and r11 are both taken.
+static int scratch(struct xg_context *ctx) {
+	int reg = !(ctx->busy & (1u << X64_R10)) ? X64_R10 : X64_R11;
+	if (ctx->busy & (1u << reg)) {
+		reg = borrow(ctx);
+	}
+	ctx->busy |= 1u << reg;
+	return (reg);
+}
+
+// Loads a constant into the register, by the shortest move.
+static void load_imm(struct xg_context *ctx, int64_t c, int reg) {
+	if (c >= 0 && c <= UINT32_MAX) {
+		emit(ctx, X64_MOV, 4, imm_op(c), reg_op(reg));
+	} else if (fits32(c)) {
+		emit(ctx, X64_MOV, 8, imm_op(c), reg_op(reg));
+	} else {
+		emit(ctx, X64_MOVABS, 8, imm_op(c), reg_op(reg));
+	}
+}
+
+// Copies 64 bits between operands, through r11 from memory to memory.
+static void move(struct xg_context *ctx, struct X64operand src, struct X64operand dst) {
+	if (src.kind == X64O_REG && dst.kind == X64O_REG && src.reg == dst.reg) {
+		return;
+	}
+	if (src.kind == X64O_MEM && dst.kind == X64O_MEM) {
+		emit(ctx, X64_MOV, 8, src, reg_op(X64_R11));
+		src = reg_op(X64_R11);
+	}
+	emit(ctx, X64_MOV, 8, src, dst);
+}
+
+// Writes the result computed in the register to its location.
+static void store_result(struct xg_context *ctx, int reg, struct X64operand dst) {
+	if (dst.kind != X64O_NONE) {
+		move(ctx, reg_op(reg), dst);
+	}
+}
+
+// Evaluates the value if its operands are constants, as rematerialized values often are.
+static bool fold_constant(const struct IRinstruction *v, int64_t *res) {
+	if (IRis_binary(v->op)) {
+		if (v->left->op != IR_IMM || v->right->op != IR_IMM) {
+			return (false);
+		}
+		int type = (v->left->type == IRT_PTR || v->type == IRT_PTR) ? IRT_I64 : v->left->type;
+		if (type == IRT_UNDEF || type == IRT_VOID) {
+			type = v->right->type;
+		}
+		if (type == IRT_UNDEF || type == IRT_VOID) {
+			type = IRT_I64;
+		}
+		if (!IRopcode_fold(v->op, type, imm_value(v->left), imm_value(v->right), res)) {
+			*res = 0;
+		}
+		return (true);
+	}
+	switch (v->op) {
+		case IR_ZEXT: case IR_SEXT: case IR_TRUNC: case IR_NEG: case IR_NOT: {
+			if (v->left->op != IR_IMM) {
+				return (false);
+			}
+			int64_t a = imm_value(v->left);
+			int type = (v->type == IRT_PTR) ? IRT_I64 : v->type;
+			if (v->op == IR_ZEXT && v->left->type == IRT_I32) {
+				*res = (uint32_t)a;
+			} else if (v->op == IR_ZEXT || v->op == IR_SEXT) {
+				*res = a;
+			} else if (v->op == IR_TRUNC) {
+				*res = IRTypecode_wrap(type, a);
+			} else if (v->op == IR_NEG) {
+				*res = IRTypecode_wrap(type, (int64_t)(0 - (uint64_t)a));
+			} else {
+				*res = (type == IRT_I1) ? !a : IRTypecode_wrap(type, ~a);
+			}
+			return (true);
+		}
+
+		case IR_SELECT: {
+			if (v->cond->op != IR_IMM) {
+				return (false);
+			}
+			struct IRinstruction *c = imm_value(v->cond) ? v->vt : v->vf;
+			if (c->op != IR_IMM) {
+				return (false);
+			}
+			*res = imm_value(c);
+			return (true);
+		}
+	}
+	return (false);
+}
+
+static void generate(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst);
+
+// Computes into the register a value without a location: a constant, the address of a stack
+// slot, or a rematerialized value.
+static void compute(struct xg_context *ctx, struct IRinstruction *v, int reg) {
+	int64_t c;
+	if (v->op == IR_IMM) {
+		load_imm(ctx, imm_value(v), reg);
+	} else if (v->op == IR_ALLOCA) {
+		emit(ctx, X64_LEA, 8, mem_op(X64_RBP, ctx->frame[v->id]), reg_op(reg));
+	} else if (fold_constant(v, &c)) {
+		load_imm(ctx, c, reg);
+	} else {
+		unsigned busy = ctx->busy;
+		generate(ctx, v, reg_op(reg));
+		ctx->busy = busy;
+	}
+}
+
+// Returns the location of an operand of the instruction generated: a register, a spill slot or
+// a constant, none if it is computed where used.
+static struct X64operand where(struct xg_context *ctx, struct IRinstruction *v) {
+	if (v->op == IR_IMM) {
+		return (imm_op(imm_value(v)));
+	}
+	if (v->op == IR_ALLOCA) {
+		return (no_op());
+	}
+	const struct IRsegment *s = IRoutssa_at(ctx->copies, v, ctx->pos);
+	if (s == NULL) {
+		fail_unreachable(__FUNCTION__);
+	}
+	if (s->reg >= 0) {
+		return (reg_op(hw_regs[s->reg]));
+	}
+	return (s->remat ? no_op() : mem_op(X64_RBP, slot_offset(ctx, s->slot)));
+}
+
+// Loads an operand of the instruction generated into the register.
+static void load(struct xg_context *ctx, struct IRinstruction *v, int reg) {
+	struct X64operand o = where(ctx, v);
+	if (o.kind == X64O_NONE) {
+		compute(ctx, v, reg);
+	} else if (o.kind == X64O_IMM) {
+		load_imm(ctx, o.imm, reg);
+	} else if (o.kind != X64O_REG || o.reg != reg) {
+		emit(ctx, X64_MOV, size_of(v->type), o, reg_op(reg));
+	}
+}
+
+// Returns an operand of the instruction generated, of one of the kinds XG_* accepted, loading it
+// into a scratch register otherwise.
+static struct X64operand operand(struct xg_context *ctx, struct IRinstruction *v, int kinds) {
+	struct X64operand o = where(ctx, v);
+	if (o.kind == X64O_REG || (o.kind == X64O_MEM && (kinds & XG_MEM))
+			|| (o.kind == X64O_IMM && (kinds & XG_IMM) && fits32(o.imm))) {
+		return (o);
+	}
+	int reg = scratch(ctx);
+	load(ctx, v, reg);
+	return (reg_op(reg));
+}
+
+// Returns the memory operand of an address, with its base and index in registers.
+static struct X64operand address(struct xg_context *ctx, const struct X64addr *a) {
+	struct X64operand m = mem_op(-1, a->disp);
+	if (a->base != NULL && a->base->op == IR_ALLOCA) {
+		m.reg = X64_RBP;
+		m.imm += ctx->frame[a->base->id];
+	} else if (a->base != NULL) {
+		m.reg = operand(ctx, a->base, XG_REG).reg;
+	}
+	if (a->index != NULL) {
+		m.index = operand(ctx, a->index, XG_REG).reg;
+		m.scale = a->scale;
+	}
+	return (m);
+}
+
+// Returns the memory operand of an address, leaving a scratch register for another operand.
+static struct X64operand address_one(struct xg_context *ctx, const struct X64addr *a) {
+	unsigned busy = ctx->busy;
+	struct X64operand m = address(ctx, a);
+	if ((ctx->busy & ~busy) == XG_SCRATCH) {
+		emit(ctx, X64_LEA, 8, m, reg_op(X64_R11));
+		ctx->busy = busy | (1u << X64_R11);
+		m = mem_op(X64_R11, 0);
+	}
+	return (m);
+}
+
+// Returns the register computing the result, the one of its location unless it is on the
+// stack or read by _src_ after being written.
+static int work_reg(struct xg_context *ctx, struct X64operand dst, const struct X64operand *src) {
+	if (dst.kind == X64O_REG && (src == NULL || !reads(src, dst.reg))) {
+		return (dst.reg);
+	}
+	return (scratch(ctx));
+}
+
+// Returns the condition code of a comparison.
+static int cc_of(int op) {
+	switch (op) {
+		case IR_CMP_EQ:		return (X64_CC_E);
+		case IR_CMP_NE:		return (X64_CC_NE);
+		case IR_CMP_LT:		return (X64_CC_L);
+		case IR_CMP_LE:		return (X64_CC_LE);
+		case IR_CMP_GT:		return (X64_CC_G);
+		case IR_CMP_GE:		return (X64_CC_GE);
+		case IR_CMP_ULT:	return (X64_CC_B);
+		case IR_CMP_ULE:	return (X64_CC_BE);
+		case IR_CMP_UGT:	return (X64_CC_A);
+		case IR_CMP_UGE:	return (X64_CC_AE);
+		default:		fail_ir_op(op, __FUNCTION__);
+	}
+}
+
+// Sets the flags by the comparison, folded into _root_ or the root itself. Returns the condition
+// code of its result. Scratch registers are released.
+static int gen_cmp(struct xg_context *ctx, struct IRinstruction *c, struct IRinstruction *root) {
+	unsigned busy = ctx->busy;
+	struct IRinstruction *l = c->left, *r = c->right, *t;
+	int op = c->op;
+	struct X64operand a, b;
+	if (l->is_folded || (l->op == IR_IMM && r->op != IR_IMM && !r->is_folded)) {
+		t = l, l = r, r = t;
+		op = IRcmp_swap(op);
+	}
+	if (r->is_folded) {
+		b = address_one(ctx, &ctx->isel->addr[root->id]);
+		a = operand(ctx, l, XG_REG);
+	} else {
+		b = operand(ctx, r, XG_REG | XG_IMM | XG_MEM);
+		a = operand(ctx, l, (b.kind == X64O_MEM) ? XG_REG : XG_MEM);
+	}
+	emit(ctx, X64_CMP, size_of(l->type), b, a);
+	ctx->busy = busy;
+	return (cc_of(op));
+}
+
+// Sets the flags by a bool, returning the condition code of its truth.
+static int gen_test(struct xg_context *ctx, struct IRinstruction *c, struct IRinstruction *root) {
+	if (ctx->isel->rule[root->id] == X64R_CC) {
+		return (gen_cmp(ctx, c, root));
+	}
+	unsigned busy = ctx->busy;
+	struct X64operand o = operand(ctx, c, XG_MEM);
+	if (o.kind == X64O_REG) {
+		emit(ctx, X64_TEST, 4, o, o);
+	} else {
+		emit(ctx, X64_CMP, 4, imm_op(0), o);
+	}
+	ctx->busy = busy;
+	return (X64_CC_NE);
+}
+
+// Returns the label of the edge to the successor of index _succ_ of the block: the block of its
+// copies if split, else the successor.
+static int target(struct xg_context *ctx, struct IRblock *b, int succ) {
+	const struct IRedge_copies *e = IRoutssa_edge(ctx->copies, b, succ);
+	if (e->place == IRC_SPLIT && e->count > 0) {
+		return (ctx->lv->nb + (int)(e - ctx->copies->edges));
+	}
+	return (e->to->id);
+}
+
+// Returns whether the label is the one of the code laid out next.
+static bool falls_into(struct xg_context *ctx, int label) {
+	return (ctx->next == label);
+}
+
+// Generates a binary operation computed by a two operand machine instruction, or lea.
+static void gen_alu(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int size = size_of(x->type), rule = ctx->isel->rule[x->id], op;
+	switch (x->op) {
+		case IR_ADD:	op = X64_ADD;	break;
+		case IR_SUB:	op = X64_SUB;	break;
+		case IR_MUL:	op = X64_IMUL;	break;
+		case IR_AND:	op = X64_AND;	break;
+		case IR_OR:	op = X64_OR;	break;
+		case IR_XOR:	op = X64_XOR;	break;
+		default:	fail_ir_op(x->op, __FUNCTION__);
+	}
+	if (rule == X64R_LEA) {
+		struct X64operand m = address_one(ctx, &ctx->isel->addr[x->id]);
+		int w = work_reg(ctx, dst, NULL);
+		emit(ctx, X64_LEA, size, m, reg_op(w));
+		store_result(ctx, w, dst);
+		return;
+	}
+
+	struct IRinstruction *l = x->left, *r = x->right, *t;
+	struct X64operand b;
+	if (rule == X64R_MEM) {
+		if (l->is_folded) {
+			t = l, l = r, r = t;
+		}
+		b = address_one(ctx, &ctx->isel->addr[x->id]);
+	} else {
+		if (IRis_commutative(x->op) && l->op == IR_IMM && r->op != IR_IMM) {
+			t = l, l = r, r = t;
+		}
+		b = operand(ctx, r, XG_REG | XG_IMM | XG_MEM);
+	}
+	struct X64operand a = where(ctx, l);
+
+	// A sum into a third register is done by lea.
+	if (x->op == IR_ADD && x->type != IRT_I1 && dst.kind == X64O_REG && a.kind == X64O_REG
+			&& a.reg != dst.reg && (b.kind == X64O_IMM || (b.kind == X64O_REG && b.reg != dst.reg))) {
+		struct X64operand m = mem_op(a.reg, (b.kind == X64O_IMM) ? b.imm : 0);
+		if (b.kind == X64O_REG) {
+			m.index = b.reg;
+		}
+		emit(ctx, X64_LEA, size, m, dst);
+		return;
+	}
+
+	// A commutative operation is computed into the register of its right operand.
+	if (rule != X64R_MEM && IRis_commutative(x->op) && dst.kind == X64O_REG && b.kind == X64O_REG
+			&& b.reg == dst.reg && (a.kind == X64O_REG || a.kind == X64O_MEM
+				|| (a.kind == X64O_IMM && fits32(a.imm)))) {
+		struct X64operand o = a;
+		t = l, l = r, r = t;
+		a = b, b = o;
+	}
+	int w = work_reg(ctx, dst, &b);
+	if (x->op == IR_MUL && b.kind == X64O_IMM) {
+		if (a.kind != X64O_REG && a.kind != X64O_MEM) {
+			load(ctx, l, w);
+			a = reg_op(w);
+		}
+		emit_ins(ctx, (struct X64ins){ .op = X64_IMUL3, .size = size, .src = a, .dst = reg_op(w), .imm = b.imm });
+	} else {
+		load(ctx, l, w);
+		emit(ctx, op, size, b, reg_op(w));
+	}
+	if (x->type == IRT_I1 && (x->op == IR_ADD || x->op == IR_SUB || x->op == IR_MUL)) {
+		emit(ctx, X64_AND, 4, imm_op(1), reg_op(w));
+	}
+	store_result(ctx, w, dst);
+}
+
+// Generates a shift, by cl when the amount is not constant.
+static void gen_shift(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int size = size_of(x->type);
+	int op = (x->op == IR_SHL) ? X64_SHL : (x->op == IR_LSHR) ? X64_SHR : X64_SAR;
+	if (x->right->op == IR_IMM) {
+		int w = work_reg(ctx, dst, NULL);
+		load(ctx, x->left, w);
+		emit(ctx, op, size, imm_op(imm_value(x->right) & (8 * size - 1)), reg_op(w));
+		if (x->type == IRT_I1 && x->op == IR_SHL) {
+			emit(ctx, X64_AND, 4, imm_op(1), reg_op(w));
+		}
+		store_result(ctx, w, dst);
+		return;
+	}
+
+	struct X64operand n = where(ctx, x->right);
+	bool in_rcx = (dst.kind == X64O_REG && dst.reg == X64_RCX);
+	int w = (!in_rcx && dst.kind == X64O_REG && !reads(&n, dst.reg)) ? dst.reg : scratch(ctx);
+	load(ctx, x->left, w);
+	bool save = false;
+	if (n.kind != X64O_REG || n.reg != X64_RCX) {
+		save = !in_rcx && (ctx->ra->used & (1u << location_of(X64_RCX)));
+		if (save) {
+			emit(ctx, X64_PUSH, 8, reg_op(X64_RCX), no_op());
+		}
+		load(ctx, x->right, X64_RCX);
+	}
+	emit(ctx, op, size, reg_op(X64_RCX), reg_op(w));
+	if (save) {
+		emit(ctx, X64_POP, 8, no_op(), reg_op(X64_RCX));
+	}
+	if (x->type == IRT_I1 && x->op == IR_SHL) {
+		emit(ctx, X64_AND, 4, imm_op(1), reg_op(w));
+	}
+	store_result(ctx, w, dst);
+}
+
+// Generates a division, remainder or high multiplication, on rdx:rax.
+static void gen_divide(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int size = size_of(x->type), op, res = X64_RDX;
+	switch (x->op) {
+		case IR_SDIV:	op = X64_IDIV;	res = X64_RAX;	break;
+		case IR_UDIV:	op = X64_DIV;	res = X64_RAX;	break;
+		case IR_SREM:	op = X64_IDIV;	break;
+		case IR_UREM:	op = X64_DIV;	break;
+		case IR_SMULH:	op = X64_IMUL1;	break;
+		case IR_UMULH:	op = X64_MUL1;	break;
+		default:	fail_ir_op(x->op, __FUNCTION__);
+	}
+	struct X64operand d = where(ctx, x->right);
+	ctx->busy |= 1u << X64_R11;
+	if (d.kind != X64O_MEM && (d.kind != X64O_REG || d.reg == X64_RAX || d.reg == X64_RDX)) {
+		load(ctx, x->right, X64_R11);
+		d = reg_op(X64_R11);
+	}
+
+	// rax and rdx are saved unless they take the result.
+	int saved[2], count = 0;
+	const int fixed[2] = { X64_RAX, X64_RDX };
+	for (int i = 0; i < 2; ++i) {
+		bool is_dst = (dst.kind == X64O_REG && dst.reg == fixed[i]);
+		if (!is_dst && (ctx->ra->used & (1u << location_of(fixed[i])))) {
+			saved[count++] = fixed[i];
+			emit(ctx, X64_PUSH, 8, reg_op(fixed[i]), no_op());
+		}
+	}
+	load(ctx, x->left, X64_RAX);
+	ctx->busy |= XG_SCRATCH;
+	if (op == X64_IDIV) {
+		emit(ctx, X64_CQO, size, no_op(), no_op());
+	} else if (op == X64_DIV) {
+		emit(ctx, X64_XOR, 4, reg_op(X64_RDX), reg_op(X64_RDX));
+	}
+	emit(ctx, op, size, d, no_op());
+
+	bool fixed_dst = (dst.kind == X64O_REG && (dst.reg == X64_RAX || dst.reg == X64_RDX));
+	if (fixed_dst) {
+		move(ctx, reg_op(res), dst);
+	} else {
+		move(ctx, reg_op(res), reg_op(X64_R10));
+	}
+	while (count > 0) {
+		emit(ctx, X64_POP, 8, no_op(), reg_op(saved[--count]));
+	}
+	if (!fixed_dst) {
+		store_result(ctx, X64_R10, dst);
+	}
+}
+
+// Generates a negation or complement.
+static void gen_unary(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int w = work_reg(ctx, dst, NULL);
+	load(ctx, x->left, w);
+	if (x->op == IR_NOT && x->type == IRT_I1) {
+		emit(ctx, X64_XOR, 4, imm_op(1), reg_op(w));
+	} else {
+		emit(ctx, (x->op == IR_NEG) ? X64_NEG : X64_NOT, size_of(x->type), no_op(), reg_op(w));
+		if (x->type == IRT_I1) {
+			emit(ctx, X64_AND, 4, imm_op(1), reg_op(w));
+		}
+	}
+	store_result(ctx, w, dst);
+}
+
+// Generates a conversion between integer types.
+static void gen_convert(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	struct IRinstruction *l = x->left;
+	if (x->op == IR_ZEXT && ctx->isel->rule[x->id] == X64R_CC) {
+		int cc = gen_cmp(ctx, l, x);
+		int w = work_reg(ctx, dst, NULL);
+		emit_cc(ctx, X64_SETCC, 1, cc, no_op(), reg_op(w));
+		emit(ctx, X64_MOVZXB, 4, reg_op(w), reg_op(w));
+		store_result(ctx, w, dst);
+		return;
+	}
+	int w = work_reg(ctx, dst, NULL);
+	if (x->op == IR_TRUNC) {
+		load(ctx, l, w);
+		if (x->type == IRT_I1) {
+			emit(ctx, X64_AND, 4, imm_op(1), reg_op(w));
+		}
+		store_result(ctx, w, dst);
+		return;
+	}
+	struct X64operand o = where(ctx, l);
+	if (o.kind != X64O_REG && o.kind != X64O_MEM) {
+		load(ctx, l, w);
+		o = reg_op(w);
+	}
+	if (x->op == IR_SEXT && l->type == IRT_I32 && size_of(x->type) == 8) {
+		emit(ctx, X64_MOVSXD, 8, o, reg_op(w));
+	} else if (o.kind != X64O_REG || o.reg != w || size_of(x->type) == 8) {
+		// Bools are 0 or 1 extended either way, and 32 bits moves zero the upper half.
+		emit(ctx, X64_MOV, 4, o, reg_op(w));
+	}
+	store_result(ctx, w, dst);
+}
+
+// Generates a comparison, setting the flags only when fused into the branch after it.
+static void gen_compare(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int cc = gen_cmp(ctx, x, x);
+	if (x->is_fused) {
+		ctx->cc = cc;
+		return;
+	}
+	int w = work_reg(ctx, dst, NULL);
+	emit_cc(ctx, X64_SETCC, 1, cc, no_op(), reg_op(w));
+	emit(ctx, X64_MOVZXB, 4, reg_op(w), reg_op(w));
+	store_result(ctx, w, dst);
+}
+
+// Generates a select by a conditional move. Rematerialized operands are computed before the
+// flags are set, constants after it by moves which keep them.
+static void gen_select(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int size = size_of(x->type);
+	if (x->cond->op == IR_IMM) {
+		int w = work_reg(ctx, dst, NULL);
+		load(ctx, imm_value(x->cond) ? x->vt : x->vf, w);
+		store_result(ctx, w, dst);
+		return;
+	}
+	struct X64operand t = where(ctx, x->vt), f = where(ctx, x->vf);
+	if (t.kind == X64O_NONE) {
+		t = operand(ctx, x->vt, XG_REG);
+	}
+	if (f.kind == X64O_NONE) {
+		f = operand(ctx, x->vf, XG_REG);
+	}
+	int cc = gen_test(ctx, x->cond, x);
+	if (t.kind == X64O_IMM) {
+		int reg = scratch(ctx);
+		load_imm(ctx, t.imm, reg);
+		t = reg_op(reg);
+	}
+	int w = work_reg(ctx, dst, &t);
+	if (f.kind == X64O_IMM) {
+		load_imm(ctx, f.imm, w);
+	} else if (f.kind != X64O_REG || f.reg != w) {
+		emit(ctx, X64_MOV, size, f, reg_op(w));
+	}
+	emit_cc(ctx, X64_CMOVCC, size, cc, t, reg_op(w));
+	store_result(ctx, w, dst);
+}
+
+// Generates a load, zero extending bools.
+static void gen_load(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	struct X64operand m = address_one(ctx, &ctx->isel->addr[x->id]);
+	int w = work_reg(ctx, dst, NULL);
+	if (x->type == IRT_I1) {
+		emit(ctx, X64_MOVZXB, 4, m, reg_op(w));
+	} else {
+		emit(ctx, X64_MOV, size_of(x->type), m, reg_op(w));
+	}
+	store_result(ctx, w, dst);
+}
+
+// Generates a store.
+static void gen_store(struct xg_context *ctx, struct IRinstruction *x) {
+	struct X64operand m = address_one(ctx, &ctx->isel->addr[x->id]);
+	struct X64operand v = operand(ctx, x->right, XG_IMM);
+	int size = (x->right->type == IRT_I1) ? 1 : size_of(x->right->type);
+	emit(ctx, X64_MOV, size, v, m);
+}
+
+// Makes copies, from the index _begin_.
+static void make_copies(struct xg_context *ctx, int begin, int count) {
+	for (int i = begin; i < begin + count; ++i) {
+		const struct IRcopy *c = &ctx->copies->copies[i];
+		struct X64operand to = location(ctx, c->to);
+		if (c->from != IRLOC_VALUE) {
+			move(ctx, location(ctx, c->from), to);
+		} else if (to.kind == X64O_REG) {
+			ctx->busy = 0;
+			ctx->avoid = 1u << to.reg;
+			compute(ctx, c->value, to.reg);
+		} else {
+			ctx->busy = 1u << X64_R11;
+			ctx->avoid = 0;
+			compute(ctx, c->value, X64_R11);
+			move(ctx, reg_op(X64_R11), to);
+		}
+		give_back(ctx);
+	}
+	ctx->busy = 0;
+}
+
+// Generates a call: arguments past the sixth are pushed, the others copied into their registers
+// in parallel, and rsp stays aligned on 16 bytes.
+static void gen_call(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int stack = (x->argc > 6) ? x->argc - 6 : 0;
+	if (stack % 2 != 0) {
+		emit(ctx, X64_SUB, 8, imm_op(8), reg_op(X64_RSP));
+	}
+	for (int i = x->argc - 1; i >= 6; --i) {
+		emit(ctx, X64_PUSH, 8, operand(ctx, x->args[i], XG_IMM | XG_MEM), no_op());
+		give_back(ctx);
+	}
+
+	struct IRcopy copies[6];
+	int count = 0;
+	for (int i = 0; i < x->argc && i < 6; ++i) {
+		struct IRinstruction *v = x->args[i];
+		struct IRcopy *c = &copies[count++];
+		*c = (struct IRcopy){ .from = IRLOC_VALUE, .to = location_of(arg_regs[i]), .value = v };
+		const struct IRsegment *s = IRliveness_is_value(v) ? IRoutssa_at(ctx->copies, v, ctx->pos) : NULL;
+		if (s != NULL && !s->remat) {
+			c->from = (s->reg >= 0) ? s->reg : ctx->ra->regs->count + s->slot;
+		}
+	}
+	int begin = IRoutssa_sequentialize(ctx->copies, copies, count);
+	make_copies(ctx, begin, ctx->copies->copy_count - begin);
+	ctx->copies->copy_count = begin;
+
+	struct X64operand func = { .kind = X64O_FUNC, .reg = -1, .index = -1, .scale = 1, .func = x->callee };
+	emit(ctx, X64_CALL, 8, func, no_op());
+	if (stack > 0) {
+		emit(ctx, X64_ADD, 8, imm_op(8 * (stack + stack % 2)), reg_op(X64_RSP));
+	}
+	store_result(ctx, X64_RAX, dst);
+}
+
+// Generates the return of the function: restores the callee-saved registers and the frame.
+static void gen_return(struct xg_context *ctx, struct IRinstruction *x) {
+	struct IRinstruction *v = x->left;
+	if (v != NULL && v->type != IRT_UNDEF && v->type != IRT_VOID) {
+		load(ctx, v, X64_RAX);
+	}
+	give_back(ctx);
+	if (ctx->saved > 0) {
+		emit(ctx, X64_LEA, 8, mem_op(X64_RBP, -8 * ctx->saved), reg_op(X64_RSP));
+		for (int i = ctx->ra->regs->count - 1; i >= 0; --i) {
+			if (ctx->ra->used & ~ctx->ra->regs->caller_saved & (1u << i)) {
+				emit(ctx, X64_POP, 8, no_op(), reg_op(hw_regs[i]));
+			}
+		}
+	} else {
+		emit(ctx, X64_MOV, 8, reg_op(X64_RBP), reg_op(X64_RSP));
+	}
+	emit(ctx, X64_POP, 8, no_op(), reg_op(X64_RBP));
+	emit(ctx, X64_RET, 8, no_op(), no_op());
+}
+
+// Generates a branch, falling into the block laid out next where possible.
+static void gen_branch(struct xg_context *ctx, struct IRinstruction *x) {
+	struct IRblock *b = x->owner;
+	if (x->op == IR_JMP || x->cond->op == IR_IMM) {
+		int label = target(ctx, b, (x->op == IR_JMP || imm_value(x->cond)) ? 0 : 1);
+		if (!falls_into(ctx, label)) {
+			emit(ctx, X64_JMP, 8, label_op(label), no_op());
+		}
+		return;
+	}
+	int cc = x->cond->is_fused ? ctx->cc : gen_test(ctx, x->cond, x);
+	give_back(ctx);
+	int t = target(ctx, b, 0), f = target(ctx, b, 1);
+	if (falls_into(ctx, t)) {
+		emit_cc(ctx, X64_JCC, 8, cc ^ 1, label_op(f), no_op());
+		return;
+	}
+	emit_cc(ctx, X64_JCC, 8, cc, label_op(t), no_op());
+	if (!falls_into(ctx, f)) {
+		emit(ctx, X64_JMP, 8, label_op(f), no_op());
+	}
+}
+
+// Generates a parameter, from its register, the stack slot it was saved to, or the stack of
+// the caller.
+static void gen_param(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	int k = x->param_index;
+	struct X64operand src = mem_op(X64_RBP, 16 + 8 * (k - 6));
+	if (k < 6) {
+		src = (ctx->home[k] != 0) ? mem_op(X64_RBP, ctx->home[k]) : reg_op(arg_regs[k]);
+	}
+	if (dst.kind != X64O_NONE) {
+		move(ctx, src, dst);
+	}
+}
+
+// Generates the instruction, its result into _dst_.
+static void generate(struct xg_context *ctx, struct IRinstruction *x, struct X64operand dst) {
+	switch (x->op) {
+		case IR_ADD: case IR_SUB: case IR_MUL: case IR_AND: case IR_OR: case IR_XOR:
+			gen_alu(ctx, x, dst);
+			break;
+
+		case IR_SHL: case IR_LSHR: case IR_ASHR:
+			gen_shift(ctx, x, dst);
+			break;
+
+		case IR_SDIV: case IR_UDIV: case IR_SREM: case IR_UREM: case IR_SMULH: case IR_UMULH:
+			gen_divide(ctx, x, dst);
+			break;
+
+		case IR_NEG: case IR_NOT:
+			gen_unary(ctx, x, dst);
+			break;
+
+		case IR_ZEXT: case IR_SEXT: case IR_TRUNC:
+			gen_convert(ctx, x, dst);
+			break;
+
+		case IR_CMP_EQ: case IR_CMP_NE: case IR_CMP_LT: case IR_CMP_LE: case IR_CMP_GT:
+		case IR_CMP_GE: case IR_CMP_ULT: case IR_CMP_ULE: case IR_CMP_UGT: case IR_CMP_UGE:
+			gen_compare(ctx, x, dst);
+			break;
+
+		case IR_SELECT:		gen_select(ctx, x, dst);	break;
+		case IR_LOAD:		gen_load(ctx, x, dst);		break;
+		case IR_STORE:		gen_store(ctx, x);		break;
+		case IR_CALL:		gen_call(ctx, x, dst);		break;
+		case IR_PARAM:		gen_param(ctx, x, dst);		break;
+		case IR_RET:		gen_return(ctx, x);		break;
+		case IR_JMP: case IR_BR:	gen_branch(ctx, x);	break;
+
+		case IR_IMM: case IR_ALLOCA: case IR_PHI:
+			break;
+
+		default:
+			fail_ir_op(x->op, __FUNCTION__);
+	}
+}
+
+// Operand callback of generate_at(): keeps the register of the operand from being borrowed.
+static void avoid_operand(struct IRinstruction **slot, void *arg) {
+	struct xg_context *ctx = arg;
+	const struct IRsegment *s = IRliveness_is_value(*slot) ? IRoutssa_at(ctx->copies, *slot, ctx->pos) : NULL;
+	if (s != NULL && s->reg >= 0) {
+		ctx->avoid |= 1u << hw_regs[s->reg];
+	}
+}
+
+// Generates the instruction at its position. Values computed where used, and values without
+// side effects which are never used, take no code.
+static void generate_at(struct xg_context *ctx, struct IRinstruction *x) {
+	struct X64operand dst = no_op();
+	if (IRliveness_is_value(x)) {
+		const struct IRsegment *s = IRoutssa_at(ctx->copies, x, ctx->pos + 1);
+		if (s != NULL && !s->remat) {
+			dst = (s->reg >= 0) ? reg_op(hw_regs[s->reg]) : mem_op(X64_RBP, slot_offset(ctx, s->slot));
+		}
+		bool dead = (s == NULL || ctx->lv->intervals[x->id].end <= ctx->pos + 1);
+		if ((s != NULL && s->remat) || (dead && !IRhas_side_effect(x->op))) {
+			return;
+		}
+	}
+	ctx->avoid = (dst.kind == X64O_REG) ? 1u << dst.reg : 0;
+	IRliveness_foreach_use(x, avoid_operand, ctx);
+	generate(ctx, x, dst);
+	give_back(ctx);
+}
+
+// Generates a block: its copies at the entry, its instructions with the moves before them and
+// the copies before the terminator, then the blocks of its split edges, followed by the block
+// of label _next_.
+static void generate_block(struct xg_context *ctx, struct IRblock *b, int next) {
+	struct IRblock *succ[2];
+	int n = IRblock_successors(b, succ), split[2], count = 0;
+	for (int i = 0; i < n; ++i) {
+		const struct IRedge_copies *e = IRoutssa_edge(ctx->copies, b, i);
+		if (e->place == IRC_SPLIT && e->count > 0) {
+			split[count++] = i;
+		}
+	}
+	ctx->next = (count > 0) ? target(ctx, b, split[0]) : next;
+	emit(ctx, X64_LABEL, 8, no_op(), label_op(b->id));
+	if (b->pre.length == 1) {
+		struct IRblock *pred = ((struct IRpredecessor*)b->pre.head)->b, *ps[2];
+		int pn = IRblock_successors(pred, ps);
+		for (int i = 0; i < pn; ++i) {
+			const struct IRedge_copies *e = IRoutssa_edge(ctx->copies, pred, i);
+			if (e->to == b && e->place == IRC_ENTRY) {
+				make_copies(ctx, e->begin, e->count);
+			}
+		}
+	}
+	for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+		struct IRinstruction *x = (void*)q;
+		ctx->pos = ctx->lv->pos[x->id];
+		make_copies(ctx, ctx->copies->move_begin[x->id], ctx->copies->move_count[x->id]);
+		if (q == b->ins.tail && n == 1) {
+			const struct IRedge_copies *e = IRoutssa_edge(ctx->copies, b, 0);
+			make_copies(ctx, e->begin, e->count);
+		}
+		if (!x->is_folded) {
+			generate_at(ctx, x);
+		}
+		ctx->busy = 0;
+	}
+	for (int i = 0; i < count; ++i) {
+		const struct IRedge_copies *e = IRoutssa_edge(ctx->copies, b, split[i]);
+		ctx->next = (i + 1 < count) ? target(ctx, b, split[i + 1]) : next;
+		emit(ctx, X64_LABEL, 8, no_op(), label_op(target(ctx, b, split[i])));
+		make_copies(ctx, e->begin, e->count);
+		if (!falls_into(ctx, e->to->id)) {
+			emit(ctx, X64_JMP, 8, label_op(e->to->id), no_op());
+		}
+	}
+}
+
+// Finds the parameters of the entry block whose argument register is written before they are
+// read, and saves those registers on the stack. With predecessors, the entry block may be run
+// again after every register is written.
+static void find_homes(struct xg_context *ctx, struct IRfunction *f, bool home[6]) {
+	struct IRblock *entry = (void*)f->bs.head;
+	unsigned written = (entry->pre.length > 0) ? ~0u : 0;
+	for (struct llist_node *q = entry->ins.head; q; q = q->nxt) {
+		struct IRinstruction *x = (void*)q;
+		int pos = ctx->lv->pos[x->id];
+		for (int i = 0; i < ctx->copies->move_count[x->id]; ++i) {
+			const struct IRcopy *c = &ctx->copies->copies[ctx->copies->move_begin[x->id] + i];
+			if (c->to >= 0 && c->to < ctx->ra->regs->count) {
+				written |= 1u << hw_regs[c->to];
+			}
+		}
+		if (x->op == IR_CALL) {
+			written = ~0u;
+		} else if (x->op == IR_PARAM) {
+			int k = x->param_index;
+			if (k < 6 && (written & (1u << arg_regs[k])) && IRoutssa_at(ctx->copies, x, pos + 1) != NULL) {
+				home[k] = true;
+			}
+		} else if (x->op != IR_IMM && x->op != IR_ALLOCA && x->op != IR_PHI) {
+			written |= (1u << X64_RAX) | (1u << X64_RCX) | (1u << X64_RDX);
+		}
+		const struct IRsegment *s = IRoutssa_at(ctx->copies, x, pos + 1);
+		if (s != NULL && s->reg >= 0) {
+			written |= 1u << hw_regs[s->reg];
+		}
+	}
+}
+
+// Lays out the frame and generates the prologue: saves the frame pointer, the callee-saved
+// registers allocated and the argument registers of the parameters read late.
+static void prologue(struct xg_context *ctx, struct IRfunction *f) {
+	const struct IRregalloc *ra = ctx->ra;
+	emit(ctx, X64_PUSH, 8, reg_op(X64_RBP), no_op());
+	emit(ctx, X64_MOV, 8, reg_op(X64_RSP), reg_op(X64_RBP));
+	for (int i = 0; i < ra->regs->count; ++i) {
+		if (ra->used & ~ra->regs->caller_saved & (1u << i)) {
+			emit(ctx, X64_PUSH, 8, reg_op(hw_regs[i]), no_op());
+			ctx->saved += 1;
+		}
+	}
+
+	int size = 8 * (ctx->saved + ra->slot_count);
+	bool home[6] = { false };
+	find_homes(ctx, f, home);
+	for (int k = 0; k < 6; ++k) {
+		if (home[k]) {
+			size += 8;
+			ctx->home[k] = -size;
+		}
+	}
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (x->op == IR_ALLOCA) {
+				int bytes = IRTypecode_size(x->slot_type) * x->slot_count;
+				size += (bytes <= 0) ? 8 : (bytes + 7) & ~7;
+				ctx->frame[x->id] = -size;
+			}
+		}
+	}
+	ctx->frame_size = size;
+	ctx->frame_at = ctx->out->length;
+	size = (size + 15) & ~15;
+	if (size > 8 * ctx->saved) {
+		emit(ctx, X64_SUB, 8, imm_op(size - 8 * ctx->saved), reg_op(X64_RSP));
+	}
+	for (int k = 0; k < 6; ++k) {
+		if (home[k]) {
+			emit(ctx, X64_MOV, 8, reg_op(arg_regs[k]), mem_op(X64_RBP, ctx->home[k]));
+		}
+	}
+}
+
+// Grows the frame allocated by the prologue by the slots of the registers borrowed.
+static void reserve_borrowed(struct xg_context *ctx) {
+	struct X64function *out = ctx->out;
+	int size = (ctx->frame_size + 8 * ctx->borrow_max + 15) & ~15;
+	struct X64ins *sub = &out->code[ctx->frame_at];
+	if (ctx->frame_at < out->length && sub->op == X64_SUB && sub->dst.kind == X64O_REG
+			&& sub->dst.reg == X64_RSP) {
+		sub->src.imm = size - 8 * ctx->saved;
+		return;
+	}
+	emit(ctx, X64_SUB, 8, imm_op(size - 8 * ctx->saved), reg_op(X64_RSP));
+	struct X64ins ins = out->code[out->length - 1];
+	memmove(&out->code[ctx->frame_at + 1], &out->code[ctx->frame_at],
+		(out->length - 1 - ctx->frame_at) * sizeof(struct X64ins));
+	out->code[ctx->frame_at] = ins;
+}
+
+// Generates the machine code of a function: selects its instructions, allocates registers
+// with the allocator of Oinfo and translates it out of SSA form. Identifiers are renumbered.
+void X64function_build(struct X64function *self, struct IRfunction *f, int index) {
+	struct X64isel isel;
+	struct IRliveness lv;
+	struct IRregalloc ra;
+	struct IRoutssa copies;
+	IRfunction_renumber(f);
+	X64isel_run(&isel, f);
+	IRliveness_build(&lv, f);
+	IRregalloc_run(&ra, f, &lv, Tinfo.regs);
+	IRoutssa_build(&copies, f, &ra);
+
+	*self = (struct X64function){ .f = f, .index = index, .labels = lv.nb + copies.edge_count };
+	struct xg_context ctx = {
+		.out = self,
+		.isel = &isel,
+		.lv = &lv,
+		.ra = &ra,
+		.copies = &copies,
+		.frame = try_calloc(lv.n + 1, sizeof(int), __FUNCTION__),
+	};
+	prologue(&ctx, f);
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		generate_block(&ctx, (void*)p, p->nxt ? ((struct IRblock*)p->nxt)->id : -1);
+	}
+	if (ctx.borrow_max > 0) {
+		reserve_borrowed(&ctx);
+	}
+
+	free(ctx.frame);
+	IRoutssa_free(&copies);
+	IRregalloc_free(&ra);
+	IRliveness_free(&lv);
+	X64isel_free(&isel);
+}
+
+// Frees the machine code.
+void X64function_free(struct X64function *self) {
+	free(self->code);
+}
@@ -0,0 +1,494 @@
+// Instruction selection for x86-64 by tree pattern matching and dynamic programming (Aho,
+// Ganapathi and Tjiang, "Code Generation Using Tree Matching and Dynamic Programming").
+// A value used once, by an instruction of the same block, is an inner node of the tree of its
+// user; other values are the roots of trees of their own, computed into registers. Bottom up,
+// each node gets the least cost at which it is available as each nonterminal: in a register,
+// as an address, as a memory operand, or as the flags set by a comparison. Top down from the
+// roots, the patterns of least cost are chosen, and the nodes they cover are folded into their
+// root. Costs count machine instructions.
+// Addresses take constant displacements, indices scaled by shifts and stack slots; loads fold
+// into the arithmetic and comparisons reading them, and comparisons into the branch, select or
+// zero extension using them. A folded instruction computes no value: its operands are read by
+// its root instead, see IRliveness_foreach_use(), so that selection comes before register
+// allocation.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+#include "x86_64.h"
+
+// Cost of a pattern which does not match.
+#define XI_NONE (1 << 24)
+
+// Ways an operand of an addition is part of its address.
+enum {
+	XI_PLAIN,	// value as base or index, stack slot, or displacement
+	XI_ADDR,	// addition folded with its own address
+	XI_SHIFT,	// shift folded as a scaled index
+};
+
+// Address computed by an addition, with the way each of its operands is part of it.
+struct xi_addr {
+	struct X64addr a;
+	int cost;		// XI_NONE if the addition is not an address
+	int fold[2];		// XI_* of the left and right operands
+};
+
+// Part of an address.
+struct xi_part {
+	struct X64addr a;
+	int cost;
+	int fold;		// one of XI_*
+};
+
+// Working state of the selection.
+struct xi_context {
+	struct X64isel *out;
+	int *uses;		// number of uses of each value, indexed by instruction id
+	int *effects;		// number of stores and calls before each instruction in its block
+	int *reg;		// least cost of each value computed into a register
+	int *rule;		// rule of that cost, X64R_*
+	struct xi_addr *addr;	// least cost address of each addition
+};
+
+// Returns whether the operand is a constant fitting in a sign extended 32 bits immediate.
+static bool is_imm32(const struct IRinstruction *v) {
+	if (v->op != IR_IMM) {
+		return (false);
+	}
+	if (v->type == IRT_UNDEF || v->type == IRT_VOID) {
+		return (true);
+	}
+	int64_t c = IRimm_value(v);
+	return (c >= INT32_MIN && c <= INT32_MAX);
+}
+
+// Returns whether values of the type take 64 bits.
+static bool is_wide(int type) {
+	return (type == IRT_I64 || type == IRT_PTR);
+}
+
+// Returns whether the operand may be folded into its user: the user is its only one, in the
+// same block, and a load or comparison does not move across a store or call.
+static bool foldable(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	if (!IRliveness_is_value(v) || v->owner != user->owner || ctx->uses[v->id] != 1) {
+		return (false);
+	}
+	if (user->op == IR_PHI || user->op == IR_CALL || user->op == IR_RET) {
+		return (false);
+	}
+	if (v->op == IR_LOAD || IRis_cmp(v->op)) {
+		return (ctx->effects[v->id] == ctx->effects[user->id]);
+	}
+	return (v->op == IR_ADD || v->op == IR_SHL);
+}
+
+// Returns whether the comparison marked by IRopt_fuse_cmp() is still fused: its only user is the
+// branch right after it. Later passes may have given it other users or moved it.
+static bool still_fused(struct xi_context *ctx, struct IRinstruction *x) {
+	struct IRinstruction *t = (struct IRinstruction*)x->n.nxt;
+	return (ctx->uses[x->id] == 1 && t != NULL && t->op == IR_BR && t->cond == x);
+}
+
+// Returns the cost of the operand in a register. A root is computed anyway.
+static int in_reg(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	if (v->op == IR_IMM || v->op == IR_ALLOCA) {
+		return (1);
+	}
+	return (foldable(ctx, v, user) ? ctx->reg[v->id] : 0);
+}
+
+// Returns the cost of the operand as an immediate or in a register.
+static int in_reg_imm(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	return (is_imm32(v) ? 0 : in_reg(ctx, v, user));
+}
+
+// Returns the cost of the operand as an address.
+static int in_addr(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	if (v->op == IR_ALLOCA) {
+		return (0);
+	}
+	int cost = in_reg(ctx, v, user);
+	if (v->op == IR_ADD && foldable(ctx, v, user) && ctx->addr[v->id].cost < cost) {
+		cost = ctx->addr[v->id].cost;
+	}
+	return (cost);
+}
+
+// Returns the cost of the operand as a memory operand: a load folded into its user. Bools take a
+// byte in memory, and are zero extended by their load.
+static int in_mem(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	if (v->op != IR_LOAD || v->type == IRT_I1 || !foldable(ctx, v, user)) {
+		return (XI_NONE);
+	}
+	return (in_addr(ctx, v->left, v));
+}
+
+// Returns whether the operands of the instruction may be swapped by the code generator.
+static bool swaps(const struct IRinstruction *x) {
+	return (IRis_commutative(x->op) || IRis_cmp(x->op));
+}
+
+// Returns the cost of a binary operation with both operands in registers, or the right one as
+// an immediate. A constant on the left is swapped to the right where possible.
+static int reg_cost(struct xi_context *ctx, struct IRinstruction *x) {
+	if (swaps(x) && is_imm32(x->left) && !is_imm32(x->right)) {
+		return (1 + in_reg(ctx, x->right, x));
+	}
+	return (1 + in_reg(ctx, x->left, x) + in_reg_imm(ctx, x->right, x));
+}
+
+// Returns which operand of a binary operation is best read from memory: 1 for the right one,
+// 0 for the left one, -1 for none. Its cost goes into _cost_.
+static int mem_side(struct xi_context *ctx, struct IRinstruction *x, int *cost) {
+	int side = -1;
+	*cost = XI_NONE;
+	int right = 1 + in_reg(ctx, x->left, x) + in_mem(ctx, x->right, x);
+	if (right < XI_NONE) {
+		side = 1;
+		*cost = right;
+	}
+	if (swaps(x)) {
+		int left = 1 + in_reg(ctx, x->right, x) + in_mem(ctx, x->left, x);
+		if (left < *cost) {
+			side = 0;
+			*cost = left;
+		}
+	}
+	return (side);
+}
+
+// Returns the cost of the operand as the flags of a comparison folded into its user.
+static int in_cc(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	if (!IRis_cmp(v->op) || !foldable(ctx, v, user)) {
+		return (XI_NONE);
+	}
+	int mem, reg = reg_cost(ctx, v);
+	mem_side(ctx, v, &mem);
+	return ((mem < reg) ? mem : reg);
+}
+
+// Fills the ways the operand of the addition is part of its address. Returns their number.
+static int parts(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *x,
+				struct xi_part res[2]) {
+	if (v->op == IR_IMM) {
+		if (!is_imm32(v)) {
+			return (0);
+		}
+		int64_t c = (v->type == IRT_UNDEF || v->type == IRT_VOID) ? 0 : IRimm_value(v);
+		res[0] = (struct xi_part){ .a = { .scale = 1, .disp = c }, .cost = 0, .fold = XI_PLAIN };
+		return (1);
+	}
+	if (v->op == IR_ALLOCA) {
+		res[0] = (struct xi_part){ .a = { .base = v, .scale = 1 }, .cost = 0, .fold = XI_PLAIN };
+		return (1);
+	}
+	int n = 0;
+	res[n++] = (struct xi_part){ .a = { .base = v, .scale = 1 }, .cost = in_reg(ctx, v, x), .fold = XI_PLAIN };
+	if (is_wide(v->type) != is_wide(x->type) || !foldable(ctx, v, x)) {
+		return (n);
+	}
+	if (v->op == IR_ADD && ctx->addr[v->id].cost < XI_NONE) {
+		res[n++] = (struct xi_part){ .a = ctx->addr[v->id].a, .cost = ctx->addr[v->id].cost, .fold = XI_ADDR };
+	} else if (v->op == IR_SHL && is_imm32(v->right) && IRliveness_is_value(v->left)) {
+		int64_t k = IRimm_value(v->right);
+		if (k >= 0 && k <= 3) {
+			res[n++] = (struct xi_part){
+				.a = { .index = v->left, .scale = 1 << k },
+				.cost = in_reg(ctx, v->left, v),
+				.fold = XI_SHIFT,
+			};
+		}
+	}
+	return (n);
+}
+
+// Adds the address _b_ to _a_. Returns false if the sum is not an x86 address: a base, which
+// may be a stack slot, and an index, any of which may be missing, plus a displacement.
+static bool combine(struct X64addr *a, const struct X64addr *b) {
+	int64_t disp = a->disp + b->disp;
+	if (disp < INT32_MIN || disp > INT32_MAX) {
+		return (false);
+	}
+	struct IRinstruction *base[4], *index[4];
+	int scale[4], nb = 0, ni = 0;
+	const struct X64addr *both[2] = { a, b };
+	for (int i = 0; i < 2; ++i) {
+		if (both[i]->base != NULL) {
+			base[nb++] = both[i]->base;
+		}
+		if (both[i]->index != NULL) {
+			scale[ni] = both[i]->scale;
+			index[ni++] = both[i]->index;
+		}
+	}
+	if (nb + ni > 2 || nb + ni == 0) {
+		return (false);
+	}
+	if (ni == 2) {
+		// One of two indices may be the base, if it is not scaled.
+		if (scale[0] != 1 && scale[1] != 1) {
+			return (false);
+		}
+		int i = (scale[0] == 1) ? 0 : 1;
+		base[nb++] = index[i];
+		index[0] = index[1 - i];
+		scale[0] = scale[1 - i];
+		ni = 1;
+	} else if (nb == 2) {
+		// Stack slots are addressed from the frame pointer, a base.
+		if (base[0]->op == IR_ALLOCA && base[1]->op == IR_ALLOCA) {
+			return (false);
+		}
+		int i = (base[1]->op == IR_ALLOCA) ? 1 : 0;
+		index[0] = base[1 - i];
+		scale[0] = 1;
+		base[0] = base[i];
+		nb = ni = 1;
+	}
+	*a = (struct X64addr){
+		.base = (nb > 0) ? base[0] : NULL,
+		.index = (ni > 0) ? index[0] : NULL,
+		.scale = (ni > 0) ? scale[0] : 1,
+		.disp = disp,
+	};
+	return (true);
+}
+
+// Computes the address of least cost of an addition.
+static void address(struct xi_context *ctx, struct IRinstruction *x) {
+	struct xi_addr *best = &ctx->addr[x->id];
+	struct xi_part l[2], r[2];
+	int nl = parts(ctx, x->left, x, l), nr = parts(ctx, x->right, x, r);
+	best->cost = XI_NONE;
+	for (int i = 0; i < nl; ++i) {
+		for (int j = 0; j < nr; ++j) {
+			struct X64addr a = l[i].a;
+			int cost = l[i].cost + r[j].cost;
+			if (cost < best->cost && combine(&a, &r[j].a)) {
+				*best = (struct xi_addr){ .a = a, .cost = cost, .fold = { l[i].fold, r[j].fold } };
+			}
+		}
+	}
+}
+
+// Computes the least cost of the instruction in a register, and its rule.
+static void label(struct xi_context *ctx, struct IRinstruction *x) {
+	int cost = 1, rule = X64R_REG, c;
+	switch (x->op) {
+		case IR_ADD: case IR_SUB: case IR_MUL: case IR_AND: case IR_OR: case IR_XOR:
+		case IR_CMP_EQ: case IR_CMP_NE: case IR_CMP_LT: case IR_CMP_LE: case IR_CMP_GT:
+		case IR_CMP_GE: case IR_CMP_ULT: case IR_CMP_ULE: case IR_CMP_UGT: case IR_CMP_UGE: {
+			cost = reg_cost(ctx, x);
+			if (mem_side(ctx, x, &c) >= 0 && c < cost) {
+				cost = c;
+				rule = X64R_MEM;
+			}
+			if (x->op == IR_ADD) {
+				address(ctx, x);
+				if (1 + ctx->addr[x->id].cost < cost) {
+					cost = 1 + ctx->addr[x->id].cost;
+					rule = X64R_LEA;
+				}
+			}
+			if (IRis_cmp(x->op) && !x->is_fused) {
+				cost += 2;	// setcc and zero extension
+			}
+		}	break;
+
+		case IR_SHL: case IR_LSHR: case IR_ASHR: {
+			cost = 1 + in_reg(ctx, x->left, x) + (is_imm32(x->right) ? 0 : 2 + in_reg(ctx, x->right, x));
+		}	break;
+
+		case IR_SDIV: case IR_UDIV: case IR_SREM: case IR_UREM: case IR_SMULH: case IR_UMULH: {
+			cost = 6 + in_reg(ctx, x->left, x) + in_reg(ctx, x->right, x);
+		}	break;
+
+		case IR_NEG: case IR_NOT: case IR_SEXT: case IR_TRUNC: {
+			cost = 1 + in_reg(ctx, x->left, x);
+		}	break;
+
+		case IR_ZEXT: {
+			cost = 1 + in_reg(ctx, x->left, x);
+			c = 2 + in_cc(ctx, x->left, x);
+			if (c < cost) {
+				cost = c;
+				rule = X64R_CC;
+			}
+		}	break;
+
+		case IR_SELECT: {
+			cost = 2 + in_reg_imm(ctx, x->vt, x) + in_reg_imm(ctx, x->vf, x);
+			c = in_cc(ctx, x->cond, x);
+			if (c < 1 + in_reg(ctx, x->cond, x)) {
+				cost += c;
+				rule = X64R_CC;
+			} else {
+				cost += 1 + in_reg(ctx, x->cond, x);
+			}
+		}	break;
+
+		case IR_LOAD: {
+			cost = 1 + in_addr(ctx, x->left, x);
+		}	break;
+
+		case IR_STORE: {
+			cost = 1 + in_addr(ctx, x->left, x) + in_reg_imm(ctx, x->right, x);
+		}	break;
+
+		case IR_BR: {
+			if (!x->cond->is_fused && in_cc(ctx, x->cond, x) < 1 + in_reg(ctx, x->cond, x)) {
+				rule = X64R_CC;
+			}
+		}	break;
+
+		case IR_IMM: case IR_ALLOCA: {
+			cost = 0;
+			rule = X64R_NONE;
+		}	break;
+	}
+	ctx->reg[x->id] = cost;
+	ctx->rule[x->id] = rule;
+}
+
+// Folds the operands of the addition which are part of its address.
+static void fold_parts(struct xi_context *ctx, struct IRinstruction *x) {
+	struct IRinstruction *ops[2] = { x->left, x->right };
+	for (int i = 0; i < 2; ++i) {
+		if (ctx->addr[x->id].fold[i] != XI_PLAIN) {
+			ops[i]->is_folded = true;
+			if (ctx->addr[x->id].fold[i] == XI_ADDR) {
+				fold_parts(ctx, ops[i]);
+			}
+		}
+	}
+}
+
+// Returns the address of an operand of the user, folding it if that is cheaper.
+static struct X64addr fold_addr(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *user) {
+	if (v->op == IR_ADD && foldable(ctx, v, user) && ctx->addr[v->id].cost < in_reg(ctx, v, user)) {
+		v->is_folded = true;
+		fold_parts(ctx, v);
+		return (ctx->addr[v->id].a);
+	}
+	return ((struct X64addr){ .base = v, .scale = 1 });
+}
+
+// Folds the load into the root, which reads it as its memory operand.
+static void fold_load(struct xi_context *ctx, struct IRinstruction *v, struct IRinstruction *root) {
+	v->is_folded = true;
+	ctx->out->addr[root->id] = fold_addr(ctx, v->left, v);
+}
+
+// Folds the memory operand of a binary operation of rule X64R_MEM into the root.
+static void fold_mem_side(struct xi_context *ctx, struct IRinstruction *x, struct IRinstruction *root) {
+	int cost;
+	fold_load(ctx, (mem_side(ctx, x, &cost) == 1) ? x->right : x->left, root);
+}
+
+// Applies the rule of a root, folding the instructions covered by its pattern.
+static void reduce(struct xi_context *ctx, struct IRinstruction *x) {
+	int rule = ctx->rule[x->id];
+	ctx->out->rule[x->id] = rule;
+	switch (rule) {
+		case X64R_MEM: {
+			fold_mem_side(ctx, x, x);
+		}	break;
+
+		case X64R_LEA: {
+			ctx->out->addr[x->id] = ctx->addr[x->id].a;
+			fold_parts(ctx, x);
+		}	break;
+
+		case X64R_CC: {
+			struct IRinstruction *c = (x->op == IR_ZEXT) ? x->left : x->cond;
+			c->is_folded = true;
+			int mem;
+			if (mem_side(ctx, c, &mem) >= 0 && mem < reg_cost(ctx, c)) {
+				fold_mem_side(ctx, c, x);
+			}
+		}	break;
+
+		case X64R_REG: {
+			if (x->op == IR_LOAD || x->op == IR_STORE) {
+				ctx->out->addr[x->id] = fold_addr(ctx, x->left, x);
+			}
+		}	break;
+	}
+}
+
+// Operand callback of X64isel_run(): counts a use of the operand.
+static void count_use(struct IRinstruction **slot, void *arg) {
+	((int*)arg)[(*slot)->id] += 1;
+}
+
+// Selects the machine instructions of a function, covering the trees of each block with
+// patterns of least cost, and marks the instructions folded into their user.
+void X64isel_run(struct X64isel *self, struct IRfunction *f) {
+	int n = 0;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			x->is_folded = false;
+			n = (x->id + 1 > n) ? x->id + 1 : n;
+		}
+	}
+	self->n = n;
+	self->rule = try_calloc(n + 1, sizeof(int), __FUNCTION__);
+	self->addr = try_calloc(n + 1, sizeof(struct X64addr), __FUNCTION__);
+	struct xi_context ctx = {
+		.out = self,
+		.uses = try_calloc(n + 1, sizeof(int), __FUNCTION__),
+		.effects = try_calloc(n + 1, sizeof(int), __FUNCTION__),
+		.reg = try_calloc(n + 1, sizeof(int), __FUNCTION__),
+		.rule = try_calloc(n + 1, sizeof(int), __FUNCTION__),
+		.addr = try_calloc(n + 1, sizeof(struct xi_addr), __FUNCTION__),
+	};
+
+	struct array ins;
+	array_init(&ins);
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		int effects = 0;
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			IRinstruction_foreach_operand(x, count_use, ctx.uses);
+			ctx.effects[x->id] = effects;
+			effects += (x->op == IR_STORE || x->op == IR_CALL);
+		}
+	}
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			x->is_fused = x->is_fused && still_fused(&ctx, x);
+		}
+	}
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		ins.length = 0;
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			label(&ctx, (void*)q);
+			array_pushback(&ins, q);
+		}
+		for (int i = ins.length - 1; i >= 0; --i) {
+			struct IRinstruction *x = ins.begin[i];
+			if (!x->is_folded) {
+				reduce(&ctx, x);
+			}
+		}
+	}
+	array_free(&ins);
+
+	free(ctx.uses);
+	free(ctx.effects);
+	free(ctx.reg);
+	free(ctx.rule);
+	free(ctx.addr);
+}
+
+// Frees the selection.
+void X64isel_free(struct X64isel *self) {
+	free(self->rule);
+	free(self->addr);
+}
@@ -0,0 +1,94 @@
+// Running of x86-64 machine code from memory, without assembler or linker. Executable memory
+// comes from POSIX mmap, so the run format works on x86-64 hosts with it, and fails elsewhere.
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define ACC_JIT 1
+#define _DEFAULT_SOURCE		// MAP_ANONYMOUS of glibc
+#include <sys/mman.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "acir.h"
+#include "x86_64.h"
+
+// Returns the type of the values returned by the function, IRT_VOID if none.
+static int return_type(struct IRfunction *f) {
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRinstruction *t = (struct IRinstruction*)((struct IRblock*)p)->ins.tail;
+		if (t && t->op == IR_RET && t->left && t->left->type != IRT_UNDEF
+				&& t->left->type != IRT_VOID) {
+			return (t->left->type);
+		}
+	}
+	return (IRT_VOID);
+}
+
+// Compiles every function of the translation unit into executable memory, calls main without
+// arguments and outputs the value it returns. Calls are resolved in place, as displacements to
+// the functions called; the memory is writable then executable, never both.
+void IRunit_run(struct IRunit *self, FILE *Outfile) {
+	struct IRfunction *entry = NULL;
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		if (strequal(((struct IRfunction*)p)->name, "main")) {
+			entry = (struct IRfunction*)p;
+		}
+	}
+	if (entry == NULL) {
+		fail_run("no function main");
+	}
+	if (entry->param_count != 0) {
+		fail_run("main takes parameters");
+	}
+	int type = return_type(entry);
+
+	struct X64code code;
+	X64code_init(&code);
+	int *value = try_malloc((self->funcs.length + 1) * sizeof(int), __FUNCTION__);
+	int index = 0;
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		struct X64function mf;
+		X64function_build(&mf, (struct IRfunction*)p, index);
+		value[index++] = X64code_encode(&code, &mf);
+		X64function_free(&mf);
+	}
+	for (int i = 0; i < code.reloc_count; ++i) {
+		const struct X64reloc *r = &code.relocs[i];
+		uint32_t disp = (uint32_t)(value[r->func->id] - (r->offset + 4));
+		for (int k = 0; k < 4; ++k) {
+			code.text[r->offset + k] = (uint8_t)(disp >> (8 * k));
+		}
+	}
+
+#ifdef ACC_JIT
+	size_t length = (size_t)code.length;
+	void *text = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (text == MAP_FAILED) {
+		fail_run("unable to map memory");
+	}
+	memcpy(text, code.text, length);
+	if (mprotect(text, length, PROT_READ | PROT_EXEC) != 0) {
+		fail_run("unable to make memory executable");
+	}
+	int64_t (*main_func)(void);
+	void *address = (char*)text + value[entry->id];
+	memcpy(&main_func, &address, sizeof(main_func));
+	int64_t ret = main_func();
+	munmap(text, length);
+
+	switch (type) {
+		case IRT_VOID:	break;
+		case IRT_I1:	fprintf(Outfile, "%d\n", (int)(ret & 1));		break;
+		case IRT_I32:	fprintf(Outfile, "%d\n", (int)(int32_t)ret);		break;
+		default:	fprintf(Outfile, "%lld\n", (long long)ret);	break;
+	}
+#else
+	(void)type;
+	fail_run("no executable memory on this host");
+#endif
+	free(value);
+	X64code_free(&code);
+}
@@ -32,7 +32,7 @@ void fail_malloc(const char *func_name) {
 
 void fail_ir_op(int op, const char *func_name) {
 	if (op < IR_NULL) {
-		fprintf(stderr, "%s: unsupported IR operator %s.\n", func_name, ast_opname[op]);
+		fprintf(stderr, "%s: unsupported IR operator %s.\n", func_name, IRopcode_stringify(op));
 	} else {
 		fprintf(stderr, "%s: unknown IR operator %d.\n", func_name, op);
 	}
@@ -64,3 +64,7 @@ void fail_char(int line, int c) {
 	exit(1);
 }
 
+void fail_run(const char *reason) {
+	fprintf(stderr, "unable to run: %s.\n", reason);
+	exit(1);
+}
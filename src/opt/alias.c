@@ -0,0 +1,110 @@
+// Alias analysis of stack memory.
+// An address is decomposed into a root pointer, which is a stack slot or any pointer value
+// not computed by an addition, plus a variable offset and a constant offset. Accesses through
+// distinct slots never overlap, nor do a slot whose address does not escape and any other root.
+// Accesses from the same root and the same variable offset overlap when their constant byte
+// ranges do. Under the strict aliasing rules of C, values of different types never overlap.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "acir.h"
+#include "opt.h"
+
+// Marks the slot as escaping if an address derived from it is used by anything else than
+// an access through it or another offset computation.
+static void mark_escape(struct IRalias *self, struct IRuses *uses, struct IRinstruction *a,
+			struct IRinstruction *addr) {
+	struct array *users = IRuses_get(uses, addr);
+	for (int i = 0; i < users->length && !self->escaped[a->id]; ++i) {
+		struct IRinstruction *u = users->begin[i];
+		if (u->op == IR_LOAD || (u->op == IR_STORE && u->left == addr && u->right != addr)) {
+			continue;
+		}
+		if (u->op == IR_ADD && u->type == IRT_PTR && u->left == addr) {
+			mark_escape(self, uses, a, u);
+			continue;
+		}
+		self->escaped[a->id] = true;
+	}
+}
+
+// Builds the alias analysis of a function.
+void IRalias_build(struct IRalias *self, struct IRfunction *f) {
+	self->n = f->ins_count;
+	self->escaped = try_calloc(self->n, sizeof(bool), __FUNCTION__);
+
+	struct IRuses uses;
+	IRuses_build(&uses, f);
+	for (struct llist_node *p = ((struct IRblock*)f->bs.head)->ins.head; p; p = p->nxt) {
+		struct IRinstruction *x = (void*)p;
+		if (x->op == IR_ALLOCA) {
+			mark_escape(self, &uses, x, x);
+		}
+	}
+	IRuses_free(&uses);
+}
+
+// Returns whether the address of the stack slot may be known outside of the accesses through it.
+// Values which are not slots, and slots created after the analysis, are considered escaping.
+bool IRalias_escapes(const struct IRalias *self, struct IRinstruction *x) {
+	return (x->op != IR_ALLOCA || x->id >= self->n || self->escaped[x->id]);
+}
+
+// Frees the alias analysis.
+void IRalias_free(struct IRalias *self) {
+	free(self->escaped);
+}
+
+// Computes the location accessed by a load or a store.
+void IRmemloc_of(struct IRmemloc *self, struct IRinstruction *access) {
+	struct IRinstruction *addr = access->left;
+	self->type = (access->op == IR_LOAD) ? access->type : access->right->type;
+	self->size = IRTypecode_size(self->type);
+	self->var = NULL;
+	self->offset = 0;
+
+	// Offsets are added to the left operand, the root being at the bottom of the chain.
+	while (addr->op == IR_ADD && addr->type == IRT_PTR) {
+		if (addr->right->op == IR_IMM && IRTypecode_is_int(addr->right->type)) {
+			self->offset += IRimm_value(addr->right);
+		} else if (self->var == NULL) {
+			self->var = addr->right;
+		} else {
+			break;
+		}
+		addr = addr->left;
+	}
+	self->root = addr;
+}
+
+// Returns whether two locations are the same one.
+bool IRmemloc_eq(const struct IRmemloc *a, const struct IRmemloc *b) {
+	return (a->root == b->root && a->var == b->var && a->offset == b->offset && a->type == b->type);
+}
+
+// Returns how two memory locations may overlap: IR_NO_ALIAS, IR_MAY_ALIAS or IR_MUST_ALIAS.
+// Must-aliasing locations also have the same type.
+int IRalias_query(const struct IRalias *self, const struct IRmemloc *a, const struct IRmemloc *b) {
+	if (Oinfo.strict_aliasing && a->type != b->type) {
+		return (IR_NO_ALIAS);
+	}
+
+	if (a->root != b->root) {
+		bool distinct_slots = a->root->op == IR_ALLOCA && b->root->op == IR_ALLOCA;
+		if (distinct_slots || !IRalias_escapes(self, a->root) || !IRalias_escapes(self, b->root)) {
+			return (IR_NO_ALIAS);
+		}
+		return (IR_MAY_ALIAS);
+	}
+
+	if (a->var != b->var) {
+		return (IR_MAY_ALIAS);
+	}
+	if (a->offset + a->size <= b->offset || b->offset + b->size <= a->offset) {
+		return (IR_NO_ALIAS);
+	}
+	if (a->offset == b->offset && a->type == b->type) {
+		return (IR_MUST_ALIAS);
+	}
+	return (IR_MAY_ALIAS);
+}
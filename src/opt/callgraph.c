@@ -0,0 +1,113 @@
+// Call graph of a translation unit.
+// Functions calling each other, directly or through a cycle of calls, form a strongly
+// connected component. The components are found by Tarjan's algorithm, which completes
+// every component after the components it calls into: listing the functions in that
+// order visits callees before their callers, the cycles excepted.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "acir.h"
+#include "opt.h"
+
+// Working state of Tarjan's algorithm.
+struct cg_tarjan {
+	struct IRcallgraph *g;
+	int *index, *low;		// visiting order and lowest index reachable, indexed by function id
+	bool *on_stack;			// whether a function is on the stack, indexed by function id
+	struct array stack;		// functions of the components being discovered
+	int visited, sccs, ordered;
+};
+
+// Visits the functions reachable from _f_, completing their components.
+static void strongconnect(struct cg_tarjan *t, struct IRfunction *f) {
+	t->index[f->id] = t->low[f->id] = ++t->visited;
+	t->on_stack[f->id] = true;
+	array_pushback(&t->stack, f);
+
+	struct array *callees = &t->g->callees[f->id];
+	for (int i = 0; i < callees->length; ++i) {
+		struct IRfunction *c = callees->begin[i];
+		if (t->index[c->id] == 0) {
+			strongconnect(t, c);
+			if (t->low[c->id] < t->low[f->id]) {
+				t->low[f->id] = t->low[c->id];
+			}
+		} else if (t->on_stack[c->id] && t->index[c->id] < t->low[f->id]) {
+			t->low[f->id] = t->index[c->id];
+		}
+	}
+
+	if (t->low[f->id] == t->index[f->id]) {
+		struct IRfunction *x;
+		do {
+			x = array_popback(&t->stack);
+			t->on_stack[x->id] = false;
+			t->g->scc[x->id] = t->sccs;
+			t->g->order[t->ordered++] = x;
+		} while (x != f);
+		++t->sccs;
+	}
+}
+
+// Builds the call graph of a translation unit.
+void IRcallgraph_build(struct IRcallgraph *self, struct IRunit *unit) {
+	int n = self->n = unit->funcs.length;
+	self->funcs = try_malloc((n + 1) * sizeof(struct IRfunction*), __FUNCTION__);
+	self->callees = try_malloc((n + 1) * sizeof(struct array), __FUNCTION__);
+	self->scc = try_malloc((n + 1) * sizeof(int), __FUNCTION__);
+	self->order = try_malloc((n + 1) * sizeof(struct IRfunction*), __FUNCTION__);
+
+	bool *seen = try_calloc(n + 1, sizeof(bool), __FUNCTION__);
+	for (struct llist_node *p = unit->funcs.head; p; p = p->nxt) {
+		struct IRfunction *f = (void*)p;
+		self->funcs[f->id] = f;
+		array_init(&self->callees[f->id]);
+		for (struct llist_node *q = f->bs.head; q; q = q->nxt) {
+			for (struct llist_node *r = ((struct IRblock*)q)->ins.head; r; r = r->nxt) {
+				struct IRinstruction *x = (void*)r;
+				if (x->op == IR_CALL && !seen[x->callee->id]) {
+					seen[x->callee->id] = true;
+					array_pushback(&self->callees[f->id], x->callee);
+				}
+			}
+		}
+		struct array *callees = &self->callees[f->id];
+		for (int i = 0; i < callees->length; ++i) {
+			seen[((struct IRfunction*)callees->begin[i])->id] = false;
+		}
+	}
+	free(seen);
+
+	struct cg_tarjan t = { .g = self };
+	t.index = try_calloc(n + 1, sizeof(int), __FUNCTION__);
+	t.low = try_malloc((n + 1) * sizeof(int), __FUNCTION__);
+	t.on_stack = try_calloc(n + 1, sizeof(bool), __FUNCTION__);
+	array_init(&t.stack);
+	for (int i = 0; i < n; ++i) {
+		if (t.index[i] == 0) {
+			strongconnect(&t, self->funcs[i]);
+		}
+	}
+	free(t.index);
+	free(t.low);
+	free(t.on_stack);
+	array_free(&t.stack);
+}
+
+// Returns whether _a_ and _b_ are in the same strongly connected component: each of them
+// may end up calling the other, or they are the same function.
+bool IRcallgraph_same_scc(const struct IRcallgraph *self, struct IRfunction *a, struct IRfunction *b) {
+	return (self->scc[a->id] == self->scc[b->id]);
+}
+
+// Frees the call graph.
+void IRcallgraph_free(struct IRcallgraph *self) {
+	for (int i = 0; i < self->n; ++i) {
+		array_free(&self->callees[i]);
+	}
+	free(self->funcs);
+	free(self->callees);
+	free(self->scc);
+	free(self->order);
+}
@@ -0,0 +1,434 @@
+// Aggressive dead code elimination and CFG simplification.
+// Liveness of instructions is computed by marking from side-effecting roots,
+// so dead cycles (e.g. phis only feeding each other) are removed as well.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/linklist.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Working state of the pass.
+struct dce_context {
+	struct IRfunction *f;
+	int nb;				// upper bound of block identifiers, fixed during the pass
+	struct IRinstruction **repl;	// pending replacements, indexed by instruction id
+	struct linklist garbage;	// removed instructions, freed after replacements are applied
+};
+
+// Returns whether the block does nothing but jumping to another block.
+static bool is_forwarder(struct IRblock *b) {
+	struct IRinstruction *t = IRblock_terminator(b);
+	return (b->ins.length == 1 && t->op == IR_JMP && t->bt != b);
+}
+
+// Changes the first edge from _p_ to _from_ to point to _to_.
+// Predecessor lists are left for the caller to update.
+static void redirect_edge(struct IRblock *p, struct IRblock *from, struct IRblock *to) {
+	struct IRinstruction *t = IRblock_terminator(p);
+	if (t->bt == from) {
+		t->bt = to;
+	} else if (t->op == IR_BR && t->bf == from) {
+		t->bf = to;
+	} else {
+		fail_unreachable(__FUNCTION__);
+	}
+}
+
+// Turns the terminate of _b_ into an unconditional jump to _target_.
+// The other edge of a conditional jump is removed from the CFG.
+static void br_to_jmp(struct IRblock *b, struct IRblock *target) {
+	struct IRinstruction *t = IRblock_terminator(b);
+	struct IRblock *other = (t->bt == target) ? t->bf : t->bt;
+
+	IRblock_remove_pre(other, b);
+	t->op = IR_JMP;
+	t->cond = NULL;
+	t->bt = target;
+	t->bf = NULL;
+}
+
+// Removes the blocks which can not be reached from the function entry.
+static bool remove_unreachable(struct dce_context *ctx) {
+	struct IRfunction *f = ctx->f;
+	int n = ctx->nb;
+	bool *reach = try_calloc(n, sizeof(bool), __FUNCTION__);
+	struct IRblock **stack = try_malloc(n * sizeof(struct IRblock*), __FUNCTION__);
+
+	int top = 0;
+	struct IRblock *entry = (void*)f->bs.head;
+	reach[entry->id] = true;
+	stack[top++] = entry;
+	while (top > 0) {
+		struct IRblock *b = stack[--top], *succ[2];
+		int sn = IRblock_successors(b, succ);
+		for (int i = 0; i < sn; ++i) {
+			if (!reach[succ[i]->id]) {
+				reach[succ[i]->id] = true;
+				stack[top++] = succ[i];
+			}
+		}
+	}
+	free(stack);
+
+	// Detach unreachable blocks from reachable ones before freeing anything.
+	bool changed = false;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p, *succ[2];
+		if (reach[b->id]) {
+			continue;
+		}
+
+		changed = true;
+		int sn = IRblock_successors(b, succ);
+		for (int i = 0; i < sn; ++i) {
+			if (reach[succ[i]->id]) {
+				IRblock_remove_pre(succ[i], b);
+			}
+		}
+	}
+
+	if (changed) {
+		struct llist_node *p = f->bs.head, *nxt;
+		llist_init(&f->bs);
+		while (p) {
+			nxt = p->nxt;
+			if (reach[((struct IRblock*)p)->id]) {
+				llist_pushback(&f->bs, p);
+			} else {
+				IRblock_free((void*)p);
+			}
+			p = nxt;
+		}
+	}
+
+	free(reach);
+	return (changed);
+}
+
+// Folds conditional jumps on constants and conditional jumps whose targets are the same.
+static bool fold_branches(struct dce_context *ctx) {
+	bool changed = false;
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		struct IRinstruction *t = IRblock_terminator(b);
+		if (t == NULL || t->op != IR_BR) {
+			continue;
+		}
+
+		if (t->bt == t->bf) {
+			br_to_jmp(b, t->bt);
+			changed = true;
+		} else if (t->cond->op == IR_IMM && t->cond->type == IRT_I1) {
+			br_to_jmp(b, t->cond->val_i1 ? t->bt : t->bf);
+			changed = true;
+		}
+	}
+	return (changed);
+}
+
+// Returns whether the edge p->b can be redirected to t, where b only jumps to t.
+// If p already jumps to t, phis in t must agree on the values from p and b.
+static bool can_thread(struct IRblock *p, struct IRblock *b, struct IRblock *t) {
+	struct llist_node *q = t->ins.head;
+	while (q && ((struct IRinstruction*)q)->op == IR_PHI) {
+		struct IRinstruction *phi = (void*)q, *v = IRphi_get_arg(phi, p);
+		if (v && v != IRphi_get_arg(phi, b)) {
+			return (false);
+		}
+		q = q->nxt;
+	}
+	return (true);
+}
+
+// Redirects jumps into empty forwarding blocks to their final targets.
+// The forwarding blocks become unreachable and are removed afterwards.
+static bool thread_jumps(struct dce_context *ctx) {
+	bool changed = false;
+	struct IRblock *entry = (void*)ctx->f->bs.head;
+
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		if (b == entry || !is_forwarder(b)) {
+			continue;
+		}
+
+		struct IRblock *t = IRblock_terminator(b)->bt;
+		if (is_forwarder(t)) {
+			continue;	// let the end of the chain be threaded first
+		}
+
+		struct llist_node *q = b->pre.head, *nxt;
+		while (q) {
+			nxt = q->nxt;
+			struct IRblock *pre = ((struct IRpredecessor*)q)->b;
+			if (can_thread(pre, b, t)) {
+				redirect_edge(pre, b, t);
+				IRblock_add_pre(t, pre);
+				struct llist_node *r = t->ins.head;
+				while (r && ((struct IRinstruction*)r)->op == IR_PHI) {
+					IRphi_add_arg((void*)r, pre, IRphi_get_arg((void*)r, b));
+					r = r->nxt;
+				}
+				IRblock_remove_pre(b, pre);
+				changed = true;
+			}
+			q = nxt;
+		}
+	}
+	return (changed);
+}
+
+// Returns the value that _x_ will finally be replaced with.
+// The chain is shortened on the way, as chains of phis may be as long as the function.
+static struct IRinstruction* resolve(struct dce_context *ctx, struct IRinstruction *x) {
+	struct IRinstruction *v = x;
+	while (ctx->repl[v->id]) {
+		v = ctx->repl[v->id];
+	}
+	while (x != v) {
+		struct IRinstruction *nxt = ctx->repl[x->id];
+		ctx->repl[x->id] = v;
+		x = nxt;
+	}
+	return (v);
+}
+
+// Returns whether all arguments of the phi are the same value (or the phi itself).
+// Writes that value into _res_.
+static bool is_trivial_phi(struct dce_context *ctx, struct IRinstruction *phi, struct IRinstruction **res) {
+	struct IRinstruction *same = NULL;
+	for (struct llist_node *q = phi->phi.head; q; q = q->nxt) {
+		struct IRinstruction *v = resolve(ctx, ((struct IRphi_arg*)q)->value);
+		if (v == phi || v == same) {
+			continue;
+		}
+		if (same) {
+			return (false);
+		}
+		same = v;
+	}
+
+	*res = same;
+	return (same != NULL);
+}
+
+// Removes phis whose arguments are all the same value.
+static bool remove_trivial_phis(struct dce_context *ctx) {
+	bool changed = false;
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		struct llist_node *q = b->ins.head, *prev = NULL;
+		while (q && ((struct IRinstruction*)q)->op == IR_PHI) {
+			struct IRinstruction *phi = (void*)q, *same;
+			struct llist_node *nxt = q->nxt;
+			if (is_trivial_phi(ctx, phi, &same)) {
+				ctx->repl[phi->id] = same;
+				if (prev) {
+					prev->nxt = nxt;
+				} else {
+					b->ins.head = nxt;
+				}
+				b->ins.length -= 1;	// the terminate follows, so the tail never changes
+				llist_pushback(&ctx->garbage, phi);
+				changed = true;
+			} else {
+				prev = q;
+			}
+			q = nxt;
+		}
+	}
+	return (changed);
+}
+
+// Merges blocks into their only predecessor, if that predecessor has no other successors.
+static bool merge_blocks(struct dce_context *ctx) {
+	struct IRfunction *f = ctx->f;
+	struct IRblock *entry = (void*)f->bs.head;
+	bool *dead = try_calloc(ctx->nb, sizeof(bool), __FUNCTION__);
+	bool changed = false;
+
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		if (dead[b->id]) {
+			continue;
+		}
+
+		// The instruction before the terminate of _b_, found once: the body of a merged block
+		// is appended after it, so walking _b_ again for each merge would be quadratic.
+		struct llist_node *last = NULL;
+		bool found = false;
+		while (true) {
+			struct IRinstruction *t = IRblock_terminator(b);
+			if (t->op != IR_JMP) {
+				break;
+			}
+
+			struct IRblock *s = t->bt;
+			if (s == b || s == entry || s->pre.length != 1) {
+				break;
+			}
+
+			// The phis in _s_ have exactly one argument, which must come from _b_.
+			while (s->ins.head && ((struct IRinstruction*)s->ins.head)->op == IR_PHI) {
+				struct IRinstruction *phi = llist_popfront(&s->ins);
+				ctx->repl[phi->id] = ((struct IRphi_arg*)phi->phi.head)->value;
+				llist_pushback(&ctx->garbage, phi);
+			}
+
+			// Drop the jump in _b_ and move the whole body of _s_ into _b_.
+			if (!found) {
+				for (struct llist_node *q = b->ins.head; q->nxt; q = q->nxt) {
+					last = q;
+				}
+				found = true;
+			}
+			struct llist_node *q = b->ins.tail;
+			if (last) {
+				last->nxt = NULL;
+				b->ins.tail = last;
+				b->ins.length -= 1;
+			} else {
+				llist_init(&b->ins);
+			}
+			IRinstruction_free((void*)q);
+
+			struct llist_node *r;
+			while ((r = llist_popfront(&s->ins)) != NULL) {
+				((struct IRinstruction*)r)->owner = b;
+				last = b->ins.tail;
+				llist_pushback(&b->ins, r);
+			}
+
+			struct IRblock *succ[2];
+			int sn = IRblock_successors(b, succ);
+			for (int i = 0; i < sn; ++i) {
+				if (i == 0 || succ[1] != succ[0]) {
+					IRblock_replace_pre(succ[i], s, b);
+				}
+			}
+
+			dead[s->id] = true;
+			changed = true;
+		}
+	}
+
+	if (changed) {
+		struct llist_node *p = f->bs.head, *nxt;
+		llist_init(&f->bs);
+		while (p) {
+			nxt = p->nxt;
+			if (dead[((struct IRblock*)p)->id]) {
+				IRblock_free((void*)p);
+			} else {
+				llist_pushback(&f->bs, p);
+			}
+			p = nxt;
+		}
+	}
+
+	free(dead);
+	return (changed);
+}
+
+// Worklist of mark_live().
+struct dce_marker {
+	bool *live;			// liveness, indexed by instruction id
+	struct IRinstruction **top;	// top of the stack of instructions to be scanned
+};
+
+// Operand callback of mark_live(): marks an operand live and schedules it.
+static void mark_operand(struct IRinstruction **slot, void *arg) {
+	struct dce_marker *m = arg;
+	struct IRinstruction *x = *slot;
+	if (!m->live[x->id]) {
+		m->live[x->id] = true;
+		*(m->top++) = x;
+	}
+}
+
+// Marks every instruction reachable from a side-effecting root through operands.
+// Returns the liveness table indexed by instruction id.
+static bool* mark_live(struct dce_context *ctx) {
+	struct IRinstruction **stack = try_malloc(ctx->f->ins_count * sizeof(struct IRinstruction*),
+							__FUNCTION__);
+	struct dce_marker m = {
+		.live = try_calloc(ctx->f->ins_count, sizeof(bool), __FUNCTION__),
+		.top = stack,
+	};
+
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (IRhas_side_effect(x->op)) {
+				m.live[x->id] = true;
+				*(m.top++) = x;
+			}
+		}
+	}
+
+	while (m.top != stack) {
+		IRinstruction_foreach_operand(*(--m.top), mark_operand, &m);
+	}
+	free(stack);
+	return (m.live);
+}
+
+// Frees every instruction not marked live.
+static bool sweep_dead(struct dce_context *ctx, bool *live) {
+	bool changed = false;
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		struct llist_node *q = b->ins.head, *nxt;
+		llist_init(&b->ins);
+		while (q) {
+			nxt = q->nxt;
+			struct IRinstruction *x = (void*)q;
+			if (live[x->id]) {
+				llist_pushback(&b->ins, x);
+			} else {
+				IRinstruction_free(x);
+				changed = true;
+			}
+			q = nxt;
+		}
+	}
+	return (changed);
+}
+
+// Aggressive dead code elimination combined with CFG simplification:
+// removes unreachable blocks, folds constant branches, threads jumps through
+// empty blocks, merges straight-line blocks and deletes instructions whose
+// results are never used. Instruction and block identifiers are renumbered.
+bool IRopt_dce(struct IRfunction *self) {
+	struct dce_context ctx = {
+		.f = self,
+		.nb = self->bs.length,
+		.repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__),
+	};
+	llist_init(&ctx.garbage);
+
+	bool changed = false, step;
+	do {
+		step = remove_unreachable(&ctx);
+		step |= fold_branches(&ctx);
+		step |= thread_jumps(&ctx);
+		step |= remove_trivial_phis(&ctx);
+		step |= merge_blocks(&ctx);
+		changed |= step;
+	} while (step);
+
+	IRfunction_apply_replacements(self, ctx.repl);
+	struct llist_node *p;
+	while ((p = llist_popfront(&ctx.garbage)) != NULL) {
+		IRinstruction_free((void*)p);
+	}
+	free(ctx.repl);
+
+	bool *live = mark_live(&ctx);
+	changed |= sweep_dead(&ctx, live);
+	free(live);
+	IRfunction_renumber(self);
+	return (changed);
+}
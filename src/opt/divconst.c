@@ -0,0 +1,227 @@
+// Division and remainder by constants.
+// A division by a constant d is a multiplication by a fixed point approximation of 1/d,
+// taking the high half of the double width product, followed by shifts and corrections
+// (Granlund and Montgomery, "Division by Invariant Integers using Multiplication", and
+// Hacker's Delight, chapter 10, whose magic number algorithms are used here).
+// A remainder is then n - (n / d) * d. Hardware division costs tens of cycles, while the
+// replacement sequences take a few.
+// Only operations no wider than the registers of the target are rewritten: the width of
+// long follows Tinfo.long_size, and a 64 bits multiplication high is no cheaper than a
+// division on 32 bits targets.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "target.h"
+#include "acir.h"
+#include "opt.h"
+
+// Multiplier and shift of a division.
+struct div_magic {
+	uint64_t mul;		// the multiplier, in the width of the operation
+	int shift;		// right shift of the high half of the product
+	bool add;		// unsigned: the multiplier needs one bit more than the width
+};
+
+// Computes the magic number of a signed division by _d_, with 2 <= |d| in _bits_ bits.
+// Hacker's Delight, figure 10-1, with arithmetic modulo 2^bits.
+static struct div_magic magic_signed(int64_t d, int bits) {
+	uint64_t mask = (bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+	uint64_t two = UINT64_C(1) << (bits - 1);
+	uint64_t ad = (uint64_t)(d < 0 ? -(uint64_t)d : (uint64_t)d) & mask;
+	uint64_t t = two + (d < 0);
+	uint64_t anc = t - 1 - t % ad;		// absolute value of nc
+	uint64_t q1 = two / anc, r1 = two - q1 * anc;
+	uint64_t q2 = two / ad, r2 = two - q2 * ad, delta;
+	int p = bits - 1;
+	do {
+		p += 1;
+		q1 = (2 * q1) & mask;
+		r1 = (2 * r1) & mask;
+		if (r1 >= anc) {
+			q1 += 1;
+			r1 -= anc;
+		}
+		q2 = (2 * q2) & mask;
+		r2 = (2 * r2) & mask;
+		if (r2 >= ad) {
+			q2 += 1;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	struct div_magic res = { .mul = (q2 + 1) & mask, .shift = p - bits, .add = false };
+	if (d < 0) {
+		res.mul = -res.mul & mask;
+	}
+	return (res);
+}
+
+// Computes the magic number of an unsigned division by _d_, with 2 <= d in _bits_ bits.
+// Hacker's Delight, figure 10-2, with arithmetic modulo 2^bits.
+static struct div_magic magic_unsigned(uint64_t d, int bits) {
+	uint64_t mask = (bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+	uint64_t two = UINT64_C(1) << (bits - 1);
+	uint64_t nc = mask - ((-d) & mask) % d;
+	uint64_t q1 = two / nc, r1 = two - q1 * nc;
+	uint64_t q2 = (two - 1) / d, r2 = (two - 1) - q2 * d, delta;
+	bool add = false;
+	int p = bits - 1;
+	do {
+		p += 1;
+		if (r1 >= nc - r1) {
+			q1 = (2 * q1 + 1) & mask;
+			r1 = (2 * r1 - nc) & mask;
+		} else {
+			q1 = (2 * q1) & mask;
+			r1 = (2 * r1) & mask;
+		}
+		if (r2 + 1 >= d - r2) {
+			add |= (q2 >= two - 1);
+			q2 = (2 * q2 + 1) & mask;
+			r2 = (2 * r2 + 1 - d) & mask;
+		} else {
+			add |= (q2 >= two);
+			q2 = (2 * q2) & mask;
+			r2 = (2 * r2 + 1) & mask;
+		}
+		delta = d - 1 - r2;
+	} while (p < 2 * bits && (q1 < delta || (q1 == delta && r1 == 0)));
+
+	struct div_magic res = { .mul = (q2 + 1) & mask, .shift = p - bits, .add = add };
+	return (res);
+}
+
+// Inserts an operation of the type of _x_ right before it.
+static struct IRinstruction* emit(struct IRinstruction *x, int op,
+				struct IRinstruction *l, struct IRinstruction *r) {
+	return (IRinstruction_new_before(x, op, x->type, l, r));
+}
+
+// Inserts a shift of _v_ by a constant before _x_.
+static struct IRinstruction* emit_shift(struct IRinstruction *x, int op, struct IRinstruction *v, int k) {
+	return (emit(x, op, v, IRblock_new_const(x->owner, x->type, k)));
+}
+
+// Returns the quotient of a signed division of _n_ by _d_, with d not in {-1, 0, 1}.
+static struct IRinstruction* signed_quotient(struct IRinstruction *x, struct IRinstruction *n, int64_t d) {
+	int bits = IRTypecode_bits(x->type);
+	uint64_t ad = d < 0 ? -(uint64_t)d : (uint64_t)d;
+	struct IRinstruction *q;
+
+	if ((ad & (ad - 1)) == 0) {
+		// Power of two: the dividend is biased by d - 1 when negative, to round towards zero.
+		int k = 0;
+		while ((UINT64_C(1) << k) != ad) {
+			k += 1;
+		}
+		struct IRinstruction *sign = (k > 1) ? emit_shift(x, IR_ASHR, n, k - 1) : n;
+		struct IRinstruction *bias = emit_shift(x, IR_LSHR, sign, bits - k);
+		q = emit_shift(x, IR_ASHR, emit(x, IR_ADD, n, bias), k);
+		return (d < 0 ? emit(x, IR_NEG, q, NULL) : q);
+	}
+
+	struct div_magic m = magic_signed(d, bits);
+	int64_t mul = IRTypecode_wrap(x->type, (int64_t)m.mul);
+	q = emit(x, IR_SMULH, n, IRblock_new_const(x->owner, x->type, mul));
+	if (d > 0 && mul < 0) {
+		q = emit(x, IR_ADD, q, n);
+	} else if (d < 0 && mul > 0) {
+		q = emit(x, IR_SUB, q, n);
+	}
+	if (m.shift > 0) {
+		q = emit_shift(x, IR_ASHR, q, m.shift);
+	}
+	// Adds one to negative quotients, which were rounded towards minus infinity.
+	return (emit(x, IR_ADD, q, emit_shift(x, IR_LSHR, q, bits - 1)));
+}
+
+// Returns the quotient of an unsigned division of _n_ by _d_, with d not a power of two.
+// The divisor may be sign extended, only its low bits are used.
+static struct IRinstruction* unsigned_quotient(struct IRinstruction *x, struct IRinstruction *n, uint64_t d) {
+	int bits = IRTypecode_bits(x->type);
+	d &= (bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+	if (d >> (bits - 1)) {
+		// The quotient is 0 or 1.
+		struct IRinstruction *dc = IRblock_new_const(x->owner, x->type, IRTypecode_wrap(x->type, (int64_t)d));
+		struct IRinstruction *ge = IRinstruction_new_before(x, IR_CMP_UGE, IRT_I1, n, dc);
+		return (IRinstruction_new_before(x, IR_ZEXT, x->type, ge, NULL));
+	}
+
+	struct div_magic m = magic_unsigned(d, bits);
+	int64_t mul = IRTypecode_wrap(x->type, (int64_t)m.mul);
+	struct IRinstruction *q = emit(x, IR_UMULH, n, IRblock_new_const(x->owner, x->type, mul));
+	if (!m.add) {
+		return (m.shift > 0 ? emit_shift(x, IR_LSHR, q, m.shift) : q);
+	}
+	// The multiplier is 2^bits + mul: n is added back, halving first to stay within the width.
+	struct IRinstruction *t = emit_shift(x, IR_LSHR, emit(x, IR_SUB, n, q), 1);
+	t = emit(x, IR_ADD, t, q);
+	return (m.shift > 1 ? emit_shift(x, IR_LSHR, t, m.shift - 1) : t);
+}
+
+// Returns whether the division or remainder is rewritten by the pass.
+static bool is_candidate(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_SDIV: case IR_UDIV: case IR_SREM: case IR_UREM:
+			break;
+		default:
+			return (false);
+	}
+
+	int bits = IRTypecode_bits(x->type);
+	if (x->right->op != IR_IMM || (bits != 32 && bits != 64) || bits > Tinfo.reg_size * 8) {
+		return (false);
+	}
+
+	int64_t d = IRimm_value(x->right);
+	if (x->op == IR_SDIV || x->op == IR_SREM) {
+		return (d < -1 || d > 1);
+	}
+	uint64_t u = (uint64_t)d & ((bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1);
+	return (u > 1 && (u & (u - 1)) != 0);	// powers of two are shifts, see IRopt_instcombine()
+}
+
+// Rewrites the division or remainder in place, the last operation of the sequence
+// taking over the instruction.
+static void rewrite(struct IRinstruction *x) {
+	struct IRinstruction *n = x->left, *dc = x->right;
+	int64_t d = IRimm_value(dc);
+	bool is_signed = (x->op == IR_SDIV || x->op == IR_SREM);
+	bool is_rem = (x->op == IR_SREM || x->op == IR_UREM);
+
+	struct IRinstruction *q = is_signed ? signed_quotient(x, n, d) : unsigned_quotient(x, n, (uint64_t)d);
+	if (is_rem) {
+		x->op = IR_SUB;
+		x->left = n;
+		x->right = emit(x, IR_MUL, q, dc);
+		return;
+	}
+
+	// The quotient is recomputed into _x_ itself, which keeps its users.
+	x->op = q->op;
+	x->left = q->left;
+	x->right = q->right;
+	llist_unlink(&x->owner->ins, q);
+	IRinstruction_free(q);
+}
+
+// Division by constants: signed and unsigned divisions and remainders by constants become
+// multiplications by magic numbers and shifts. Identifiers are renumbered.
+bool IRopt_div_const(struct IRfunction *self) {
+	bool changed = false;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (is_candidate(x)) {
+				rewrite(x);
+				changed = true;
+			}
+		}
+	}
+	if (changed) {
+		IRfunction_renumber(self);
+	}
+	return (changed);
+}
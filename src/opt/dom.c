@@ -0,0 +1,251 @@
+// Dominator tree, computed by the iterative algorithm of Cooper, Harvey and Kennedy
+// ("A Simple, Fast Dominance Algorithm"). Blocks are visited in reverse postorder and
+// the immediate dominator of each block is refined by intersecting the dominator tree
+// paths of its predecessors, until a fixed point is reached. On the small control flow
+// graphs produced from structured code this converges in two or three iterations.
+// The post-dominator tree is the dominator tree of the reversed graph, whose entry is a
+// virtual exit block preceding every block that returns.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "acir.h"
+#include "opt.h"
+
+// Fills the reverse postorder of the blocks reachable from the entry.
+// The depth first search is iterative, so that long chains of blocks do not overflow the stack.
+static void IRdomtree_order(struct IRdomtree *self, struct IRfunction *f) {
+	int n = self->n;
+	struct IRblock **stack = try_malloc(n * sizeof(struct IRblock*), __FUNCTION__);
+	int *next = try_calloc(n, sizeof(int), __FUNCTION__);	// next successor to visit
+	bool *seen = try_calloc(n, sizeof(bool), __FUNCTION__);
+
+	int top = 0, post = n;
+	struct IRblock *entry = (void*)f->bs.head;
+	stack[top++] = entry;
+	seen[entry->id] = true;
+	while (top > 0) {
+		struct IRblock *b = stack[top - 1], *succ[2];
+		int sn = IRblock_successors(b, succ);
+		if (next[b->id] < sn) {
+			struct IRblock *s = succ[next[b->id]++];
+			if (!seen[s->id]) {
+				seen[s->id] = true;
+				stack[top++] = s;
+			}
+		} else {
+			// Postorder numbers are handed out backwards, which gives the reverse postorder.
+			self->order[--post] = b;
+			top -= 1;
+		}
+	}
+
+	// Move the reachable blocks to the beginning of the table.
+	self->count = n - post;
+	for (int i = 0; i < self->count; ++i) {
+		self->order[i] = self->order[post + i];
+		self->rpo[self->order[i]->id] = i;
+	}
+
+	free(seen);
+	free(next);
+	free(stack);
+}
+
+// Returns the nearest common dominator of two blocks whose dominators are computed.
+// The block with the larger reverse postorder number can not dominate the other one,
+// so it is the one walking up the tree.
+static struct IRblock* IRdomtree_intersect(struct IRdomtree *self, struct IRblock *a, struct IRblock *b) {
+	while (a != b) {
+		while (self->rpo[a->id] > self->rpo[b->id]) {
+			a = self->idom[a->id];
+		}
+		while (self->rpo[b->id] > self->rpo[a->id]) {
+			b = self->idom[b->id];
+		}
+	}
+	return (a);
+}
+
+// Builds the dominator tree of a function.
+// Block identifiers must be compact, see IRfunction_renumber().
+void IRdomtree_build(struct IRdomtree *self, struct IRfunction *f) {
+	int n = f->bs.length;
+	self->n = n;
+	self->order = try_malloc(n * sizeof(struct IRblock*), __FUNCTION__);
+	self->idom = try_calloc(n, sizeof(struct IRblock*), __FUNCTION__);
+	self->depth = try_calloc(n, sizeof(int), __FUNCTION__);
+	self->rpo = try_malloc(n * sizeof(int), __FUNCTION__);
+	for (int i = 0; i < n; ++i) {
+		self->rpo[i] = -1;
+	}
+	IRdomtree_order(self, f);
+
+	// The entry temporarily dominates itself, which marks it as processed.
+	struct IRblock *entry = self->order[0];
+	self->idom[entry->id] = entry;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 1; i < self->count; ++i) {
+			struct IRblock *b = self->order[i], *res = NULL;
+			for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+				struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+				if (self->idom[pre->id] == NULL) {
+					continue;	// not processed yet, or unreachable
+				}
+				res = res ? IRdomtree_intersect(self, res, pre) : pre;
+			}
+
+			if (self->idom[b->id] != res) {
+				self->idom[b->id] = res;
+				changed = true;
+			}
+		}
+	}
+	self->idom[entry->id] = NULL;
+
+	// Parents come before their children in reverse postorder.
+	for (int i = 1; i < self->count; ++i) {
+		struct IRblock *b = self->order[i];
+		self->depth[b->id] = self->depth[self->idom[b->id]->id] + 1;
+	}
+}
+
+// Fills the reverse postorder of the reversed graph, from the virtual exit, of the blocks
+// reaching a return. The search starts from each returning block in turn.
+static void IRdomtree_order_post(struct IRdomtree *self, struct IRfunction *f) {
+	int n = self->n;
+	struct IRblock **stack = try_malloc(n * sizeof(struct IRblock*), __FUNCTION__);
+	struct llist_node **next = try_malloc(n * sizeof(struct llist_node*), __FUNCTION__);
+	bool *seen = try_calloc(n, sizeof(bool), __FUNCTION__);
+
+	int post = n;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *exit = (void*)p, *succ[2];
+		if (IRblock_successors(exit, succ) > 0 || seen[exit->id]) {
+			continue;
+		}
+
+		int top = 0;
+		stack[top++] = exit;
+		next[exit->id] = exit->pre.head;
+		seen[exit->id] = true;
+		while (top > 0) {
+			struct IRblock *b = stack[top - 1];
+			if (next[b->id]) {
+				struct IRblock *s = ((struct IRpredecessor*)next[b->id])->b;
+				next[b->id] = next[b->id]->nxt;
+				if (!seen[s->id]) {
+					seen[s->id] = true;
+					next[s->id] = s->pre.head;
+					stack[top++] = s;
+				}
+			} else {
+				self->order[--post] = b;
+				top -= 1;
+			}
+		}
+	}
+
+	self->count = n - post;
+	for (int i = 0; i < self->count; ++i) {
+		self->order[i] = self->order[post + i];
+		self->rpo[self->order[i]->id] = i;
+	}
+
+	free(seen);
+	free(next);
+	free(stack);
+}
+
+// Returns the nearest common post-dominator of two blocks, NULL for the virtual exit,
+// which comes first in reverse postorder.
+static struct IRblock* IRdomtree_intersect_post(struct IRdomtree *self, struct IRblock *a, struct IRblock *b) {
+	while (a != b) {
+		while (a && (!b || self->rpo[a->id] > self->rpo[b->id])) {
+			a = self->idom[a->id];
+		}
+		while (b && (!a || self->rpo[b->id] > self->rpo[a->id])) {
+			b = self->idom[b->id];
+		}
+	}
+	return (a);
+}
+
+// Builds the post-dominator tree of a function: _idom_ holds the immediate post-dominator
+// of each block, NULL for the returning blocks, and the blocks which reach no return are
+// left unreachable. Block identifiers must be compact, see IRfunction_renumber().
+void IRdomtree_build_post(struct IRdomtree *self, struct IRfunction *f) {
+	int n = f->bs.length;
+	self->n = n;
+	self->order = try_malloc(n * sizeof(struct IRblock*), __FUNCTION__);
+	self->idom = try_calloc(n, sizeof(struct IRblock*), __FUNCTION__);
+	self->depth = try_calloc(n, sizeof(int), __FUNCTION__);
+	self->rpo = try_malloc(n * sizeof(int), __FUNCTION__);
+	for (int i = 0; i < n; ++i) {
+		self->rpo[i] = -1;
+	}
+	IRdomtree_order_post(self, f);
+
+	// The returning blocks are processed from the start, as they follow the virtual exit.
+	bool *done = try_calloc(n, sizeof(bool), __FUNCTION__);
+	for (int i = 0; i < self->count; ++i) {
+		struct IRblock *succ[2];
+		done[self->order[i]->id] = (IRblock_successors(self->order[i], succ) == 0);
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < self->count; ++i) {
+			struct IRblock *b = self->order[i], *succ[2], *res = NULL;
+			int sn = IRblock_successors(b, succ);
+			bool any = false;
+			for (int k = 0; k < sn; ++k) {
+				if (!done[succ[k]->id]) {
+					continue;	// not processed yet, or reaching no return
+				}
+				res = any ? IRdomtree_intersect_post(self, res, succ[k]) : succ[k];
+				any = true;
+			}
+
+			if (sn > 0 && any && (!done[b->id] || self->idom[b->id] != res)) {
+				self->idom[b->id] = res;
+				done[b->id] = true;
+				changed = true;
+			}
+		}
+	}
+	free(done);
+
+	for (int i = 0; i < self->count; ++i) {
+		struct IRblock *b = self->order[i];
+		self->depth[b->id] = self->idom[b->id] ? self->depth[self->idom[b->id]->id] + 1 : 0;
+	}
+}
+
+// Returns whether the block is reachable from the function entry.
+bool IRdomtree_reachable(const struct IRdomtree *self, struct IRblock *b) {
+	return (b->id < self->n && self->rpo[b->id] >= 0);
+}
+
+// Returns whether _a_ dominates _b_. Every block dominates itself.
+bool IRdomtree_dominates(const struct IRdomtree *self, struct IRblock *a, struct IRblock *b) {
+	if (!IRdomtree_reachable(self, a) || !IRdomtree_reachable(self, b)) {
+		return (false);
+	}
+
+	while (self->depth[b->id] > self->depth[a->id]) {
+		b = self->idom[b->id];
+	}
+	return (a == b);
+}
+
+// Frees the dominator tree.
+void IRdomtree_free(struct IRdomtree *self) {
+	free(self->order);
+	free(self->idom);
+	free(self->depth);
+	free(self->rpo);
+}
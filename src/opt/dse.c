@@ -0,0 +1,310 @@
+// Dead store elimination.
+// A store is dead when no load may read the value it writes: either a later store to the
+// same location overwrites it on every path, which is the case when the later store post-
+// dominates it and no load in between may alias the location, or the location is a stack
+// slot whose address does not escape and no load reachable from the store may alias it.
+// Paths are followed forwards from the store until the overwriting store, through loops and
+// paths never returning, which the post-dominator tree does not cover. As for loads, a path
+// crossing the definition of the root or of the variable offset of the location reaches the
+// overwriting store with another address, so it makes the store live.
+//
+// Searches may cover the whole function for each store. For functions too large for that, a
+// local variant only removes the stores overwritten later in their block, walking it
+// backwards with a few of the locations stored since.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "util/sparseset.h"
+#include "acir.h"
+#include "opt.h"
+
+// Number of locations remembered by IRopt_dse_local().
+#define DSE_LOCAL_WINDOW 16
+
+// Working state of the pass.
+struct dse_context {
+	struct IRfunction *f;
+	struct IRalias alias;
+	struct IRdomtree *pdom;		// post-dominator tree, from the analysis cache
+	struct IRmemloc *locs;		// location of each access, indexed by instruction id
+	int *pos;			// position of each instruction in its block, indexed by instruction id
+	struct IRinstruction *end;	// the overwriting store of the current search, if any
+	struct sparseset seen;		// blocks visited by the current search, cleared for each one
+	struct IRblock **stack;		// blocks to visit
+};
+
+// Returns whether the instruction may read the location, or change its address before the
+// overwriting store.
+static bool may_read(struct dse_context *ctx, struct IRinstruction *x, const struct IRmemloc *loc) {
+	if (ctx->end && (x == loc->root || x == loc->var)) {
+		return (true);
+	}
+	return (x->op == IR_LOAD && IRalias_query(&ctx->alias, &ctx->locs[x->id], loc) != IR_NO_ALIAS);
+}
+
+// Returns whether the instructions from _from_ up to _to_ excluded, or the end of the block
+// when _to_ is NULL, may read the location.
+static bool scan(struct dse_context *ctx, struct llist_node *from, struct IRinstruction *to,
+			const struct IRmemloc *loc) {
+	for (struct llist_node *p = from; p && p != (void*)to; p = p->nxt) {
+		if (may_read(ctx, (void*)p, loc)) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Returns whether a load may read the value written by _s_ before the program reaches _end_,
+// or returns when _end_ is NULL.
+static bool is_read(struct dse_context *ctx, struct IRinstruction *s, struct IRinstruction *end) {
+	const struct IRmemloc *loc = &ctx->locs[s->id];
+	struct IRblock *b = s->owner;
+	ctx->end = end;
+	if (end && end->owner == b && ctx->pos[end->id] > ctx->pos[s->id]) {
+		return (scan(ctx, s->n.nxt, end, loc));
+	}
+	if (scan(ctx, s->n.nxt, NULL, loc)) {
+		return (true);
+	}
+
+	sparseset_clear(&ctx->seen);
+	int top = 0;
+	struct IRblock *succ[2];
+	for (int k = IRblock_successors(b, succ) - 1; k >= 0; --k) {
+		sparseset_add(&ctx->seen, succ[k]->id);
+		ctx->stack[top++] = succ[k];
+	}
+	while (top > 0) {
+		struct IRblock *x = ctx->stack[--top];
+		if (end && x == end->owner) {
+			if (scan(ctx, x->ins.head, end, loc)) {
+				return (true);
+			}
+			continue;
+		}
+		if (scan(ctx, x->ins.head, NULL, loc)) {
+			return (true);
+		}
+		for (int k = IRblock_successors(x, succ) - 1; k >= 0; --k) {
+			if (sparseset_add(&ctx->seen, succ[k]->id)) {
+				ctx->stack[top++] = succ[k];
+			}
+		}
+	}
+	return (false);
+}
+
+// Returns whether _b_ is executed after _a_ on every path to a return.
+static bool post_dominates(struct dse_context *ctx, struct IRinstruction *b, struct IRinstruction *a) {
+	if (a->owner == b->owner) {
+		return (ctx->pos[b->id] > ctx->pos[a->id]);
+	}
+	return (IRdomtree_dominates(ctx->pdom, b->owner, a->owner));
+}
+
+// Returns whether the store is dead, among the stores of the same location.
+static bool is_dead(struct dse_context *ctx, struct IRinstruction *s, struct array *same) {
+	const struct IRmemloc *loc = &ctx->locs[s->id];
+	if (!IRalias_escapes(&ctx->alias, loc->root) && !is_read(ctx, s, NULL)) {
+		return (true);
+	}
+	for (int i = 0; i < same->length; ++i) {
+		struct IRinstruction *t = same->begin[i];
+		if (t != s && post_dominates(ctx, t, s) && !is_read(ctx, s, t)) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// A store and its location.
+struct dse_store {
+	struct IRinstruction *x;
+	struct IRmemloc loc;
+};
+
+// Returns the identifier of a value of a location key, -1 for none.
+static int key_id(const struct IRinstruction *x) {
+	return (x ? x->id : -1);
+}
+
+// Sorting order of the stores: by location, then by identifier.
+static int compare_store(const void *pa, const void *pb) {
+	const struct dse_store *a = pa, *b = pb;
+	if (a->loc.root != b->loc.root) {
+		return (key_id(a->loc.root) - key_id(b->loc.root));
+	}
+	if (a->loc.var != b->loc.var) {
+		return (key_id(a->loc.var) - key_id(b->loc.var));
+	}
+	if (a->loc.offset != b->loc.offset) {
+		return (a->loc.offset < b->loc.offset ? -1 : 1);
+	}
+	if (a->loc.type != b->loc.type) {
+		return (a->loc.type - b->loc.type);
+	}
+	return (a->x->id - b->x->id);
+}
+
+// Dead store elimination: removes the stores overwritten before any load may read them, and
+// the stores to stack slots which are never read afterwards. Identifiers are renumbered.
+bool IRopt_dse(struct IRfunction *self, struct IRanalyses *am) {
+	struct array stores;
+	array_init(&stores);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			if (((struct IRinstruction*)q)->op == IR_STORE) {
+				array_pushback(&stores, q);
+			}
+		}
+	}
+	if (stores.length == 0) {
+		array_free(&stores);
+		return (false);
+	}
+
+	int n = self->ins_count, nb = self->bs.length;
+	struct dse_context ctx = { .f = self };
+	IRalias_build(&ctx.alias, self);
+	ctx.pdom = IRanalyses_postdom(am);
+	ctx.locs = try_malloc(n * sizeof(struct IRmemloc), __FUNCTION__);
+	ctx.pos = try_malloc(n * sizeof(int), __FUNCTION__);
+	sparseset_init(&ctx.seen, nb);
+	ctx.stack = try_malloc(nb * sizeof(struct IRblock*), __FUNCTION__);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		int i = 0;
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			ctx.pos[x->id] = i++;
+			if (x->op == IR_LOAD || x->op == IR_STORE) {
+				IRmemloc_of(&ctx.locs[x->id], x);
+			}
+		}
+	}
+
+	struct dse_store *ss = try_malloc(stores.length * sizeof(struct dse_store), __FUNCTION__);
+	for (int i = 0; i < stores.length; ++i) {
+		ss[i].x = stores.begin[i];
+		ss[i].loc = ctx.locs[ss[i].x->id];
+	}
+	qsort(ss, stores.length, sizeof(struct dse_store), compare_store);
+
+	// Stores are only removed once every decision is made: a store overwritten by a dead
+	// store is still dead, as nothing reads the location in between either.
+	struct array same, dead;
+	array_init(&same);
+	array_init(&dead);
+	for (int i = 0; i < stores.length; ++i) {
+		if (i == 0 || !IRmemloc_eq(&ss[i].loc, &ss[i - 1].loc)) {
+			same.length = 0;
+			for (int k = i; k < stores.length && IRmemloc_eq(&ss[k].loc, &ss[i].loc); ++k) {
+				array_pushback(&same, ss[k].x);
+			}
+		}
+		if (is_dead(&ctx, ss[i].x, &same)) {
+			array_pushback(&dead, ss[i].x);
+		}
+	}
+
+	for (int i = 0; i < dead.length; ++i) {
+		struct IRinstruction *x = dead.begin[i];
+		llist_unlink(&x->owner->ins, x);
+		IRinstruction_free(x);
+	}
+	bool changed = (dead.length > 0);
+	if (changed) {
+		IRfunction_renumber(self);
+	}
+
+	free(ss);
+	free(ctx.locs);
+	free(ctx.pos);
+	sparseset_free(&ctx.seen);
+	free(ctx.stack);
+	IRalias_free(&ctx.alias);
+	array_free(&same);
+	array_free(&dead);
+	array_free(&stores);
+	return (changed);
+}
+
+// Local dead store elimination: removes the stores overwritten later in their block before
+// any load may read them, among the last locations stored. Identifiers are renumbered.
+bool IRopt_dse_local(struct IRfunction *self, struct IRanalyses *am) {
+	(void)am;
+	struct IRalias alias;
+	IRalias_build(&alias, self);
+	struct IRmemloc window[DSE_LOCAL_WINDOW];	// locations stored later in the block, oldest first
+	struct array ins;
+	array_init(&ins);
+
+	bool changed = false;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		ins.length = 0;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			array_pushback(&ins, q);
+		}
+
+		int len = 0, dead = 0;
+		for (int k = ins.length - 1; k >= 0; --k) {
+			struct IRinstruction *x = ins.begin[k];
+			struct IRmemloc loc;
+			bool is_access = (x->op == IR_LOAD || x->op == IR_STORE);
+			if (is_access) {
+				IRmemloc_of(&loc, x);
+			}
+
+			// Locations a load may read are live. Before the definition of its address, a
+			// later store writes somewhere else.
+			int kept = 0;
+			for (int i = 0; i < len; ++i) {
+				bool live = (x == window[i].root || x == window[i].var)
+						|| (x->op == IR_LOAD && IRalias_query(&alias, &window[i], &loc) != IR_NO_ALIAS);
+				if (!live) {
+					window[kept++] = window[i];
+				}
+			}
+			len = kept;
+			if (x->op != IR_STORE) {
+				continue;
+			}
+
+			int i = 0;
+			while (i < len && IRalias_query(&alias, &window[i], &loc) != IR_MUST_ALIAS) {
+				++i;
+			}
+			if (i < len) {
+				IRinstruction_free(x);
+				ins.begin[k] = NULL;
+				++dead;
+				continue;
+			}
+			if (len == DSE_LOCAL_WINDOW) {
+				memmove(window, window + 1, (len - 1) * sizeof(struct IRmemloc));
+				--len;
+			}
+			window[len++] = loc;
+		}
+
+		// The block is relinked at once, as unlinking each store would walk it again.
+		if (dead > 0) {
+			llist_init(&b->ins);
+			for (int k = 0; k < ins.length; ++k) {
+				if (ins.begin[k]) {
+					llist_pushback(&b->ins, ins.begin[k]);
+				}
+			}
+			changed = true;
+		}
+	}
+	if (changed) {
+		IRfunction_renumber(self);
+	}
+
+	IRalias_free(&alias);
+	array_free(&ins);
+	return (changed);
+}
@@ -0,0 +1,62 @@
+// Compare and branch fusion.
+// A comparison whose only use is the conditional jump of its own block does not need
+// its bool result materialized: a backend emits one flags-setting compare followed by
+// a conditional jump. Such comparisons are moved right before the jump and marked.
+// Passes after this one may give a marked comparison other users or move it, so marks are
+// recomputed from scratch on each run, and checked again by the backend.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "acir.h"
+#include "opt.h"
+
+// Marks the comparisons whose only use is the conditional jump ending their block,
+// and moves them right before that jump, so that nothing can clobber the flags in between.
+// Marks left by an earlier run are cleared first.
+bool IRopt_fuse_cmp(struct IRfunction *self) {
+	struct IRuses uses;
+	IRuses_build(&uses, self);
+
+	bool changed = false;
+	bool *was_fused = try_calloc(self->ins_count + 1, sizeof(bool), __FUNCTION__);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			was_fused[x->id] = x->is_fused;
+			x->is_fused = false;
+		}
+	}
+
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		struct IRinstruction *t = IRblock_terminator((void*)p);
+		if (t == NULL || t->op != IR_BR) {
+			continue;
+		}
+
+		struct IRinstruction *c = t->cond;
+		if (!IRis_cmp(c->op) || c->owner != t->owner || c->is_fused) {
+			continue;
+		}
+
+		struct array *users = IRuses_get(&uses, c);
+		if (users->length != 1 || users->begin[0] != t) {
+			continue;
+		}
+
+		if (c->n.nxt != &t->n) {
+			IRinstruction_move_before(c, t);
+			changed = true;
+		}
+		c->is_fused = true;
+	}
+
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			changed = changed || (x->is_fused != was_fused[x->id]);
+		}
+	}
+	free(was_fused);
+	IRuses_free(&uses);
+	return (changed);
+}
@@ -0,0 +1,197 @@
+// If-conversion: small branch diamonds and triangles are replaced by selects.
+// A mispredicted branch on a data dependent condition costs tens of cycles, while
+// executing both sides of a small diamond and selecting the result costs a few.
+// The arms are speculated into the branching block, the phis of the join block become
+// selects, and the branch becomes a jump. Backends lower selects to conditional moves,
+// or to branchless mask sequences on targets without them.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "fatals.h"
+#include "target.h"
+#include "acir.h"
+#include "opt.h"
+
+// Largest cost of the instructions executed unconditionally by one conversion,
+// roughly the expected cost of a branch mispredicted half of the time.
+#define IFCONV_BUDGET 8
+
+// Returns the cost of executing an instruction speculatively, or -1 if it can not be speculated.
+// Divisions may trap, and are too slow to execute on both paths anyway.
+// Loads may trap too, on addresses only valid on their own path.
+static int speculation_cost(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_IMM:
+			return (0);
+		case IR_PHI: case IR_LOAD: case IR_ALLOCA:
+		case IR_SDIV: case IR_UDIV: case IR_SREM: case IR_UREM:
+			return (-1);
+		case IR_MUL: case IR_SMULH: case IR_UMULH:
+			return (3);
+		default:
+			return (IRhas_side_effect(x->op) ? -1 : 1);
+	}
+}
+
+// Returns the cost of a select on the target.
+static int select_cost(void) {
+	return (Tinfo.has_cmov ? 1 : 4);
+}
+
+// Returns whether the block is an arm of the branch in _h_ which can be speculated:
+// its only predecessor is _h_ and it jumps unconditionally to _j_.
+// Writes the cost of speculating its instructions into _cost_.
+static bool is_arm(struct IRblock *b, struct IRblock *h, struct IRblock *j, int *cost) {
+	if (b == h || b->pre.length != 1 || ((struct IRpredecessor*)b->pre.head)->b != h) {
+		return (false);
+	}
+
+	struct IRinstruction *t = IRblock_terminator(b);
+	if (t == NULL || t->op != IR_JMP || t->bt != j) {
+		return (false);
+	}
+
+	*cost = 0;
+	for (struct llist_node *p = b->ins.head; p != &t->n; p = p->nxt) {
+		int c = speculation_cost((void*)p);
+		if (c < 0) {
+			return (false);
+		}
+		*cost += c;
+	}
+	return (true);
+}
+
+// Returns the number of phis of the join block which need a select, or -1 if
+// one of them can not be turned into a select.
+static int count_selects(struct IRblock *j, struct IRblock *from_t, struct IRblock *from_f) {
+	int res = 0;
+	for (struct llist_node *p = j->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		struct IRinstruction *phi = (void*)p;
+		if (!IRTypecode_is_int(phi->type)) {
+			return (-1);
+		}
+		if (IRphi_get_arg(phi, from_t) != IRphi_get_arg(phi, from_f)) {
+			res += 1;
+		}
+	}
+	return (res);
+}
+
+// Moves every instruction of an arm but its terminator before _pos_.
+static void hoist_arm(struct IRblock *arm, struct IRinstruction *pos) {
+	struct IRinstruction *t = IRblock_terminator(arm);
+	while (arm->ins.head != &t->n) {
+		IRinstruction_move_before((void*)arm->ins.head, pos);
+	}
+}
+
+// Removes an arm left with its terminator only from the function, and frees it.
+static void free_arm(struct IRblock *arm) {
+	llist_unlink(&arm->owner->bs, arm);
+	IRblock_free(arm);
+}
+
+// Converts the branch ending _h_ into a jump to _j_, where _bt_ and _bf_ are the arms
+// taken when the condition is true and false, or NULL when that side goes to _j_ directly.
+static void convert(struct IRblock *h, struct IRblock *bt, struct IRblock *bf, struct IRblock *j) {
+	struct IRinstruction *br = IRblock_terminator(h), *c = br->cond;
+	struct IRblock *from_t = bt ? bt : h, *from_f = bf ? bf : h;
+
+	// The values of the phis, computed before the edges change.
+	int n = 0;
+	for (struct llist_node *p = j->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		n += 1;
+	}
+	struct IRinstruction **vals = try_malloc((n + 1) * sizeof(struct IRinstruction*), __FUNCTION__);
+	if (bt) {
+		hoist_arm(bt, br);
+	}
+	if (bf) {
+		hoist_arm(bf, br);
+	}
+
+	int i = 0;
+	for (struct llist_node *p = j->ins.head; i < n; p = p->nxt, ++i) {
+		struct IRinstruction *phi = (void*)p;
+		struct IRinstruction *vt = IRphi_get_arg(phi, from_t), *vf = IRphi_get_arg(phi, from_f);
+		vals[i] = (vt == vf) ? vt : IRinstruction_new_select(br, c, vt, vf);
+	}
+
+	// Every edge into the join block from the diamond is replaced by a single one from _h_.
+	IRblock_remove_pre(j, from_t);
+	IRblock_remove_pre(j, from_f);
+	IRblock_add_pre(j, h);
+	i = 0;
+	for (struct llist_node *p = j->ins.head; i < n; p = p->nxt, ++i) {
+		IRphi_add_arg((void*)p, h, vals[i]);
+	}
+	free(vals);
+
+	// The condition is now read by the selects, as a value.
+	c->is_fused = false;
+	br->op = IR_JMP;
+	br->cond = NULL;
+	br->bt = j;
+	br->bf = NULL;
+	if (bt) {
+		free_arm(bt);
+	}
+	if (bf) {
+		free_arm(bf);
+	}
+}
+
+// Tries to if-convert the branch ending the block.
+static bool try_convert(struct IRblock *h) {
+	struct IRinstruction *br = IRblock_terminator(h);
+	if (br == NULL || br->op != IR_BR || br->bt == br->bf) {
+		return (false);
+	}
+
+	struct IRblock *t = br->bt, *f = br->bf, *j = NULL, *arm_t = NULL, *arm_f = NULL;
+	struct IRinstruction *tt = IRblock_terminator(t), *ft = IRblock_terminator(f);
+	int cost_t = 0, cost_f = 0;
+
+	if (tt && tt->op == IR_JMP && ft && ft->op == IR_JMP && tt->bt == ft->bt
+		&& is_arm(t, h, tt->bt, &cost_t) && is_arm(f, h, ft->bt, &cost_f)) {
+		j = tt->bt;			// diamond
+		arm_t = t;
+		arm_f = f;
+	} else if (tt && tt->op == IR_JMP && tt->bt == f && is_arm(t, h, f, &cost_t)) {
+		j = f;				// triangle on the true side
+		arm_t = t;
+	} else if (ft && ft->op == IR_JMP && ft->bt == t && is_arm(f, h, t, &cost_f)) {
+		j = t;				// triangle on the false side
+		arm_f = f;
+	} else {
+		return (false);
+	}
+
+	if (j == h) {
+		return (false);
+	}
+
+	int nsel = count_selects(j, arm_t ? arm_t : h, arm_f ? arm_f : h);
+	if (nsel < 0 || cost_t + cost_f + nsel * select_cost() > IFCONV_BUDGET) {
+		return (false);
+	}
+
+	convert(h, arm_t, arm_f, j);
+	return (true);
+}
+
+// If-conversion: turns small side-effect-free branch diamonds and triangles
+// into selects, when a cost model finds executing both sides cheaper than a
+// possibly mispredicted branch. Identifiers are renumbered.
+bool IRopt_ifconvert(struct IRfunction *self) {
+	bool changed = false;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		changed |= try_convert((void*)p);
+	}
+
+	if (changed) {
+		IRfunction_renumber(self);
+	}
+	return (changed);
+}
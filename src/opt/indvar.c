@@ -0,0 +1,345 @@
+// Induction variables and strength reduction.
+// A basic induction variable is a phi of a loop header which grows by a loop invariant step
+// on every iteration. Adding, subtracting, multiplying or shifting an induction variable by a
+// loop invariant gives a derived one, which also grows by a fixed amount on every iteration.
+// Wrapping integer arithmetic distributes multiplication over addition, so (init + k * step) * c
+// equals init * c + k * (step * c) even when some of the values overflow.
+//
+// Multiplications of induction variables are replaced by new phis growing by an addition
+// on each iteration. Shifts by constants are handled the same way, since the instruction
+// combiner turns multiplications by powers of two into them. If the basic induction variable
+// is then only used by the exit test, the test is rewritten against one of the new phis
+// (linear function test replacement), and the old counter dies.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "acir.h"
+#include "opt.h"
+
+// Recurrence of a value in the current loop.
+// The initial value and the step are materialized in the preheader on demand.
+struct iv_entry {
+	bool is_iv;			// whether the value is an induction variable
+	struct IRinstruction *base;	// induction variable this one is derived from, NULL for basic ones
+	int op;				// IR_ADD, IR_SUB, IR_MUL or IR_SHL applied to _base_ and _operand_
+	struct IRinstruction *operand;	// loop invariant operand
+	struct IRinstruction *init;	// value on the first iteration, NULL until materialized
+	struct IRinstruction *step;	// growth per iteration, NULL until materialized
+	struct IRinstruction *scaled;	// for basic variables, a reduced multiple of the variable
+	int64_t scale;			// constant factor of _scaled_
+};
+
+// Working state of the pass.
+struct sr_context {
+	struct IRfunction *f;
+	struct IRloopinfo *info;	// loop nest, from the analysis cache
+	struct IRuses uses;
+	struct IRrange *ranges;		// value ranges, indexed by instruction id
+	int n;				// number of instructions when the pass started
+	struct iv_entry *iv;		// recurrences in the current loop, indexed by instruction id
+	struct IRinstruction **repl;	// pending replacements, indexed by instruction id
+	struct IRloop *loop;		// the current loop
+	struct IRblock *ph, *latch;	// preheader and only latch of the current loop
+};
+
+// Returns the recurrence of a value, or NULL if it is not an induction variable.
+static struct iv_entry* iv_get(struct sr_context *ctx, struct IRinstruction *x) {
+	if (x->id >= ctx->n || !ctx->iv[x->id].is_iv) {
+		return (NULL);
+	}
+	return (&ctx->iv[x->id]);
+}
+
+// Returns whether the value is available before the current loop.
+static bool is_invariant(struct sr_context *ctx, struct IRinstruction *x) {
+	return (!IRloop_contains(ctx->info, ctx->loop, x->owner));
+}
+
+// Constructs an instruction at the end of the preheader.
+static struct IRinstruction* emit(struct sr_context *ctx, int op, int type,
+					struct IRinstruction *left, struct IRinstruction *right) {
+	return (IRinstruction_new_before(IRblock_terminator(ctx->ph), op, type, left, right));
+}
+
+// Returns the step of an induction variable, materializing it if needed.
+static struct IRinstruction* iv_step(struct sr_context *ctx, struct IRinstruction *x) {
+	struct iv_entry *e = iv_get(ctx, x);
+	if (e->step) {
+		return (e->step);
+	}
+
+	if (e->base == NULL) {
+		e->step = emit(ctx, IR_NEG, x->type, e->operand, NULL);	// basic, counting down
+	} else if (e->op == IR_ADD || e->op == IR_SUB) {
+		e->step = iv_step(ctx, e->base);
+	} else {
+		e->step = emit(ctx, e->op, x->type, iv_step(ctx, e->base), e->operand);
+	}
+	return (e->step);
+}
+
+// Returns the initial value of an induction variable, materializing it if needed.
+static struct IRinstruction* iv_init(struct sr_context *ctx, struct IRinstruction *x) {
+	struct iv_entry *e = iv_get(ctx, x);
+	if (e->init == NULL) {
+		e->init = emit(ctx, e->op, x->type, iv_init(ctx, e->base), e->operand);
+	}
+	return (e->init);
+}
+
+// Records the basic induction variables of the current loop.
+static void find_basic(struct sr_context *ctx) {
+	struct IRblock *h = ctx->loop->header;
+	for (struct llist_node *p = h->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		struct IRinstruction *phi = (void*)p, *v = IRphi_get_arg(phi, ctx->latch), *s;
+		if (phi->id >= ctx->n || !IRTypecode_is_int(phi->type) || phi->type == IRT_I1) {
+			continue;
+		}
+
+		if (v->op == IR_ADD && v->left == phi) {
+			s = v->right;
+		} else if ((v->op == IR_ADD && v->right == phi) || (v->op == IR_SUB && v->left == phi)) {
+			s = v->left == phi ? v->right : v->left;
+		} else {
+			continue;
+		}
+		if (!is_invariant(ctx, s)) {
+			continue;
+		}
+
+		struct iv_entry *e = &ctx->iv[phi->id];
+		e->is_iv = true;
+		e->op = v->op;
+		e->operand = s;
+		e->init = IRphi_get_arg(phi, ctx->ph);
+		e->step = v->op == IR_ADD ? s : NULL;
+	}
+}
+
+// Replaces a multiple of an induction variable with a new phi growing by an addition.
+static void reduce(struct sr_context *ctx, struct IRinstruction *x) {
+	struct iv_entry *e = &ctx->iv[x->id];
+	struct IRinstruction *init = iv_init(ctx, x), *step = iv_step(ctx, x);
+
+	struct IRinstruction *phi = IRinstruction_new_phi(ctx->loop->header, x->type);
+	struct IRinstruction *next = IRinstruction_new_before(IRblock_terminator(ctx->latch),
+								IR_ADD, x->type, phi, step);
+	IRphi_add_arg(phi, ctx->ph, init);
+	IRphi_add_arg(phi, ctx->latch, next);
+	ctx->repl[x->id] = phi;
+
+	// A constant multiple of a basic variable may take over its exit test.
+	struct iv_entry *b = iv_get(ctx, e->base);
+	if (b->base == NULL && b->scaled == NULL && e->operand->op == IR_IMM) {
+		int64_t c = IRimm_value(e->operand);
+		if (e->op == IR_SHL) {
+			c = (c < IRTypecode_bits(x->type) - 1) ? INT64_C(1) << c : 0;
+		}
+		if (c > 0) {
+			b->scaled = phi;
+			b->scale = c;
+		}
+	}
+}
+
+// Records the derived induction variables of the current loop, and reduces the multiplications.
+// Blocks are listed in reverse postorder, so the recurrences of operands are known first.
+static bool find_derived(struct sr_context *ctx) {
+	bool changed = false;
+	for (int i = 0; i < ctx->loop->blocks.length; ++i) {
+		struct IRblock *b = ctx->loop->blocks.begin[i];
+		for (struct llist_node *p = b->ins.head; p; p = p->nxt) {
+			struct IRinstruction *x = (void*)p;
+			if (x->id >= ctx->n || ctx->iv[x->id].is_iv || ctx->repl[x->id] || !IRTypecode_is_int(x->type)) {
+				continue;
+			}
+
+			struct IRinstruction *base, *operand;
+			if ((x->op == IR_ADD || x->op == IR_MUL) && iv_get(ctx, x->right) && is_invariant(ctx, x->left)) {
+				base = x->right;
+				operand = x->left;
+			} else if ((x->op == IR_ADD || x->op == IR_SUB || x->op == IR_MUL || x->op == IR_SHL)
+					&& iv_get(ctx, x->left) && is_invariant(ctx, x->right)) {
+				base = x->left;
+				operand = x->right;
+			} else {
+				continue;
+			}
+
+			if (x->op == IR_SHL && (operand->op != IR_IMM || IRimm_value(operand) < 0
+				|| IRimm_value(operand) >= IRTypecode_bits(x->type))) {
+				continue;
+			}
+
+			struct iv_entry *e = &ctx->iv[x->id];
+			e->is_iv = true;
+			e->base = base;
+			e->op = x->op;
+			e->operand = operand;
+			if (x->op == IR_MUL || x->op == IR_SHL) {
+				reduce(ctx, x);
+				changed = true;
+			}
+		}
+	}
+	return (changed);
+}
+
+// Returns whether v * c is representable in the type.
+static bool mul_fits(int type, int64_t v, int64_t c) {
+	int64_t r;
+	return (!IRmul_overflow(v, c, &r) && IRTypecode_wrap(type, r) == r);
+}
+
+// Returns whether every user of the basic induction variable, except its increment and
+// the comparison _cmp_, has been replaced.
+static bool only_counts(struct sr_context *ctx, struct IRinstruction *phi, struct IRinstruction *cmp) {
+	struct IRinstruction *next = IRphi_get_arg(phi, ctx->latch);
+	struct array *users = IRuses_get(&ctx->uses, phi);
+	for (int i = 0; i < users->length; ++i) {
+		struct IRinstruction *u = users->begin[i];
+		if (u != next && u != cmp && (u->id >= ctx->n || ctx->repl[u->id] == NULL)) {
+			return (false);
+		}
+	}
+
+	users = IRuses_get(&ctx->uses, next);
+	for (int i = 0; i < users->length; ++i) {
+		if (users->begin[i] != phi) {
+			return (false);
+		}
+	}
+	return (true);
+}
+
+// Linear function test replacement: rewrites the exit test of the current loop, comparing
+// a counter with a loop invariant bound, into a test on a reduced multiple of the counter.
+// Only counters with constant initial values and positive constant steps are handled, and the
+// range of the bound must show that scaling the counter and the bound can not overflow.
+static bool replace_test(struct sr_context *ctx) {
+	struct IRblock *h = ctx->loop->header;
+	struct IRinstruction *br = IRblock_terminator(h), *cmp = br->cond;
+	if (br->op != IR_BR || !IRis_cmp(cmp->op) || cmp->id >= ctx->n) {
+		return (false);
+	}
+
+	// Normalize into: stay in the loop while (counter op bound).
+	int op = cmp->op;
+	bool on_left = iv_get(ctx, cmp->left) != NULL;
+	struct IRinstruction *phi = on_left ? cmp->left : cmp->right, *bound = on_left ? cmp->right : cmp->left;
+	struct iv_entry *e = iv_get(ctx, phi);
+	if (e == NULL || e->base != NULL || phi->op != IR_PHI || phi->owner != h
+		|| e->scaled == NULL || !is_invariant(ctx, bound) || bound->id >= ctx->n) {
+		return (false);
+	}
+	if (!on_left) {
+		op = IRcmp_swap(op);
+	}
+	bool t_in = IRloop_contains(ctx->info, ctx->loop, br->bt), f_in = IRloop_contains(ctx->info, ctx->loop, br->bf);
+	if (t_in == f_in) {
+		return (false);
+	}
+	if (!t_in) {
+		op = IRcmp_inverse(op);
+	}
+	if (op != IR_CMP_LT && op != IR_CMP_LE) {
+		return (false);
+	}
+
+	if (e->init->op != IR_IMM || e->step == NULL || e->step->op != IR_IMM || IRimm_value(e->step) <= 0) {
+		return (false);
+	}
+	if (!only_counts(ctx, phi, cmp)) {
+		return (false);
+	}
+
+	// The counter starts at _a_ and only grows until it passes the bound.
+	int type = phi->type;
+	const struct IRrange *r = &ctx->ranges[bound->id];
+	int64_t a = IRimm_value(e->init), s = IRimm_value(e->step), c = e->scale, hi;
+	if (IRrange_is_empty(r) || IRadd_overflow(r->hi, s - (op == IR_CMP_LT), &hi)
+		|| IRTypecode_wrap(type, hi) != hi) {
+		return (false);
+	}
+	if (hi < a) {
+		hi = a;
+	}
+	if (!mul_fits(type, a, c) || !mul_fits(type, hi, c) || !mul_fits(type, r->lo, c) || !mul_fits(type, r->hi, c)) {
+		return (false);
+	}
+
+	struct IRinstruction *scaled_bound = emit(ctx, IR_MUL, type, bound, IRblock_new_const(ctx->ph, type, c));
+	if (on_left) {
+		cmp->left = e->scaled;
+		cmp->right = scaled_bound;
+	} else {
+		cmp->left = scaled_bound;
+		cmp->right = e->scaled;
+	}
+	return (true);
+}
+
+// Returns the only latch of the loop, or NULL if there are several back edges.
+static struct IRblock* only_latch(struct sr_context *ctx) {
+	struct IRblock *res = NULL;
+	for (struct llist_node *p = ctx->loop->header->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		if (!IRloop_contains(ctx->info, ctx->loop, pre)) {
+			continue;
+		}
+		if (res) {
+			return (NULL);
+		}
+		res = pre;
+	}
+	return (res);
+}
+
+// Strength reduction of induction variables: multiplications of induction variables become
+// additive recurrences, and exit tests are moved onto the reduced values when that lets the
+// original counter die. Loops without preheaders are skipped.
+bool IRopt_strength_reduce(struct IRfunction *self, struct IRanalyses *am) {
+	struct sr_context ctx = {
+		.f = self,
+		.info = IRanalyses_loops(am),
+		.n = self->ins_count,
+		.iv = try_malloc((self->ins_count + 1) * sizeof(struct iv_entry), __FUNCTION__),
+		.repl = try_calloc(self->ins_count + 1, sizeof(struct IRinstruction*), __FUNCTION__),
+	};
+	if (ctx.info->loops.length > 0) {
+		IRuses_build(&ctx.uses, self);
+		ctx.ranges = IRrange_analyze(self);
+	}
+
+	bool changed = false;
+	for (struct llist_node *p = ctx.info->loops.head; p; p = p->nxt) {
+		ctx.loop = (void*)p;
+		ctx.ph = IRloop_preheader(ctx.info, ctx.loop);
+		ctx.latch = only_latch(&ctx);
+		if (ctx.ph == NULL || ctx.latch == NULL) {
+			continue;
+		}
+
+		memset(ctx.iv, 0, ctx.n * sizeof(struct iv_entry));
+		find_basic(&ctx);
+		changed |= find_derived(&ctx);
+		changed |= replace_test(&ctx);
+	}
+
+	if (changed) {
+		// The table must also cover the instructions created by the pass.
+		struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+		memcpy(repl, ctx.repl, ctx.n * sizeof(struct IRinstruction*));
+		IRfunction_apply_replacements(self, repl);
+		free(repl);
+		IRfunction_renumber(self);
+	}
+	if (ctx.info->loops.length > 0) {
+		IRuses_free(&ctx.uses);
+		free(ctx.ranges);
+	}
+	free(ctx.repl);
+	free(ctx.iv);
+	return (changed);
+}
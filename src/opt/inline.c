@@ -0,0 +1,263 @@
+// Function inlining.
+// A call is replaced by a copy of the body of the callee: the block of the call is split
+// after it, the blocks of the callee are cloned in between with new identifiers from the
+// caller, parameters becoming the arguments, and returns jumps to the rest of the block,
+// where a phi merges the returned values. Stack slots of the callee are created in the
+// entry of the caller, as the other passes expect them there.
+//
+// Functions are handled bottom-up in the call graph, so a callee is inlined once it is
+// optimized, with its final size. The cost of a call is the size of the callee, less the
+// call itself, and a bonus for each constant argument, which will likely fold part of the
+// body. Calls within a cycle of the call graph are never inlined.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "acir.h"
+#include "opt.h"
+
+// Cost saved by each constant argument.
+#define INLINE_CONST_ARG_BONUS 4
+
+// Largest size of a caller which calls may still be inlined into.
+#define INLINE_MAX_CALLER_SIZE 2000
+
+// Working state of the pass.
+struct inline_context {
+	struct IRfunction *f;
+	struct IRfunction *callee;	// the function of the current call
+	struct IRinstruction **vmap;	// copy of each instruction of the callee, indexed by instruction id
+	struct IRblock **bmap;		// copy of each block of the callee, indexed by block id
+	struct llist_node *pos;		// layout position after which new blocks are inserted
+};
+
+// Returns the number of instructions of a function, constants and parameters excluded.
+static int function_size(struct IRfunction *f) {
+	int size = 0;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			int op = ((struct IRinstruction*)q)->op;
+			size += (op != IR_IMM && op != IR_PARAM);
+		}
+	}
+	return (size);
+}
+
+// Returns whether the body of the function can be copied: its entry is not the target of a
+// jump, and it returns somewhere.
+static bool is_inlinable(struct IRfunction *f) {
+	if (((struct IRblock*)f->bs.head)->pre.length > 0) {
+		return (false);
+	}
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRinstruction *t = IRblock_terminator((void*)p);
+		if (t && t->op == IR_RET) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Returns the cost of inlining the call, with the size of its callee.
+static int call_cost(struct IRinstruction *call, int size) {
+	int cost = size - 1 - call->argc;
+	for (int i = 0; i < call->argc; ++i) {
+		if (call->args[i]->op == IR_IMM) {
+			cost -= INLINE_CONST_ARG_BONUS;
+		}
+	}
+	return (cost);
+}
+
+// Operand callback of inline_call().
+static void map_operand(struct IRinstruction **slot, void *arg) {
+	struct inline_context *ctx = arg;
+	*slot = ctx->vmap[(*slot)->id];
+}
+
+// Constructs a block, placed in layout after the previously constructed ones.
+static struct IRblock* new_block(struct inline_context *ctx) {
+	struct IRblock *b = IRblock_new(ctx->f);
+	llist_unlink(&ctx->f->bs, b);
+	llist_insert_after(&ctx->f->bs, ctx->pos, b);
+	ctx->pos = &b->n;
+	return (b);
+}
+
+// Moves the instructions following the call into a new block, which takes over the
+// successors of the block of the call.
+static struct IRblock* split_after(struct inline_context *ctx, struct IRinstruction *call) {
+	struct IRblock *b = call->owner, *rest = new_block(ctx);
+	while (call->n.nxt) {
+		struct IRinstruction *x = (void*)call->n.nxt;
+		llist_unlink(&b->ins, x);
+		llist_pushback(&rest->ins, x);
+		x->owner = rest;
+	}
+	rest->is_complete = true;
+	b->is_complete = false;
+
+	struct IRblock *succ[2];
+	int k = IRblock_successors(rest, succ);
+	for (int i = 0; i < k; ++i) {
+		if (i == 0 || succ[i] != succ[0]) {
+			IRblock_replace_pre(succ[i], b, rest);
+		}
+	}
+	return (rest);
+}
+
+// Copies the body of the callee in place of the call, and returns the value of the call.
+// The call is unlinked from its block.
+static struct IRinstruction* inline_call(struct inline_context *ctx, struct IRinstruction *call) {
+	struct IRfunction *g = call->callee;
+	struct IRblock *entry = (void*)ctx->f->bs.head, *b = call->owner;
+	ctx->callee = g;
+	ctx->vmap = try_calloc(g->ins_count + 1, sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx->bmap = try_calloc(g->bs.length + 1, sizeof(struct IRblock*), __FUNCTION__);
+
+	// Blocks are laid out as: the block of the call, the body, then the rest of the block.
+	ctx->pos = &b->n;
+	for (struct llist_node *p = g->bs.head; p; p = p->nxt) {
+		ctx->bmap[((struct IRblock*)p)->id] = new_block(ctx);
+	}
+	struct IRblock *rest = split_after(ctx, call);
+	llist_unlink(&b->ins, call);
+	IRinstruction_new_jmp(b, IR_JMP, NULL, ctx->bmap[((struct IRblock*)g->bs.head)->id], NULL);
+
+	// Values first, as operands may be defined later in layout order.
+	for (struct llist_node *p = g->bs.head; p; p = p->nxt) {
+		struct IRblock *c = ctx->bmap[((struct IRblock*)p)->id];
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q, *y;
+			if (x->op == IR_PHI) {
+				y = IRinstruction_new_phi(c, x->type);
+			} else if (x->op == IR_PARAM) {
+				y = call->args[x->param_index];
+			} else if (x->op == IR_ALLOCA) {
+				y = IRblock_new_alloca(entry, x->slot_type, x->slot_count);
+			} else if (IRis_terminate(x->op)) {
+				continue;
+			} else {
+				y = IRinstruction_clone(x, c);
+			}
+			ctx->vmap[x->id] = y;
+		}
+	}
+
+	// Then operands, phi arguments and terminators. Returns jump to the rest of the block.
+	struct array rets, vals;
+	array_init(&rets);
+	array_init(&vals);
+	for (struct llist_node *p = g->bs.head; p; p = p->nxt) {
+		struct IRblock *c = ctx->bmap[((struct IRblock*)p)->id];
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q, *y = ctx->vmap[x->id];
+			if (x->op == IR_PHI) {
+				for (struct llist_node *r = x->phi.head; r; r = r->nxt) {
+					struct IRphi_arg *a = (void*)r;
+					IRphi_add_arg(y, ctx->bmap[a->source->id], ctx->vmap[a->value->id]);
+				}
+			} else if (x->op == IR_RET) {
+				array_pushback(&rets, c);
+				array_pushback(&vals, ctx->vmap[x->left->id]);
+				IRinstruction_new_jmp(c, IR_JMP, NULL, rest, NULL);
+			} else if (x->op == IR_JMP) {
+				IRinstruction_new_jmp(c, IR_JMP, NULL, ctx->bmap[x->bt->id], NULL);
+			} else if (x->op == IR_BR) {
+				IRinstruction_new_jmp(c, IR_BR, ctx->vmap[x->cond->id],
+						ctx->bmap[x->bt->id], ctx->bmap[x->bf->id]);
+			} else if (x->op != IR_PARAM && x->op != IR_ALLOCA) {
+				IRinstruction_foreach_operand(y, map_operand, ctx);
+			}
+		}
+	}
+
+	// Falling off the end of a function returns an undefined value, zero is used instead.
+	struct IRinstruction *res;
+	if (call->type == IRT_VOID) {
+		res = vals.begin[0];
+	} else {
+		for (int i = 0; i < vals.length; ++i) {
+			struct IRinstruction *v = vals.begin[i];
+			if (v->type != call->type) {
+				vals.begin[i] = IRblock_new_const(entry, call->type, 0);
+			}
+		}
+		res = vals.begin[0];
+		if (rets.length > 1) {
+			res = IRinstruction_new_phi(rest, call->type);
+			for (int i = 0; i < rets.length; ++i) {
+				IRphi_add_arg(res, rets.begin[i], vals.begin[i]);
+			}
+		}
+	}
+
+	array_free(&rets);
+	array_free(&vals);
+	free(ctx->vmap);
+	free(ctx->bmap);
+	return (res);
+}
+
+// Function inlining: replaces the calls whose cost is below the inlining threshold with a copy
+// of the body of the callee. Callees should be optimized before their callers, in the
+// bottom-up order of the call graph. Identifiers are renumbered.
+bool IRopt_inline(struct IRfunction *self, const struct IRcallgraph *cg, int threshold) {
+	struct array calls;
+	array_init(&calls);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (x->op == IR_CALL && !IRcallgraph_same_scc(cg, self, x->callee)) {
+				array_pushback(&calls, x);
+			}
+		}
+	}
+	if (threshold <= 0 || calls.length == 0) {
+		array_free(&calls);
+		return (false);
+	}
+
+	struct inline_context ctx = { .f = self };
+	struct array done, values;
+	array_init(&done);
+	array_init(&values);
+	int size = function_size(self);
+	for (int i = 0; i < calls.length; ++i) {
+		struct IRinstruction *call = calls.begin[i];
+		struct IRfunction *g = call->callee;
+		if (!is_inlinable(g)) {
+			continue;
+		}
+		int callee_size = function_size(g);
+		if (call_cost(call, callee_size) > threshold || size + callee_size > INLINE_MAX_CALLER_SIZE) {
+			continue;
+		}
+
+		IRfunction_renumber(g);
+		array_pushback(&values, inline_call(&ctx, call));
+		array_pushback(&done, call);
+		size += callee_size - 1;
+	}
+
+	bool changed = (done.length > 0);
+	if (changed) {
+		struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+		for (int i = 0; i < done.length; ++i) {
+			repl[((struct IRinstruction*)done.begin[i])->id] = values.begin[i];
+		}
+		IRfunction_apply_replacements(self, repl);
+		IRfunction_renumber(self);
+		for (int i = 0; i < done.length; ++i) {
+			IRinstruction_free(done.begin[i]);
+		}
+		free(repl);
+	}
+
+	array_free(&calls);
+	array_free(&done);
+	array_free(&values);
+	return (changed);
+}
@@ -0,0 +1,529 @@
+// Peephole instruction combiner.
+// Patterns are described by a rule table, the instructions whose operands have
+// changed are revisited with a worklist until no rule applies any more.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// A rewriting rule of the combiner.
+// A rule matches an instruction with opcode _op_ whose left operand has opcode _inner_,
+// and for which _cond_ holds. The rewrite function either changes the instruction
+// in place and returns it, returns another value replacing it, or returns NULL
+// if the pattern turns out not to apply.
+struct combine_rule {
+	int op;						// opcode of the instruction, IR_NULL for any
+	int inner;					// opcode of the left operand, IR_NULL for any
+	bool (*cond)(struct IRinstruction *x);		// extra condition, NULL for none
+	struct IRinstruction* (*rewrite)(struct IRinstruction *x);
+};
+
+// Returns whether the instruction is an integer immediate.
+static bool is_int_imm(struct IRinstruction *x) {
+	return (x->op == IR_IMM && IRTypecode_is_int(x->type));
+}
+
+// Returns whether the instruction is an integer immediate of the given value.
+static bool is_imm_of(struct IRinstruction *x, int64_t v) {
+	return (is_int_imm(x) && IRimm_value(x) == v);
+}
+
+// Returns the base 2 logarithm of a positive power of two, or -1 for other values.
+static int log2_exact(int64_t v) {
+	if (v <= 0 || (v & (v - 1)) != 0) {
+		return (-1);
+	}
+
+	int k = 0;
+	while (v > 1) {
+		v >>= 1;
+		k += 1;
+	}
+	return (k);
+}
+
+// Condition: every operand of the instruction is an integer immediate.
+static bool all_const(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_ZEXT: case IR_SEXT: case IR_TRUNC:
+		case IR_NEG: case IR_NOT:
+			return (is_int_imm(x->left));
+
+		default:
+			return (IRis_binary(x->op) && is_int_imm(x->left) && is_int_imm(x->right));
+	}
+}
+
+// Condition: only the left operand is an immediate, which should be swapped to the right.
+static bool const_on_left(struct IRinstruction *x) {
+	return (IRis_binary(x->op) && (IRis_commutative(x->op) || IRis_cmp(x->op))
+		&& is_int_imm(x->left) && !is_int_imm(x->right));
+}
+
+// Condition: a binary operation whose right operand is an immediate.
+static bool const_on_right(struct IRinstruction *x) {
+	return (IRis_binary(x->op) && is_int_imm(x->right));
+}
+
+// Condition: a binary operation on the same value twice.
+static bool same_operands(struct IRinstruction *x) {
+	return (IRis_binary(x->op) && x->left == x->right);
+}
+
+// Condition: a bool compared with a constant.
+static bool bool_vs_const(struct IRinstruction *x) {
+	return (x->left->type == IRT_I1 && is_int_imm(x->right));
+}
+
+// Condition: a zero extended value compared with a constant that fits in the unextended type.
+static bool zext_vs_const(struct IRinstruction *x) {
+	if (!IRis_cmp(x->op) || !is_int_imm(x->right)) {
+		return (false);
+	}
+
+	int64_t v = IRimm_value(x->right);
+	int inner = x->left->left->type;
+	return (v >= 0 && (inner == IRT_I1 ? v <= 1 : IRTypecode_wrap(inner, v) == v));
+}
+
+// Condition: a sign extended integer compared with a constant that fits in the unextended type.
+static bool sext_vs_const(struct IRinstruction *x) {
+	if (!IRis_cmp(x->op) || !is_int_imm(x->right)) {
+		return (false);
+	}
+
+	int inner = x->left->left->type;
+	return (inner != IRT_I1 && IRTypecode_wrap(inner, IRimm_value(x->right)) == IRimm_value(x->right));
+}
+
+// Condition: a constant added to or subtracted from the result of another such operation.
+static bool const_chain(struct IRinstruction *x) {
+	struct IRinstruction *y = x->left;
+	return (is_int_imm(x->right) && y->type == x->type && is_int_imm(y->right) && y->right->type == x->right->type);
+}
+
+// Rewrite: evaluates an instruction on constants.
+// Operations with undefined results, such as divisions by zero, are left alone.
+static struct IRinstruction* fold_const(struct IRinstruction *x) {
+	uint64_t a = IRimm_value(x->left), res;
+	if (IRis_binary(x->op)) {
+		int64_t v;
+		if (!IRopcode_fold(x->op, x->left->type, a, IRimm_value(x->right), &v)) {
+			return (NULL);
+		}
+		IRimm_set(x, x->type, v);
+		return (x);
+	}
+
+	switch (x->op) {
+		case IR_ZEXT: {
+			int bits = IRTypecode_bits(x->left->type);
+			res = (bits == 64) ? a : (a & ((UINT64_C(1) << bits) - 1));
+		}	break;
+
+		case IR_SEXT: {
+			res = (x->left->type == IRT_I1) ? -a : a;	// values are kept sign extended
+		}	break;
+
+		case IR_TRUNC:	res = a;		break;
+		case IR_NEG:	res = -a;		break;
+		case IR_NOT:	res = ~a;		break;
+		default:	fail_ir_op(x->op, __FUNCTION__);
+	}
+
+	IRimm_set(x, x->type, IRTypecode_wrap(x->type, res));
+	return (x);
+}
+
+// Rewrite: op(c, x) => op(x, c) for commutative operations, and cmp(c, x) => swapped cmp(x, c).
+static struct IRinstruction* swap_operands(struct IRinstruction *x) {
+	struct IRinstruction *t = x->left;
+	x->left = x->right;
+	x->right = t;
+	if (IRis_cmp(x->op)) {
+		x->op = IRcmp_swap(x->op);
+	}
+	return (x);
+}
+
+// Rewrite: algebraic identities with a constant right operand, e.g.
+// x + 0 => x, x * 1 => x, x * 0 => 0, x & -1 => x, x | -1 => -1, x * -1 => -x.
+// Subtractions of constants become additions, x - c => x + -c, to expose common expressions.
+static struct IRinstruction* fold_identity(struct IRinstruction *x) {
+	struct IRinstruction *l = x->left, *r = x->right;
+	switch (x->op) {
+		case IR_ADD: case IR_SUB: case IR_OR: case IR_XOR:
+		case IR_SHL: case IR_LSHR: case IR_ASHR: {
+			if (is_imm_of(r, 0)) {
+				return (l);
+			}
+			if (x->op == IR_SUB && x->type != IRT_I1) {
+				x->op = IR_ADD;
+				x->right = IRblock_new_const(x->owner, r->type, IRTypecode_wrap(r->type, -(uint64_t)IRimm_value(r)));
+				return (x);
+			}
+			if (x->op == IR_XOR && is_imm_of(r, -1) && x->type != IRT_I1) {
+				x->op = IR_NOT;
+				x->right = NULL;
+				return (x);
+			}
+			if (x->op == IR_OR && is_imm_of(r, IRTypecode_wrap(x->type, -1))) {
+				return (r);
+			}
+		}	break;
+
+		case IR_MUL: {
+			if (is_imm_of(r, 0)) {
+				return (r);
+			}
+			if (is_imm_of(r, -1)) {
+				x->op = IR_NEG;
+				x->right = NULL;
+				return (x);
+			}
+		}	// fall through
+
+		case IR_SDIV: case IR_UDIV: {
+			if (is_imm_of(r, 1)) {
+				return (l);
+			}
+		}	break;
+
+		case IR_AND: {
+			if (is_imm_of(r, 0)) {
+				return (r);
+			}
+			if (is_imm_of(r, IRTypecode_wrap(x->type, -1))) {
+				return (l);
+			}
+		}	break;
+	}
+	return (NULL);
+}
+
+// Rewrite: x - x => 0, x ^ x => 0, x & x => x, x | x => x, and comparisons of a value with itself.
+static struct IRinstruction* fold_same_operands(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_SUB: case IR_XOR: {
+			IRimm_set(x, x->type, 0);
+			return (x);
+		}
+
+		case IR_AND: case IR_OR: {
+			return (x->left);
+		}
+
+		case IR_CMP_EQ: case IR_CMP_LE: case IR_CMP_GE: case IR_CMP_ULE: case IR_CMP_UGE: {
+			IRimm_set(x, IRT_I1, 1);
+			return (x);
+		}
+
+		case IR_CMP_NE: case IR_CMP_LT: case IR_CMP_GT: case IR_CMP_ULT: case IR_CMP_UGT: {
+			IRimm_set(x, IRT_I1, 0);
+			return (x);
+		}
+
+		default: {
+			return (NULL);
+		}
+	}
+}
+
+// Rewrite: multiplications and unsigned divisions by a power of two become shifts,
+// x * 2^k => x << k, x /u 2^k => x >>u k, x %u 2^k => x & (2^k - 1).
+static struct IRinstruction* fold_pow2(struct IRinstruction *x) {
+	int64_t v = IRimm_value(x->right);
+	int k = log2_exact(v);
+	if (k <= 0) {
+		return (NULL);
+	}
+
+	switch (x->op) {
+		case IR_MUL:	x->op = IR_SHL;		break;
+		case IR_UDIV:	x->op = IR_LSHR;	break;
+		case IR_UREM: {
+			x->op = IR_AND;
+			x->right = IRblock_new_const(x->owner, x->type, v - 1);
+			return (x);
+		}
+		default:	return (NULL);
+	}
+	x->right = IRblock_new_const(x->owner, x->type, k);
+	return (x);
+}
+
+// Rewrite: (y + c1) + c2 => y + (c1 + c2), and likewise with subtractions, so that the
+// addresses of neighbouring elements share their base.
+static struct IRinstruction* fold_const_chain(struct IRinstruction *x) {
+	struct IRinstruction *y = x->left;
+	uint64_t c1 = IRimm_value(y->right), c2 = IRimm_value(x->right);
+	if (y->op == IR_SUB) {
+		c1 = -c1;
+	}
+	if (x->op == IR_SUB) {
+		c2 = -c2;
+	}
+
+	int type = x->right->type;
+	x->op = IR_ADD;
+	x->left = y->left;
+	x->right = IRblock_new_const(x->owner, type, IRTypecode_wrap(type, c1 + c2));
+	return (x);
+}
+
+// Rewrite: trunc(ext(y)) => y, ext(y) or trunc(y), depending on the width of y.
+static struct IRinstruction* fold_trunc_ext(struct IRinstruction *x) {
+	struct IRinstruction *ext = x->left, *y = ext->left;
+	int from = IRTypecode_bits(y->type), to = IRTypecode_bits(x->type);
+
+	if (from == to) {
+		return (y);
+	}
+	x->op = (from < to) ? ext->op : IR_TRUNC;
+	x->left = y;
+	return (x);
+}
+
+// Rewrite: ext(ext(y)) => ext(y), trunc(trunc(y)) => trunc(y).
+// A sign extension of a zero extended value is a zero extension.
+static struct IRinstruction* fold_cast_cast(struct IRinstruction *x) {
+	x->op = x->left->op;
+	x->left = x->left->left;
+	return (x);
+}
+
+// Rewrite: not(not(y)) => y, neg(neg(y)) => y.
+static struct IRinstruction* fold_involution(struct IRinstruction *x) {
+	return (x->left->left);
+}
+
+// Rewrite: not(cmp(a, b)) => inverse_cmp(a, b) on bools.
+static struct IRinstruction* fold_not_cmp(struct IRinstruction *x) {
+	struct IRinstruction *c = x->left;
+	if (x->type != IRT_I1 || !IRis_cmp(c->op)) {
+		return (NULL);
+	}
+
+	x->op = IRcmp_inverse(c->op);
+	x->left = c->left;
+	x->right = c->right;
+	return (x);
+}
+
+// Rewrite: eq(c, 0) => !c, eq(c, 1) => c, ne(c, 0) => c, ne(c, 1) => !c, for a bool c.
+// !c is an inverted comparison if c is a comparison, otherwise a bitwise not on bool.
+static struct IRinstruction* fold_bool_cmp(struct IRinstruction *x) {
+	struct IRinstruction *c = x->left;
+	bool keep = (IRimm_value(x->right) != 0) == (x->op == IR_CMP_EQ);
+	if (keep) {
+		return (c);
+	}
+
+	if (IRis_cmp(c->op)) {
+		x->op = IRcmp_inverse(c->op);
+		x->left = c->left;
+		x->right = c->right;
+	} else {
+		x->op = IR_NOT;
+		x->left = c;
+		x->right = NULL;
+	}
+	return (x);
+}
+
+// Rewrite: cmp(ext(y), k) => cmp(y, k) when k is representable in the type of y.
+// Extensions keep the order of values, but zero extended values are never negative,
+// so signed comparisons of them become unsigned comparisons of the unextended values.
+static struct IRinstruction* fold_cmp_ext(struct IRinstruction *x) {
+	static const int to_unsigned[][2] = {
+		{IR_CMP_LT,	IR_CMP_ULT},
+		{IR_CMP_LE,	IR_CMP_ULE},
+		{IR_CMP_GT,	IR_CMP_UGT},
+		{IR_CMP_GE,	IR_CMP_UGE},
+		{IR_NULL},
+	};
+
+	struct IRinstruction *y = x->left->left;
+	if (x->left->op == IR_ZEXT) {
+		for (int i = 0; to_unsigned[i][0] != IR_NULL; ++i) {
+			if (to_unsigned[i][0] == x->op) {
+				x->op = to_unsigned[i][1];
+				break;
+			}
+		}
+	}
+	x->left = y;
+	x->right = IRblock_new_const(x->owner, y->type, IRimm_value(x->right));
+	return (x);
+}
+
+// Rewrite: select(true, a, b) => a, select(false, a, b) => b, select(c, a, a) => a,
+// and on bools select(c, true, false) => c.
+static struct IRinstruction* fold_select(struct IRinstruction *x) {
+	if (is_int_imm(x->cond)) {
+		return (IRimm_value(x->cond) ? x->vt : x->vf);
+	}
+	if (x->vt == x->vf) {
+		return (x->vt);
+	}
+	if (x->type == IRT_I1 && is_imm_of(x->vt, 1) && is_imm_of(x->vf, 0)) {
+		return (x->cond);
+	}
+	return (NULL);
+}
+
+// Rewrite: select(!c, a, b) => select(c, b, a).
+static struct IRinstruction* fold_select_not(struct IRinstruction *x) {
+	struct IRinstruction *t = x->vt;
+	x->cond = x->cond->left;
+	x->vt = x->vf;
+	x->vf = t;
+	return (x);
+}
+
+// The rule table, tried in order.
+static const struct combine_rule rules[] = {
+	{IR_NULL,	IR_NULL,	all_const,	fold_const},
+	{IR_NULL,	IR_NULL,	const_on_left,	swap_operands},
+	{IR_NULL,	IR_NULL,	const_on_right,	fold_identity},
+	{IR_NULL,	IR_NULL,	same_operands,	fold_same_operands},
+	{IR_MUL,	IR_NULL,	const_on_right,	fold_pow2},
+	{IR_UDIV,	IR_NULL,	const_on_right,	fold_pow2},
+	{IR_UREM,	IR_NULL,	const_on_right,	fold_pow2},
+	{IR_ADD,	IR_ADD,		const_chain,	fold_const_chain},
+	{IR_ADD,	IR_SUB,		const_chain,	fold_const_chain},
+	{IR_SUB,	IR_ADD,		const_chain,	fold_const_chain},
+	{IR_SUB,	IR_SUB,		const_chain,	fold_const_chain},
+	{IR_TRUNC,	IR_SEXT,	NULL,		fold_trunc_ext},
+	{IR_TRUNC,	IR_ZEXT,	NULL,		fold_trunc_ext},
+	{IR_TRUNC,	IR_TRUNC,	NULL,		fold_cast_cast},
+	{IR_SEXT,	IR_SEXT,	NULL,		fold_cast_cast},
+	{IR_SEXT,	IR_ZEXT,	NULL,		fold_cast_cast},
+	{IR_ZEXT,	IR_ZEXT,	NULL,		fold_cast_cast},
+	{IR_NOT,	IR_NOT,		NULL,		fold_involution},
+	{IR_NEG,	IR_NEG,		NULL,		fold_involution},
+	{IR_NOT,	IR_NULL,	NULL,		fold_not_cmp},
+	{IR_CMP_EQ,	IR_NULL,	bool_vs_const,	fold_bool_cmp},
+	{IR_CMP_NE,	IR_NULL,	bool_vs_const,	fold_bool_cmp},
+	{IR_NULL,	IR_ZEXT,	zext_vs_const,	fold_cmp_ext},
+	{IR_NULL,	IR_SEXT,	sext_vs_const,	fold_cmp_ext},
+	{IR_SELECT,	IR_NULL,	NULL,		fold_select},
+	{IR_SELECT,	IR_NOT,		NULL,		fold_select_not},
+	{IR_NULL,	IR_NULL,	NULL,		NULL}
+};
+
+// Returns whether the rule matches the instruction.
+static bool rule_match(const struct combine_rule *r, struct IRinstruction *x) {
+	if (r->op != IR_NULL && r->op != x->op) {
+		return (false);
+	}
+
+	if (r->inner != IR_NULL) {
+		switch (x->op) {
+			case IR_IMM: case IR_PHI: case IR_JMP: case IR_ALLOCA:
+			case IR_PARAM: case IR_CALL:
+				return (false);
+			default:
+				if (x->left == NULL || x->left->op != r->inner) {
+					return (false);
+				}
+		}
+	}
+	return (r->cond == NULL || r->cond(x));
+}
+
+// Worklist of the combiner.
+struct combine_worklist {
+	int n;				// number of instructions covered by the tables
+	bool *queued;			// whether an instruction is in the worklist, indexed by id
+	bool *replaced;			// whether an instruction has been replaced, indexed by id
+	struct array stack;
+	struct IRuses uses;
+};
+
+// Adds an instruction to the worklist.
+// Instructions created by the combiner itself are immediates and never need a revisit.
+static void worklist_push(struct combine_worklist *w, struct IRinstruction *x) {
+	if (x->id < w->n && !w->queued[x->id] && !w->replaced[x->id]) {
+		w->queued[x->id] = true;
+		array_pushback(&w->stack, x);
+	}
+}
+
+// Adds every user of an instruction to the worklist.
+static void worklist_push_users(struct combine_worklist *w, struct IRinstruction *x) {
+	struct array *users = IRuses_get(&w->uses, x);
+	for (int i = 0; i < users->length; ++i) {
+		worklist_push(w, users->begin[i]);
+	}
+}
+
+// Operand callback: records an operand of an instruction changed in place.
+static void record_operand(struct IRinstruction **slot, void *arg) {
+	struct combine_worklist *w = ((void**)arg)[0];
+	IRuses_add(&w->uses, *slot, ((void**)arg)[1]);
+}
+
+// Peephole instruction combiner: folds constants, redundant casts and algebraic
+// identities described by a rule table, until no rule applies any more.
+// Replaced instructions are left for IRopt_dce() to remove.
+bool IRopt_instcombine(struct IRfunction *self) {
+	struct combine_worklist w = {
+		.n = self->ins_count,
+		.queued = try_calloc(self->ins_count, sizeof(bool), __FUNCTION__),
+		.replaced = try_calloc(self->ins_count, sizeof(bool), __FUNCTION__),
+	};
+	array_init(&w.stack);
+	IRuses_build(&w.uses, self);
+
+	// Push in reverse so that instructions are visited in program order.
+	struct IRinstruction **all = try_malloc(self->ins_count * sizeof(struct IRinstruction*), __FUNCTION__);
+	int cnt = 0;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			all[cnt++] = (void*)q;
+		}
+	}
+	while (cnt > 0) {
+		worklist_push(&w, all[--cnt]);
+	}
+	free(all);
+
+	bool changed = false;
+	struct IRinstruction *x;
+	while ((x = array_popback(&w.stack)) != NULL) {
+		w.queued[x->id] = false;
+		for (int i = 0; rules[i].rewrite; ++i) {
+			if (!rule_match(&rules[i], x)) {
+				continue;
+			}
+
+			struct IRinstruction *y = rules[i].rewrite(x);
+			if (y == NULL) {
+				continue;
+			}
+
+			changed = true;
+			if (y == x) {
+				void *arg[2] = {&w, x};
+				IRinstruction_foreach_operand(x, record_operand, arg);
+				worklist_push(&w, x);
+				worklist_push_users(&w, x);
+			} else {
+				w.replaced[x->id] = true;
+				IRuses_replace(&w.uses, x, y);
+				worklist_push_users(&w, y);
+			}
+			break;
+		}
+	}
+
+	array_free(&w.stack);
+	IRuses_free(&w.uses);
+	free(w.queued);
+	free(w.replaced);
+	return (changed);
+}
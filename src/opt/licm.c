@@ -0,0 +1,144 @@
+// Loop invariant code motion.
+// An instruction of a loop is invariant when each of its operands is defined outside of the
+// loop or is invariant itself. Invariant instructions which can not trap are moved into the
+// preheader of the loop, where they are executed once instead of on every iteration.
+// Loops are processed from the innermost outwards, so that values invariant in several
+// nested loops travel to the outermost preheader they can reach.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "acir.h"
+#include "opt.h"
+
+// Working state of the pass.
+struct licm_context {
+	struct IRloopinfo *info;	// loop nest, from the analysis cache
+	int ni;				// size of the table
+	bool *inv;			// invariance in the current loop, indexed by instruction id
+	struct IRloop *loop;		// the current loop
+	bool ok;			// whether every operand seen so far is available before the loop
+};
+
+// Returns whether the instruction may be executed even when the loop body would not be.
+// Divisions are only safe when the divisor is a constant which can not trap.
+static bool is_speculatable(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_PHI:
+			return (false);
+
+		// Memory may be written by the loop, and an address may be out of bounds before the loop test.
+		case IR_LOAD: case IR_ALLOCA:
+			return (false);
+
+		case IR_SDIV: case IR_SREM: {
+			int64_t d = x->right->op == IR_IMM ? IRimm_value(x->right) : 0;
+			return (x->right->op == IR_IMM && d != 0 && d != -1);
+		}
+
+		case IR_UDIV: case IR_UREM:
+			return (x->right->op == IR_IMM && IRimm_value(x->right) != 0);
+
+		default:
+			return (!IRhas_side_effect(x->op));
+	}
+}
+
+// Operand callback of is_invariant().
+static void check_operand(struct IRinstruction **slot, void *arg) {
+	struct licm_context *ctx = arg;
+	struct IRinstruction *x = *slot;
+	if (IRloop_contains(ctx->info, ctx->loop, x->owner) && !ctx->inv[x->id]) {
+		ctx->ok = false;
+	}
+}
+
+// Returns whether the instruction can be computed before the current loop.
+static bool is_invariant(struct licm_context *ctx, struct IRinstruction *x) {
+	if (!is_speculatable(x)) {
+		return (false);
+	}
+	ctx->ok = true;
+	IRinstruction_foreach_operand(x, check_operand, ctx);
+	return (ctx->ok);
+}
+
+// Marks the invariant instructions of the loop, and returns their number.
+// Blocks are listed in reverse postorder, so definitions are seen before their uses.
+static int mark_invariants(struct licm_context *ctx, struct IRloop *loop) {
+	ctx->loop = loop;
+	memset(ctx->inv, 0, ctx->ni * sizeof(bool));
+
+	int res = 0;
+	for (int i = 0; i < loop->blocks.length; ++i) {
+		struct IRblock *b = loop->blocks.begin[i];
+		for (struct llist_node *p = b->ins.head; p; p = p->nxt) {
+			struct IRinstruction *x = (void*)p;
+			if (is_invariant(ctx, x)) {
+				ctx->inv[x->id] = true;
+				res += 1;
+			}
+		}
+	}
+	return (res);
+}
+
+// Moves the marked instructions of the loop into its preheader, keeping their order.
+static void hoist(struct licm_context *ctx, struct IRloop *loop, struct IRblock *ph) {
+	struct IRinstruction *pos = IRblock_terminator(ph);
+	for (int i = 0; i < loop->blocks.length; ++i) {
+		struct IRblock *b = loop->blocks.begin[i];
+		struct llist_node *p = b->ins.head, *nxt;
+		while (p) {
+			nxt = p->nxt;
+			struct IRinstruction *x = (void*)p;
+			if (ctx->inv[x->id]) {
+				IRinstruction_move_before(x, pos);
+				x->is_fused = false;
+			}
+			p = nxt;
+		}
+	}
+}
+
+// Loop invariant code motion: moves invariant instructions which can not trap into loop
+// preheaders. Preheaders are created where needed, and identifiers renumbered then.
+bool IRopt_licm(struct IRfunction *self, struct IRanalyses *am) {
+	struct licm_context ctx = {
+		.info = IRanalyses_loops(am),
+		.ni = self->ins_count,
+		.inv = try_calloc(self->ins_count + 1, sizeof(bool), __FUNCTION__),
+	};
+
+	// Preheaders are only created for loops with something to hoist,
+	// otherwise the CFG simplification would just remove them again.
+	bool changed = false;
+	for (struct llist_node *p = ctx.info->loops.head; p; p = p->nxt) {
+		struct IRloop *loop = (void*)p;
+		if (IRloop_preheader(ctx.info, loop) == NULL && (void*)loop->header != self->bs.head
+			&& mark_invariants(&ctx, loop) > 0) {
+			IRloop_insert_preheader(ctx.info, loop);
+			changed = true;
+		}
+	}
+	if (changed) {
+		IRfunction_renumber(self);
+		IRanalyses_invalidate(am, 0);
+		free(ctx.inv);
+		ctx.ni = self->ins_count;
+		ctx.inv = try_calloc(self->ins_count + 1, sizeof(bool), __FUNCTION__);
+		ctx.info = IRanalyses_loops(am);
+	}
+
+	for (struct llist_node *p = ctx.info->loops.head; p; p = p->nxt) {
+		struct IRloop *loop = (void*)p;
+		struct IRblock *ph = IRloop_preheader(ctx.info, loop);
+		if (ph && mark_invariants(&ctx, loop) > 0) {
+			hoist(&ctx, loop, ph);
+			changed = true;
+		}
+	}
+
+	free(ctx.inv);
+	return (changed);
+}
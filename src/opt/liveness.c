@@ -0,0 +1,428 @@
+// Liveness of SSA values, by path exploration (Brandner, Boissinot, Darte, Dupont de Dinechin
+// and Rastello, "Computing Liveness Sets for SSA-Form Programs").
+// From each use of a value, the paths of the CFG are followed backwards up to its definition:
+// the value is live at the entry of every block on the way, and at the end of their
+// predecessors. A use by a phi is at the end of the predecessor it comes from, and the value of
+// a phi is live at the entry of its block but not before. As the definition dominates every
+// use, the walk always stops there, and stops as well at blocks where the value is already
+// known live: each block is visited once per value, and no fixed point is iterated. Values
+// are explored one at a time, so sets are built in increasing order, with time and space
+// proportional to their sizes rather than to the number of blocks times the number of values.
+//
+// Instructions are then numbered in layout order, two positions apart so that moves may be
+// placed in between later. The live interval of a value covers its definition, its uses and
+// the blocks it is live in, without holes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "util/sparseset.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Returns whether the instruction produces a value held in a register. Constants and the
+// addresses of stack slots are materialized where they are used instead, a comparison
+// fused with its branch leaves its result in the flags, and an instruction folded into its
+// user is computed by it.
+bool IRliveness_is_value(const struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_IMM: case IR_ALLOCA: case IR_STORE: case IR_RET: case IR_JMP: case IR_BR:
+			return (false);
+
+		case IR_CALL:
+			return (x->type != IRT_VOID);
+
+		default:
+			return (!x->is_fused && !x->is_folded);
+	}
+}
+
+// Context of the operand callback of IRliveness_foreach_use().
+struct use_walk {
+	IRoperand_fn fn;
+	void *arg;
+};
+
+// Operand callback of IRliveness_foreach_use(): goes through folded operands.
+static void visit_folded(struct IRinstruction **slot, void *arg) {
+	struct use_walk *w = arg;
+	if ((*slot)->is_folded) {
+		IRinstruction_foreach_operand(*slot, visit_folded, w);
+	} else {
+		w->fn(slot, w->arg);
+	}
+}
+
+// Calls _fn_ on every operand slot read by the instruction, including phi arguments: the
+// operands of an instruction folded into it are read by it instead, and a folded instruction
+// reads nothing itself.
+void IRliveness_foreach_use(struct IRinstruction *x, IRoperand_fn fn, void *arg) {
+	if (x->is_folded) {
+		return;
+	}
+	struct use_walk w = { .fn = fn, .arg = arg };
+	IRinstruction_foreach_operand(x, visit_folded, &w);
+}
+
+// Returns the values live at the entry of the block, and their number in _count_.
+const int* IRliveness_in(const struct IRliveness *self, struct IRblock *b, int *count) {
+	*count = self->in_begin[b->id + 1] - self->in_begin[b->id];
+	return (self->live_in + self->in_begin[b->id]);
+}
+
+// Returns the values live at the end of the block, and their number in _count_.
+const int* IRliveness_out(const struct IRliveness *self, struct IRblock *b, int *count) {
+	*count = self->out_begin[b->id + 1] - self->out_begin[b->id];
+	return (self->live_out + self->out_begin[b->id]);
+}
+
+// Pairs of a block and a value live there, in increasing value order.
+struct live_marks {
+	int *block, *value;
+	int length, cap;
+};
+
+// Appends a pair to the marks.
+static void push_mark(struct live_marks *m, int block, int value) {
+	if (m->length == m->cap) {
+		m->cap = (m->cap < 64) ? 64 : m->cap * 2;
+		m->block = realloc(m->block, m->cap * sizeof(int));
+		m->value = realloc(m->value, m->cap * sizeof(int));
+		if (m->block == NULL || m->value == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+	}
+	m->block[m->length] = block;
+	m->value[m->length++] = value;
+}
+
+// Turns the marks into the sets of each block, which keep the order of the values.
+static void group_marks(struct live_marks *m, int nb, int **begin, int **values) {
+	*begin = try_calloc(nb + 2, sizeof(int), __FUNCTION__);
+	*values = try_malloc((m->length + 1) * sizeof(int), __FUNCTION__);
+	for (int i = 0; i < m->length; ++i) {
+		(*begin)[m->block[i] + 2] += 1;
+	}
+	for (int b = 0; b < nb; ++b) {
+		(*begin)[b + 2] += (*begin)[b + 1];
+	}
+	for (int i = 0; i < m->length; ++i) {
+		(*values)[(*begin)[m->block[i] + 1]++] = m->value[i];
+	}
+	free(m->block);
+	free(m->value);
+}
+
+// Working state of the exploration, one value at a time.
+struct live_context {
+	struct IRinstruction **def;	// instruction of each identifier
+	int *use_begin;			// first use of each value in _uses_, indexed by instruction id
+	struct IRblock **uses;		// blocks using each value, grouped by value
+	bool *at_end;			// whether each use is by a phi, at the end of the block
+	int *cursor;			// next free use of each value while filling _uses_
+	bool fill;			// whether uses are recorded, or only counted
+	struct IRblock *user;		// block of the instruction whose operands are visited
+	int *in_mark, *out_mark;	// last value marked live at the entry and at the end of each block
+	struct live_marks in, out;
+	struct IRblock **stack;		// blocks to mark
+};
+
+// Counts or records a use of the value by the block.
+static void add_use(struct live_context *ctx, struct IRinstruction *v, struct IRblock *b, bool at_end) {
+	if (!IRliveness_is_value(v)) {
+		return;
+	}
+	if (ctx->fill) {
+		int k = ctx->cursor[v->id]++;
+		ctx->uses[k] = b;
+		ctx->at_end[k] = at_end;
+	} else {
+		ctx->use_begin[v->id + 1] += 1;
+	}
+}
+
+// Operand callback of walk_uses().
+static void visit_use(struct IRinstruction **slot, void *arg) {
+	struct live_context *ctx = arg;
+	add_use(ctx, *slot, ctx->user, false);
+}
+
+// Counts or records the uses of every value. A phi uses its arguments at the end of the
+// blocks they come from.
+static void walk_uses(struct live_context *ctx, struct IRfunction *f) {
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		ctx->user = (void*)p;
+		for (struct llist_node *q = ctx->user->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (x->op != IR_PHI) {
+				IRliveness_foreach_use(x, visit_use, ctx);
+				continue;
+			}
+			for (struct llist_node *r = x->phi.head; r; r = r->nxt) {
+				struct IRphi_arg *a = (void*)r;
+				add_use(ctx, a->value, a->source, true);
+			}
+		}
+	}
+}
+
+// Marks the value live at the end of the block.
+static void mark_out(struct live_context *ctx, struct IRblock *b, int v) {
+	if (ctx->out_mark[b->id] != v) {
+		ctx->out_mark[b->id] = v;
+		push_mark(&ctx->out, b->id, v);
+	}
+}
+
+// Marks the value live at the entry of _b_, and at the end of the predecessors of the blocks
+// it is live in, back to its definition.
+static void up_and_mark(struct live_context *ctx, struct IRblock *b, struct IRinstruction *v) {
+	int top = 0;
+	ctx->stack[top++] = b;
+	while (top > 0) {
+		b = ctx->stack[--top];
+		if ((v->owner == b && v->op != IR_PHI) || ctx->in_mark[b->id] == v->id) {
+			continue;
+		}
+		ctx->in_mark[b->id] = v->id;
+		push_mark(&ctx->in, b->id, v->id);
+		if (v->owner == b) {
+			continue;	// the phi defining the value
+		}
+		for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+			struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+			mark_out(ctx, pre, v->id);
+			if (ctx->in_mark[pre->id] != v->id) {
+				ctx->stack[top++] = pre;
+			}
+		}
+	}
+}
+
+// Computes the live-in and live-out sets of every block, exploring the uses of each value in
+// turn, so that the blocks it was marked live in are known by their last mark.
+static void compute_sets(struct IRliveness *self, struct IRfunction *f) {
+	// A block is pushed at most once for each of its predecessor entries while marking one
+	// value, as it is marked before its predecessors are looked at.
+	int n = self->n, nb = self->nb, edges = 1;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		edges += ((struct IRblock*)p)->pre.length;
+	}
+	struct live_context ctx = {
+		.def = try_calloc(n + 1, sizeof(struct IRinstruction*), __FUNCTION__),
+		.use_begin = try_calloc(n + 2, sizeof(int), __FUNCTION__),
+		.cursor = try_malloc((n + 1) * sizeof(int), __FUNCTION__),
+		.in_mark = try_malloc((nb + 1) * sizeof(int), __FUNCTION__),
+		.out_mark = try_malloc((nb + 1) * sizeof(int), __FUNCTION__),
+		.stack = try_malloc(edges * sizeof(struct IRblock*), __FUNCTION__),
+	};
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			ctx.def[((struct IRinstruction*)q)->id] = (void*)q;
+		}
+	}
+	for (int b = 0; b < nb; ++b) {
+		ctx.in_mark[b] = ctx.out_mark[b] = -1;
+	}
+
+	walk_uses(&ctx, f);
+	for (int i = 0; i < n; ++i) {
+		ctx.use_begin[i + 1] += ctx.use_begin[i];
+		ctx.cursor[i] = ctx.use_begin[i];
+	}
+	ctx.uses = try_malloc((ctx.use_begin[n] + 1) * sizeof(struct IRblock*), __FUNCTION__);
+	ctx.at_end = try_malloc((ctx.use_begin[n] + 1) * sizeof(bool), __FUNCTION__);
+	ctx.fill = true;
+	walk_uses(&ctx, f);
+
+	for (int v = 0; v < n; ++v) {
+		for (int k = ctx.use_begin[v]; k < ctx.use_begin[v + 1]; ++k) {
+			if (ctx.at_end[k]) {
+				mark_out(&ctx, ctx.uses[k], v);
+			}
+			up_and_mark(&ctx, ctx.uses[k], ctx.def[v]);
+		}
+	}
+	group_marks(&ctx.in, nb, &self->in_begin, &self->live_in);
+	group_marks(&ctx.out, nb, &self->out_begin, &self->live_out);
+
+	free(ctx.def);
+	free(ctx.use_begin);
+	free(ctx.uses);
+	free(ctx.at_end);
+	free(ctx.cursor);
+	free(ctx.in_mark);
+	free(ctx.out_mark);
+	free(ctx.stack);
+}
+
+// Extends the interval of a value to cover a position.
+static void extend(struct IRinterval *i, int pos) {
+	if (i->start < 0 || pos < i->start) {
+		i->start = pos;
+	}
+	if (pos > i->end) {
+		i->end = pos;
+	}
+}
+
+// Context of the operand callbacks of compute_intervals().
+struct live_walk {
+	struct IRliveness *lv;
+	struct IRinstruction *user;	// the instruction whose operands are visited
+	struct sparseset live;		// values live after the user, when walking a block backwards
+};
+
+// Operand callback of compute_intervals(): extends the interval of the operand to the use.
+static void extend_use(struct IRinstruction **slot, void *arg) {
+	struct live_walk *w = arg;
+	if (IRliveness_is_value(*slot)) {
+		extend(&w->lv->intervals[(*slot)->id], w->lv->pos[w->user->id]);
+	}
+}
+
+// Operand callback of compute_intervals(): makes the operand live before its use.
+static void count_use(struct IRinstruction **slot, void *arg) {
+	struct live_walk *w = arg;
+	if (IRliveness_is_value(*slot)) {
+		sparseset_add(&w->live, (*slot)->id);
+	}
+}
+
+// Numbers the instructions and computes the live intervals, and the register pressure of each
+// block, walking it backwards from the values live at its end.
+static void compute_intervals(struct IRliveness *self, struct IRfunction *f) {
+	int k = 0;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		self->from[b->id] = 2 * k;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			self->pos[((struct IRinstruction*)q)->id] = 2 * k++;
+		}
+		self->to[b->id] = 2 * k;
+	}
+	for (int i = 0; i < self->n; ++i) {
+		self->intervals[i].start = self->intervals[i].end = -1;
+	}
+
+	struct live_walk w = { .lv = self };
+	sparseset_init(&w.live, self->n);
+	struct array ins;
+	array_init(&ins);
+	self->max_pressure = 0;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		int nin, nout;
+		const int *in = IRliveness_in(self, b, &nin), *out = IRliveness_out(self, b, &nout);
+		for (int i = 0; i < nin; ++i) {
+			extend(&self->intervals[in[i]], self->from[b->id]);
+		}
+		for (int i = 0; i < nout; ++i) {
+			extend(&self->intervals[out[i]], self->to[b->id]);
+		}
+
+		ins.length = 0;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			array_pushback(&ins, x);
+			if (IRliveness_is_value(x)) {
+				extend(&self->intervals[x->id], self->pos[x->id]);
+			}
+			if (x->op != IR_PHI) {
+				w.user = x;
+				IRliveness_foreach_use(x, extend_use, &w);
+			}
+		}
+
+		// A value is live from its definition to its last use, a dead one at its definition.
+		sparseset_clear(&w.live);
+		for (int i = 0; i < nout; ++i) {
+			sparseset_add(&w.live, out[i]);
+		}
+		int pressure = w.live.length;
+		for (int i = ins.length - 1; i >= 0; --i) {
+			struct IRinstruction *x = ins.begin[i];
+			if (x->op == IR_PHI) {
+				break;
+			}
+			if (IRliveness_is_value(x)) {
+				if (sparseset_has(&w.live, x->id)) {
+					sparseset_remove(&w.live, x->id);
+				} else if (w.live.length + 1 > pressure) {
+					pressure = w.live.length + 1;
+				}
+			}
+			IRliveness_foreach_use(x, count_use, &w);
+			if (w.live.length > pressure) {
+				pressure = w.live.length;
+			}
+		}
+		self->pressure[b->id] = (nin > pressure) ? nin : pressure;
+		if (self->pressure[b->id] > self->max_pressure) {
+			self->max_pressure = self->pressure[b->id];
+		}
+	}
+	array_free(&ins);
+	sparseset_free(&w.live);
+}
+
+// Computes the liveness of the values of a function.
+// Instruction and block identifiers must be compact, see IRfunction_renumber().
+void IRliveness_build(struct IRliveness *self, struct IRfunction *f) {
+	self->n = f->ins_count;
+	self->nb = f->bs.length;
+	self->pos = try_malloc((self->n + 1) * sizeof(int), __FUNCTION__);
+	self->from = try_malloc((self->nb + 1) * sizeof(int), __FUNCTION__);
+	self->to = try_malloc((self->nb + 1) * sizeof(int), __FUNCTION__);
+	self->intervals = try_malloc((self->n + 1) * sizeof(struct IRinterval), __FUNCTION__);
+	self->pressure = try_malloc((self->nb + 1) * sizeof(int), __FUNCTION__);
+	compute_sets(self, f);
+	compute_intervals(self, f);
+}
+
+// Frees the liveness.
+void IRliveness_free(struct IRliveness *self) {
+	free(self->in_begin);
+	free(self->live_in);
+	free(self->out_begin);
+	free(self->live_out);
+	free(self->pos);
+	free(self->from);
+	free(self->to);
+	free(self->intervals);
+	free(self->pressure);
+}
+
+// Outputs the function with the register pressure of each block and the values live at its
+// entry, as comments.
+void IRliveness_print(const struct IRliveness *self, struct IRfunction *f, FILE *Outfile) {
+	fprintf(Outfile, "%s:\t\t\t// pressure %d\n", f->name, self->max_pressure);
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		int nin;
+		const int *in = IRliveness_in(self, b, &nin);
+		fprintf(Outfile, "L%d:\t\t\t// pressure %d, live", b->id, self->pressure[b->id]);
+		for (int i = 0; i < nin; ++i) {
+			fprintf(Outfile, " $%d", in[i]);
+		}
+		fprintf(Outfile, "\n");
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			IRinstruction_print((void*)q, Outfile);
+		}
+	}
+}
+
+// Outputs every function of the translation unit with its register pressure.
+// Identifiers are renumbered.
+void IRunit_print_pressure(struct IRunit *self, FILE *Outfile) {
+	for (struct llist_node *p = self->funcs.head; p; p = p->nxt) {
+		struct IRfunction *f = (void*)p;
+		struct IRliveness lv;
+		IRfunction_renumber(f);
+		IRliveness_build(&lv, f);
+		IRliveness_print(&lv, f, Outfile);
+		IRliveness_free(&lv);
+	}
+}
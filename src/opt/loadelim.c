@@ -0,0 +1,340 @@
+// Redundant load elimination and store to load forwarding.
+// The loads of one location are handled together. In each block, a store to the location or
+// a load of it defines its value, and a store which may overlap it kills the value, as does
+// a new definition of its root or variable offset, since the address then changes.
+// The value is available at the entry of a block when it is at the end of every predecessor:
+//   AVIN(b) = AND of AVOUT(p) over the predecessors	AVOUT(b) = DEF(b) | (AVIN(b) & ~KILL(b))
+// A load is then replaced with the last definition before it in its block, or, if there is
+// none and the value is available at the entry, with the value looked up backwards from the
+// predecessors, placing phis where they differ. Nothing is known at the function entry.
+//
+// The cost grows with the number of locations times the size of the function. For functions
+// too large for that, a local variant only forwards values within blocks, remembering a few
+// of the last locations accessed.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "acir.h"
+#include "opt.h"
+
+// Number of locations remembered by IRopt_load_elim_local().
+#define LE_LOCAL_WINDOW 16
+
+// Last event of a block on the current location.
+enum {
+	LE_NONE,	// the location is untouched
+	LE_DEF,		// the location is defined
+	LE_KILL,	// the location may change
+};
+
+// Working state of the pass.
+struct le_context {
+	struct IRfunction *f;
+	struct IRalias alias;
+	struct IRdomtree *dom;		// dominator tree, from the analysis cache
+	int n, nb;
+	struct IRmemloc *locs;		// location of each access, indexed by instruction id
+	struct IRinstruction **repl;	// pending replacements, indexed by instruction id
+	struct IRmemloc *cur;		// the current location
+	int *event;			// last event of each block
+	struct IRinstruction **def;	// value defined by the last event of each block
+	bool *avin, *avout;		// availability at the entry and the end of each block
+	struct IRinstruction **at_entry;// value at the entry of each block
+};
+
+// Returns the effect of an instruction on the current location, writing the value defined
+// into _value_.
+static int event_of(struct le_context *ctx, struct IRinstruction *x, struct IRinstruction **value) {
+	if (x == ctx->cur->root || x == ctx->cur->var) {
+		return (LE_KILL);
+	}
+	if (x->op != IR_LOAD && x->op != IR_STORE) {
+		return (LE_NONE);
+	}
+
+	switch (IRalias_query(&ctx->alias, &ctx->locs[x->id], ctx->cur)) {
+		case IR_MUST_ALIAS: {
+			*value = (x->op == IR_LOAD) ? x : x->right;
+			return (LE_DEF);
+		}
+		case IR_MAY_ALIAS: {
+			return (x->op == IR_STORE ? LE_KILL : LE_NONE);
+		}
+		default: {
+			return (LE_NONE);
+		}
+	}
+}
+
+// Computes the last event of every block, and the availability of the current location.
+static void compute_availability(struct le_context *ctx) {
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		ctx->event[b->id] = LE_NONE;
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			struct IRinstruction *v = NULL;
+			int e = event_of(ctx, (void*)q, &v);
+			if (e != LE_NONE) {
+				ctx->event[b->id] = e;
+				ctx->def[b->id] = v;
+			}
+		}
+	}
+
+	// Optimistic start, the entry excepted.
+	for (int i = 0; i < ctx->nb; ++i) {
+		ctx->avin[i] = ctx->avout[i] = true;
+	}
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < ctx->dom->count; ++i) {
+			struct IRblock *b = ctx->dom->order[i];
+			bool in = (b->pre.length > 0);
+			for (struct llist_node *p = b->pre.head; p && in; p = p->nxt) {
+				in = ctx->avout[((struct IRpredecessor*)p)->b->id];
+			}
+			bool out = ctx->event[b->id] == LE_DEF || (in && ctx->event[b->id] == LE_NONE);
+			changed |= (in != ctx->avin[b->id] || out != ctx->avout[b->id]);
+			ctx->avin[b->id] = in;
+			ctx->avout[b->id] = out;
+		}
+	}
+}
+
+static struct IRinstruction* value_at_entry(struct le_context *ctx, struct IRblock *b);
+
+// Returns the value of the current location at the end of a block where it is available.
+static struct IRinstruction* value_at_end(struct le_context *ctx, struct IRblock *b) {
+	if (ctx->event[b->id] == LE_DEF) {
+		return (ctx->def[b->id]);
+	}
+	return (value_at_entry(ctx, b));
+}
+
+// Returns the value of the current location at the entry of a block where it is available.
+static struct IRinstruction* value_at_entry(struct le_context *ctx, struct IRblock *b) {
+	struct IRinstruction *v = ctx->at_entry[b->id];
+	if (v) {
+		return (v);
+	}
+
+	if (b->pre.length == 1) {
+		v = value_at_end(ctx, ((struct IRpredecessor*)b->pre.head)->b);
+	} else {
+		v = IRinstruction_new_phi(b, ctx->cur->type);
+		ctx->at_entry[b->id] = v;	// breaks cycles through loops
+		for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+			struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+			IRphi_add_arg(v, pre, value_at_end(ctx, pre));
+		}
+	}
+	ctx->at_entry[b->id] = v;
+	return (v);
+}
+
+// Replaces the loads of the current location whose value is known, and returns whether
+// there were any.
+static bool replace_loads(struct le_context *ctx) {
+	bool changed = false;
+	memset(ctx->at_entry, 0, ctx->nb * sizeof(struct IRinstruction*));
+	compute_availability(ctx);
+
+	for (struct llist_node *p = ctx->f->bs.head; p; p = p->nxt) {
+		struct IRblock *b = (void*)p;
+		bool known = ctx->avin[b->id];
+		struct IRinstruction *cur = NULL;	// NULL for the value at the entry
+		for (struct llist_node *q = b->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q, *v = NULL;
+			int e = event_of(ctx, x, &v);
+			if (e == LE_KILL) {
+				known = false;
+			} else if (e == LE_DEF && x->op == IR_LOAD && known) {
+				ctx->repl[x->id] = cur ? cur : value_at_entry(ctx, b);
+				changed = true;
+			} else if (e == LE_DEF) {
+				known = true;
+				cur = v;
+			}
+		}
+	}
+	return (changed);
+}
+
+// A load and its location.
+struct le_load {
+	struct IRinstruction *x;
+	struct IRmemloc loc;
+};
+
+// Returns the identifier of a value of a location key, -1 for none.
+static int key_id(const struct IRinstruction *x) {
+	return (x ? x->id : -1);
+}
+
+// Sorting order of the loads: by location, then by identifier.
+static int compare_load(const void *pa, const void *pb) {
+	const struct le_load *a = pa, *b = pb;
+	if (a->loc.root != b->loc.root) {
+		return (key_id(a->loc.root) - key_id(b->loc.root));
+	}
+	if (a->loc.var != b->loc.var) {
+		return (key_id(a->loc.var) - key_id(b->loc.var));
+	}
+	if (a->loc.offset != b->loc.offset) {
+		return (a->loc.offset < b->loc.offset ? -1 : 1);
+	}
+	if (a->loc.type != b->loc.type) {
+		return (a->loc.type - b->loc.type);
+	}
+	return (a->x->id - b->x->id);
+}
+
+// Redundant load elimination: loads whose value is known from an earlier store or load
+// of the same location, on every path, are replaced with that value. Loads replaced are
+// left for IRopt_dce() to remove. Identifiers are renumbered.
+bool IRopt_load_elim(struct IRfunction *self, struct IRanalyses *am) {
+	struct le_context ctx = {
+		.f = self,
+		.n = self->ins_count,
+		.nb = self->bs.length,
+	};
+
+	struct array loads;
+	array_init(&loads);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			if (((struct IRinstruction*)q)->op == IR_LOAD) {
+				array_pushback(&loads, q);
+			}
+		}
+	}
+
+	// Unreachable blocks are left to IRopt_dce().
+	ctx.dom = IRanalyses_dom(am);
+	if (loads.length == 0 || ctx.dom->count != ctx.nb) {
+		array_free(&loads);
+		return (false);
+	}
+
+	IRalias_build(&ctx.alias, self);
+	ctx.locs = try_malloc(ctx.n * sizeof(struct IRmemloc), __FUNCTION__);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (x->op == IR_LOAD || x->op == IR_STORE) {
+				IRmemloc_of(&ctx.locs[x->id], x);
+			}
+		}
+	}
+
+	struct le_load *ls = try_malloc(loads.length * sizeof(struct le_load), __FUNCTION__);
+	for (int i = 0; i < loads.length; ++i) {
+		ls[i].x = loads.begin[i];
+		ls[i].loc = ctx.locs[ls[i].x->id];
+	}
+	qsort(ls, loads.length, sizeof(struct le_load), compare_load);
+
+	ctx.repl = try_calloc(ctx.n, sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.event = try_malloc(ctx.nb * sizeof(int), __FUNCTION__);
+	ctx.def = try_malloc(ctx.nb * sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.avin = try_malloc(ctx.nb * sizeof(bool), __FUNCTION__);
+	ctx.avout = try_malloc(ctx.nb * sizeof(bool), __FUNCTION__);
+	ctx.at_entry = try_malloc(ctx.nb * sizeof(struct IRinstruction*), __FUNCTION__);
+
+	bool changed = false;
+	for (int i = 0; i < loads.length; ++i) {
+		if (i == 0 || !IRmemloc_eq(&ls[i].loc, &ls[i - 1].loc)) {
+			ctx.cur = &ls[i].loc;
+			changed |= replace_loads(&ctx);
+		}
+	}
+
+	if (changed) {
+		// The table must also cover the phis created by the pass.
+		struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+		memcpy(repl, ctx.repl, ctx.n * sizeof(struct IRinstruction*));
+		IRfunction_apply_replacements(self, repl);
+		free(repl);
+		IRfunction_renumber(self);
+	}
+
+	free(ls);
+	free(ctx.locs);
+	free(ctx.repl);
+	free(ctx.event);
+	free(ctx.def);
+	free(ctx.avin);
+	free(ctx.avout);
+	free(ctx.at_entry);
+	IRalias_free(&ctx.alias);
+	array_free(&loads);
+	return (changed);
+}
+
+// Location accessed recently in a block, and its value.
+struct le_entry {
+	struct IRmemloc loc;
+	struct IRinstruction *value;
+};
+
+// Local redundant load elimination: loads whose value is known from a store or a load of the
+// same location earlier in their block, among the last locations accessed, are replaced with
+// that value. Loads replaced are left for IRopt_dce() to remove. Identifiers are renumbered.
+bool IRopt_load_elim_local(struct IRfunction *self, struct IRanalyses *am) {
+	(void)am;
+	struct IRalias alias;
+	IRalias_build(&alias, self);
+	struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	struct le_entry window[LE_LOCAL_WINDOW];	// locations accessed in the block, oldest first
+
+	bool changed = false;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		int len = 0;
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			struct IRinstruction *x = (void*)q;
+			if (x->op != IR_LOAD && x->op != IR_STORE) {
+				continue;
+			}
+			struct le_entry e = { .value = (x->op == IR_LOAD) ? x : x->right };
+			IRmemloc_of(&e.loc, x);
+
+			if (x->op == IR_LOAD) {
+				int i = 0;
+				while (i < len && IRalias_query(&alias, &window[i].loc, &e.loc) != IR_MUST_ALIAS) {
+					++i;
+				}
+				if (i < len) {
+					repl[x->id] = window[i].value;
+					changed = true;
+					continue;
+				}
+			} else {
+				// A store kills the locations it may overlap.
+				int kept = 0;
+				for (int i = 0; i < len; ++i) {
+					if (IRalias_query(&alias, &window[i].loc, &e.loc) == IR_NO_ALIAS) {
+						window[kept++] = window[i];
+					}
+				}
+				len = kept;
+			}
+
+			if (len == LE_LOCAL_WINDOW) {
+				memmove(window, window + 1, (len - 1) * sizeof(struct le_entry));
+				--len;
+			}
+			window[len++] = e;
+		}
+	}
+
+	if (changed) {
+		IRfunction_apply_replacements(self, repl);
+		IRfunction_renumber(self);
+	}
+	free(repl);
+	IRalias_free(&alias);
+	return (changed);
+}
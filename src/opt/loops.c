@@ -0,0 +1,238 @@
+// Natural loop analysis.
+// An edge b->h is a back edge when h dominates b. The natural loop of a header h is h
+// together with every block reaching a back edge into h without passing through h.
+// Headers are visited in postorder, so inner loops are found before the loops containing
+// them, and a block already claimed by an inner loop makes that loop a child of the new one.
+// Retreating edges into blocks which do not dominate their sources (irreducible control
+// flow) do not form loops; the structured front end never produces them.
+
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Returns the outermost loop found so far containing _loop_.
+static struct IRloop* IRloop_outermost(struct IRloop *loop) {
+	while (loop->parent) {
+		loop = loop->parent;
+	}
+	return (loop);
+}
+
+// Pushes the reachable predecessors of the block onto the stack.
+static void push_preds(struct array *stack, const struct IRdomtree *dom, struct IRblock *b) {
+	for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		if (IRdomtree_reachable(dom, pre)) {
+			array_pushback(stack, pre);
+		}
+	}
+}
+
+// Collects the blocks of the loop headed by _h_, whose back edges come from the blocks on _stack_.
+static void IRloopinfo_discover(struct IRloopinfo *self, const struct IRdomtree *dom,
+				struct IRloop *loop, struct array *stack) {
+	self->inner[loop->header->id] = loop;
+	while (stack->length > 0) {
+		struct IRblock *b = array_popback(stack);
+		struct IRloop *sub = self->inner[b->id];
+		if (sub == NULL) {
+			self->inner[b->id] = loop;
+			push_preds(stack, dom, b);
+			continue;
+		}
+
+		// The block belongs to a loop found earlier: the outermost loop containing it is nested here,
+		// and only the entry edges of that loop still need to be followed.
+		sub = IRloop_outermost(sub);
+		if (sub != loop) {
+			sub->parent = loop;
+			push_preds(stack, dom, sub->header);
+		}
+	}
+}
+
+// Builds the loop nest of a function from its dominator tree.
+void IRloopinfo_build(struct IRloopinfo *self, const struct IRdomtree *dom) {
+	self->n = dom->n;
+	self->inner = try_calloc(dom->n, sizeof(struct IRloop*), __FUNCTION__);
+	llist_init(&self->loops);
+
+	struct array stack;
+	array_init(&stack);
+	for (int i = dom->count - 1; i >= 0; --i) {
+		struct IRblock *h = dom->order[i];
+		for (struct llist_node *p = h->pre.head; p; p = p->nxt) {
+			struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+			if (IRdomtree_dominates(dom, h, pre)) {
+				array_pushback(&stack, pre);
+			}
+		}
+		if (stack.length == 0) {
+			continue;
+		}
+
+		struct IRloop *loop = try_malloc(sizeof(struct IRloop), __FUNCTION__);
+		loop->header = h;
+		loop->parent = NULL;
+		array_init(&loop->blocks);
+		llist_pushback(&self->loops, loop);
+		IRloopinfo_discover(self, dom, loop, &stack);
+	}
+	array_free(&stack);
+
+	for (struct llist_node *p = self->loops.head; p; p = p->nxt) {
+		struct IRloop *loop = (void*)p;
+		loop->depth = 0;
+		for (struct IRloop *l = loop; l; l = l->parent) {
+			loop->depth += 1;
+		}
+	}
+
+	// Visiting blocks in reverse postorder lists the header of each loop first.
+	for (int i = 0; i < dom->count; ++i) {
+		struct IRblock *b = dom->order[i];
+		for (struct IRloop *l = self->inner[b->id]; l; l = l->parent) {
+			array_pushback(&l->blocks, b);
+		}
+	}
+}
+
+// Returns the innermost loop containing the block, or NULL if it is in no loop.
+struct IRloop* IRloopinfo_get(const struct IRloopinfo *self, struct IRblock *b) {
+	return (b->id < self->n ? self->inner[b->id] : NULL);
+}
+
+// Returns the loop nesting depth of the block, 0 outside of loops.
+int IRloopinfo_depth(const struct IRloopinfo *self, struct IRblock *b) {
+	struct IRloop *loop = IRloopinfo_get(self, b);
+	return (loop ? loop->depth : 0);
+}
+
+// Returns whether the loop contains the block, possibly through nested loops.
+bool IRloop_contains(const struct IRloopinfo *info, struct IRloop *loop, struct IRblock *b) {
+	for (struct IRloop *l = IRloopinfo_get(info, b); l; l = l->parent) {
+		if (l == loop) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Returns the preheader of the loop: its only predecessor outside of the loop, provided that
+// the predecessor jumps to the header unconditionally. Returns NULL if there is none.
+struct IRblock* IRloop_preheader(const struct IRloopinfo *info, struct IRloop *loop) {
+	struct IRblock *res = NULL;
+	for (struct llist_node *p = loop->header->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		if (IRloop_contains(info, loop, pre)) {
+			continue;
+		}
+		if (res) {
+			return (NULL);
+		}
+		res = pre;
+	}
+
+	if (res == NULL || IRblock_terminator(res)->op != IR_JMP) {
+		return (NULL);
+	}
+	return (res);
+}
+
+// Changes the first edge from _p_ to _from_ to point to _to_.
+static void redirect_edge(struct IRblock *p, struct IRblock *from, struct IRblock *to) {
+	struct IRinstruction *t = IRblock_terminator(p);
+	if (t->bt == from) {
+		t->bt = to;
+	} else if (t->op == IR_BR && t->bf == from) {
+		t->bf = to;
+	} else {
+		fail_unreachable(__FUNCTION__);
+	}
+}
+
+// Creates a preheader for the loop: a block placed right before the header in layout, which
+// every edge entering the loop goes through. Phi arguments coming from outside of the loop are
+// merged into phis of the preheader, unless they are all the same value.
+// The analyses are not updated: the new block belongs to no loop, and identifiers must be
+// renumbered before they are built again.
+struct IRblock* IRloop_insert_preheader(const struct IRloopinfo *info, struct IRloop *loop) {
+	struct IRblock *h = loop->header;
+	struct IRfunction *f = h->owner;
+	if ((struct llist_node*)h == f->bs.head) {
+		fail_unreachable(__FUNCTION__);		// the entry has no edge coming from outside
+	}
+
+	struct IRblock *ph = IRblock_new(f);
+	llist_unlink(&f->bs, ph);
+	struct llist_node *prev = f->bs.head;
+	while (prev->nxt != (struct llist_node*)h) {
+		prev = prev->nxt;
+	}
+	llist_insert_after(&f->bs, prev, ph);
+
+	// Values entering the loop, computed before the edges change.
+	struct array vals;
+	array_init(&vals);
+	for (struct llist_node *p = h->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		struct IRinstruction *phi = (void*)p, *same = NULL;
+		bool differ = false;
+		for (struct llist_node *q = phi->phi.head; q; q = q->nxt) {
+			struct IRphi_arg *a = (void*)q;
+			if (!IRloop_contains(info, loop, a->source)) {
+				differ |= (same != NULL && same != a->value);
+				same = a->value;
+			}
+		}
+
+		if (differ) {
+			struct IRinstruction *merged = IRinstruction_new_phi(ph, phi->type);
+			for (struct llist_node *q = phi->phi.head; q; q = q->nxt) {
+				struct IRphi_arg *a = (void*)q;
+				if (!IRloop_contains(info, loop, a->source)) {
+					IRphi_add_arg(merged, a->source, a->value);
+				}
+			}
+			same = merged;
+		}
+		array_pushback(&vals, same);
+	}
+
+	// Every edge entering the loop is redirected to the preheader.
+	struct array outside;
+	array_init(&outside);
+	for (struct llist_node *p = h->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		if (!IRloop_contains(info, loop, pre)) {
+			array_pushback(&outside, pre);
+		}
+	}
+	for (int i = 0; i < outside.length; ++i) {
+		struct IRblock *pre = outside.begin[i];
+		redirect_edge(pre, h, ph);
+		IRblock_add_pre(ph, pre);
+		IRblock_remove_pre(h, pre);
+	}
+	array_free(&outside);
+
+	IRinstruction_new_jmp(ph, IR_JMP, NULL, h, NULL);
+	int i = 0;
+	for (struct llist_node *p = h->ins.head; i < vals.length; p = p->nxt, ++i) {
+		IRphi_add_arg((void*)p, ph, vals.begin[i]);
+	}
+	array_free(&vals);
+	return (ph);
+}
+
+// Frees the loop nest.
+void IRloopinfo_free(struct IRloopinfo *self) {
+	struct llist_node *p;
+	while ((p = llist_popfront(&self->loops)) != NULL) {
+		array_free(&((struct IRloop*)p)->blocks);
+		free(p);
+	}
+	free(self->inner);
+}
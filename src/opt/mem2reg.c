@@ -0,0 +1,200 @@
+// Promotion of stack slots to SSA values.
+// A slot of a single element whose address is only used by loads and stores directly is a
+// local variable in disguise: each load reads the value of the last store before it, which is
+// found backwards in its own block, or else at the end of the predecessors of the block, with
+// phis where they differ, like the SSA construction of the front end.
+// The stores and the slot are then deleted. A value loaded before any store is indeterminate,
+// zero is used as the front end does for variables read before their assignment.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "acir.h"
+#include "opt.h"
+
+// A load or a store of the current slot.
+struct m2r_access {
+	struct IRinstruction *x;
+	int pos;			// position of the instruction in its block
+};
+
+// Working state of the pass.
+struct m2r_context {
+	struct IRfunction *f;
+	struct IRuses uses;
+	int *pos;			// position of each instruction in its block, indexed by instruction id
+	struct IRinstruction **repl;	// pending replacements, indexed by instruction id
+	struct IRinstruction *slot;	// the current slot
+	struct IRinstruction **at_end;	// value of the slot at the end of each block
+	struct IRinstruction **at_entry;// value of the slot at the entry of each block
+	struct array garbage;		// unlinked loads and slots, freed once the replacements are done
+};
+
+// Returns whether every use of the slot is a load from it, or a store of another value into it.
+static bool is_promotable(struct m2r_context *ctx, struct IRinstruction *a) {
+	if (a->slot_count != 1) {
+		return (false);
+	}
+
+	struct array *users = IRuses_get(&ctx->uses, a);
+	for (int i = 0; i < users->length; ++i) {
+		struct IRinstruction *u = users->begin[i];
+		bool ok = (u->op == IR_LOAD && u->type == a->slot_type)
+			|| (u->op == IR_STORE && u->left == a && u->right != a && u->right->type == a->slot_type);
+		if (!ok) {
+			return (false);
+		}
+	}
+	return (true);
+}
+
+// Sorting order of the accesses: by block, then by position.
+static int compare_access(const void *pa, const void *pb) {
+	const struct m2r_access *a = pa, *b = pb;
+	if (a->x->owner != b->x->owner) {
+		return (a->x->owner->id - b->x->owner->id);
+	}
+	return (a->pos - b->pos);
+}
+
+static struct IRinstruction* value_at_entry(struct m2r_context *ctx, struct IRblock *b);
+
+// Returns the value of the slot at the end of the block.
+static struct IRinstruction* value_at_end(struct m2r_context *ctx, struct IRblock *b) {
+	if (ctx->at_end[b->id] == NULL) {
+		ctx->at_end[b->id] = value_at_entry(ctx, b);
+	}
+	return (ctx->at_end[b->id]);
+}
+
+// Returns the value of the slot at the entry of the block.
+static struct IRinstruction* value_at_entry(struct m2r_context *ctx, struct IRblock *b) {
+	struct IRinstruction *v = ctx->at_entry[b->id];
+	if (v) {
+		return (v);
+	}
+
+	int type = ctx->slot->slot_type;
+	if (b->pre.length == 0) {
+		v = IRblock_new_const(b, type, 0);
+	} else if (b->pre.length == 1) {
+		v = value_at_end(ctx, ((struct IRpredecessor*)b->pre.head)->b);
+	} else {
+		v = IRinstruction_new_phi(b, type);
+		ctx->at_entry[b->id] = v;	// breaks cycles through loops
+		for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+			struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+			IRphi_add_arg(v, pre, value_at_end(ctx, pre));
+		}
+	}
+	ctx->at_entry[b->id] = v;
+	return (v);
+}
+
+// Replaces the loads of the slot with the values stored, and deletes the stores and the slot.
+// Loads may be the values of other loads and stores, so they are only unlinked.
+static void promote(struct m2r_context *ctx, struct IRinstruction *a) {
+	struct array *users = IRuses_get(&ctx->uses, a);
+	struct m2r_access *acc = try_malloc((users->length + 1) * sizeof(struct m2r_access), __FUNCTION__);
+	for (int i = 0; i < users->length; ++i) {
+		acc[i].x = users->begin[i];
+		acc[i].pos = ctx->pos[acc[i].x->id];
+	}
+	qsort(acc, users->length, sizeof(struct m2r_access), compare_access);
+
+	ctx->slot = a;
+	int nb = ctx->f->bs.length;
+	memset(ctx->at_end, 0, nb * sizeof(struct IRinstruction*));
+	memset(ctx->at_entry, 0, nb * sizeof(struct IRinstruction*));
+	for (int i = 0; i < users->length; ++i) {
+		if (acc[i].x->op == IR_STORE) {
+			ctx->at_end[acc[i].x->owner->id] = acc[i].x->right;
+		}
+	}
+
+	// Loads see the last store before them in their block, if any.
+	struct IRinstruction *cur = NULL;
+	for (int i = 0; i < users->length; ++i) {
+		struct IRinstruction *x = acc[i].x;
+		if (i == 0 || x->owner != acc[i - 1].x->owner) {
+			cur = NULL;
+		}
+		if (x->op == IR_STORE) {
+			cur = x->right;
+		} else {
+			ctx->repl[x->id] = cur ? cur : value_at_entry(ctx, x->owner);
+		}
+	}
+
+	for (int i = 0; i < users->length; ++i) {
+		struct IRinstruction *x = acc[i].x;
+		llist_unlink(&x->owner->ins, x);
+		if (x->op == IR_STORE) {
+			IRinstruction_free(x);
+		} else {
+			array_pushback(&ctx->garbage, x);
+		}
+	}
+	llist_unlink(&a->owner->ins, a);
+	array_pushback(&ctx->garbage, a);
+	free(acc);
+}
+
+// Promotes the stack slots of a single element, whose address does not escape, to SSA values.
+// Identifiers are renumbered.
+bool IRopt_mem2reg(struct IRfunction *self) {
+	struct IRblock *entry = (void*)self->bs.head;
+	struct array slots;
+	array_init(&slots);
+
+	struct m2r_context ctx = { .f = self };
+	IRuses_build(&ctx.uses, self);
+	for (struct llist_node *p = entry->ins.head; p; p = p->nxt) {
+		struct IRinstruction *x = (void*)p;
+		if (x->op == IR_ALLOCA && is_promotable(&ctx, x)) {
+			array_pushback(&slots, x);
+		}
+	}
+	if (slots.length == 0) {
+		IRuses_free(&ctx.uses);
+		array_free(&slots);
+		return (false);
+	}
+
+	int n = self->ins_count, nb = self->bs.length;
+	array_init(&ctx.garbage);
+	ctx.pos = try_malloc(n * sizeof(int), __FUNCTION__);
+	ctx.repl = try_calloc(n, sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.at_end = try_malloc(nb * sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.at_entry = try_malloc(nb * sizeof(struct IRinstruction*), __FUNCTION__);
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		int i = 0;
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			ctx.pos[((struct IRinstruction*)q)->id] = i++;
+		}
+	}
+
+	for (int i = 0; i < slots.length; ++i) {
+		promote(&ctx, slots.begin[i]);
+	}
+
+	// The table must also cover the phis and constants created by the pass.
+	struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	memcpy(repl, ctx.repl, n * sizeof(struct IRinstruction*));
+	IRfunction_apply_replacements(self, repl);
+	IRfunction_renumber(self);
+	for (int i = 0; i < ctx.garbage.length; ++i) {
+		IRinstruction_free(ctx.garbage.begin[i]);
+	}
+
+	free(repl);
+	free(ctx.repl);
+	free(ctx.pos);
+	free(ctx.at_end);
+	free(ctx.at_entry);
+	IRuses_free(&ctx.uses);
+	array_free(&ctx.garbage);
+	array_free(&slots);
+	return (true);
+}
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Scalar passes, which expose work for each other.
+#define SIMPLIFY "fix(instcombine,sroa,mem2reg,load-elim,dse,narrow,pre,dce,ifconvert,licm,strength-reduce)"
+
+// Scalar passes which do not grow the code.
+#define SIMPLIFY_SIZE "fix(instcombine,sroa,mem2reg,load-elim,dse,narrow,dce,ifconvert,licm)"
+
+// Default pipeline, of -O2.
+#define PIPELINE_O2 "dce,inline," SIMPLIFY ",barrier,unroll," SIMPLIFY ",div-const,fuse-cmp"
+
+// Pipelines of the optimization levels.
+// Functions are simplified bottom-up in the call graph, so that calls are inlined from
+// simplified callees, and the inlined code is simplified again in the context of the caller.
+// Unrolling waits until every function is inlined, not to copy unrolled loops which the caller
+// could handle better knowing its arguments, and is simplified afterwards. Divisions by
+// constants are expanded last, as the other passes know divisions better than the sequences
+// replacing them. Registers are allocated by linear scan below -O2, which compiles faster.
+static const struct {
+	char level;
+	const char *pipeline;
+	int regalloc;
+} levels[] = {
+	{ '0', "", RA_LINEAR_SCAN },
+	{ '1', "dce,fix(instcombine,sroa,mem2reg,load-elim,narrow,dce),barrier,div-const,fuse-cmp", RA_LINEAR_SCAN },
+	{ '2', PIPELINE_O2, RA_COLORING },
+	{ 's', "dce,inline," SIMPLIFY_SIZE ",barrier,div-const,fuse-cmp", RA_COLORING },
+};
+
+// Inlining threshold of -Os: only callees about the size of the call are inlined.
+#define OS_INLINE_THRESHOLD 1
+
+struct opt_info Oinfo = {
+	.unroll_budget = 48,
+	.inline_threshold = 40,
+	.strict_aliasing = true,
+	.pipeline = PIPELINE_O2,
+	.regalloc = RA_COLORING,
+};
+
+// Optimization level of the command line, and the options given explicitly there, which the
+// defaults of the level do not override whatever the order of the arguments.
+static char opt_level = '2';
+static bool has_pipeline, has_inline_threshold, has_regalloc;
+
+// Parses the count of a numeric option, between 0 and 100000.
+static bool parse_count(const char *s, int *res) {
+	char *end;
+	long v = strtol(s, &end, 10);
+	if (*end != '\0' || end == s || v < 0 || v > 100000) {
+		return (false);
+	}
+	*res = v;
+	return (true);
+}
+
+// Parses an optimizer option of the command line into Oinfo.
+// Returns false if the option is unknown or malformed.
+bool Oinfo_parse(const char *arg) {
+	static const char unroll[] = "-unroll-budget=";
+	static const char inlining[] = "-inline-threshold=";
+	static const char passes[] = "-passes=";
+	if (strncmp(arg, unroll, sizeof(unroll) - 1) == 0) {
+		return (parse_count(arg + sizeof(unroll) - 1, &Oinfo.unroll_budget));
+	}
+	if (strncmp(arg, inlining, sizeof(inlining) - 1) == 0) {
+		has_inline_threshold = true;
+		return (parse_count(arg + sizeof(inlining) - 1, &Oinfo.inline_threshold));
+	}
+	if (strncmp(arg, passes, sizeof(passes) - 1) == 0) {
+		struct IRpipeline p;
+		if (!IRpipeline_parse(&p, arg + sizeof(passes) - 1)) {
+			return (false);
+		}
+		IRpipeline_free(&p);
+		Oinfo.pipeline = arg + sizeof(passes) - 1;
+		has_pipeline = true;
+		return (true);
+	}
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+		if (arg[1] == 'O' && arg[2] == levels[i].level && arg[3] == '\0') {
+			opt_level = levels[i].level;
+			return (true);
+		}
+	}
+	if (strcmp(arg, "-fno-strict-aliasing") == 0) {
+		Oinfo.strict_aliasing = false;
+		return (true);
+	}
+	if (strcmp(arg, "-Rpass-skipped") == 0) {
+		Oinfo.remark_skipped = true;
+		return (true);
+	}
+	if (strcmp(arg, "-regalloc=linear") == 0 || strcmp(arg, "-regalloc=coloring") == 0) {
+		Oinfo.regalloc = (arg[10] == 'l') ? RA_LINEAR_SCAN : RA_COLORING;
+		has_regalloc = true;
+		return (true);
+	}
+	if (strcmp(arg, "-print-pressure") == 0) {
+		Oinfo.print_pressure = true;
+		return (true);
+	}
+	return (false);
+}
+
+// Applies the defaults of the optimization level, the last one given, to the options of Oinfo
+// not given explicitly. Called once the command line is parsed.
+void Oinfo_resolve(void) {
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+		if (levels[i].level != opt_level) {
+			continue;
+		}
+		if (!has_pipeline) {
+			Oinfo.pipeline = levels[i].pipeline;
+		}
+		if (!has_regalloc) {
+			Oinfo.regalloc = levels[i].regalloc;
+		}
+		if (!has_inline_threshold && opt_level == 's') {
+			Oinfo.inline_threshold = OS_INLINE_THRESHOLD;
+		}
+	}
+}
+
+// Runs the optimization pipeline on every function of the translation unit.
+void IRunit_optimize(struct IRunit *self) {
+	struct IRpipeline p;
+	if (!IRpipeline_parse(&p, Oinfo.pipeline)) {
+		fail_unreachable(__FUNCTION__);	// checked by Oinfo_parse()
+	}
+	IRpipeline_run(&p, self);
+	IRpipeline_free(&p);
+}
@@ -0,0 +1,362 @@
+// Pass manager.
+// Passes are registered in a table with the analyses they preserve when they change the
+// function. Analyses are cached per function, and dropped after a change by a pass which
+// does not preserve them, so that consecutive passes keeping the CFG share a single
+// dominator tree and loop nest.
+//
+// A pipeline is parsed from a textual description into steps: passes, groups repeated until
+// they reach a fixed point, and barriers between the parts of the pipeline run over the whole
+// unit. Functions are visited bottom-up in the call graph, so that inlining sees optimized
+// callees. A group is skipped when the function did not change since the same group last
+// reached its fixed point.
+//
+// Each pass declares the size of the functions it handles in reasonable time. Passes whose
+// cost grows faster than the function run a cheaper variant above their limit, when they
+// have one, and are skipped otherwise; -Rpass-skipped reports where it happens.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Upper bound of rounds of a fix(...) group.
+#define PASS_MAX_ROUNDS 4
+
+// Initializes the analysis cache of a function.
+void IRanalyses_init(struct IRanalyses *self, struct IRfunction *f, const struct IRcallgraph *cg) {
+	self->f = f;
+	self->cg = cg;
+	self->valid = 0;
+	self->fixpoint = NULL;
+	self->remarked = 0;
+}
+
+// Returns the dominator tree of the function.
+struct IRdomtree* IRanalyses_dom(struct IRanalyses *self) {
+	if (!(self->valid & IRA_DOM)) {
+		IRdomtree_build(&self->dom, self->f);
+		self->valid |= IRA_DOM;
+	}
+	return (&self->dom);
+}
+
+// Returns the post-dominator tree of the function.
+struct IRdomtree* IRanalyses_postdom(struct IRanalyses *self) {
+	if (!(self->valid & IRA_POSTDOM)) {
+		IRdomtree_build_post(&self->postdom, self->f);
+		self->valid |= IRA_POSTDOM;
+	}
+	return (&self->postdom);
+}
+
+// Returns the loop nest of the function.
+struct IRloopinfo* IRanalyses_loops(struct IRanalyses *self) {
+	if (!(self->valid & IRA_LOOPS)) {
+		IRloopinfo_build(&self->loops, IRanalyses_dom(self));
+		self->valid |= IRA_LOOPS;
+	}
+	return (&self->loops);
+}
+
+// Returns the liveness of the values of the function.
+struct IRliveness* IRanalyses_liveness(struct IRanalyses *self) {
+	if (!(self->valid & IRA_LIVENESS)) {
+		IRliveness_build(&self->liveness, self->f);
+		self->valid |= IRA_LIVENESS;
+	}
+	return (&self->liveness);
+}
+
+// Drops the analyses which are not in _preserved_, after a change of the function.
+// The loop nest is built from the dominator tree, so it goes with it.
+void IRanalyses_invalidate(struct IRanalyses *self, int preserved) {
+	if (!(preserved & IRA_DOM)) {
+		preserved &= ~IRA_LOOPS;
+	}
+	int drop = self->valid & ~preserved;
+	if (drop & IRA_LOOPS) {
+		IRloopinfo_free(&self->loops);
+	}
+	if (drop & IRA_DOM) {
+		IRdomtree_free(&self->dom);
+	}
+	if (drop & IRA_POSTDOM) {
+		IRdomtree_free(&self->postdom);
+	}
+	if (drop & IRA_LIVENESS) {
+		IRliveness_free(&self->liveness);
+	}
+	self->valid &= preserved;
+}
+
+// Frees the analysis cache.
+void IRanalyses_free(struct IRanalyses *self) {
+	IRanalyses_invalidate(self, 0);
+}
+
+// Registered function pass.
+struct IRpass {
+	const char *name;
+	bool (*run)(struct IRfunction *f, struct IRanalyses *am);
+	int preserves;		// analyses still valid after the pass changed the function
+	int max_ins;		// largest number of instructions of a function to run on, 0 for no limit
+	int max_blocks;		// largest number of blocks of a function to run on, 0 for no limit
+	bool (*cheap)(struct IRfunction *f, struct IRanalyses *am);	// variant run above the limits, or NULL to skip
+};
+
+// Adapts a pass which uses no analysis to the interface of the registry.
+#define IRPASS_PLAIN(fn) \
+	static bool run_##fn(struct IRfunction *f, struct IRanalyses *am) { \
+		(void)am; \
+		return (IRopt_##fn(f)); \
+	}
+
+IRPASS_PLAIN(dce)
+IRPASS_PLAIN(instcombine)
+IRPASS_PLAIN(narrow)
+IRPASS_PLAIN(sroa)
+IRPASS_PLAIN(mem2reg)
+IRPASS_PLAIN(ifconvert)
+IRPASS_PLAIN(div_const)
+IRPASS_PLAIN(fuse_cmp)
+
+static bool run_inline(struct IRfunction *f, struct IRanalyses *am) {
+	return (am->cg && IRopt_inline(f, am->cg, Oinfo.inline_threshold));
+}
+
+static bool run_unroll(struct IRfunction *f, struct IRanalyses *am) {
+	return (IRopt_unroll(f, am, Oinfo.unroll_budget));
+}
+
+// Limits of the passes whose cost grows with the number of locations, loops or expressions
+// times the size of the function. Functions below them take a few tenths of a second.
+#define PASS_MAX_INS	20000
+#define PASS_MAX_BLOCKS	4000
+
+// Registry of the passes, by name.
+static const struct IRpass passes[] = {
+	{ "dce",		run_dce,		0,		0,		0,			NULL },
+	{ "inline",		run_inline,		0,		0,		0,			NULL },
+	{ "instcombine",	run_instcombine,	IRA_CFG,	0,		0,			NULL },
+	{ "sroa",		run_sroa,		IRA_CFG,	0,		0,			NULL },
+	{ "mem2reg",		run_mem2reg,		IRA_CFG,	0,		0,			NULL },
+	{ "load-elim",		IRopt_load_elim,	IRA_CFG,	PASS_MAX_INS,	0,			IRopt_load_elim_local },
+	{ "dse",		IRopt_dse,		IRA_CFG,	PASS_MAX_INS,	0,			IRopt_dse_local },
+	{ "narrow",		run_narrow,		IRA_CFG,	0,		0,			NULL },
+	{ "pre",		IRopt_pre,		0,		PASS_MAX_INS,	PASS_MAX_BLOCKS,	NULL },
+	{ "ifconvert",		run_ifconvert,		0,		0,		0,			NULL },
+	{ "licm",		IRopt_licm,		0,		PASS_MAX_INS,	PASS_MAX_BLOCKS,	NULL },
+	{ "strength-reduce",	IRopt_strength_reduce,	IRA_CFG,	PASS_MAX_INS,	PASS_MAX_BLOCKS,	NULL },
+	{ "unroll",		run_unroll,		0,		PASS_MAX_INS,	PASS_MAX_BLOCKS,	NULL },
+	{ "div-const",		run_div_const,		IRA_CFG,	0,		0,			NULL },
+	{ "fuse-cmp",		run_fuse_cmp,		IRA_CFG,	0,		0,			NULL },
+};
+
+// Kinds of pipeline steps.
+enum {
+	IRS_PASS,	// run a pass
+	IRS_FIX,	// repeat a group of steps until nothing changes
+	IRS_BARRIER,	// wait for every function of the unit
+};
+
+// Step of a pipeline.
+struct IRstep {
+	int kind;
+	const struct IRpass *pass;	// the pass to run
+	struct array body;		// steps of a group
+	char *text;			// source text of a group
+};
+
+// Returns the registered pass named by the _len_ first characters of _name_, or NULL.
+static const struct IRpass* find_pass(const char *name, int len) {
+	for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i) {
+		if ((int)strlen(passes[i].name) == len && strncmp(passes[i].name, name, len) == 0) {
+			return (&passes[i]);
+		}
+	}
+	return (NULL);
+}
+
+// Frees the steps of a list.
+static void steps_free(struct array *steps) {
+	for (int i = 0; i < steps->length; ++i) {
+		struct IRstep *s = steps->begin[i];
+		steps_free(&s->body);
+		free(s->text);
+		free(s);
+	}
+	array_free(steps);
+}
+
+// Parses a comma separated list of steps into _steps_, up to a closing parenthesis in a group.
+// Returns the position after the list, or NULL if it is malformed.
+static const char* parse_steps(struct array *steps, const char *p, bool in_group) {
+	for (;;) {
+		const char *name = p;
+		while (*p && *p != ',' && *p != '(' && *p != ')') {
+			++p;
+		}
+		int len = p - name;
+		if (len == 0) {
+			return (NULL);
+		}
+
+		struct IRstep *s = try_calloc(1, sizeof(struct IRstep), __FUNCTION__);
+		array_init(&s->body);
+		array_pushback(steps, s);
+		if (*p == '(') {
+			const char *end = (len == 3 && strncmp(name, "fix", 3) == 0)
+					? parse_steps(&s->body, p + 1, true) : NULL;
+			if (end == NULL) {
+				return (NULL);
+			}
+			s->kind = IRS_FIX;
+			s->text = try_malloc(end - name + 1, __FUNCTION__);
+			memcpy(s->text, name, end - name);
+			s->text[end - name] = '\0';
+			p = end;
+		} else if (len == 7 && strncmp(name, "barrier", 7) == 0 && !in_group) {
+			s->kind = IRS_BARRIER;
+		} else {
+			s->kind = IRS_PASS;
+			s->pass = find_pass(name, len);
+			if (s->pass == NULL) {
+				return (NULL);
+			}
+		}
+
+		if (*p == ',') {
+			++p;
+		} else if (*p == ')' && in_group) {
+			return (p + 1);
+		} else if (*p == '\0' && !in_group) {
+			return (p);
+		} else {
+			return (NULL);
+		}
+	}
+}
+
+// Parses a pipeline. Returns false if it is malformed or names an unknown pass.
+// The empty pipeline runs nothing.
+bool IRpipeline_parse(struct IRpipeline *self, const char *text) {
+	array_init(&self->steps);
+	if (*text && parse_steps(&self->steps, text, false) == NULL) {
+		steps_free(&self->steps);
+		return (false);
+	}
+	return (true);
+}
+
+// Frees a pipeline.
+void IRpipeline_free(struct IRpipeline *self) {
+	steps_free(&self->steps);
+}
+
+// Returns whether the function is over the limits of the pass. With -Rpass-skipped, the
+// first time the pass is degraded or skipped on the function is reported.
+static bool over_limits(const struct IRpass *pass, struct IRfunction *f, struct IRanalyses *am) {
+	if (pass->max_ins == 0 && pass->max_blocks == 0) {
+		return (false);
+	}
+
+	// Instruction identifiers are only compact after a renumbering, blocks are counted instead.
+	const char *what = "instructions";
+	int size = 0, limit = pass->max_ins;
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		size += ((struct IRblock*)p)->ins.length;
+	}
+	if (limit == 0 || size <= limit) {
+		what = "blocks";
+		size = f->bs.length;
+		limit = pass->max_blocks;
+		if (limit == 0 || size <= limit) {
+			return (false);
+		}
+	}
+
+	int bit = 1 << (pass - passes);
+	if (Oinfo.remark_skipped && !(am->remarked & bit)) {
+		am->remarked |= bit;
+		fprintf(stderr, "remark: function '%s': pass '%s' %s, %d %s over the limit of %d [-Rpass-skipped]\n",
+				f->name, pass->name, pass->cheap ? "degraded to its local variant" : "skipped",
+				size, what, limit);
+	}
+	return (true);
+}
+
+// Runs a pass, or its cheaper variant if the function is over its limits, and invalidates the
+// analyses it does not preserve if it changed the function.
+static bool run_pass(const struct IRpass *pass, struct IRfunction *f, struct IRanalyses *am) {
+	bool (*run)(struct IRfunction*, struct IRanalyses*) = pass->run;
+	if (over_limits(pass, f, am)) {
+		run = pass->cheap;
+		if (run == NULL) {
+			return (false);
+		}
+	}
+	bool changed = run(f, am);
+	if (changed) {
+		IRanalyses_invalidate(am, pass->preserves);
+		am->fixpoint = NULL;
+	}
+	return (changed);
+}
+
+// Runs the steps _from_ to _to_ excluded of a list on a function, barriers excepted.
+// Returns whether the function was changed.
+static bool run_steps(const struct array *steps, int from, int to, struct IRfunction *f, struct IRanalyses *am) {
+	bool changed = false;
+	for (int i = from; i < to; ++i) {
+		struct IRstep *s = steps->begin[i];
+		if (s->kind == IRS_PASS) {
+			changed |= run_pass(s->pass, f, am);
+		} else if (s->kind == IRS_FIX) {
+			if (am->fixpoint && strcmp(am->fixpoint, s->text) == 0) {
+				continue;
+			}
+			for (int k = 0; k < PASS_MAX_ROUNDS; ++k) {
+				if (!run_steps(&s->body, 0, s->body.length, f, am)) {
+					am->fixpoint = s->text;
+					break;
+				}
+				changed = true;
+			}
+		}
+	}
+	return (changed);
+}
+
+// Runs the passes of a pipeline on every function of the unit.
+void IRpipeline_run(const struct IRpipeline *self, struct IRunit *unit) {
+	struct IRcallgraph cg;
+	IRcallgraph_build(&cg, unit);
+	struct IRanalyses *am = try_malloc((cg.n + 1) * sizeof(struct IRanalyses), __FUNCTION__);
+	for (int i = 0; i < cg.n; ++i) {
+		IRanalyses_init(&am[i], cg.funcs[i], &cg);
+	}
+
+	// Runs the steps between barriers over every function in turn.
+	const struct array *steps = &self->steps;
+	for (int from = 0; from < steps->length; ) {
+		int to = from;
+		while (to < steps->length && ((struct IRstep*)steps->begin[to])->kind != IRS_BARRIER) {
+			++to;
+		}
+		for (int i = 0; i < cg.n; ++i) {
+			struct IRfunction *f = cg.order[i];
+			run_steps(steps, from, to, f, &am[f->id]);
+		}
+		from = to + 1;
+	}
+
+	for (int i = 0; i < cg.n; ++i) {
+		IRanalyses_free(&am[i]);
+	}
+	free(am);
+	IRcallgraph_free(&cg);
+}
@@ -0,0 +1,574 @@
+// Partial redundancy elimination by lazy code motion (Knoop, Rüthing and Steffen,
+// in the edge based formulation of Drechsler and Stadel).
+// Expressions are lexical: the same operation on the same operands, constants being compared
+// by value. An expression is killed in the blocks defining its operands. Four bit vector
+// problems are solved over the CFG:
+//   AVIN(b)     = AND of AVOUT(p) over the predecessors	AVOUT(b) = COMP(b) | (AVIN(b) & TRANSP(b))
+//   ANTOUT(b)   = AND of ANTIN(s) over the successors	ANTIN(b) = ANTLOC(b) | (ANTOUT(b) & TRANSP(b))
+//   EARLIEST(p,s) = ANTIN(s) & ~AVOUT(p) & (~TRANSP(p) | ~ANTOUT(p))
+//   LATER(p,s)  = EARLIEST(p,s) | (LATERIN(p) & ~ANTLOC(p))	LATERIN(b) = AND of LATER(p,b)
+// Computations are inserted on the edges in LATER(p,s) & ~LATERIN(s), and the upward exposed
+// computations in ANTLOC(b) & ~LATERIN(b) are deleted. Insertions only happen where the
+// expression is computed on every path anyway, so no path computes it more often than before,
+// and fully redundant computations are deleted as a special case.
+// The value of a deleted computation is then looked up backwards from its block, placing
+// phis where the computations reaching it differ, like the SSA construction of the front end.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "util/bitset.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Computation of an expression.
+struct pre_occurrence {
+	struct IRinstruction *x;
+	struct IRinstruction *ops[3];	// operands, in canonical order for commutative operations
+	int seq;			// position in layout order
+};
+
+// CFG edge, with the solution of the LATER problem.
+struct pre_edge {
+	struct IRblock *from, *to;
+	struct IRblock *split;		// block created on the edge to hold insertions, or NULL
+	uint64_t *later;
+};
+
+// Working state of the pass.
+struct pre_context {
+	struct IRfunction *f;
+	struct IRdomtree *dom;		// dominator tree, from the analysis cache
+	int nb;				// number of blocks
+	int nw;				// number of words of a bit vector
+	int ne;				// number of expressions
+	int *first;			// first occurrence of each expression, one more entry for the end
+	struct pre_occurrence *occ;	// occurrences sorted by expression, then by position
+	uint64_t *antloc, *comp, *transp;
+	uint64_t *antin, *antout, *avin, *avout, *laterin;
+	int nedge;
+	struct pre_edge *edges;		// edges between reachable blocks, grouped by target
+	int *in;			// first edge into each block, indexed by block id, one more entry for the end
+	struct IRinstruction **repl;	// pending replacements, indexed by instruction id
+	struct IRinstruction **at_end;	// value of the current expression at the end of each block
+	struct IRinstruction **at_entry;// value of the current expression at the entry of each block
+};
+
+// Returns the bit vector of a block in a per-block table.
+static uint64_t* pre_set(struct pre_context *ctx, uint64_t *table, struct IRblock *b) {
+	return (table + (size_t)b->id * ctx->nw);
+}
+
+// Returns whether the instruction computes an expression which may be moved.
+// Insertions only happen where the expression is anticipated, so divisions are candidates too.
+// Loads are not: their value also depends on the stores in between, which are not tracked.
+static bool is_candidate(struct IRinstruction *x) {
+	switch (x->op) {
+		case IR_IMM: case IR_PHI: case IR_ALLOCA: case IR_LOAD: case IR_PARAM:
+			return (false);
+		default:
+			return (!IRhas_side_effect(x->op));
+	}
+}
+
+// Compares operands: constants by type and value, other values by identity.
+static int compare_operand(const struct IRinstruction *a, const struct IRinstruction *b) {
+	if (a == b) {
+		return (0);
+	}
+	if (a == NULL || b == NULL) {
+		return (a ? 1 : -1);
+	}
+	if ((a->op == IR_IMM) != (b->op == IR_IMM)) {
+		return (a->op == IR_IMM ? -1 : 1);
+	}
+	if (a->op == IR_IMM) {
+		if (a->type != b->type) {
+			return (a->type - b->type);
+		}
+		int64_t va = IRimm_value(a), vb = IRimm_value(b);
+		return ((va > vb) - (va < vb));
+	}
+	return ((a->id > b->id) - (a->id < b->id));
+}
+
+// Compares occurrences by expression.
+static int compare_expression(const struct pre_occurrence *a, const struct pre_occurrence *b) {
+	if (a->x->op != b->x->op) {
+		return (a->x->op - b->x->op);
+	}
+	if (a->x->type != b->x->type) {
+		return (a->x->type - b->x->type);
+	}
+	for (int i = 0; i < 3; ++i) {
+		int c = compare_operand(a->ops[i], b->ops[i]);
+		if (c != 0) {
+			return (c);
+		}
+	}
+	return (0);
+}
+
+// Sorting order of the occurrences: by expression, then by position.
+static int compare_occurrence(const void *pa, const void *pb) {
+	const struct pre_occurrence *a = pa, *b = pb;
+	int c = compare_expression(a, b);
+	return (c != 0 ? c : a->seq - b->seq);
+}
+
+// Fills the operands of an occurrence.
+static void get_operands(struct pre_occurrence *o) {
+	struct IRinstruction *x = o->x;
+	o->ops[0] = o->ops[1] = o->ops[2] = NULL;
+	switch (x->op) {
+		case IR_SELECT: {
+			o->ops[0] = x->cond;
+			o->ops[1] = x->vt;
+			o->ops[2] = x->vf;
+		}	break;
+
+		case IR_ZEXT: case IR_SEXT: case IR_TRUNC:
+		case IR_NEG: case IR_NOT: {
+			o->ops[0] = x->left;
+		}	break;
+
+		default: {
+			if (!IRis_binary(x->op)) {
+				fail_ir_op(x->op, __FUNCTION__);
+			}
+			o->ops[0] = x->left;
+			o->ops[1] = x->right;
+			if (IRis_commutative(x->op) && compare_operand(o->ops[0], o->ops[1]) > 0) {
+				o->ops[0] = x->right;
+				o->ops[1] = x->left;
+			}
+		}
+	}
+}
+
+// Collects the occurrences of the expressions computed at least twice, and numbers the expressions.
+static void collect_expressions(struct pre_context *ctx) {
+	int n = 0, seq = 0;
+	ctx->occ = try_malloc((ctx->f->ins_count + 1) * sizeof(struct pre_occurrence), __FUNCTION__);
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		struct IRblock *b = ctx->dom->order[i];
+		for (struct llist_node *p = b->ins.head; p; p = p->nxt) {
+			struct IRinstruction *x = (void*)p;
+			if (is_candidate(x)) {
+				ctx->occ[n].x = x;
+				ctx->occ[n].seq = seq++;
+				get_operands(&ctx->occ[n]);
+				n += 1;
+			}
+		}
+	}
+	qsort(ctx->occ, n, sizeof(struct pre_occurrence), compare_occurrence);
+
+	// Expressions computed once are dropped, nothing can be redundant with them.
+	int m = 0;
+	ctx->first = try_malloc((n + 1) * sizeof(int), __FUNCTION__);
+	ctx->ne = 0;
+	for (int i = 0, j; i < n; i = j) {
+		for (j = i + 1; j < n && compare_expression(&ctx->occ[i], &ctx->occ[j]) == 0; ++j) {
+		}
+		if (j - i < 2) {
+			continue;
+		}
+		ctx->first[ctx->ne++] = m;
+		while (i < j) {
+			ctx->occ[m++] = ctx->occ[i++];
+		}
+	}
+	ctx->first[ctx->ne] = m;
+}
+
+// Computes the local properties of the blocks.
+static void compute_local(struct pre_context *ctx) {
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		bitset_fill(pre_set(ctx, ctx->transp, ctx->dom->order[i]), ctx->nw, true);
+	}
+	for (int e = 0; e < ctx->ne; ++e) {
+		struct pre_occurrence *o = &ctx->occ[ctx->first[e]];
+		for (int i = 0; i < 3; ++i) {
+			if (o->ops[i] && o->ops[i]->op != IR_IMM) {
+				bitset_remove(pre_set(ctx, ctx->transp, o->ops[i]->owner), e);
+			}
+		}
+		for (int k = ctx->first[e]; k < ctx->first[e + 1]; ++k) {
+			bitset_add(pre_set(ctx, ctx->comp, ctx->occ[k].x->owner), e);
+		}
+	}
+
+	// In SSA form, a computation follows the definitions of its operands: every computation
+	// of a block is upward exposed, unless an operand is defined in the block.
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		struct IRblock *b = ctx->dom->order[i];
+		uint64_t *antloc = pre_set(ctx, ctx->antloc, b);
+		uint64_t *comp = pre_set(ctx, ctx->comp, b), *transp = pre_set(ctx, ctx->transp, b);
+		for (int w = 0; w < ctx->nw; ++w) {
+			antloc[w] = comp[w] & transp[w];
+		}
+	}
+}
+
+// Solves the availability problem, forwards.
+static void compute_availability(struct pre_context *ctx) {
+	uint64_t *tmp = bitset_new(ctx->nw);
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		bitset_fill(pre_set(ctx, ctx->avout, ctx->dom->order[i]), ctx->nw, true);
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < ctx->dom->count; ++i) {
+			struct IRblock *b = ctx->dom->order[i];
+			uint64_t *avin = pre_set(ctx, ctx->avin, b);
+			bitset_fill(avin, ctx->nw, i != 0);
+			for (int k = ctx->in[b->id]; k < ctx->in[b->id + 1]; ++k) {
+				bitset_intersect(avin, pre_set(ctx, ctx->avout, ctx->edges[k].from), ctx->nw);
+			}
+
+			uint64_t *comp = pre_set(ctx, ctx->comp, b), *transp = pre_set(ctx, ctx->transp, b);
+			for (int w = 0; w < ctx->nw; ++w) {
+				tmp[w] = comp[w] | (avin[w] & transp[w]);
+			}
+			changed |= bitset_update(pre_set(ctx, ctx->avout, b), tmp, ctx->nw);
+		}
+	}
+	free(tmp);
+}
+
+// Solves the anticipability problem, backwards.
+static void compute_anticipability(struct pre_context *ctx) {
+	uint64_t *tmp = bitset_new(ctx->nw);
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		bitset_fill(pre_set(ctx, ctx->antin, ctx->dom->order[i]), ctx->nw, true);
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = ctx->dom->count - 1; i >= 0; --i) {
+			struct IRblock *b = ctx->dom->order[i], *succ[2];
+			int sn = IRblock_successors(b, succ);
+			uint64_t *antout = pre_set(ctx, ctx->antout, b);
+			bitset_fill(antout, ctx->nw, sn > 0);
+			for (int k = 0; k < sn; ++k) {
+				bitset_intersect(antout, pre_set(ctx, ctx->antin, succ[k]), ctx->nw);
+			}
+
+			uint64_t *antloc = pre_set(ctx, ctx->antloc, b), *transp = pre_set(ctx, ctx->transp, b);
+			for (int w = 0; w < ctx->nw; ++w) {
+				tmp[w] = antloc[w] | (antout[w] & transp[w]);
+			}
+			changed |= bitset_update(pre_set(ctx, ctx->antin, b), tmp, ctx->nw);
+		}
+	}
+	free(tmp);
+}
+
+// Lists the edges between reachable blocks, grouped by target, one for each predecessor entry.
+static void collect_edges(struct pre_context *ctx) {
+	int n = 0;
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		n += ctx->dom->order[i]->pre.length;
+	}
+	ctx->edges = try_calloc(n + 1, sizeof(struct pre_edge), __FUNCTION__);
+	ctx->in = try_calloc(ctx->nb + 1, sizeof(int), __FUNCTION__);
+
+	ctx->nedge = 0;
+	struct llist_node *q = ctx->f->bs.head;
+	for (int id = 0; id < ctx->nb; ++id, q = q->nxt) {
+		struct IRblock *b = (void*)q;
+		ctx->in[id] = ctx->nedge;
+		if (!IRdomtree_reachable(ctx->dom, b)) {
+			continue;
+		}
+		for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+			struct pre_edge *e = &ctx->edges[ctx->nedge++];
+			e->from = ((struct IRpredecessor*)p)->b;
+			e->to = b;
+			e->later = bitset_new(ctx->nw);
+		}
+	}
+	ctx->in[ctx->nb] = ctx->nedge;
+}
+
+// Solves the placement problem: EARLIEST, then LATER and LATERIN, from the entry downwards.
+static void compute_placement(struct pre_context *ctx) {
+	uint64_t *earliest = try_malloc(((size_t)ctx->nedge + 1) * ctx->nw * sizeof(uint64_t), __FUNCTION__);
+	for (int k = 0; k < ctx->nedge; ++k) {
+		struct pre_edge *e = &ctx->edges[k];
+		uint64_t *antin = pre_set(ctx, ctx->antin, e->to);
+		uint64_t *avout = pre_set(ctx, ctx->avout, e->from);
+		uint64_t *transp = pre_set(ctx, ctx->transp, e->from);
+		uint64_t *antout = pre_set(ctx, ctx->antout, e->from);
+		for (int w = 0; w < ctx->nw; ++w) {
+			earliest[k * ctx->nw + w] = antin[w] & ~avout[w] & (~transp[w] | ~antout[w]);
+		}
+	}
+
+	// The entry is entered by a virtual edge, earliest for everything anticipated there.
+	uint64_t *tmp = bitset_new(ctx->nw);
+	for (int i = 0; i < ctx->dom->count; ++i) {
+		struct IRblock *b = ctx->dom->order[i];
+		if (i == 0) {
+			bitset_copy(pre_set(ctx, ctx->laterin, b), pre_set(ctx, ctx->antin, b), ctx->nw);
+		} else {
+			bitset_fill(pre_set(ctx, ctx->laterin, b), ctx->nw, true);
+		}
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < ctx->dom->count; ++i) {
+			struct IRblock *b = ctx->dom->order[i];
+			bitset_fill(tmp, ctx->nw, true);
+			for (int k = ctx->in[b->id]; k < ctx->in[b->id + 1]; ++k) {
+				struct pre_edge *e = &ctx->edges[k];
+				uint64_t *laterin = pre_set(ctx, ctx->laterin, e->from);
+				uint64_t *antloc = pre_set(ctx, ctx->antloc, e->from);
+				for (int w = 0; w < ctx->nw; ++w) {
+					e->later[w] = earliest[k * ctx->nw + w] | (laterin[w] & ~antloc[w]);
+					tmp[w] &= e->later[w];
+				}
+			}
+			if (i != 0) {
+				changed |= bitset_update(pre_set(ctx, ctx->laterin, b), tmp, ctx->nw);
+			}
+		}
+	}
+	free(tmp);
+	free(earliest);
+}
+
+// Returns whether the expression is inserted on the edge.
+static bool is_inserted(struct pre_context *ctx, struct pre_edge *e, int x) {
+	return (bitset_test(e->later, x) && !bitset_test(pre_set(ctx, ctx->laterin, e->to), x));
+}
+
+// Returns whether the computations of the expression in the block are deleted.
+static bool is_deleted(struct pre_context *ctx, struct IRblock *b, int x) {
+	return (bitset_test(pre_set(ctx, ctx->antloc, b), x) && !bitset_test(pre_set(ctx, ctx->laterin, b), x));
+}
+
+// Returns the block receiving the insertions of an edge: the source if it has no other
+// successor, otherwise a new block splitting the edge.
+// The target always has several predecessors, or nothing would be inserted on the edge.
+static struct IRblock* insertion_block(struct pre_context *ctx, struct pre_edge *e) {
+	struct IRblock *succ[2];
+	if (IRblock_successors(e->from, succ) == 1) {
+		return (e->from);
+	}
+	if (e->split) {
+		return (e->split);
+	}
+
+	struct IRfunction *f = ctx->f;
+	struct IRblock *s = IRblock_new(f);
+	llist_unlink(&f->bs, s);
+	llist_insert_after(&f->bs, e->from, s);
+
+	struct IRinstruction *t = IRblock_terminator(e->from);
+	if (t->bt == e->to) {
+		t->bt = s;
+	} else {
+		t->bf = s;
+	}
+	IRblock_add_pre(s, e->from);
+	IRblock_replace_pre(e->to, e->from, s);
+
+	// The jump is completed by hand: the edge into the target already exists.
+	struct IRinstruction *j = IRinstruction_new_jmp(s, IR_JMP, NULL, NULL, NULL);
+	j->bt = e->to;
+	e->split = s;
+	return (s);
+}
+
+// Inserts a computation of the expression of _o_ at the end of the block.
+// Constant operands are materialized again, their definitions may not reach the block.
+static struct IRinstruction* insert_computation(struct pre_occurrence *o, struct IRblock *b) {
+	struct IRinstruction *x = o->x;
+	struct IRinstruction *y = IRinstruction_new_before(IRblock_terminator(b), x->op, x->type, x->left, x->right);
+	if (x->op == IR_SELECT) {
+		y->vf = x->vf;
+	}
+
+	struct IRinstruction **slots[3] = { &y->left, NULL, NULL };
+	if (x->op == IR_SELECT) {
+		slots[1] = &y->vt;
+		slots[2] = &y->vf;
+	} else if (IRis_binary(x->op)) {
+		slots[1] = &y->right;
+	}
+	for (int i = 0; i < 3; ++i) {
+		if (slots[i] && (*slots[i])->op == IR_IMM) {
+			*slots[i] = IRblock_new_const(b, (*slots[i])->type, IRimm_value(*slots[i]));
+		}
+	}
+	return (y);
+}
+
+static struct IRinstruction* value_at_entry(struct pre_context *ctx, struct IRinstruction *x, struct IRblock *b);
+
+// Returns the value of the current expression at the end of the block.
+static struct IRinstruction* value_at_end(struct pre_context *ctx, struct IRinstruction *x, struct IRblock *b) {
+	if (ctx->at_end[b->id] == NULL) {
+		ctx->at_end[b->id] = value_at_entry(ctx, x, b);
+	}
+	return (ctx->at_end[b->id]);
+}
+
+// Returns the value of the current expression, computed by _x_, at the entry of the block.
+// The expression is available there on every path, by construction of the insertions.
+static struct IRinstruction* value_at_entry(struct pre_context *ctx, struct IRinstruction *x, struct IRblock *b) {
+	struct IRinstruction *v = ctx->at_entry[b->id];
+	if (v) {
+		return (v);
+	}
+
+	if (b->pre.length == 0) {
+		fail_unreachable(__FUNCTION__);
+	} else if (b->pre.length == 1) {
+		v = value_at_end(ctx, x, ((struct IRpredecessor*)b->pre.head)->b);
+	} else {
+		v = IRinstruction_new_phi(b, x->type);
+		ctx->at_entry[b->id] = v;	// breaks cycles through loops
+		for (struct llist_node *p = b->pre.head; p; p = p->nxt) {
+			struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+			IRphi_add_arg(v, pre, value_at_end(ctx, x, pre));
+		}
+	}
+	ctx->at_entry[b->id] = v;
+	return (v);
+}
+
+// Moves the computations of an expression as decided, and returns whether anything changed.
+static bool transform(struct pre_context *ctx, int x) {
+	struct pre_occurrence *first = &ctx->occ[ctx->first[x]], *end = &ctx->occ[ctx->first[x + 1]];
+	int n = ctx->nb + ctx->nedge;
+	memset(ctx->at_end, 0, n * sizeof(struct IRinstruction*));
+	memset(ctx->at_entry, 0, n * sizeof(struct IRinstruction*));
+
+	bool changed = false;
+	for (int k = 0; k < ctx->nedge; ++k) {
+		struct pre_edge *e = &ctx->edges[k];
+		if (is_inserted(ctx, e, x)) {
+			struct IRblock *b = insertion_block(ctx, e);
+			ctx->at_end[b->id] = insert_computation(first, b);
+			changed = true;
+		}
+	}
+
+	// Computations kept in a block define the value at its end, later ones in the block are
+	// the same value.
+	for (struct pre_occurrence *o = first; o < end; ++o) {
+		struct IRblock *b = o->x->owner;
+		if (is_deleted(ctx, b, x)) {
+			continue;
+		}
+		if (ctx->at_end[b->id]) {
+			ctx->repl[o->x->id] = ctx->at_end[b->id];
+			changed = true;
+		} else {
+			ctx->at_end[b->id] = o->x;
+		}
+	}
+
+	for (struct pre_occurrence *o = first; o < end; ++o) {
+		struct IRblock *b = o->x->owner;
+		if (is_deleted(ctx, b, x)) {
+			ctx->repl[o->x->id] = value_at_entry(ctx, o->x, b);
+			changed = true;
+		}
+	}
+
+	// Computations kept may have gained users, in other blocks through phis: a comparison is
+	// no longer fused into its branch then, see IRopt_fuse_cmp().
+	if (changed) {
+		for (struct pre_occurrence *o = first; o < end; ++o) {
+			if (ctx->repl[o->x->id] == NULL) {
+				o->x->is_fused = false;
+			}
+		}
+	}
+	return (changed);
+}
+
+// Partial redundancy elimination: computations available on some incoming paths only are
+// inserted on the others, which makes the later computation fully redundant. Critical edges
+// are split where an insertion needs it. Identifiers are renumbered.
+bool IRopt_pre(struct IRfunction *self, struct IRanalyses *am) {
+	struct pre_context ctx = {
+		.f = self,
+		.nb = self->bs.length,
+		.dom = IRanalyses_dom(am),
+	};
+
+	// Unreachable blocks are left to IRopt_dce(), and a branch to the same block on both
+	// sides has two edges which the predecessor lists can not tell apart.
+	bool ok = ctx.dom->count == ctx.nb;
+	for (int i = 0; ok && i < ctx.dom->count; ++i) {
+		struct IRblock *succ[2];
+		ok = IRblock_successors(ctx.dom->order[i], succ) != 2 || succ[0] != succ[1];
+	}
+	if (!ok) {
+		return (false);
+	}
+
+	collect_expressions(&ctx);
+	if (ctx.ne == 0) {
+		free(ctx.first);
+		free(ctx.occ);
+		return (false);
+	}
+
+	ctx.nw = bitset_words(ctx.ne);
+	uint64_t **tables[] = { &ctx.antloc, &ctx.comp, &ctx.transp, &ctx.antin,
+				&ctx.antout, &ctx.avin, &ctx.avout, &ctx.laterin };
+	for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+		*tables[i] = try_calloc((size_t)ctx.nb * ctx.nw, sizeof(uint64_t), __FUNCTION__);
+	}
+	compute_local(&ctx);
+	collect_edges(&ctx);
+	compute_availability(&ctx);
+	compute_anticipability(&ctx);
+	compute_placement(&ctx);
+
+	int ni = self->ins_count;
+	ctx.repl = try_calloc(ni + 1, sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.at_end = try_malloc((ctx.nb + ctx.nedge) * sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.at_entry = try_malloc((ctx.nb + ctx.nedge) * sizeof(struct IRinstruction*), __FUNCTION__);
+	bool changed = false;
+	for (int x = 0; x < ctx.ne; ++x) {
+		changed |= transform(&ctx, x);
+	}
+
+	if (changed) {
+		// The table must also cover the instructions created by the pass.
+		struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+		memcpy(repl, ctx.repl, ni * sizeof(struct IRinstruction*));
+		IRfunction_apply_replacements(self, repl);
+		free(repl);
+		IRfunction_renumber(self);
+	}
+
+	free(ctx.at_entry);
+	free(ctx.at_end);
+	free(ctx.repl);
+	for (int k = 0; k < ctx.nedge; ++k) {
+		free(ctx.edges[k].later);
+	}
+	free(ctx.edges);
+	free(ctx.in);
+	for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+		free(*tables[i]);
+	}
+	free(ctx.first);
+	free(ctx.occ);
+	return (changed);
+}
@@ -0,0 +1,625 @@
+// Value range and known bits analysis, and the narrowing pass built on it.
+// The analysis is optimistic: every value starts with an empty range, which grows
+// until a fixed point is reached. Phis whose range keeps growing are widened to the
+// full range of their type, so loops converge quickly.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "target.h"
+#include "acir.h"
+#include "opt.h"
+
+// Number of times a phi may grow before it is widened to its full type range.
+#define RANGE_WIDEN_LIMIT 8
+
+#define SIGN_BIT (UINT64_C(1) << 63)
+
+// Returns the smallest value of an integer type.
+static int64_t type_min(int t) {
+	switch (t) {
+		case IRT_I1:	return (0);
+		case IRT_I32:	return (INT32_MIN);
+		default:	return (INT64_MIN);
+	}
+}
+
+// Returns the largest value of an integer type.
+static int64_t type_max(int t) {
+	switch (t) {
+		case IRT_I1:	return (1);
+		case IRT_I32:	return (INT32_MAX);
+		default:	return (INT64_MAX);
+	}
+}
+
+// Returns the index of the highest set bit of a non-zero integer.
+static int highest_bit(uint64_t x) {
+	int res = 0;
+	while (x >>= 1) {
+		res += 1;
+	}
+	return (res);
+}
+
+// Returns whether the range is empty.
+bool IRrange_is_empty(const struct IRrange *self) {
+	return (self->lo > self->hi);
+}
+
+// Returns whether every value of the range is representable in the given integer type.
+bool IRrange_fits(const struct IRrange *self, int type) {
+	return (self->lo >= type_min(type) && self->hi <= type_max(type));
+}
+
+// Derives known bits from the bounds, and tightens the bounds with the known bits.
+static struct IRrange range_normalize(struct IRrange r) {
+	if (IRrange_is_empty(&r)) {
+		return (r);
+	}
+
+	// Bounds of the same sign share their leading bits with every value in between.
+	if ((r.lo < 0) == (r.hi < 0)) {
+		uint64_t d = (uint64_t)r.lo ^ (uint64_t)r.hi, m = ~UINT64_C(0);
+		if (d) {
+			int h = highest_bit(d);
+			m = (h == 63) ? 0 : ~((UINT64_C(2) << h) - 1);
+		}
+		r.one |= (uint64_t)r.lo & m;
+		r.zero |= ~(uint64_t)r.lo & m;
+	}
+
+	// The smallest value has no unknown bits set and the largest has all of them,
+	// except for the sign bit which works the other way round.
+	int64_t lo, hi;
+	if ((r.zero | r.one) & SIGN_BIT) {
+		lo = (int64_t)r.one;
+		hi = (int64_t)~r.zero;
+	} else {
+		lo = (int64_t)(r.one | SIGN_BIT);
+		hi = (int64_t)(~r.zero & ~SIGN_BIT);
+	}
+	r.lo = (lo > r.lo) ? lo : r.lo;
+	r.hi = (hi < r.hi) ? hi : r.hi;
+	return (r);
+}
+
+// Constructs a range from its bounds.
+static struct IRrange range_make(int64_t lo, int64_t hi) {
+	struct IRrange r = { .lo = lo, .hi = hi, .zero = 0, .one = 0 };
+	return (range_normalize(r));
+}
+
+// Constructs the range of a single value.
+static struct IRrange range_const(int64_t v) {
+	struct IRrange r = { .lo = v, .hi = v, .zero = ~(uint64_t)v, .one = (uint64_t)v };
+	return (r);
+}
+
+// Constructs the range covering every value of the type.
+static struct IRrange range_full(int type) {
+	if (!IRTypecode_is_int(type)) {
+		type = IRT_I64;
+	}
+	return (range_make(type_min(type), type_max(type)));
+}
+
+// Constructs the empty range.
+static struct IRrange range_empty(void) {
+	struct IRrange r = { .lo = 1, .hi = 0, .zero = 0, .one = 0 };
+	return (r);
+}
+
+// Returns the smallest range containing both ranges.
+static struct IRrange range_union(struct IRrange a, struct IRrange b) {
+	if (IRrange_is_empty(&a)) {
+		return (b);
+	}
+	if (IRrange_is_empty(&b)) {
+		return (a);
+	}
+
+	struct IRrange r = {
+		.lo = (a.lo < b.lo) ? a.lo : b.lo,
+		.hi = (a.hi > b.hi) ? a.hi : b.hi,
+		.zero = a.zero & b.zero,
+		.one = a.one & b.one,
+	};
+	return (range_normalize(r));
+}
+
+// Returns whether two ranges are the same.
+static bool range_equal(const struct IRrange *a, const struct IRrange *b) {
+	if (IRrange_is_empty(a) || IRrange_is_empty(b)) {
+		return (IRrange_is_empty(a) == IRrange_is_empty(b));
+	}
+	return (a->lo == b->lo && a->hi == b->hi && a->zero == b->zero && a->one == b->one);
+}
+
+// Returns whether two ranges can not have any value in common.
+static bool range_disjoint(const struct IRrange *a, const struct IRrange *b) {
+	return (a->hi < b->lo || b->hi < a->lo || (a->one & b->zero) || (a->zero & b->one));
+}
+
+// Returns the range of a signed comparison of a and b: whether a < b, or a <= b if _eq_ is set.
+static struct IRrange range_less(const struct IRrange *a, const struct IRrange *b, bool eq) {
+	if (eq ? a->hi <= b->lo : a->hi < b->lo) {
+		return (range_const(1));
+	}
+	if (eq ? a->lo > b->hi : a->lo >= b->hi) {
+		return (range_const(0));
+	}
+	return (range_make(0, 1));
+}
+
+// Returns the range of a comparison from the ranges of its operands.
+static struct IRrange transfer_cmp(int op, const struct IRrange *a, const struct IRrange *b) {
+	switch (op) {
+		case IR_CMP_EQ: case IR_CMP_NE: {
+			bool eq = (op == IR_CMP_EQ);
+			if (a->lo == a->hi && b->lo == b->hi && a->lo == b->lo) {
+				return (range_const(eq));
+			}
+			if (range_disjoint(a, b)) {
+				return (range_const(!eq));
+			}
+			return (range_make(0, 1));
+		}
+
+		case IR_CMP_LT:	return (range_less(a, b, false));
+		case IR_CMP_LE:	return (range_less(a, b, true));
+		case IR_CMP_GT:	return (range_less(b, a, false));
+		case IR_CMP_GE:	return (range_less(b, a, true));
+
+		default: {
+			// Values of the same sign are ordered the same way signed and unsigned.
+			if ((a->lo >= 0 && b->lo >= 0) || (a->hi < 0 && b->hi < 0)) {
+				static const int to_signed[][2] = {
+					{IR_CMP_ULT,	IR_CMP_LT},
+					{IR_CMP_ULE,	IR_CMP_LE},
+					{IR_CMP_UGT,	IR_CMP_GT},
+					{IR_CMP_UGE,	IR_CMP_GE},
+					{IR_NULL},
+				};
+				for (int i = 0; to_signed[i][0] != IR_NULL; ++i) {
+					if (to_signed[i][0] == op) {
+						return (transfer_cmp(to_signed[i][1], a, b));
+					}
+				}
+			}
+			return (range_make(0, 1));
+		}
+	}
+}
+
+// Returns the range [lo, hi] if it is representable in the type, otherwise the full range of the type.
+static struct IRrange range_checked(int type, bool overflow, int64_t lo, int64_t hi) {
+	if (overflow || lo < type_min(type) || hi > type_max(type)) {
+		return (range_full(type));
+	}
+	return (range_make(lo, hi));
+}
+
+// Returns the range of a bitwise operation from the known bits of its operands.
+static struct IRrange transfer_bitwise(int op, int type, const struct IRrange *a, const struct IRrange *b) {
+	struct IRrange r = range_full(type);
+	switch (op) {
+		case IR_AND: {
+			r.zero |= a->zero | b->zero;
+			r.one |= a->one & b->one;
+			// Masking with a non-negative value can not give more than the value.
+			if (a->lo >= 0 || b->lo >= 0) {
+				r.lo = 0;
+				r.hi = (a->lo >= 0 && (b->lo < 0 || a->hi < b->hi)) ? a->hi : b->hi;
+			}
+		}	break;
+
+		case IR_OR: {
+			r.zero |= a->zero & b->zero;
+			r.one |= a->one | b->one;
+		}	break;
+
+		default: {
+			r.zero |= (a->zero & b->zero) | (a->one & b->one);
+			r.one |= (a->zero & b->one) | (a->one & b->zero);
+		}	break;
+	}
+	return (range_normalize(r));
+}
+
+// Computes the range of a binary operation from the ranges of its operands.
+static struct IRrange transfer_binary(struct IRinstruction *x, struct IRrange a, struct IRrange b) {
+	if (IRrange_is_empty(&a) || IRrange_is_empty(&b)) {
+		return (range_empty());
+	}
+	if (IRis_cmp(x->op)) {
+		return (transfer_cmp(x->op, &a, &b));
+	}
+
+	int t = x->type, bits = IRTypecode_bits(t);
+	bool k = (b.lo == b.hi);	// whether the right operand is a constant
+	int64_t lo, hi;
+	switch (x->op) {
+		case IR_ADD: {
+			bool o = IRadd_overflow(a.lo, b.lo, &lo) | IRadd_overflow(a.hi, b.hi, &hi);
+			return (range_checked(t, o, lo, hi));
+		}
+
+		case IR_SUB: {
+			bool o = IRsub_overflow(a.lo, b.hi, &lo) | IRsub_overflow(a.hi, b.lo, &hi);
+			return (range_checked(t, o, lo, hi));
+		}
+
+		case IR_MUL: {
+			int64_t p[4];
+			bool o = IRmul_overflow(a.lo, b.lo, &p[0]) | IRmul_overflow(a.lo, b.hi, &p[1])
+				| IRmul_overflow(a.hi, b.lo, &p[2]) | IRmul_overflow(a.hi, b.hi, &p[3]);
+			lo = hi = p[0];
+			for (int i = 1; i < 4; ++i) {
+				lo = (p[i] < lo) ? p[i] : lo;
+				hi = (p[i] > hi) ? p[i] : hi;
+			}
+			return (range_checked(t, o, lo, hi));
+		}
+
+		case IR_SDIV: {
+			// Division by a constant other than 0 and -1 is monotonic in the dividend.
+			if (k && b.lo > 0) {
+				return (range_make(a.lo / b.lo, a.hi / b.lo));
+			}
+			if (k && b.lo < -1) {
+				return (range_make(a.hi / b.lo, a.lo / b.lo));
+			}
+		}	break;
+
+		case IR_SREM: {
+			// The remainder is smaller than the divisor in magnitude, and has the sign of the dividend.
+			if (k && b.lo != 0 && b.lo != INT64_MIN) {
+				int64_t m = ((b.lo < 0) ? -b.lo : b.lo) - 1;
+				lo = (a.lo >= 0) ? 0 : ((a.lo > -m) ? a.lo : -m);
+				hi = (a.hi <= 0) ? 0 : ((a.hi < m) ? a.hi : m);
+				return (range_make(lo, hi));
+			}
+		}	break;
+
+		case IR_UDIV: case IR_UREM: {
+			// Non-negative operands are the same signed and unsigned.
+			if (a.lo >= 0 && b.lo > 0) {
+				if (x->op == IR_UDIV) {
+					return (range_make(a.lo / b.hi, a.hi / b.lo));
+				}
+				return (range_make(0, (a.hi < b.hi - 1) ? a.hi : b.hi - 1));
+			}
+		}	break;
+
+		case IR_SHL: {
+			if (k && b.lo >= 0 && b.lo < bits) {
+				int64_t m = INT64_C(1) << b.lo;
+				bool o = IRmul_overflow(a.lo, m, &lo) | IRmul_overflow(a.hi, m, &hi);
+				struct IRrange r = range_checked(t, o, lo, hi);
+				r.zero |= (uint64_t)m - 1;
+				return (range_normalize(r));
+			}
+		}	break;
+
+		case IR_ASHR: case IR_LSHR: {
+			if (!k || b.lo < 0 || b.lo >= bits) {
+				break;
+			}
+			if (x->op == IR_ASHR || a.lo >= 0) {
+				return (range_make(a.lo >> b.lo, a.hi >> b.lo));
+			}
+			if (b.lo > 0) {
+				uint64_t mask = (bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+				return (range_make(0, (int64_t)(mask >> b.lo)));
+			}
+		}	break;
+
+		case IR_AND: case IR_OR: case IR_XOR: {
+			return (transfer_bitwise(x->op, t, &a, &b));
+		}
+	}
+	return (range_full(t));
+}
+
+// Computes the range of an instruction from the ranges of its operands.
+static struct IRrange transfer(struct IRinstruction *x, struct IRrange *tab) {
+	if (!IRTypecode_is_int(x->type)) {
+		return (range_full(x->type));
+	}
+
+	switch (x->op) {
+		case IR_IMM: {
+			return (range_const(IRimm_value(x)));
+		}
+
+		case IR_PHI: {
+			struct IRrange r = range_empty();
+			for (struct llist_node *p = x->phi.head; p; p = p->nxt) {
+				r = range_union(r, tab[((struct IRphi_arg*)p)->value->id]);
+			}
+			return (r);
+		}
+
+		case IR_SELECT: {
+			struct IRrange c = tab[x->cond->id];
+			if (c.lo == c.hi) {
+				return (tab[(c.lo ? x->vt : x->vf)->id]);
+			}
+			return (range_union(tab[x->vt->id], tab[x->vf->id]));
+		}
+
+		case IR_ZEXT: case IR_SEXT: case IR_TRUNC:
+		case IR_NEG: case IR_NOT:
+			break;
+
+		default: {
+			if (IRis_binary(x->op)) {
+				return (transfer_binary(x, tab[x->left->id], tab[x->right->id]));
+			}
+			return (range_full(x->type));
+		}
+	}
+
+	// Unary operations.
+	struct IRrange a = tab[x->left->id];
+	if (IRrange_is_empty(&a)) {
+		return (a);
+	}
+
+	switch (x->op) {
+		case IR_ZEXT: {
+			if (a.lo >= 0) {
+				return (a);
+			}
+			int bits = IRTypecode_bits(x->left->type);
+			return (range_make(0, (bits == 64) ? INT64_MAX : (INT64_C(1) << bits) - 1));
+		}
+
+		case IR_SEXT: {
+			if (x->left->type == IRT_I1) {
+				return (range_make(-a.hi, -a.lo));
+			}
+			return (a);
+		}
+
+		case IR_TRUNC: {
+			return (IRrange_fits(&a, x->type) ? a : range_full(x->type));
+		}
+
+		case IR_NEG: {
+			if (a.lo > type_min(x->type)) {
+				return (range_make(-a.hi, -a.lo));
+			}
+			return (range_full(x->type));
+		}
+
+		case IR_NOT: {
+			if (x->type == IRT_I1) {
+				return (range_make(1 - a.hi, 1 - a.lo));
+			}
+			struct IRrange r = { .lo = ~a.hi, .hi = ~a.lo, .zero = a.one, .one = a.zero };
+			return (range_normalize(r));
+		}
+
+		default: {
+			fail_ir_op(x->op, __FUNCTION__);
+		}
+	}
+}
+
+// Computes the range of every instruction in the function, indexed by instruction id.
+// Instructions in unreachable cycles may be left with empty ranges.
+struct IRrange* IRrange_analyze(struct IRfunction *self) {
+	int n = self->ins_count;
+	struct IRrange *tab = try_malloc(n * sizeof(struct IRrange), __FUNCTION__);
+	int *grown = try_calloc(n, sizeof(int), __FUNCTION__);
+	bool *queued = try_calloc(n, sizeof(bool), __FUNCTION__);
+	for (int i = 0; i < n; ++i) {
+		tab[i] = range_empty();
+	}
+
+	struct IRuses uses;
+	IRuses_build(&uses, self);
+
+	struct array stack;
+	array_init(&stack);
+	// Push in reverse so that instructions are visited in program order.
+	struct IRinstruction **all = try_malloc(n * sizeof(struct IRinstruction*), __FUNCTION__);
+	int cnt = 0;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			all[cnt++] = (void*)q;
+		}
+	}
+	while (cnt > 0) {
+		struct IRinstruction *x = all[--cnt];
+		queued[x->id] = true;
+		array_pushback(&stack, x);
+	}
+	free(all);
+
+	struct IRinstruction *x;
+	while ((x = array_popback(&stack)) != NULL) {
+		queued[x->id] = false;
+		struct IRrange r = transfer(x, tab);
+		if (range_equal(&r, &tab[x->id])) {
+			continue;
+		}
+
+		if (x->op == IR_PHI && ++grown[x->id] > RANGE_WIDEN_LIMIT) {
+			r = range_full(x->type);
+		}
+		tab[x->id] = r;
+
+		struct array *users = IRuses_get(&uses, x);
+		for (int i = 0; i < users->length; ++i) {
+			struct IRinstruction *u = users->begin[i];
+			if (!queued[u->id]) {
+				queued[u->id] = true;
+				array_pushback(&stack, u);
+			}
+		}
+	}
+
+	array_free(&stack);
+	IRuses_free(&uses);
+	free(queued);
+	free(grown);
+	return (tab);
+}
+
+// State of the narrowing pass.
+struct narrow_context {
+	struct IRfunction *f;
+	int n;				// number of instructions covered by the tables
+	struct IRrange *tab;		// ranges, indexed by instruction id
+	struct IRinstruction **repl;	// replacements, indexed by instruction id
+};
+
+// Returns whether a 64 bits value can be narrowed to 32 bits without extra instructions.
+static bool narrow_is_free(struct narrow_context *ctx, struct IRinstruction *v) {
+	if (v->op == IR_IMM) {
+		return (true);
+	}
+	if ((v->op == IR_SEXT || v->op == IR_ZEXT) && v->left->type == IRT_I32) {
+		return (v->op == IR_SEXT || ctx->tab[v->left->id].lo >= 0);
+	}
+	return (false);
+}
+
+// Returns a 32 bits value equal to the 64 bits value _v_, which is known to fit.
+// New instructions are placed before _pos_.
+static struct IRinstruction* narrow_value(struct narrow_context *ctx, struct IRinstruction *v,
+						struct IRinstruction *pos) {
+	if (v->op == IR_IMM) {
+		return (IRblock_new_const(pos->owner, IRT_I32, IRimm_value(v)));
+	}
+	if (narrow_is_free(ctx, v)) {
+		return (v->left);
+	}
+	return (IRinstruction_new_before(pos, IR_TRUNC, IRT_I32, v, NULL));
+}
+
+// Narrows a 64 bits operation into a 32 bits one, if its operands and result fit.
+// On targets with 64 bits registers, only operands which are free to narrow are accepted.
+static bool narrow_op(struct narrow_context *ctx, struct IRinstruction *x) {
+	// Shifts are not narrowed: the shift amount may be out of range for 32 bits.
+	bool cmp = IRis_cmp(x->op);
+	switch (x->op) {
+		case IR_NEG: case IR_NOT:
+		case IR_ADD: case IR_SUB: case IR_MUL: case IR_SDIV: case IR_SREM:
+		case IR_AND: case IR_OR: case IR_XOR:
+			break;
+		default:
+			if (!cmp) {
+				return (false);
+			}
+	}
+
+	struct IRinstruction *l = x->left, *r = IRis_binary(x->op) ? x->right : NULL;
+	if (l->type != IRT_I64) {
+		return (false);
+	}
+	if (!cmp && !IRrange_fits(&ctx->tab[x->id], IRT_I32)) {
+		return (false);
+	}
+	if (!IRrange_fits(&ctx->tab[l->id], IRT_I32) || (r && !IRrange_fits(&ctx->tab[r->id], IRT_I32))) {
+		return (false);
+	}
+
+	// INT32_MIN / -1 overflows in 32 bits, even when the 64 bits remainder is 0.
+	if ((x->op == IR_SDIV || x->op == IR_SREM) && ctx->tab[l->id].lo == INT32_MIN
+		&& ctx->tab[r->id].lo <= -1 && ctx->tab[r->id].hi >= -1) {
+		return (false);
+	}
+
+	bool wide_regs = (Tinfo.reg_size >= 8);
+	if (wide_regs && !(narrow_is_free(ctx, l) && (r == NULL || narrow_is_free(ctx, r)))) {
+		return (false);
+	}
+	if (l->op == IR_IMM && (r == NULL || r->op == IR_IMM)) {
+		return (false);		// left for constant folding
+	}
+
+	l = narrow_value(ctx, l, x);
+	if (r) {
+		r = narrow_value(ctx, r, x);
+	}
+
+	if (cmp) {
+		x->left = l;
+		x->right = r;
+	} else {
+		struct IRinstruction *y = IRinstruction_new_before(x, x->op, IRT_I32, l, r);
+		x->op = IR_SEXT;
+		x->left = y;
+		x->right = NULL;
+	}
+	return (true);
+}
+
+// Simplifies one instruction with the range information.
+static bool narrow_instruction(struct narrow_context *ctx, struct IRinstruction *x) {
+	if (x->id >= ctx->n || x->op == IR_IMM || IRhas_side_effect(x->op) || !IRTypecode_is_int(x->type)) {
+		return (false);
+	}
+
+	struct IRrange *r = &ctx->tab[x->id];
+	if (IRrange_is_empty(r)) {
+		return (false);
+	}
+
+	// A value known to be a constant.
+	if (r->lo == r->hi) {
+		ctx->repl[x->id] = IRblock_new_const(x->owner, x->type, r->lo);
+		return (true);
+	}
+
+	// ext(trunc(y)) where y already fits into the truncated type.
+	if ((x->op == IR_SEXT || x->op == IR_ZEXT) && x->left->op == IR_TRUNC) {
+		struct IRinstruction *y = x->left->left;
+		struct IRrange *yr = &ctx->tab[y->id];
+		if (y->type == x->type && IRrange_fits(yr, x->left->type)
+			&& (x->op == IR_SEXT || yr->lo >= 0)) {
+			ctx->repl[x->id] = y;
+			return (true);
+		}
+	}
+
+	return (narrow_op(ctx, x));
+}
+
+// Range based simplification: replaces values known to be constant, deletes
+// extensions of truncations whose input already fits, and narrows 64 bits
+// operations whose operands and result fit in 32 bits.
+bool IRopt_narrow(struct IRfunction *self) {
+	struct narrow_context ctx = {
+		.f = self,
+		.n = self->ins_count,
+		.tab = IRrange_analyze(self),
+		.repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__),
+	};
+
+	bool changed = false;
+	for (struct llist_node *p = self->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			changed |= narrow_instruction(&ctx, (void*)q);
+		}
+	}
+
+	// Instructions created by the pass have identifiers beyond the table,
+	// which IRfunction_apply_replacements() must not look up.
+	struct IRinstruction **repl = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	for (int i = 0; i < ctx.n; ++i) {
+		repl[i] = ctx.repl[i];
+	}
+	IRfunction_apply_replacements(self, repl);
+
+	free(repl);
+	free(ctx.repl);
+	free(ctx.tab);
+	return (changed);
+}
@@ -0,0 +1,120 @@
+// Scalar replacement of aggregates.
+// A stack slot of several elements, whose elements are only accessed at constant offsets,
+// is split into one slot per element accessed, which IRopt_mem2reg() can then promote.
+// Accesses through an address computed at run time, or an address escaping into memory,
+// keep the slot whole: any element may be accessed through them.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "acir.h"
+#include "opt.h"
+
+// Returns whether the user of an address loads or stores an element of the given type there.
+static bool is_access(struct IRinstruction *u, struct IRinstruction *addr, int type) {
+	if (u->op == IR_LOAD) {
+		return (u->type == type);
+	}
+	return (u->op == IR_STORE && u->left == addr && u->right != addr && u->right->type == type);
+}
+
+// Returns whether the address is only used by loads and stores of elements of the slot.
+static bool is_access_only(struct IRuses *uses, struct IRinstruction *addr, int type) {
+	struct array *users = IRuses_get(uses, addr);
+	for (int i = 0; i < users->length; ++i) {
+		if (!is_access(users->begin[i], addr, type)) {
+			return (false);
+		}
+	}
+	return (true);
+}
+
+// Returns the element of the slot addressed by a user of the slot, or -1 if it is not a
+// direct access to an element.
+static int element_of(struct IRuses *uses, struct IRinstruction *a, struct IRinstruction *u) {
+	if (u->op == IR_LOAD || u->op == IR_STORE) {
+		return (is_access(u, a, a->slot_type) ? 0 : -1);
+	}
+	if (u->op != IR_ADD || u->left != a || u->right->op != IR_IMM || !IRTypecode_is_int(u->right->type)) {
+		return (-1);
+	}
+
+	int64_t off = IRimm_value(u->right), size = IRTypecode_size(a->slot_type);
+	if (off < 0 || off % size != 0 || off / size >= a->slot_count) {
+		return (-1);
+	}
+	return (is_access_only(uses, u, a->slot_type) ? off / size : -1);
+}
+
+// Splits the slot if every use accesses an element at a constant offset.
+// The element addresses are recorded as replacements of the offset computations, which are
+// added to _dead_ with the slot.
+static void split(struct IRuses *uses, struct IRinstruction *a, struct IRinstruction **repl, struct array *dead) {
+	struct array *users = IRuses_get(uses, a);
+	for (int i = 0; i < users->length; ++i) {
+		if (element_of(uses, a, users->begin[i]) < 0) {
+			return;
+		}
+	}
+
+	// Slots are only constructed for the elements accessed.
+	struct IRinstruction **elems = try_calloc(a->slot_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	for (int i = 0; i < users->length; ++i) {
+		struct IRinstruction *u = users->begin[i];
+		int k = element_of(uses, a, u);
+		if (elems[k] == NULL) {
+			elems[k] = IRblock_new_alloca(a->owner, a->slot_type, 1);
+		}
+		if (u->op == IR_ADD) {
+			repl[u->id] = elems[k];
+			array_pushback(dead, u);
+		} else {
+			u->left = elems[k];
+		}
+	}
+	free(elems);
+	array_pushback(dead, a);
+}
+
+// Scalar replacement of aggregates: splits stack slots of several elements, which are
+// all accessed at constant offsets, into slots of one element. Identifiers are renumbered.
+bool IRopt_sroa(struct IRfunction *self) {
+	struct IRblock *entry = (void*)self->bs.head;
+	struct IRuses uses;
+	IRuses_build(&uses, self);
+
+	int n = self->ins_count;
+	struct IRinstruction **repl = try_calloc(n, sizeof(struct IRinstruction*), __FUNCTION__);
+	struct array dead;
+	array_init(&dead);
+	for (struct llist_node *p = entry->ins.head; p; p = p->nxt) {
+		struct IRinstruction *x = (void*)p;
+		if (x->op == IR_ALLOCA && x->id < n && x->slot_count > 1) {
+			split(&uses, x, repl, &dead);
+		}
+	}
+	if (dead.length == 0) {
+		free(repl);
+		IRuses_free(&uses);
+		array_free(&dead);
+		return (false);
+	}
+
+	// The table must also cover the new slots. The offset computations and the split slots
+	// have no users left afterwards.
+	struct IRinstruction **all = try_calloc(self->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	memcpy(all, repl, n * sizeof(struct IRinstruction*));
+	IRfunction_apply_replacements(self, all);
+	for (int i = 0; i < dead.length; ++i) {
+		struct IRinstruction *x = dead.begin[i];
+		llist_unlink(&x->owner->ins, x);
+		IRinstruction_free(x);
+	}
+	free(all);
+	free(repl);
+	IRuses_free(&uses);
+	array_free(&dead);
+	IRfunction_renumber(self);
+	return (true);
+}
@@ -0,0 +1,450 @@
+// Loop unrolling of innermost loops.
+// Only loops shaped like the ones produced from while and for statements are handled: the
+// header tests the exit condition, the rest of the loop ends with a single latch jumping back
+// to the header, and the only edge leaving the loop starts from the header.
+//
+// When the trip count is a constant, the loop is replaced by that many copies of its body,
+// followed by a last copy of the header. Otherwise it is unrolled by a factor U: a new loop,
+// running U copies of the body per iteration, executes while at least U iterations are left,
+// and the original loop runs the remaining ones. Whether U iterations are left is tested
+// without overflow as the unsigned distance between the counter and the bound.
+// The copies are left for the other passes to fold and merge.
+
+#include <stdlib.h>
+#include <string.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Largest factor of partial unrolling.
+#define UNROLL_MAX_FACTOR 8
+
+// Basic induction variable counting the iterations of a loop, and its exit test.
+struct unroll_counter {
+	struct IRinstruction *phi;	// the counter, a header phi
+	struct IRinstruction *cmp;	// the exit test, comparing the counter with _bound_
+	struct IRinstruction *bound;	// loop invariant bound
+	int op;				// the test, normalized into: stay while (counter op bound)
+	int64_t step;			// constant growth per iteration
+};
+
+// Working state of the pass.
+struct unroll_context {
+	struct IRfunction *f;
+	struct IRloopinfo *info;	// loop nest, from the analysis cache
+	struct IRloop *loop;		// the current loop
+	struct IRblock *ph, *latch;	// preheader and latch of the current loop
+	struct IRblock *body;		// successor of the header inside of the loop
+	struct IRblock *exit;		// successor of the header outside of the loop
+	int n, nb;			// number of instructions and blocks when the pass started
+	struct IRinstruction **vmap;	// values of the current copy, indexed by instruction id
+	struct IRblock **bmap;		// blocks of the current copy, indexed by block id
+	struct llist_node *pos;		// layout position after which new blocks are inserted
+};
+
+// Returns the value of _x_ in the current copy.
+static struct IRinstruction* map_value(struct unroll_context *ctx, struct IRinstruction *x) {
+	if (x->id < ctx->n && ctx->vmap[x->id]) {
+		return (ctx->vmap[x->id]);
+	}
+	return (x);
+}
+
+// Operand callback of clone_instruction().
+static void map_operand(struct IRinstruction **slot, void *arg) {
+	*slot = map_value(arg, *slot);
+}
+
+// Constructs a block, placed in layout after the previously constructed ones.
+static struct IRblock* new_block(struct unroll_context *ctx) {
+	struct IRblock *b = IRblock_new(ctx->f);
+	llist_unlink(&ctx->f->bs, b);
+	llist_insert_after(&ctx->f->bs, ctx->pos, b);
+	ctx->pos = &b->n;
+	return (b);
+}
+
+// Appends a copy of a value instruction to _b_, with its operands taken from the current copy.
+static void clone_instruction(struct unroll_context *ctx, struct IRinstruction *x, struct IRblock *b) {
+	struct IRinstruction *y = IRinstruction_clone(x, b);
+	IRinstruction_foreach_operand(y, map_operand, ctx);
+	ctx->vmap[x->id] = y;
+}
+
+// Clones the non-phi instructions of a block but its terminator.
+static void clone_body(struct unroll_context *ctx, struct IRblock *from, struct IRblock *to) {
+	struct IRinstruction *t = IRblock_terminator(from);
+	for (struct llist_node *p = from->ins.head; p != &t->n; p = p->nxt) {
+		struct IRinstruction *x = (void*)p;
+		if (x->op != IR_PHI) {
+			clone_instruction(ctx, x, to);
+		}
+	}
+}
+
+// Clones one iteration of the loop: the header into _h_, which the caller constructed, and the
+// other blocks into new ones. The header jumps straight into the body, and the latch to _next_.
+// The header phis must already be mapped to their values on this iteration.
+static void clone_iteration(struct unroll_context *ctx, struct IRblock *h, struct IRblock *next) {
+	struct array *blocks = &ctx->loop->blocks;
+	ctx->bmap[ctx->loop->header->id] = h;
+	for (int i = 1; i < blocks->length; ++i) {
+		struct IRblock *b = blocks->begin[i];
+		ctx->bmap[b->id] = new_block(ctx);
+	}
+
+	// Predecessors come first in reverse postorder, since the latch is the only block jumping back.
+	for (int i = 0; i < blocks->length; ++i) {
+		struct IRblock *b = blocks->begin[i], *c = ctx->bmap[b->id];
+		for (struct llist_node *p = b->ins.head; i > 0 && p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+			struct IRinstruction *phi = (void*)p, *y = IRinstruction_new_phi(c, phi->type);
+			for (struct llist_node *q = phi->phi.head; q; q = q->nxt) {
+				struct IRphi_arg *a = (void*)q;
+				IRphi_add_arg(y, ctx->bmap[a->source->id], map_value(ctx, a->value));
+			}
+			ctx->vmap[phi->id] = y;
+		}
+		clone_body(ctx, b, c);
+
+		struct IRinstruction *t = IRblock_terminator(b);
+		if (b == ctx->loop->header) {
+			IRinstruction_new_jmp(c, IR_JMP, NULL, ctx->bmap[ctx->body->id], NULL);
+		} else if (b == ctx->latch) {
+			IRinstruction_new_jmp(c, IR_JMP, NULL, next, NULL);
+		} else if (t->op == IR_JMP) {
+			IRinstruction_new_jmp(c, IR_JMP, NULL, ctx->bmap[t->bt->id], NULL);
+		} else {
+			IRinstruction_new_jmp(c, IR_BR, map_value(ctx, t->cond), ctx->bmap[t->bt->id], ctx->bmap[t->bf->id]);
+		}
+	}
+}
+
+// Maps the header phis to their values on the iteration after the current copy.
+static void next_iteration(struct unroll_context *ctx) {
+	struct array vals;
+	array_init(&vals);
+	struct IRblock *h = ctx->loop->header;
+	for (struct llist_node *p = h->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		array_pushback(&vals, map_value(ctx, IRphi_get_arg((void*)p, ctx->latch)));
+	}
+
+	memset(ctx->vmap, 0, ctx->n * sizeof(struct IRinstruction*));
+	int i = 0;
+	for (struct llist_node *p = h->ins.head; i < vals.length; p = p->nxt, ++i) {
+		ctx->vmap[((struct IRinstruction*)p)->id] = vals.begin[i];
+	}
+	array_free(&vals);
+}
+
+// Changes the edge from the preheader to the header to point to _to_.
+static void enter_at(struct unroll_context *ctx, struct IRblock *to) {
+	struct IRinstruction *t = IRblock_terminator(ctx->ph);
+	t->bt = to;
+	IRblock_add_pre(to, ctx->ph);
+	IRblock_remove_pre(ctx->loop->header, ctx->ph);
+}
+
+// Returns the number of instructions of the loop, phis excluded.
+static int loop_size(struct IRloop *loop) {
+	int res = 0;
+	for (int i = 0; i < loop->blocks.length; ++i) {
+		struct IRblock *b = loop->blocks.begin[i];
+		for (struct llist_node *p = b->ins.head; p; p = p->nxt) {
+			res += (((struct IRinstruction*)p)->op != IR_PHI);
+		}
+	}
+	return (res);
+}
+
+// Checks the shape of the current loop, and fills the latch, body and exit of the context.
+static bool check_shape(struct unroll_context *ctx) {
+	struct IRloop *loop = ctx->loop;
+	struct IRblock *h = loop->header;
+	for (struct llist_node *p = ctx->info->loops.head; p; p = p->nxt) {
+		if (((struct IRloop*)p)->parent == loop) {
+			return (false);		// not an innermost loop
+		}
+	}
+
+	ctx->latch = NULL;
+	for (struct llist_node *p = h->pre.head; p; p = p->nxt) {
+		struct IRblock *pre = ((struct IRpredecessor*)p)->b;
+		if (IRloop_contains(ctx->info, loop, pre)) {
+			if (ctx->latch) {
+				return (false);
+			}
+			ctx->latch = pre;
+		}
+	}
+
+	struct IRinstruction *t = IRblock_terminator(h);
+	if (ctx->ph == NULL || ctx->latch == NULL || ctx->latch == h || t->op != IR_BR) {
+		return (false);
+	}
+	bool t_in = IRloop_contains(ctx->info, loop, t->bt), f_in = IRloop_contains(ctx->info, loop, t->bf);
+	if (t_in == f_in) {
+		return (false);
+	}
+	ctx->body = t_in ? t->bt : t->bf;
+	ctx->exit = t_in ? t->bf : t->bt;
+
+	for (int i = 1; i < loop->blocks.length; ++i) {
+		struct IRblock *b = loop->blocks.begin[i], *succ[2];
+		int sn = IRblock_successors(b, succ);
+		for (int j = 0; j < sn; ++j) {
+			if (!IRloop_contains(ctx->info, loop, succ[j])) {
+				return (false);
+			}
+		}
+	}
+	return (true);
+}
+
+// Finds the counter of the current loop and its exit test.
+static bool find_counter(struct unroll_context *ctx, struct unroll_counter *res) {
+	struct IRblock *h = ctx->loop->header;
+	struct IRinstruction *br = IRblock_terminator(h), *cmp = br->cond;
+	if (!IRis_cmp(cmp->op) || cmp->owner != h) {
+		return (false);
+	}
+
+	bool on_left = cmp->left->op == IR_PHI && cmp->left->owner == h;
+	res->phi = on_left ? cmp->left : cmp->right;
+	res->bound = on_left ? cmp->right : cmp->left;
+	res->cmp = cmp;
+	if (res->phi->op != IR_PHI || res->phi->owner != h || IRloop_contains(ctx->info, ctx->loop, res->bound->owner)) {
+		return (false);
+	}
+
+	struct IRinstruction *v = IRphi_get_arg(res->phi, ctx->latch);
+	if ((v->op != IR_ADD && v->op != IR_SUB) || v->left != res->phi || v->right->op != IR_IMM
+		|| IRimm_value(v->right) == INT64_MIN) {
+		return (false);
+	}
+	res->step = (v->op == IR_ADD) ? IRimm_value(v->right) : -IRimm_value(v->right);
+
+	res->op = on_left ? cmp->op : IRcmp_swap(cmp->op);
+	if (br->bt != ctx->body) {
+		res->op = IRcmp_inverse(res->op);
+	}
+	return (res->step != 0);
+}
+
+// Returns the number of iterations of the current loop, or -1 if it is not a constant below _limit_.
+// The counter is simulated with the arithmetic of the IR, so wrapping is taken into account.
+static int trip_count(struct unroll_context *ctx, struct unroll_counter *c, int limit) {
+	struct IRinstruction *init = IRphi_get_arg(c->phi, ctx->ph);
+	if (init->op != IR_IMM || c->bound->op != IR_IMM) {
+		return (-1);
+	}
+
+	int type = c->phi->type;
+	int64_t i = IRimm_value(init), bound = IRimm_value(c->bound), stay;
+	for (int k = 0; k <= limit; ++k) {
+		if (!IRopcode_fold(c->op, type, i, bound, &stay)) {
+			return (-1);
+		}
+		if (!stay) {
+			return (k);
+		}
+		IRopcode_fold(IR_ADD, type, i, c->step, &i);
+	}
+	return (-1);
+}
+
+// Maps the header phis to their values when entering the loop.
+static void first_iteration(struct unroll_context *ctx) {
+	memset(ctx->vmap, 0, ctx->n * sizeof(struct IRinstruction*));
+	struct IRblock *h = ctx->loop->header;
+	for (struct llist_node *p = h->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		ctx->vmap[((struct IRinstruction*)p)->id] = IRphi_get_arg((void*)p, ctx->ph);
+	}
+}
+
+// Replaces the current loop with _count_ copies of its body followed by a copy of the header.
+static void unroll_fully(struct unroll_context *ctx, int count) {
+	struct IRblock *h = ctx->loop->header;
+	ctx->pos = &ctx->ph->n;
+	first_iteration(ctx);
+	struct IRblock *c = new_block(ctx);
+	enter_at(ctx, c);
+	for (int k = 0; k < count; ++k) {
+		struct IRblock *next = new_block(ctx);
+		clone_iteration(ctx, c, next);
+		next_iteration(ctx);
+		c = next;
+	}
+
+	// The last test fails: the copy of the header leaves the loop. The jump adds an edge
+	// without phi arguments, so the edge from the header is renamed instead.
+	clone_body(ctx, h, c);
+	IRinstruction_new_jmp(c, IR_JMP, NULL, ctx->exit, NULL);
+	IRblock_remove_pre(ctx->exit, c);
+	IRblock_replace_pre(ctx->exit, h, c);
+
+	// Values of the header may be used after the loop, the other ones can not be.
+	struct IRinstruction **repl = try_calloc(ctx->f->ins_count, sizeof(struct IRinstruction*), __FUNCTION__);
+	for (struct llist_node *p = h->ins.head; p; p = p->nxt) {
+		struct IRinstruction *x = (void*)p;
+		repl[x->id] = ctx->vmap[x->id];
+	}
+	IRfunction_apply_replacements(ctx->f, repl);
+	free(repl);
+
+	struct array *blocks = &ctx->loop->blocks;
+	for (int i = 0; i < blocks->length; ++i) {
+		llist_unlink(&ctx->f->bs, blocks->begin[i]);
+		IRblock_free(blocks->begin[i]);
+	}
+}
+
+// Unrolls the current loop by _factor_ into a new loop placed before it, which runs while at
+// least _factor_ iterations are left. The original loop runs the remaining iterations.
+static void unroll_partially(struct unroll_context *ctx, struct unroll_counter *c, int factor) {
+	struct IRblock *h = ctx->loop->header;
+	int type = c->phi->type;
+	ctx->pos = &ctx->ph->n;
+	first_iteration(ctx);
+	struct IRblock *uh = new_block(ctx);
+
+	// The header of the new loop merges the values entering the loop and the values after
+	// each round of _factor_ iterations.
+	struct array phis;
+	array_init(&phis);
+	for (struct llist_node *p = h->ins.head; p && ((struct IRinstruction*)p)->op == IR_PHI; p = p->nxt) {
+		struct IRinstruction *phi = (void*)p, *y = IRinstruction_new_phi(uh, phi->type);
+		IRphi_add_arg(y, ctx->ph, ctx->vmap[phi->id]);
+		ctx->vmap[phi->id] = y;
+		array_pushback(&phis, y);
+	}
+	enter_at(ctx, uh);
+
+	// Whether the counter passes the test, and is at least (factor - 1) steps away from the bound.
+	struct IRinstruction *i = ctx->vmap[c->phi->id], *dist;
+	struct IRinstruction *test = IRinstruction_new(uh, c->op, IRT_I1, i, c->bound);
+	if (c->step > 0) {
+		dist = IRinstruction_new(uh, IR_SUB, type, c->bound, i);
+	} else {
+		dist = IRinstruction_new(uh, IR_SUB, type, i, c->bound);
+	}
+	int64_t step = (c->step > 0) ? c->step : -c->step;
+	struct IRinstruction *k = IRinstruction_new_imm(uh, type, step * (factor - 1));
+	bool strict = (c->op == IR_CMP_LT || c->op == IR_CMP_GT);
+	struct IRinstruction *far = IRinstruction_new(uh, strict ? IR_CMP_UGT : IR_CMP_UGE, IRT_I1, dist, k);
+	struct IRinstruction *go = IRinstruction_new(uh, IR_AND, IRT_I1, test, far);
+
+	struct IRblock *first = new_block(ctx);
+	IRinstruction_new_jmp(uh, IR_BR, go, first, h);
+	int j = 0;
+	for (struct llist_node *p = h->ins.head; j < phis.length; p = p->nxt, ++j) {
+		IRphi_add_arg((void*)p, uh, phis.begin[j]);
+	}
+
+	struct IRblock *b = first;
+	for (int r = 0; r < factor; ++r) {
+		struct IRblock *next = (r == factor - 1) ? uh : new_block(ctx);
+		clone_iteration(ctx, b, next);
+		next_iteration(ctx);
+		b = next;
+	}
+
+	// The last latch copy jumps back to the new header.
+	struct IRblock *last = ((struct IRpredecessor*)uh->pre.tail)->b;
+	j = 0;
+	for (struct llist_node *p = h->ins.head; j < phis.length; p = p->nxt, ++j) {
+		IRphi_add_arg(phis.begin[j], last, ctx->vmap[((struct IRinstruction*)p)->id]);
+	}
+	array_free(&phis);
+}
+
+// Returns whether the test of the counter can be checked for distance as done by unroll_partially().
+static bool is_monotonic_test(struct unroll_counter *c) {
+	switch (c->op) {
+		case IR_CMP_LT: case IR_CMP_LE:
+			return (c->step > 0);
+		case IR_CMP_GT: case IR_CMP_GE:
+			return (c->step < 0);
+		default:
+			return (false);
+	}
+}
+
+// Unrolls the current loop if it fits into the budget.
+static bool unroll_loop(struct unroll_context *ctx, int budget) {
+	if (!check_shape(ctx)) {
+		return (false);
+	}
+
+	struct unroll_counter c;
+	if (!find_counter(ctx, &c)) {
+		return (false);
+	}
+
+	int size = loop_size(ctx->loop);
+	int count = trip_count(ctx, &c, budget / size);
+	if (count >= 0) {
+		unroll_fully(ctx, count);
+		return (true);
+	}
+
+	int factor = budget / size;
+	if (factor > UNROLL_MAX_FACTOR) {
+		factor = UNROLL_MAX_FACTOR;
+	}
+
+	// The distance of (factor - 1) steps, tested against the one to the bound, must be a
+	// positive value of the counter type: large steps lower the factor.
+	int64_t step = (c.step > 0) ? c.step : -c.step, distance;
+	while (factor >= 2 && (IRmul_overflow(step, factor - 1, &distance)
+			|| IRTypecode_wrap(c.phi->type, distance) != distance)) {
+		--factor;
+	}
+	if (factor < 2 || !is_monotonic_test(&c)) {
+		return (false);
+	}
+	unroll_partially(ctx, &c, factor);
+	return (true);
+}
+
+// Loop unrolling: innermost loops with a constant trip count are unrolled fully, other
+// counted loops by a factor, followed by a remainder loop. The budget bounds the number of
+// instructions of the unrolled code. Identifiers are renumbered.
+bool IRopt_unroll(struct IRfunction *self, struct IRanalyses *am, int budget) {
+	if (budget <= 0) {
+		return (false);
+	}
+
+	struct unroll_context ctx = { .f = self, .info = IRanalyses_loops(am) };
+
+	// Give every loop a preheader first, as unrolling needs one.
+	bool changed = false;
+	for (struct llist_node *p = ctx.info->loops.head; p; p = p->nxt) {
+		struct IRloop *loop = (void*)p;
+		if (IRloop_preheader(ctx.info, loop) == NULL && (void*)loop->header != self->bs.head) {
+			IRloop_insert_preheader(ctx.info, loop);
+			changed = true;
+		}
+	}
+	if (changed) {
+		IRfunction_renumber(self);
+		IRanalyses_invalidate(am, 0);
+		ctx.info = IRanalyses_loops(am);
+	}
+
+	ctx.n = self->ins_count;
+	ctx.nb = self->bs.length;
+	ctx.vmap = try_calloc(ctx.n + 1, sizeof(struct IRinstruction*), __FUNCTION__);
+	ctx.bmap = try_calloc(ctx.nb + 1, sizeof(struct IRblock*), __FUNCTION__);
+	for (struct llist_node *p = ctx.info->loops.head; p; p = p->nxt) {
+		ctx.loop = (void*)p;
+		ctx.ph = IRloop_preheader(ctx.info, ctx.loop);
+		changed |= unroll_loop(&ctx, budget);
+	}
+
+	free(ctx.vmap);
+	free(ctx.bmap);
+	IRfunction_renumber(self);
+	return (changed);
+}
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include "util/misc.h"
+#include "util/array.h"
+#include "fatals.h"
+#include "acir.h"
+#include "opt.h"
+
+// Context of the operand callback used while building def-use chains.
+struct uses_builder {
+	struct IRuses *uses;
+	struct IRinstruction *user;
+};
+
+// Operand callback of IRuses_build().
+static void IRuses_add_operand(struct IRinstruction **slot, void *arg) {
+	struct uses_builder *b = arg;
+	IRuses_add(b->uses, *slot, b->user);
+}
+
+// Builds the def-use chains of a function.
+void IRuses_build(struct IRuses *self, struct IRfunction *f) {
+	self->n = f->ins_count;
+	self->users = try_malloc(self->n * sizeof(struct array), __FUNCTION__);
+	for (int i = 0; i < self->n; ++i) {
+		array_init(&self->users[i]);
+	}
+
+	struct uses_builder b = { .uses = self };
+	for (struct llist_node *p = f->bs.head; p; p = p->nxt) {
+		for (struct llist_node *q = ((struct IRblock*)p)->ins.head; q; q = q->nxt) {
+			b.user = (void*)q;
+			IRinstruction_foreach_operand(b.user, IRuses_add_operand, &b);
+		}
+	}
+}
+
+// Returns the user list of an instruction.
+// The table grows to cover instructions created after it was built.
+struct array* IRuses_get(struct IRuses *self, struct IRinstruction *value) {
+	if (value->id >= self->n) {
+		int n = value->id + 1;
+		self->users = realloc(self->users, n * sizeof(struct array));
+		if (self->users == NULL) {
+			fail_malloc(__FUNCTION__);
+		}
+		for (int i = self->n; i < n; ++i) {
+			array_init(&self->users[i]);
+		}
+		self->n = n;
+	}
+	return (&self->users[value->id]);
+}
+
+// Records that _user_ uses _value_.
+void IRuses_add(struct IRuses *self, struct IRinstruction *value, struct IRinstruction *user) {
+	array_pushback(IRuses_get(self, value), user);
+}
+
+// Context of the operand callback used by IRuses_replace().
+struct uses_replacer {
+	struct IRinstruction *old, *new;
+	bool found;
+};
+
+// Operand callback of IRuses_replace().
+static void IRuses_replace_operand(struct IRinstruction **slot, void *arg) {
+	struct uses_replacer *r = arg;
+	if (*slot == r->old) {
+		*slot = r->new;
+		r->found = true;
+	}
+}
+
+// Replaces all uses of _old_ with _new_, and moves the users to the user list of _new_.
+void IRuses_replace(struct IRuses *self, struct IRinstruction *old, struct IRinstruction *new) {
+	struct array users = *IRuses_get(self, old);
+	array_init(IRuses_get(self, old));
+
+	for (int i = 0; i < users.length; ++i) {
+		struct IRinstruction *u = users.begin[i];
+		struct uses_replacer r = { .old = old, .new = new, .found = false };
+		IRinstruction_foreach_operand(u, IRuses_replace_operand, &r);
+		if (r.found) {
+			IRuses_add(self, new, u);
+		}
+	}
+	array_free(&users);
+}
+
+// Frees the def-use chains.
+void IRuses_free(struct IRuses *self) {
+	for (int i = 0; i < self->n; ++i) {
+		array_free(&self->users[i]);
+	}
+	free(self->users);
+}
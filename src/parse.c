@@ -6,12 +6,38 @@
 #include "token.h"
 #include "ast.h"
 #include "fatals.h"
+#include "util/misc.h"
+#include "util/array.h"
+#include "util/critbit.h"
+
+// A local variable visible from the current position.
+struct Pvariable {
+	struct critbit_node n;		// node of the name lookup tree, keyed by the variable name
+	int id;				// variable identifier, unique in the function
+	int depth;			// block nesting depth of the declaration
+	struct VType type;		// declared type, the element type of arrays
+	int len;			// number of elements of an array, 0 for scalars
+	struct Pvariable *shadowed;	// variable of the same name in an outer block
+};
+
+// A function declared in the translation unit.
+struct Pfunction {
+	struct critbit_node n;		// node of the function lookup tree, keyed by the function name
+	struct Afunction *f;		// the function, owned by the translation unit
+	int call_line;			// line of the first call, 0 if it is not called
+};
 
 // Parsing Context
 struct Pcontext {
 	struct linklist tokens;	// token list
 	struct llist_node *cur;	// current token
+	struct Aunit *unit;	// the translation unit
 	struct Afunction *func;	// current function
+	struct critbit_tree funcs;	// declared functions by name
+	struct array pfuncs;	// declared functions in declaration order
+	struct critbit_tree names;	// visible local variables by name
+	struct array scope;	// visible local variables in declaration order
+	int depth;		// current block nesting depth
 };
 
 // Checks that we have a binary operator and return its precedence.
@@ -20,13 +46,25 @@ static int op_precedence(struct token *t) {
 	switch (t->type) {
 		case T_ASSIGN:
 			return (20);
-		case T_GT: case T_GE: case T_LT: case T_LE:
-			return (40);
+		case T_LOR:
+			return (30);
+		case T_LAND:
+			return (35);
+		case T_OR:
+			return (36);
+		case T_XOR:
+			return (37);
+		case T_AMPER:
+			return (38);
 		case T_EQ: case T_NE:
+			return (40);
+		case T_GT: case T_GE: case T_LT: case T_LE:
 			return (50);
+		case T_LSHIFT: case T_RSHIFT:
+			return (60);
 		case T_PLUS: case T_MINUS:
 			return (70);
-		case T_STAR: case T_SLASH:
+		case T_STAR: case T_SLASH: case T_PERCENT:
 			return (90);
 		default:
 			fail_ce_expect(t->line, "an operator", token_typename[t->type]);
@@ -40,6 +78,12 @@ static int binary_arithop(struct token *t) {
 		{T_MINUS,	A_SUB},
 		{T_STAR,	A_MUL},
 		{T_SLASH,	A_DIV},
+		{T_PERCENT,	A_MOD},
+		{T_AMPER,	A_BAND},
+		{T_OR,		A_BOR},
+		{T_XOR,		A_BXOR},
+		{T_LSHIFT,	A_LSHIFT},
+		{T_RSHIFT,	A_RSHIFT},
 		{T_EQ,		A_EQ},
 		{T_NE,		A_NE},
 		{T_LT,		A_LT},
@@ -127,6 +171,74 @@ static void expect(struct Pcontext *ctx, int t) {
 
 static struct ASTnode* statement(struct Pcontext *ctx);
 static struct ASTnode* expression(struct Pcontext *ctx);
+static bool parse_type(struct VType *self, struct Pcontext *ctx, bool ce);
+
+// Enters a new block scope.
+static void scope_enter(struct Pcontext *ctx) {
+	ctx->depth += 1;
+}
+
+// Leaves the current block scope: the variables declared in it are forgotten,
+// and the ones they shadowed become visible again.
+static void scope_leave(struct Pcontext *ctx) {
+	while (ctx->scope.length > 0) {
+		struct Pvariable *v = ctx->scope.begin[ctx->scope.length - 1];
+		if (v->depth < ctx->depth) {
+			break;
+		}
+
+		array_popback(&ctx->scope);
+		critbit_erase(&ctx->names, v->n.key);
+		if (v->shadowed) {
+			critbit_insert(&ctx->names, &v->shadowed->n);
+		}
+		free(v->n.key);
+		free(v);
+	}
+	ctx->depth -= 1;
+}
+
+// Declares a local variable in the current scope.
+static struct Pvariable* scope_declare(struct Pcontext *ctx, char *name, const struct VType *type, int line) {
+	struct Pvariable *v = try_malloc(sizeof(struct Pvariable), __FUNCTION__);
+	v->n.key = name;
+	v->id = ctx->func->var_count++;
+	v->depth = ctx->depth;
+	v->type = *type;
+	v->len = 0;
+	v->shadowed = (void*)critbit_insert(&ctx->names, &v->n);
+
+	// Parameters, at depth 1, share the scope of the outermost block of the function body.
+	int depth = v->shadowed ? v->shadowed->depth : -1;
+	if (depth == ctx->depth || (depth == 1 && ctx->depth == 2)) {
+		fail_ce(line, "variable declared twice");
+	}
+	array_pushback(&ctx->scope, v);
+	return (v);
+}
+
+// Parses the arguments of a function call, e.g. (a, b + 1)
+static struct ASTnode* call(struct Pcontext *ctx, struct Pfunction *pf, int line) {
+	struct linklist args;
+	llist_init(&args);
+	match(ctx, T_LP);
+	while (current(ctx)->type != T_RP) {
+		if (args.length > 0) {
+			match(ctx, T_COMMA);
+		}
+		struct ASTnode *x = expression(ctx);
+		if (x == NULL) {
+			fail_ce(current(ctx)->line, "primary expression expected");
+		}
+		llist_pushback(&args, x);
+	}
+	match(ctx, T_RP);
+
+	if (pf->call_line == 0) {
+		pf->call_line = line;
+	}
+	return (ASTcallnode_new(pf->f, &args, line));
+}
 
 // Parse a primary factor and return an
 // AST node representing it.
@@ -146,17 +258,32 @@ static struct ASTnode* primary(struct Pcontext *ctx) {
 		res = ASTi64node_new(current(ctx)->val_i64);
 		next(ctx);
 	} else if (t->type == T_ID) {
-		// TODO: identifier.
-		fail_ce(t->line, "got an identifier");
-		/*
-		int id = findglob((char*)current(ctx)->val);
-		if (id == -1) {
-			fprintf(stderr, "syntax error on line %d: unknown indentifier %s.\n", Line, (char*)current(ctx)->val);
-			exit(1);
+		struct Pvariable *v = (void*)critbit_get(&ctx->names, t->val_s);
+		struct Pfunction *pf = (void*)critbit_get(&ctx->funcs, t->val_s);
+		if (v == NULL && pf && t->n.nxt && ((struct token*)t->n.nxt)->type == T_LP) {
+			next(ctx);
+			return (call(ctx, pf, t->line));
+		}
+		if (v == NULL) {
+			fail_ce(t->line, "undeclared identifier");
 		}
 		next(ctx);
-		return (ASTvarnode_new(id));
-		*/
+		if (current(ctx)->type == T_LP) {
+			fail_ce(t->line, "called object is not a function");
+		}
+		res = ASTvarnode_new(v->id, &v->type, v->len);
+		if (v->len > 0) {
+			// An array is only usable through its elements, e.g. a[i].
+			int line = current(ctx)->line;
+			if (current(ctx)->type != T_LS) {
+				fail_ce(t->line, "array used as a value");
+			}
+			next(ctx);
+			res = ASTindexnode_new(res, expression(ctx), line);
+			match(ctx, T_RS);
+		} else if (current(ctx)->type == T_LS) {
+			fail_ce(current(ctx)->line, "subscripted value is not an array");
+		}
 	} else {
 		fail_ce(t->line, "primary expression expected");
 	}
@@ -192,6 +319,8 @@ static bool is_binop(int t) {
 	switch (t) {
 		case T_ASSIGN:
 		case T_PLUS: case T_MINUS: case T_STAR: case T_SLASH:
+		case T_PERCENT: case T_LSHIFT: case T_RSHIFT:
+		case T_AMPER: case T_OR: case T_XOR:
 		case T_LAND: case T_LOR:
 		case T_EQ: case T_NE: case T_LT:
 		case T_GT: case T_LE: case T_GE:
@@ -218,10 +347,10 @@ static struct ASTnode* binexpr(struct Pcontext *ctx, int precedence) {
 
 		if (direction_rtl(op->type)) {
 			right = binexpr(ctx, precedence);
-			left = ASTassignnode_new(binary_arithop(op), left, right);
+			left = ASTassignnode_new(binary_arithop(op), left, right, op->line);
 		} else {
 			right = binexpr(ctx, tp);
-			left = ASTbinnode_new(binary_arithop(op), left, right); // join right into left
+			left = ASTbinnode_new(binary_arithop(op), left, right, op->line); // join right into left
 		}
 
 		op = current(ctx);
@@ -241,6 +370,7 @@ static struct ASTnode* block(struct Pcontext *ctx) {
 		return (NULL);
 	}
 
+	scope_enter(ctx);
 	struct ASTblocknode* res = (struct ASTblocknode*)ASTblocknode_new();
 	while (current(ctx)->type != T_RB) {
 		struct ASTnode *x;
@@ -252,6 +382,7 @@ static struct ASTnode* block(struct Pcontext *ctx) {
 		}
 	}
 	match(ctx, T_RB);
+	scope_leave(ctx);
 	return ((struct ASTnode*)res);
 }
 
@@ -264,20 +395,43 @@ static struct ASTnode* expression(struct Pcontext *ctx) {
 	return (binexpr(ctx, 0));
 }
 
-/*
-// parse variable declaration statement
-static struct ASTnode* var_declaration(void) {
-	match(ctx, T_INT);
-	expect(ctx, T_IDENT);
-	if (findglob((char*)current(ctx)->val) != -1) {
-		fail_ce("variable declared twice.");
+// parse variable declaration statement, e.g. int x; or long y = 1; or int a[10];
+// Returns the assignment of the initializer, or NULL if there is none.
+// The length of an array is an integer literal, and arrays have no initializer.
+static struct ASTnode* var_declaration(struct Pcontext *ctx) {
+	struct VType type;
+	int line = current(ctx)->line;
+	parse_type(&type, ctx, true);
+	if (!VType_is_int(&type)) {
+		fail_type(line);
 	}
-	addglob((char*)current(ctx)->val);
+
+	expect(ctx, T_ID);
+	struct Pvariable *v = scope_declare(ctx, current(ctx)->val_s, &type, line);
+	current(ctx)->val_s = NULL;		// ownership of the name is transfered to the variable
 	next(ctx);
+
+	if (current(ctx)->type == T_LS) {
+		next(ctx);
+		if (current(ctx)->type != T_I32_LIT || current(ctx)->val_i32 <= 0) {
+			fail_ce(current(ctx)->line, "array length must be a positive integer literal");
+		}
+		v->len = current(ctx)->val_i32;
+		next(ctx);
+		match(ctx, T_RS);
+		match(ctx, T_SEMI);
+		return (NULL);
+	}
+
+	struct ASTnode *res = NULL;
+	if (current(ctx)->type == T_ASSIGN) {
+		line = current(ctx)->line;
+		next(ctx);
+		res = ASTassignnode_new(A_ASSIGN, ASTvarnode_new(v->id, &v->type, 0), expression(ctx), line);
+	}
 	match(ctx, T_SEMI);
-	return (NULL);
+	return (res);
 }
-*/
 
 // parse an if statement
 static struct ASTnode* if_statement(struct Pcontext *ctx) {
@@ -298,18 +452,21 @@ static struct ASTnode* if_statement(struct Pcontext *ctx) {
 
 // parse an while statement
 static struct ASTnode* while_statement(struct Pcontext *ctx) {
+	int line = current(ctx)->line;
 	match(ctx, T_WHILE);
 	match(ctx, T_LP);
 	struct ASTnode* cond = expression(ctx);
 	match(ctx, T_RP);
 	struct ASTnode* body = statement(ctx);
-	return (ASTbinnode_new(A_WHILE, cond, body));
+	return (ASTbinnode_new(A_WHILE, cond, body, line));
 }
 
 // parse a for statement (into a while loop)
 static struct ASTnode* for_statement(struct Pcontext *ctx) {
+	int line = current(ctx)->line;
 	match(ctx, T_FOR);
 	match(ctx, T_LP);
+	scope_enter(ctx);			// variables declared by the initializer belong to the loop
 	struct ASTnode *init = statement(ctx);
 
 	struct ASTnode *cond;
@@ -346,7 +503,8 @@ static struct ASTnode* for_statement(struct Pcontext *ctx) {
 	}
 
 	llist_pushback_notnull(&container->st, init);
-	llist_pushback(&container->st, ASTbinnode_new(A_WHILE, cond, wbody));
+	llist_pushback(&container->st, ASTbinnode_new(A_WHILE, cond, wbody, line));
+	scope_leave(ctx);
 	return ((void*)container);
 }
 
@@ -366,8 +524,9 @@ static struct ASTnode* statement(struct Pcontext *ctx) {
 		case T_SEMI:
 			return (NULL);
 
-//		case T_INT:
-//			return (var_declaration());
+		case T_INT: case T_LONG: case T_VOID:
+			return (var_declaration(ctx));
+
 		case T_IF:
 			return (if_statement(ctx));
 
@@ -418,29 +577,137 @@ static bool parse_type(struct VType *self, struct Pcontext *ctx, bool ce) {
 	return (true);
 }
 
-// Parse one top-level function
-// Sets the func_name param.
-static struct Afunction* function(struct Pcontext *ctx) {
-	struct Afunction *res = Afunction_new();
-	ctx->func = res;
+// A parameter of a function declaration.
+struct Pparam {
+	struct VType type;
+	char *name;		// parameter name, NULL if omitted
+	int line;
+};
+
+// Parses the parameter list of a function declaration, e.g. (int a, long b), (void) or ().
+// The names of the parameters may be omitted, and are owned by the parameters.
+static void parameter_list(struct Pcontext *ctx, struct array *params) {
+	match(ctx, T_LP);
+	if (current(ctx)->type == T_VOID && ctx->cur->nxt && ((struct token*)ctx->cur->nxt)->type == T_RP) {
+		next(ctx);
+	}
+
+	while (current(ctx)->type != T_RP) {
+		if (params->length > 0) {
+			match(ctx, T_COMMA);
+		}
+		struct Pparam *p = try_malloc(sizeof(struct Pparam), __FUNCTION__);
+		p->line = current(ctx)->line;
+		p->name = NULL;
+		array_pushback(params, p);
+
+		parse_type(&p->type, ctx, true);
+		if (!VType_is_int(&p->type)) {
+			fail_type(p->line);
+		}
+		if (current(ctx)->type == T_ID) {
+			p->name = current(ctx)->val_s;
+			current(ctx)->val_s = NULL;
+			next(ctx);
+		}
+	}
+	match(ctx, T_RP);
+}
+
+// Frees the parameters of a declaration.
+static void parameters_free(struct array *params) {
+	for (int i = 0; i < params->length; ++i) {
+		struct Pparam *p = params->begin[i];
+		free(p->name);
+		free(p);
+	}
+	array_free(params);
+}
 
-	parse_type(&res->ret_type, ctx, true);
+// Returns whether a declaration has the signature of a function declared before.
+static bool same_signature(struct Afunction *f, const struct VType *ret, struct array *params) {
+	if (!VType_eq(&f->ret_type, ret) || f->param_count != params->length) {
+		return (false);
+	}
+	for (int i = 0; i < params->length; ++i) {
+		if (!VType_eq(&f->param_types[i], &((struct Pparam*)params->begin[i])->type)) {
+			return (false);
+		}
+	}
+	return (true);
+}
+
+// Declares a function of the translation unit, named by the token _id_.
+static struct Pfunction* declare_function(struct Pcontext *ctx, struct token *id, const struct VType *ret,
+					struct array *params) {
+	struct Afunction *f = Afunction_new();
+	f->id = ctx->unit->funcs.length;
+	f->name = id->val_s;			// transfer ownership of the identifier string to the function
+	id->val_s = NULL;			// prevent it from being freed in token_free().
+	f->ret_type = *ret;
+	f->param_count = params->length;
+	f->param_types = try_malloc((params->length + 1) * sizeof(struct VType), __FUNCTION__);
+	for (int i = 0; i < params->length; ++i) {
+		f->param_types[i] = ((struct Pparam*)params->begin[i])->type;
+	}
+	llist_pushback(&ctx->unit->funcs, f);
+
+	struct Pfunction *pf = try_malloc(sizeof(struct Pfunction), __FUNCTION__);
+	pf->n.key = f->name;
+	pf->f = f;
+	pf->call_line = 0;
+	critbit_insert(&ctx->funcs, &pf->n);
+	array_pushback(&ctx->pfuncs, pf);
+	return (pf);
+}
+
+// Parses one top-level function declaration, e.g. int f(int a); or definition, e.g.
+// int f(int a) { ... }. A function may be declared several times with the same signature,
+// and defined once. Functions must be declared before they are called.
+static void function(struct Pcontext *ctx) {
+	struct VType ret;
+	int line = current(ctx)->line;
+	parse_type(&ret, ctx, true);
 	expect(ctx, T_ID);
-	res->name = current(ctx)->val_s;	// transfer ownership of the identifier string to caller
-	current(ctx)->val_s = NULL;		// prevent it from being freed in token_free() called by next(ctx).
+	struct token *id = current(ctx);
 	next(ctx);
 
-	match(ctx, T_LP);
-	if (current(ctx)->type == T_VOID) {
+	struct array params;
+	array_init(&params);
+	parameter_list(ctx, &params);
+
+	struct Pfunction *pf = (void*)critbit_get(&ctx->funcs, id->val_s);
+	if (pf == NULL) {
+		pf = declare_function(ctx, id, &ret, &params);
+	} else if (!same_signature(pf->f, &ret, &params)) {
+		fail_ce(line, "conflicting types for function");
+	}
+
+	if (current(ctx)->type == T_SEMI) {
 		next(ctx);
-		goto END_PARAM_LIST;
+		parameters_free(&params);
+		return;
+	}
+	if (pf->f->is_defined) {
+		fail_ce(line, "function defined twice");
 	}
-	// TODO: parameter list
 
-END_PARAM_LIST:
-	match(ctx, T_RP);
-	res->rt = block(ctx);
-	return (res);
+	// Parameters are in the same scope as the outermost block of the body.
+	struct Afunction *f = pf->f;
+	ctx->func = f;
+	f->is_defined = true;
+	scope_enter(ctx);
+	for (int i = 0; i < params.length; ++i) {
+		struct Pparam *p = params.begin[i];
+		if (p->name == NULL) {
+			fail_ce(p->line, "parameter name omitted");
+		}
+		scope_declare(ctx, p->name, &p->type, p->line);
+		p->name = NULL;			// ownership of the name is transfered to the variable
+	}
+	f->rt = block(ctx);
+	scope_leave(ctx);
+	parameters_free(&params);
 }
 
 // Frees a Pcontext and all its components.
@@ -451,16 +718,40 @@ static void Pcontext_free(struct Pcontext *ctx) {
 		token_free((void*)p);
 		p = nxt;
 	}
+	array_free(&ctx->scope);
+	for (int i = 0; i < ctx->pfuncs.length; ++i) {
+		struct Pfunction *pf = ctx->pfuncs.begin[i];
+		critbit_erase(&ctx->funcs, pf->n.key);
+		free(pf);
+	}
+	array_free(&ctx->pfuncs);
 }
 
 // Parse source into AST.
-struct Afunction* Afunction_from_source(const char *filename) {
+// Every function called must be defined in the translation unit.
+struct Aunit* Aunit_from_source(const char *filename) {
 	struct Pcontext ctx = {
 		.tokens = scan_tokens(filename),
 	};
 	ctx.cur = ctx.tokens.head;
+	ctx.unit = try_malloc(sizeof(struct Aunit), __FUNCTION__);
+	llist_init(&ctx.unit->funcs);
+	critbit_init(&ctx.funcs);
+	critbit_init(&ctx.names);
+	array_init(&ctx.pfuncs);
+	array_init(&ctx.scope);
+
+	while (current(&ctx)->type != T_EOF) {
+		function(&ctx);
+	}
+	for (int i = 0; i < ctx.pfuncs.length; ++i) {
+		struct Pfunction *pf = ctx.pfuncs.begin[i];
+		if (pf->call_line && !pf->f->is_defined) {
+			fail_ce(pf->call_line, "undefined function");
+		}
+	}
 
-	struct Afunction* res = function(&ctx);
+	struct Aunit *res = ctx.unit;
 	Pcontext_free(&ctx);
 	return (res);
 }
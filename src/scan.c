@@ -132,10 +132,15 @@ static bool scan_1c(struct token *t) {
 		{'-', T_MINUS},
 		{'*', T_STAR},
 		{'/', T_SLASH},
+		{'%', T_PERCENT},
+		{'^', T_XOR},
 		{'{', T_LB},
 		{'}', T_RB},
 		{'(', T_LP},
 		{')', T_RP},
+		{',', T_COMMA},
+		{'[', T_LS},
+		{']', T_RS},
 		{';', T_SEMI},
 		{'\0', T_EXCEED}
 	};
@@ -192,6 +197,9 @@ static struct token* scan(void) {
 		if (c == '=') {
 			t->type = T_LE;
 			next();
+		} else if (c == '<') {
+			t->type = T_LSHIFT;
+			next();
 		}
 	} else if (c == '>') {
 		t->type = T_GT;
@@ -200,6 +208,9 @@ static struct token* scan(void) {
 		if (c == '=') {
 			t->type = T_GE;
 			next();
+		} else if (c == '>') {
+			t->type = T_RSHIFT;
+			next();
 		}
 	} else if (c == '~') {
 		t->type = T_BNOT;
@@ -209,18 +220,18 @@ static struct token* scan(void) {
 		c = preview();
 		if (c == '&') {
 			t->type = T_LAND;
+			next();
 		} else {
-			// TODO: bitwise and
-			fail_char(t->line, c);
+			t->type = T_AMPER;
 		}
 	} else if (c == '|') {
 		next();
 		c = preview();
 		if (c == '|') {
 			t->type = T_LOR;
+			next();
 		} else {
-			// TODO: bitwise or
-			fail_char(t->line, c);
+			t->type = T_OR;
 		}
 	} else {
 		if (isdigit(c)) { // If it's a digit, scan the integer literal value in
@@ -35,26 +35,72 @@ int target_parse(const char *target_string) {
 
 struct target_info Tinfo;
 
+// Registers are listed caller-saved first, which leaf functions use without saving them.
+// x86-64 keeps r10 and r11 as scratch registers.
+static const char *const x86_64_names[] = {
+	"rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9",
+	"rbx", "r12", "r13", "r14", "r15",
+};
+static const struct target_regs x86_64_regs = { 12, x86_64_names, 0x7f };
+
+static const char *const x86_32_names[] = {
+	"eax", "ecx", "edx", "ebx", "esi", "edi",
+};
+static const struct target_regs x86_32_regs = { 6, x86_32_names, 0x7 };
+
+static const char *const unknown_names[] = {
+	"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+	"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+};
+static const struct target_regs unknown16_regs = { 8, unknown_names, 0xf };
+static const struct target_regs unknown32_regs = { 16, unknown_names, 0xff };
+
+// RISC-V keeps t5 and t6 as scratch registers, and s0 as the frame pointer.
+static const char *const riscv_names[] = {
+	"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+	"t0", "t1", "t2", "t3", "t4",
+	"s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+};
+static const struct target_regs riscv_regs = { 24, riscv_names, 0x1fff };
+
 void Tinfo_load(int target) {
 	static struct target_info map[] = {
 	{	// x86-64
 		.int_size = 4,
 		.long_size = 8,
+		.reg_size = 8,
+		.has_cmov = true,
+		.regs = &x86_64_regs,
 	}, {	// x84
 		.int_size = 4,
 		.long_size = 4,
+		.reg_size = 4,
+		.has_cmov = true,
+		.regs = &x86_32_regs,
 	}, {	// unknown16
 		.int_size = 2,
 		.long_size = 2,
+		.reg_size = 2,
+		.has_cmov = false,
+		.regs = &unknown16_regs,
 	}, {	// unknown32
 		.int_size = 4,
 		.long_size = 4,
+		.reg_size = 4,
+		.has_cmov = false,
+		.regs = &unknown32_regs,
 	}, {	// riscv_32
 		.int_size = 4,
 		.long_size = 4,
+		.reg_size = 4,
+		.has_cmov = false,
+		.regs = &riscv_regs,
 	}, {	// riscv_64
 		.int_size = 4,
-		.long_size = 8
+		.long_size = 8,
+		.reg_size = 8,
+		.has_cmov = false,
+		.regs = &riscv_regs,
 	}};
 
 	if (target < 0 || target >= TARGET_NULL) {
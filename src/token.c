@@ -4,11 +4,15 @@
 const char *token_typename[63] = {
 	"EOF",
 	";",
+	",",
 	"{", "}", "(", ")",
+	"[", "]",
 	"=",
 	"+", "-", "*", "/",
+	"%",
 	"!", "&&", "||",
-	"~",
+	"~", "&", "|", "^",
+	"<<", ">>",
 	"==", "!=", "<", ">", "<=", ">=",
 	"int", "void", "char", "long",
 	"short",
@@ -26,7 +26,7 @@ static void array_enlarge(struct array *a) {
 		a->cap *= 1.7;
 	}
 
-	a->begin = realloc(a->begin, a->cap);
+	a->begin = realloc(a->begin, a->cap * sizeof(void*));
 	if (a->begin == NULL) {
 		fail_malloc(__FUNCTION__);
 	}
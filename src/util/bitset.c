@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include "util/bitset.h"
+#include "util/misc.h"
+
+// Returns the number of words of a set of _n_ elements.
+int bitset_words(int n) {
+	return ((n + 63) / 64);
+}
+
+// Allocates a set of _nw_ words, all elements absent.
+uint64_t* bitset_new(int nw) {
+	return (try_calloc(nw + 1, sizeof(uint64_t), __FUNCTION__));
+}
+
+// Returns whether _i_ is in the set.
+bool bitset_test(const uint64_t *s, int i) {
+	return ((s[i >> 6] >> (i & 63)) & 1);
+}
+
+// Adds _i_ to the set.
+void bitset_add(uint64_t *s, int i) {
+	s[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+// Removes _i_ from the set.
+void bitset_remove(uint64_t *s, int i) {
+	s[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+// Makes every element present, or absent.
+// Bits past the last element are set too: a full set is the top of a dataflow problem, met
+// with other sets, but it should not be counted or listed itself.
+void bitset_fill(uint64_t *s, int nw, bool v) {
+	memset(s, v ? 0xff : 0, nw * sizeof(uint64_t));
+}
+
+// Copies _src_ into _dst_.
+void bitset_copy(uint64_t *dst, const uint64_t *src, int nw) {
+	memcpy(dst, src, nw * sizeof(uint64_t));
+}
+
+// Copies _src_ into _dst_, and returns whether _dst_ changed.
+bool bitset_update(uint64_t *dst, const uint64_t *src, int nw) {
+	if (memcmp(dst, src, nw * sizeof(uint64_t)) == 0) {
+		return (false);
+	}
+	memcpy(dst, src, nw * sizeof(uint64_t));
+	return (true);
+}
+
+// The changes are accumulated into a word rather than tested word by word, which keeps the
+// loops free of branches.
+
+// dst = dst | src. Returns whether _dst_ changed.
+bool bitset_union(uint64_t *dst, const uint64_t *src, int nw) {
+	uint64_t diff = 0;
+	for (int w = 0; w < nw; ++w) {
+		uint64_t v = dst[w] | src[w];
+		diff |= v ^ dst[w];
+		dst[w] = v;
+	}
+	return (diff != 0);
+}
+
+// dst = dst & src. Returns whether _dst_ changed.
+bool bitset_intersect(uint64_t *dst, const uint64_t *src, int nw) {
+	uint64_t diff = 0;
+	for (int w = 0; w < nw; ++w) {
+		uint64_t v = dst[w] & src[w];
+		diff |= v ^ dst[w];
+		dst[w] = v;
+	}
+	return (diff != 0);
+}
+
+// dst = dst & ~src. Returns whether _dst_ changed.
+bool bitset_diff(uint64_t *dst, const uint64_t *src, int nw) {
+	uint64_t diff = 0;
+	for (int w = 0; w < nw; ++w) {
+		uint64_t v = dst[w] & ~src[w];
+		diff |= v ^ dst[w];
+		dst[w] = v;
+	}
+	return (diff != 0);
+}
+
+// Returns whether two sets are equal.
+bool bitset_equal(const uint64_t *a, const uint64_t *b, int nw) {
+	return (memcmp(a, b, nw * sizeof(uint64_t)) == 0);
+}
+
+// Returns the number of bits set in a word, counted in parallel in fields of 2, 4 then 8 bits,
+// and the bytes summed by the multiplication.
+int bitword_count(uint64_t w) {
+	w -= (w >> 1) & UINT64_C(0x5555555555555555);
+	w = (w & UINT64_C(0x3333333333333333)) + ((w >> 2) & UINT64_C(0x3333333333333333));
+	w = (w + (w >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+	return ((int)((w * UINT64_C(0x0101010101010101)) >> 56));
+}
+
+// Returns the index of the lowest bit set in a word, which must not be null: the bits below it
+// are the ones set by subtracting one from the lowest bit alone.
+int bitword_lowest(uint64_t w) {
+	return (bitword_count((w & -w) - 1));
+}
+
+// Returns the number of elements of the set.
+int bitset_count(const uint64_t *s, int nw) {
+	int n = 0;
+	for (int w = 0; w < nw; ++w) {
+		n += bitword_count(s[w]);
+	}
+	return (n);
+}
+
+// Returns the smallest element not less than _i_, or -1 if there is none.
+int bitset_next(const uint64_t *s, int nw, int i) {
+	int w = i >> 6;
+	if (w >= nw) {
+		return (-1);
+	}
+	uint64_t bits = s[w] & (~(uint64_t)0 << (i & 63));
+	while (bits == 0) {
+		if (++w == nw) {
+			return (-1);
+		}
+		bits = s[w];
+	}
+	return (w * 64 + bitword_lowest(bits));
+}
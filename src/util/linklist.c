@@ -89,6 +89,23 @@ void llist_insert(struct linklist *l, int index, void *val) {
 	p->nxt = x;
 }
 
+// Insert _val_ into the linklist right after the element _pos_.
+// If _pos_ is NULL, _val_ becomes the first element.
+void llist_insert_after(struct linklist *l, void *pos, void *val) {
+	struct llist_node *x = (struct llist_node*)val, *p = (struct llist_node*)pos;
+	if (p == NULL) {
+		llist_insert(l, 0, val);
+		return;
+	}
+
+	l->length += 1;
+	x->nxt = p->nxt;
+	p->nxt = x;
+	if (l->tail == p) {
+		l->tail = x;
+	}
+}
+
 // Pop the first element of the link list.
 // Returns the first element.
 void* llist_popfront(struct linklist *l) {
@@ -128,3 +145,27 @@ void* llist_remove(struct linklist *l, int index) {
 	q->nxt = NULL;
 	return (q);
 }
+
+// Unlinks the element _val_ from the linklist, without freeing it.
+// Nothing happens if _val_ is not in the list.
+void llist_unlink(struct linklist *l, void *val) {
+	struct llist_node *p = l->head, *prev = NULL;
+	while (p && p != val) {
+		prev = p;
+		p = p->nxt;
+	}
+	if (p == NULL) {
+		return;
+	}
+
+	if (prev) {
+		prev->nxt = p->nxt;
+	} else {
+		l->head = p->nxt;
+	}
+	if (l->tail == p) {
+		l->tail = prev;
+	}
+	l->length -= 1;
+	p->nxt = NULL;
+}
@@ -13,6 +13,16 @@ void* try_malloc(size_t s, const char *func_name) {
 	return (res);
 }
 
+// This function tries to allocate _n_ zero-initialized objects of size _s_.
+// Will call fail_malloc() in fatals.h when failing.
+void* try_calloc(size_t n, size_t s, const char *func_name) {
+	void *res = calloc(n ? n : 1, s);
+	if (res == NULL) {
+		fail_malloc(func_name);
+	}
+	return (res);
+}
+
 // This function does what you think it does :)
 // Returns whether the given strings are the same.
 bool strequal(const char *s1, const char *s2) {
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <string.h>
+#include "util/sparseset.h"
+#include "util/misc.h"
+#include "fatals.h"
+
+// Initializes an empty set of elements below _cap_.
+// The sparse array must be zeroed: sparseset_has() reads it before any check, and a garbage
+// negative value would pass the test against the length and index the dense array out of bounds.
+void sparseset_init(struct sparseset *self, int cap) {
+	self->length = 0;
+	self->cap = cap;
+	self->dense = try_malloc((cap + 1) * sizeof(int), __FUNCTION__);
+	self->sparse = try_calloc(cap + 1, sizeof(int), __FUNCTION__);
+}
+
+// Frees the set.
+void sparseset_free(struct sparseset *self) {
+	free(self->dense);
+	free(self->sparse);
+}
+
+// Raises the upper bound of elements to at least _cap_. The new slots of the sparse array are
+// zeroed, as in sparseset_init().
+void sparseset_reserve(struct sparseset *self, int cap) {
+	if (cap <= self->cap) {
+		return;
+	}
+	self->dense = realloc(self->dense, (cap + 1) * sizeof(int));
+	self->sparse = realloc(self->sparse, (cap + 1) * sizeof(int));
+	if (self->dense == NULL || self->sparse == NULL) {
+		fail_malloc(__FUNCTION__);
+	}
+	memset(self->sparse + self->cap + 1, 0, (cap - self->cap) * sizeof(int));
+	self->cap = cap;
+}
+
+// Returns whether _i_ is in the set.
+bool sparseset_has(const struct sparseset *self, int i) {
+	int k = self->sparse[i];
+	return (k < self->length && self->dense[k] == i);
+}
+
+// Adds _i_ to the set. Returns false if it was there already.
+bool sparseset_add(struct sparseset *self, int i) {
+	if (sparseset_has(self, i)) {
+		return (false);
+	}
+	self->sparse[i] = self->length;
+	self->dense[self->length++] = i;
+	return (true);
+}
+
+// Removes _i_ from the set.
+void sparseset_remove(struct sparseset *self, int i) {
+	if (!sparseset_has(self, i)) {
+		return;
+	}
+	int k = self->sparse[i], last = self->dense[--self->length];
+	self->dense[k] = last;
+	self->sparse[last] = k;
+}
+
+// Removes every element.
+void sparseset_clear(struct sparseset *self) {
+	self->length = 0;
+}
+
+// Removes and returns the last element added.
+int sparseset_pop(struct sparseset *self) {
+	return (self->dense[--self->length]);
+}
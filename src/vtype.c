@@ -30,6 +30,38 @@ void VType_unary(const struct VType *self, int op, struct VType *res, int line)
 	}
 }
 
+// Find out the type after appling the give ast operator(binary arithmetic variant).
+// Writes into parameter _res_
+void VType_binary(const struct VType *x, const struct VType *y, int op, struct VType *res, int line) {
+	VType_init(res);
+	if (x->bt == VT_VOID || y->bt == VT_VOID) {
+		fail_type(line);
+	}
+
+	switch (op) {
+		case A_LAND: case A_LOR:
+		case A_EQ: case A_NE: case A_LT: case A_GT: case A_LE: case A_GE: {
+			res->bt = VT_BOOL;
+		}	break;
+
+		// Usual arithmetic conversions: both operands are promoted, then the
+		// narrower one is converted to the type of the wider one.
+		case A_ADD: case A_SUB: case A_MUL: case A_DIV: case A_MOD:
+		case A_BAND: case A_BOR: case A_BXOR: {
+			res->bt = (x->bt == VT_I64 || y->bt == VT_I64) ? VT_I64 : VT_I32;
+		}	break;
+
+		// The type of a shift is the promoted type of its left operand.
+		case A_LSHIFT: case A_RSHIFT: {
+			res->bt = (x->bt == VT_I64) ? VT_I64 : VT_I32;
+		}	break;
+
+		default: {
+			fail_ast_op(op, __FUNCTION__);
+		}
+	}
+}
+
 // Initialize a VType into void.
 void VType_init(struct VType *self) {
 	self->bt = VT_VOID;
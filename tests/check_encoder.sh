@@ -0,0 +1,64 @@
+#!/bin/sh
+# Checks the integrated x86-64 encoder against the system assembler. Every program of
+# tests/valid is written as an object by the obj format, and as assembly by the asm format
+# then assembled by as: the disassemblies of both objects must be the same, but for the nops
+# padding functions, as choosing other forms of the same length.
+# Without options, the programs are compiled at every -O level and with both allocators.
+#
+# Usage: tests/check_encoder.sh compiler [options...]
+# or through xmake: xmake build test_encoder && xmake run test_encoder [options...]
+# Needs as and objdump of GNU binutils targeting x86-64.
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 compiler [options...]" >&2
+	exit 2
+fi
+acc=$1
+shift
+dir=$(dirname "$0")
+tmp=$(mktemp -d) || exit 2
+trap 'rm -rf "$tmp"' EXIT
+checked=0
+failures=0
+
+# Prints the instructions of an object, without labels of blocks nor nops.
+disassemble() {
+	objdump -d -r "$1" | sed '1,3d; s/<\.L[^>]*>//' | awk -F '\t' 'NF >= 3 && $3 !~ /nop|xchg +%ax,%ax/'
+}
+
+# Checks every program with the options given as arguments.
+check() {
+	for f in "$dir"/valid/*.c; do
+		name=$(basename "$f" .c)
+		checked=$((checked + 1))
+		if ! "$acc" "$@" x86_64 obj "$f" "$tmp/$name.o" 2>"$tmp/err" \
+				|| ! "$acc" "$@" x86_64 asm "$f" "$tmp/$name.s" 2>>"$tmp/err" \
+				|| ! as -o "$tmp/$name.ref.o" "$tmp/$name.s" 2>>"$tmp/err"; then
+			echo "FAIL $* $f: $(head -n 1 "$tmp/err")"
+			failures=$((failures + 1))
+			continue
+		fi
+		disassemble "$tmp/$name.o" >"$tmp/got"
+		disassemble "$tmp/$name.ref.o" >"$tmp/want"
+		if ! cmp -s "$tmp/got" "$tmp/want"; then
+			echo "FAIL $* $f: encoding differs from as"
+			diff "$tmp/want" "$tmp/got" | head -n 10
+			failures=$((failures + 1))
+		fi
+	done
+}
+
+if [ $# -gt 0 ]; then
+	check "$@"
+else
+	for level in -O0 -O1 -O2 -Os; do
+		check "$level" -regalloc=linear
+		check "$level" -regalloc=coloring
+	done
+fi
+
+if [ $failures -ne 0 ]; then
+	echo "FAIL: $failures of $checked programs"
+	exit 1
+fi
+echo "OK: $checked programs"
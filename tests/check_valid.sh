@@ -0,0 +1,52 @@
+#!/bin/sh
+# Checks the code generated for every program of tests/valid by running it: the value main
+# returns, printed by the run format, must be the one listed in tests/valid/expected.txt.
+# Without options, the programs are compiled at every -O level and with both allocators.
+#
+# Usage: tests/check_valid.sh compiler [options...]
+# or through xmake: xmake build test_valid && xmake run test_valid [options...]
+# Needs an x86-64 host with POSIX mmap, as the run format does.
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 compiler [options...]" >&2
+	exit 2
+fi
+acc=$1
+shift
+dir=$(dirname "$0")
+checked=0
+failures=0
+
+# Checks every program with the options given as arguments.
+check() {
+	for f in "$dir"/valid/*.c; do
+		name=$(basename "$f" .c)
+		want=$(awk -v name="$name" '$1 == name { print $2 }' "$dir/valid/expected.txt")
+		checked=$((checked + 1))
+		if [ -z "$want" ]; then
+			echo "FAIL $f: no expected value in $dir/valid/expected.txt"
+			failures=$((failures + 1))
+			continue
+		fi
+		got=$("$acc" "$@" x86_64 run "$f" 2>&1)
+		if [ "$got" != "$want" ]; then
+			echo "FAIL $* $f: got $got, expected $want"
+			failures=$((failures + 1))
+		fi
+	done
+}
+
+if [ $# -gt 0 ]; then
+	check "$@"
+else
+	for level in -O0 -O1 -O2 -Os; do
+		check "$level" -regalloc=linear
+		check "$level" -regalloc=coloring
+	done
+fi
+
+if [ $failures -ne 0 ]; then
+	echo "FAIL: $failures of $checked programs"
+	exit 1
+fi
+echo "OK: $checked programs"
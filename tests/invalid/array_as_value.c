@@ -0,0 +1,5 @@
+int main() {
+    int a[4];
+    int x = a;
+    return x;
+}
\ No newline at end of file
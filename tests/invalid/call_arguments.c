@@ -0,0 +1,7 @@
+int twice(int x) {
+    return x + x;
+}
+
+int main() {
+    return twice(1, 2);
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+int helper(int x);
+
+int main() {
+    return helper(1);
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+int f(int x);
+
+long f(int x) {
+    return x;
+}
+
+int main() {
+    return f(1);
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+int main() {
+    int x = 1;
+    x[0] = 2;
+    return x;
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+int main() {
+    int x;
+    int x;
+    return 0;
+}
\ No newline at end of file
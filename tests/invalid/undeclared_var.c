@@ -0,0 +1,3 @@
+int main() {
+    return y;
+}
\ No newline at end of file
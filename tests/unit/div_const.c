@@ -0,0 +1,186 @@
+// Checks the sequences of IRopt_div_const() against the division they replace.
+// Each division or remainder by a constant is rewritten, and the resulting instructions
+// are evaluated on dividends, comparing with IRopcode_fold() on the original operation.
+// Divisors in a range around zero and near the limits are checked on selected dividends,
+// in 32 and 64 bits. A divisor of each kind of sequence is then swept over 32 bits dividends:
+// every one near zero and the limits, and one in SWEEP_STRIDE over the whole range. The
+// exhaustive check runs them on every 32 bits dividend with -all, as the divisors given on
+// the command line. It takes a few minutes per divisor.
+//
+// Build and run with: xmake build test_div_const && xmake run test_div_const [-all] [divisor...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "target.h"
+#include "acir.h"
+#include "opt.h"
+
+// Step of a rewritten sequence: operands are indexes of earlier steps.
+struct step {
+	int op, type;
+	int a, b;
+	int64_t v;		// value of immediates
+};
+
+// Rewritten sequence of a division.
+struct sequence {
+	int n;
+	struct step s[32];
+};
+
+static const int ops[] = { IR_SDIV, IR_UDIV, IR_SREM, IR_UREM };
+
+// Distance between the dividends of the bounded sweep, odd so that every residue of a power
+// of two is met, and number of dividends checked around zero and each limit.
+enum { SWEEP_STRIDE = 4093, SWEEP_WINDOW = 1 << 16 };
+
+static int failures;
+
+// Rewrites n op d, and records the instructions of the result. Step 0 is the dividend.
+static void build(struct sequence *seq, int op, int type, int64_t d) {
+	struct IRfunction f = { .name = "test" };
+	llist_init(&f.bs);
+	struct IRblock *b = IRblock_new(&f);
+	struct IRinstruction *n = IRinstruction_new_imm(b, type, 0);
+	struct IRinstruction *x = IRinstruction_new(b, op, type, n, IRinstruction_new_imm(b, type, d));
+	IRinstruction_new(b, IR_RET, IRT_VOID, x, NULL);
+	IRopt_div_const(&f);
+
+	// Constants are created at the beginning of the block, before the dividend.
+	int *index = calloc(f.ins_count, sizeof(int));
+	seq->n = 1;
+	for (struct llist_node *p = b->ins.head; p; p = p->nxt) {
+		struct IRinstruction *y = (void*)p;
+		if (y == n || y->op == IR_RET) {
+			continue;
+		}
+		struct step *s = &seq->s[seq->n];
+		s->op = y->op;
+		s->type = y->op == IR_IMM ? y->type : y->left->type;
+		if (y->op == IR_IMM) {
+			s->v = IRimm_value(y);
+		} else {
+			s->a = (y->left == n) ? 0 : index[y->left->id];
+			s->b = (IRis_binary(y->op) && y->right != n) ? index[y->right->id] : 0;
+		}
+		index[y->id] = seq->n++;
+	}
+	free(index);
+	IRblock_free(b);
+}
+
+// Evaluates the sequence on a dividend.
+static int64_t run(const struct sequence *seq, int type, int64_t n) {
+	int64_t v[32];
+	v[0] = n;
+	for (int i = 1; i < seq->n; ++i) {
+		const struct step *s = &seq->s[i];
+		switch (s->op) {
+			case IR_IMM:	v[i] = s->v;					break;
+			case IR_NEG:	v[i] = IRTypecode_wrap(type, -(uint64_t)v[s->a]);	break;
+			case IR_ZEXT:	v[i] = v[s->a];					break;
+			default:	IRopcode_fold(s->op, s->type, v[s->a], v[s->b], &v[i]);
+		}
+	}
+	return (v[seq->n - 1]);
+}
+
+// Checks one dividend, and reports a mismatch.
+static void check(const struct sequence *seq, int op, int type, int64_t n, int64_t d) {
+	int64_t want, got;
+	if (!IRopcode_fold(op, type, n, d, &want)) {
+		return;
+	}
+	got = run(seq, type, n);
+	if (got != want && failures++ < 20) {
+		printf("%s i%d: %lld %s %lld = %lld, got %lld\n", IRopcode_stringify(op), IRTypecode_bits(type),
+			(long long)n, IRopcode_stringify(op), (long long)d, (long long)want, (long long)got);
+	}
+}
+
+// Checks a divisor on dividends near the limits, near multiples of the divisor, and spread over the range.
+static void check_selected(int type, int64_t d) {
+	int bits = IRTypecode_bits(type);
+	int64_t max = IRTypecode_wrap(type, (int64_t)(((uint64_t)1 << (bits - 1)) - 1)), min = IRTypecode_wrap(type, max + 1);
+	for (int k = 0; k < 4; ++k) {
+		struct sequence seq;
+		build(&seq, ops[k], type, d);
+		for (int64_t i = -64; i <= 64; ++i) {
+			check(&seq, ops[k], type, i, d);
+			check(&seq, ops[k], type, IRTypecode_wrap(type, max - 64 + i), d);
+			check(&seq, ops[k], type, IRTypecode_wrap(type, d * i), d);
+			check(&seq, ops[k], type, IRTypecode_wrap(type, d * i - 1), d);
+		}
+		uint64_t r = 0x9e3779b97f4a7c15u;
+		for (int i = 0; i < 1024; ++i) {
+			r = r * 6364136223846793005u + 1442695040888963407u;
+			check(&seq, ops[k], type, IRTypecode_wrap(type, (int64_t)r), d);
+		}
+		check(&seq, ops[k], type, min, d);
+	}
+}
+
+// Checks a 32 bits divisor on every dividend.
+static void check_all(int64_t d) {
+	for (int k = 0; k < 4; ++k) {
+		struct sequence seq;
+		build(&seq, ops[k], IRT_I32, d);
+		uint32_t n = 0;
+		do {
+			check(&seq, ops[k], IRT_I32, (int32_t)n, d);
+		} while (++n != 0);
+	}
+}
+
+// Checks a 32 bits divisor on every dividend around zero and the signed and unsigned limits,
+// and on dividends spread evenly over the range.
+static void check_sweep(int64_t d) {
+	for (int k = 0; k < 4; ++k) {
+		struct sequence seq;
+		build(&seq, ops[k], IRT_I32, d);
+		for (uint32_t i = 0; i < SWEEP_WINDOW; ++i) {
+			check(&seq, ops[k], IRT_I32, (int32_t)i, d);
+			check(&seq, ops[k], IRT_I32, (int32_t)(0u - 1 - i), d);
+			check(&seq, ops[k], IRT_I32, (int32_t)(INT32_MAX - i), d);
+			check(&seq, ops[k], IRT_I32, (int32_t)((uint32_t)INT32_MIN + i), d);
+		}
+		for (uint64_t n = 0; n <= UINT32_MAX; n += SWEEP_STRIDE) {
+			check(&seq, ops[k], IRT_I32, (int32_t)(uint32_t)n, d);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Tinfo_load(TARGET_X86_64);
+
+	for (int64_t d = -2000; d <= 2000; ++d) {
+		check_selected(IRT_I32, d);
+		check_selected(IRT_I32, IRTypecode_wrap(IRT_I32, INT32_MAX - d));
+		check_selected(IRT_I64, d);
+		check_selected(IRT_I64, INT64_MAX - 2000 - d);
+		check_selected(IRT_I64, (int64_t)1 << 32 | (d & 0xffff));
+	}
+
+	// Signed and unsigned, with and without the added dividend, powers of two, and limits.
+	static const int64_t kinds[] = { 3, 7, -3, -7, 6, 641, -8, INT32_MIN, INT32_MAX, -0x7fffffff };
+	bool all = false;
+	for (int i = 1; i < argc; ++i) {
+		all |= (strcmp(argv[i], "-all") == 0);
+	}
+	for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+		if (all) {
+			check_all(kinds[k]);
+		} else {
+			check_sweep(kinds[k]);
+		}
+	}
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-all") != 0) {
+			check_all(IRTypecode_wrap(IRT_I32, strtoll(argv[i], NULL, 0)));
+		}
+	}
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+	return (failures != 0);
+}
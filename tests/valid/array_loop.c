@@ -0,0 +1,11 @@
+int main() {
+    int fib[20];
+    fib[0] = 0;
+    fib[1] = 1;
+    for (int i = 2; i < 20; i = i + 1)
+        fib[i] = fib[i - 1] + fib[i - 2];
+    int s = 0;
+    for (int i = 0; i < 20; i = i + 1)
+        s = s + fib[i] % 7;
+    return s;
+}
\ No newline at end of file
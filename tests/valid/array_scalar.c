@@ -0,0 +1,13 @@
+int main() {
+    int a[3];
+    long b[2];
+    a[0] = 7;
+    b[0] = 0;
+    a[1] = a[0] * 2;
+    b[1] = a[1] + 100000000000;
+    if (a[0] > 5)
+        a[2] = 1;
+    else
+        a[2] = 2;
+    return a[2] + (b[1] > 0) + b[0];
+}
\ No newline at end of file
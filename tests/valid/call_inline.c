@@ -0,0 +1,20 @@
+int square(int x) {
+    return x * x;
+}
+
+long scale(long a, int b);
+
+int sum_squares(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i = i + 1)
+        s = s + square(i);
+    return s;
+}
+
+long scale(long a, int b) {
+    return a * b;
+}
+
+int main() {
+    return sum_squares(5) + scale(3, 4);
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+int main() {
+    if (2 <= 3 && 4 >= 4 && -1 < 0 && 5 > 4)
+        return 1;
+    return 0;
+}
\ No newline at end of file
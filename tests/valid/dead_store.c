@@ -0,0 +1,16 @@
+int main() {
+    int a[4];
+    int t[2];
+    int i = 0;
+    while (i < 4) {
+        a[i] = 0;
+        i = i + 1;
+    }
+    a[0] = 7;
+    a[1] = 2;
+    a[2] = a[1] + 3;
+    a[3] = 1;
+    t[i & 1] = 5;
+    t[0] = 4;
+    return a[i - 4] + a[i - 3] + a[i - 2] + a[i - 1];
+}
\ No newline at end of file
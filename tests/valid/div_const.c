@@ -0,0 +1,9 @@
+int main() {
+    int i = 0;
+    int s = 0;
+    while (i < 200) {
+        s = s + (i * 37 - 3000) / 7 + (i * 37 - 3000) % 10 - i / -3;
+        i = i + 1;
+    }
+    return s % 256;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+int main() {
+    if (!(1 && 0))
+        if (0 || ~0)
+            return 1;
+        else
+            return 2;
+    return 3;
+}
\ No newline at end of file
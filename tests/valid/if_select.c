@@ -0,0 +1,9 @@
+int main() {
+    int a = 7;
+    int m = 0;
+    if (a > 5)
+        m = a;
+    else
+        m = 5;
+    return m;
+}
\ No newline at end of file
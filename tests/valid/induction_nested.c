@@ -0,0 +1,11 @@
+int main() {
+    int n = 7;
+    int s = 0;
+    int m = 3;
+    for (int i = 2; i <= n; i = i + 2) {
+        s = s + (i + 1) * m + (i << 2);
+        for (int j = n; j > 0; j = j - 1)
+            s = s + j * i;
+    }
+    return s;
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+int main() {
+    int a[8];
+    long b[8];
+    int s = 0;
+    for (int i = 0; i < 8; i = i + 1) {
+        a[i] = i * 3;
+        b[i] = a[i] + 1;
+        if (a[i] > 10)
+            s = s + a[i];
+        else
+            b[i] = b[i] + a[i];
+        s = s + b[i];
+    }
+    return s;
+}
\ No newline at end of file
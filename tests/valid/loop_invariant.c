@@ -0,0 +1,11 @@
+int main() {
+    int n = 5;
+    int k = 3;
+    int s = 0;
+    while (s < 100) {
+        if (s > 50)
+            k = k + 1;
+        s = s + k * n + (n << 2);
+    }
+    return s;
+}
\ No newline at end of file
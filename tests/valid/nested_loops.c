@@ -0,0 +1,11 @@
+int main() {
+    int n = 5;
+    int s = 0;
+    for (int i = 0; i < n; i = i + 1) {
+        for (int j = 0; j < i; j = j + 1) {
+            long t = n * 8 + 1;
+            s = s + t / 4 + j;
+        }
+    }
+    return s;
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+int main() {
+    return 0 || 0;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+int main() {
+    int i = 0;
+    int s = 0;
+    int a = 0;
+    while (i < 50) {
+        a = i * i;
+        if (i % 4 == 0)
+            s = s + (a ^ i) / 3;
+        s = s - (a ^ i) / 3;
+        i = i + 1;
+    }
+    return s % 256;
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+int main() {
+    return 1 || 0 && 2;
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+int main() {
+    return 3 != 2 < 1;
+}
\ No newline at end of file
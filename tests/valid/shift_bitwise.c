@@ -0,0 +1,3 @@
+int main() {
+    return (1 << 4 | 3) ^ 12 & 10 >> 1;
+}
\ No newline at end of file
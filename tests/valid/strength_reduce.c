@@ -0,0 +1,7 @@
+int main() {
+    int n = 100;
+    long s = 0;
+    for (int i = 0; i < n; i = i + 1)
+        s = s + i * 12;
+    return s;
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+int main() {
+    int s = 0;
+    for (int i = 0; i < 4; i = i + 1)
+        s = s + i * 3;
+    return s;
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+int main() {
+    int n = 0;
+    int s = 0;
+    int t = 0;
+    int i;
+    for (i = 0; i < 1000; i = i + 1)
+        if (i % 100 == 0)
+            n = n + 1;
+    for (i = 0; i < n; i = i + 613566757)
+        s = s + 1;
+    for (i = 0; i < n * 150000000; i = i + 300000000)
+        t = t + 1;
+    return s * 10 + t;
+}
@@ -0,0 +1,9 @@
+int main() {
+    int n = 3;
+    int s = 0;
+    for (int i = 0; i < 40; i = i + 1) {
+        for (int j = 0; j < i; j = j + 1)
+            s = s + (j ^ n);
+    }
+    return s & 255;
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+int main() {
+    int a = 3;
+    long b;
+    b = a * 4;
+    a = b - 2;
+    return a;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+int main() {
+    int x = 1;
+    {
+        int x = 5;
+        x = x + 1;
+    }
+    return x;
+}
\ No newline at end of file
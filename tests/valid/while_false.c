@@ -0,0 +1,5 @@
+int main() {
+    while (0 && 1)
+        return 1;
+    return 2;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+int main() {
+    int i = 0;
+    int s = 0;
+    while (i < 10) {
+        if (i & 1)
+            s = s + i;
+        i = i + 1;
+    }
+    return s;
+}
\ No newline at end of file
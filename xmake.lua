@@ -24,3 +24,33 @@ target("build")
 		set_symbols("debug")
 		add_defines("DEBUG")
 	end
+
+target("test_div_const")
+	set_kind("binary")
+	set_default(false)
+	set_warnings("allextra")
+	set_optimize("faster")
+	add_files("src/**.c")
+	add_files("tests/unit/div_const.c")
+	add_includedirs("include/")
+	add_includedirs("native/standalone/")
+
+target("test_encoder")
+	set_kind("phony")
+	set_default(false)
+	add_deps("build")
+	on_run(function (target)
+		import("core.base.option")
+		local script = path.join(os.projectdir(), "tests/check_encoder.sh")
+		os.execv("sh", table.join({script, target:dep("build"):targetfile()}, option.get("arguments") or {}))
+	end)
+
+target("test_valid")
+	set_kind("phony")
+	set_default(false)
+	add_deps("build")
+	on_run(function (target)
+		import("core.base.option")
+		local script = path.join(os.projectdir(), "tests/check_valid.sh")
+		os.execv("sh", table.join({script, target:dep("build"):targetfile()}, option.get("arguments") or {}))
+	end)